@@ -236,6 +236,48 @@ rrvm_nth0_enum(I, [_|T], Index, Elem) :-
 member_term(T, [H|_]) :- T == H, !.
 member_term(T, [_|T2]) :- member_term(T, T2).
 
+%% pure_goal(+Goal)
+%% True if Goal only defines its destination temp: no tape access, output
+%% or control transfer. Passes may fold, hoist or drop such goals when the
+%% result is unused. Native intrinsics carry their purity flag in the dump.
+pure_goal(const(_, _, _)).
+pure_goal(add(_, _, _, _)).
+pure_goal(sub(_, _, _, _)).
+pure_goal(mul(_, _, _, _)).
+pure_goal(bitand(_, _, _, _)).
+pure_goal(bitor(_, _, _, _)).
+pure_goal(bitxor(_, _, _, _)).
+pure_goal(lsh(_, _, _, _)).
+pure_goal(lrsh(_, _, _, _)).
+pure_goal(arsh(_, _, _, _)).
+pure_goal(or(_, _, _, _)).
+pure_goal(and(_, _, _, _)).
+pure_goal(not(_, _, _)).
+pure_goal(gez(_, _, _)).
+pure_goal(select(_, _, _, _, _)).
+pure_goal(min(_, _, _, _)).
+pure_goal(max(_, _, _, _)).
+pure_goal(abs(_, _, _)).
+pure_goal(popcnt(_, _, _)).
+pure_goal(clz(_, _, _)).
+pure_goal(ctz(_, _, _)).
+pure_goal(bswap(_, _, _)).
+pure_goal(rotl(_, _, _, _)).
+pure_goal(rotr(_, _, _, _)).
+pure_goal(mulhi(_, _, _, _)).
+pure_goal(ncall(_, _, _, _, pure)).
+pure_goal(vsplat(_, _, _)).
+pure_goal(vadd(_, _, _, _)).
+pure_goal(vsub(_, _, _, _)).
+pure_goal(vmul(_, _, _, _)).
+pure_goal(vmin(_, _, _, _)).
+pure_goal(vmax(_, _, _, _)).
+pure_goal(vand(_, _, _, _)).
+pure_goal(vor(_, _, _, _)).
+pure_goal(vxor(_, _, _, _)).
+pure_goal(vhsum(_, _, _)).
+pure_goal(vshuffle(_, _, _, _)).
+
 %% rrvm_is_list(+Term)
 %% Portable list predicate used instead of relying on `is_list/1`.
 rrvm_is_list(X) :- var(X), !, fail.
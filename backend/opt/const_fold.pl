@@ -96,6 +96,27 @@ const_fold_impl(Orig, [const(D, Type, V) | Tail]) -->
     },
     const_fold_impl(Orig, Tail).
 
+%% Fold: popcnt, clz, ctz, bswap (see bit_fold/4)
+const_fold_impl(Orig, [const(D, Type, V) | Tail]) -->
+    [const(A, Type, VA), G],
+    { G =.. [Op, D, Type, A],
+      bit_op1(Op),
+      count_occurrences(A, Orig, AC), AC =:= 1,
+      bit_fold(Op, Type, VA, V)
+    },
+    const_fold_impl(Orig, Tail).
+
+%% Fold: rotl, rotr, mulhi (see bit_fold/5)
+const_fold_impl(Orig, [const(D, Type, V) | Tail]) -->
+    [const(A, Type, VA), const(B, Type, VB), G],
+    { G =.. [Op, D, Type, A, B],
+      bit_op2(Op),
+      count_occurrences(A, Orig, AC), AC =:= 1,
+      count_occurrences(B, Orig, BC), BC =:= 1,
+      bit_fold(Op, Type, VA, VB, V)
+    },
+    const_fold_impl(Orig, Tail).
+
 %% Default: copy head goal unchanged and continue
 const_fold_impl(Orig, [G|Gs]) -->
     [G],
@@ -169,6 +190,26 @@ const_fold_aggressive_impl(Orig, [const(D, Type, V) | Tail]) -->
     },
     const_fold_aggressive_impl(Orig, Tail).
 
+%% Aggressive Fold: popcnt, clz, ctz, bswap
+const_fold_aggressive_impl(Orig, [const(D, Type, V) | Tail]) -->
+    [const(A, Type, VA), G],
+    { G =.. [Op, D, Type, A],
+      bit_op1(Op),
+      bit_fold(Op, Type, VA, V),
+      format(user_error, "DEBUG: aggressive fold ~w -> const(~w,~w,~w) (operand ~w)~n", [Op,D,Type,V,A])
+    },
+    const_fold_aggressive_impl(Orig, Tail).
+
+%% Aggressive Fold: rotl, rotr, mulhi
+const_fold_aggressive_impl(Orig, [const(D, Type, V) | Tail]) -->
+    [const(A, Type, VA), const(B, Type, VB), G],
+    { G =.. [Op, D, Type, A, B],
+      bit_op2(Op),
+      bit_fold(Op, Type, VA, VB, V),
+      format(user_error, "DEBUG: aggressive fold ~w -> const(~w,~w,~w) (operands ~w,~w)~n", [Op,D,Type,V,A,B])
+    },
+    const_fold_aggressive_impl(Orig, Tail).
+
 %% Default: copy head goal unchanged and continue
 const_fold_aggressive_impl(Orig, [G|Gs]) -->
     [G],
@@ -226,4 +267,121 @@ integer_type(i64).
 integer_type(u64).
 integer_type(bool).
 
+% Bit manipulation folds, on the low bits of the type as the VM computes
+% them (interpreter.h). GNU Prolog integers stop short of 64 bits, so a
+% 64-bit operand folds only for the counts and only when it is not
+% negative; no intermediate value below reaches 2^36.
+bit_op1(popcnt).
+bit_op1(clz).
+bit_op1(ctz).
+bit_op1(bswap).
+
+bit_op2(rotl).
+bit_op2(rotr).
+bit_op2(mulhi).
+
+type_width(i8, 8).
+type_width(u8, 8).
+type_width(i16, 16).
+type_width(u16, 16).
+type_width(i32, 32).
+type_width(u32, 32).
+type_width(i64, 64).
+type_width(u64, 64).
+type_width(bool, 64).
+
+signed_type(i8).
+signed_type(i16).
+signed_type(i32).
+signed_type(i64).
+signed_type(bool).
+
+% bits_low(+V, +W, -L): the low W bits of V as an unsigned number, W < 64
+bits_low(V, W, L) :- W < 64, L is V /\ ((1 << W) - 1).
+
+% bits_extend(+L, +W, +Type, -V): L read back as a value of Type
+bits_extend(L, W, Type, V) :-
+    ( signed_type(Type), W < 64, L >= 1 << (W - 1) -> V is L - (1 << W) ; V = L ).
+
+bit_count(0, 0) :- !.
+bit_count(L, N) :- L1 is L >> 1, bit_count(L1, N1), N is N1 + (L /\ 1).
+
+bit_length(0, 0) :- !.
+bit_length(L, N) :- L1 is L >> 1, bit_length(L1, N1), N is N1 + 1.
+
+trailing_zeros(L, 0) :- L /\ 1 =:= 1, !.
+trailing_zeros(L, N) :- L1 is L >> 1, trailing_zeros(L1, N1), N is N1 + 1.
+
+byte_swap(_, 0, R, R) :- !.
+byte_swap(L, K, Acc, R) :-
+    Acc1 is (Acc << 8) \/ (L /\ 255), L1 is L >> 8, K1 is K - 1,
+    byte_swap(L1, K1, Acc1, R).
+
+% bit_fold(+Op, +Type, +VA, -V). A 64-bit mask (1 << 64) is out of range,
+% so a 64-bit VA is taken as it is, which needs it not negative.
+bit_fold(Op, Type, VA, V) :-
+    integer_type(Type), type_width(Type, W),
+    (   W =:= 64
+    ->  Op \== bswap, VA >= 0, L = VA
+    ;   bits_low(VA, W, L)
+    ),
+    bit_fold_low(Op, W, L, R),
+    ( Op == bswap -> bits_extend(R, W, Type, V) ; V = R ).
+
+bit_fold_low(popcnt, _, L, N) :- bit_count(L, N).
+bit_fold_low(clz, W, L, N) :- bit_length(L, B), N is W - B.
+bit_fold_low(ctz, W, 0, W) :- !.
+bit_fold_low(ctz, _, L, N) :- trailing_zeros(L, N).
+bit_fold_low(bswap, W, L, R) :- K is W // 8, byte_swap(L, K, 0, R).
+
+% bit_fold(+Op, +Type, +VA, +VB, -V): types of at most 32 bits
+bit_fold(Op, Type, VA, VB, V) :-
+    integer_type(Type), type_width(Type, W), W =< 32,
+    bits_low(VA, W, LA), bits_low(VB, W, LB),
+    bit_fold_low(Op, Type, W, LA, LB, R),
+    bits_extend(R, W, Type, V).
+
+% rotl by K: the bits that stay are masked before the shift
+bit_fold_low(rotl, _, W, LA, LB, R) :-
+    K is LB mod W,
+    R is ((LA /\ ((1 << (W - K)) - 1)) << K) \/ (LA >> (W - K)).
+bit_fold_low(rotr, Type, W, LA, LB, R) :-
+    K is (W - LB mod W) mod W,
+    bit_fold_low(rotl, Type, W, LA, K, R).
+% high half of the product from 16-bit halves; signed operands subtract
+% the other operand for each negative one (mod 2^W)
+bit_fold_low(mulhi, Type, W, LA, LB, R) :-
+    H is W // 2, M is (1 << H) - 1,
+    A1 is LA >> H, A0 is LA /\ M, B1 is LB >> H, B0 is LB /\ M,
+    U is A1 * B1 + ((A1 * B0 + A0 * B1 + ((A0 * B0) >> H)) >> H),
+    ( signed_type(Type) ->
+        SA is (LA >> (W - 1)) * LB, SB is (LB >> (W - 1)) * LA,
+        R is (U - SA - SB) mod (1 << W)
+    ; R = U
+    ).
+
+% bit_fold_check: every bit_fold_case/4 folds to the value the VM computes
+% and no bit_fold_skip/3 folds. Run it on its own with
+%   gprolog --consult-file backend/opt/const_fold.pl --query-goal bit_fold_check
+bit_fold_case(popcnt, i64, 255, 8).
+bit_fold_case(popcnt, i64, 1152921504606846975, 60).
+bit_fold_case(popcnt, u8, -1, 8).
+bit_fold_case(clz, i64, 0, 64).
+bit_fold_case(clz, i64, 1, 63).
+bit_fold_case(clz, i64, 576460752303423488, 4).
+bit_fold_case(clz, i32, 1, 31).
+bit_fold_case(ctz, i64, 0, 64).
+bit_fold_case(ctz, i64, 576460752303423488, 59).
+bit_fold_case(ctz, u16, 65536, 16).
+bit_fold_case(bswap, i16, 128, -32768).
+bit_fold_case(bswap, u32, 1, 16777216).
+
+bit_fold_skip(popcnt, i64, -1).
+bit_fold_skip(clz, u64, -1).
+bit_fold_skip(bswap, i64, 1).
+
+bit_fold_check :-
+    \+ ( bit_fold_case(Op, Type, VA, V), \+ bit_fold(Op, Type, VA, V) ),
+    \+ ( bit_fold_skip(Op, Type, VA), bit_fold(Op, Type, VA, _) ).
+
 % end of file
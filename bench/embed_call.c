@@ -0,0 +1,92 @@
+/*
+ * Host-to-guest call overhead through the embedding API (frontend/rrvm.h).
+ *
+ * Build and run from the repo root after ./build.sh:
+ *   cc -std=c11 -O2 -D_DEFAULT_SOURCE -I. bench/embed_call.c bin/librrvm.a -lm -pthread -o bin/embed_call
+ *   ./bin/embed_call [calls]   (default 10000000)
+ *
+ * Loads a program once, creates one context, checks a few results, a guest
+ * fault and the captured output, then times rrvm_call_index on a
+ * two-argument function.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "frontend/rrvm.h"
+
+static const char *source =
+    "func add2\n"
+    "  add\n"
+    "  ret\n"
+    "end\n"
+    "func hyp\n"
+    "  ncall pow\n"
+    "  ret\n"
+    "end\n"
+    "func div2\n"
+    "  div\n"
+    "  ret\n"
+    "end\n"
+    "func greet\n"
+    "  push i64 42\n"
+    "  print\n"
+    "  ret\n"
+    "end\n"
+    "push i64 1\n"
+    "print\n"
+    "halt\n";
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    long calls = argc > 1 ? atol(argv[1]) : 10000000L;
+    char *err = NULL;
+    rrvm_program *prog = rrvm_program_from_source(source, &err);
+    if (!prog) { fprintf(stderr, "load failed: %s\n", err ? err : "?"); free(err); return 1; }
+    rrvm_context *ctx = rrvm_context_new(prog);
+    if (!ctx) { fprintf(stderr, "context failed\n"); return 1; }
+
+    rrvm_value r;
+    rrvm_value two[2] = { rrvm_i64(40), rrvm_i64(2) };
+    if (rrvm_call(ctx, "add2", two, 2, &r) != RRVM_OK || r.type != RRVM_I64 || r.bits != 42) {
+        fprintf(stderr, "add2 returned %lld\n", (long long)r.bits);
+        return 1;
+    }
+    rrvm_value pw[2] = { rrvm_f64(2.0), rrvm_f64(10.0) };
+    if (rrvm_call(ctx, "hyp", pw, 2, &r) != RRVM_OK || r.type != RRVM_F64 || rrvm_as_f64(r) != 1024.0) {
+        fprintf(stderr, "hyp returned %f\n", rrvm_as_f64(r));
+        return 1;
+    }
+    /* a guest fault is an error code; the context carries on */
+    rrvm_value zero[2] = { rrvm_i64(1), rrvm_i64(0) };
+    if (rrvm_call(ctx, "div2", zero, 2, &r) != RRVM_ERR_FAULT || !rrvm_error(ctx)) {
+        fprintf(stderr, "div2 by zero did not fault\n");
+        return 1;
+    }
+    size_t len;
+    if (rrvm_run(ctx) != RRVM_OK || rrvm_call(ctx, "greet", NULL, 0, NULL) != RRVM_OK) return 1;
+    const char *out = rrvm_output(ctx, &len);
+    printf("captured %zu bytes: %s", len, out);
+    rrvm_output_clear(ctx);
+
+    int add2 = rrvm_function_index(prog, "add2");
+    int64_t sum = 0;
+    double t0 = now_sec();
+    for (long i = 0; i < calls; ++i) {
+        two[0].bits = i;
+        rrvm_call_index(ctx, add2, two, 2, &r);
+        sum += r.bits;
+    }
+    double dt = now_sec() - t0;
+    printf("%ld calls: %.1f ns/call (checksum %lld)\n", calls, dt * 1e9 / (double)calls, (long long)sum);
+
+    rrvm_context_free(ctx);
+    rrvm_program_free(prog);
+    return 0;
+}
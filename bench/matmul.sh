@@ -0,0 +1,53 @@
+#!/bin/sh
+# Loop fusion and tiling benchmark: bench/matmul.rr scaled to N x N (default
+# 64) on a larger tape, run by the TAC executor (--tac --run) with its fill
+# loops fused (the default) and with the multiply nest tiled too. The
+# executor counts tape misses in a modelled data cache; the interpreter and
+# both executor runs must print the same checksum.
+#
+# Usage: bench/matmul.sh [N] [tile] [cache KiB]   (default 64 16 8)
+set -e
+
+cd "$(dirname "$0")/.." || exit 1
+
+N=${1:-64}
+TILE=${2:-16}
+CACHE_KB=${3:-8}
+CC=${CC:-cc}
+RRVM=./bin/rrvm-matmul
+PROG=./bin/matmul.rr
+
+# A, B and C take N*N cells each after the 8 scalars
+tape=1024
+while [ $tape -lt $((3 * N * N + 8 + 256)) ]; do tape=$((tape * 2)); done
+$CC -std=c11 -O2 -D_DEFAULT_SOURCE -I. -DTAPE_SIZE=$tape -pthread -o $RRVM frontend/main.c \
+  frontend/lexer/lexer.c frontend/parser/parser.c frontend/native/native.c frontend/tier/tier.c \
+  frontend/tier/jit.c frontend/tier/trace.c frontend/tier/opt.c frontend/tier/perf.c -lm
+
+sed -e "s/push i64 16\$/push i64 $N/" -e "s/push i64 256\$/push i64 $((N * N))/" \
+    -e "s/push i64 264\$/push i64 $((N * N + 8))/" -e "s/push i64 520\$/push i64 $((2 * N * N + 8))/" \
+    bench/matmul.rr > $PROG
+
+now_ns() { date +%s%N; }
+
+expect=$($RRVM --no-tier $PROG)
+run() {
+  label=$1
+  shift
+  start=$(now_ns)
+  out=$($RRVM --tac --run --stats --cache-kb "$CACHE_KB" "$@" $PROG 2>/tmp/matmul.$$)
+  end=$(now_ns)
+  if [ "$out" != "$expect" ]; then
+    echo "$label: printed $out, the interpreter $expect" >&2
+    rm -f /tmp/matmul.$$
+    exit 1
+  fi
+  printf '%-22s %s (%d ms)\n' "$label:" "$(grep '^tac run:' /tmp/matmul.$$ | sed 's/^tac run: //')" \
+    $(( (end - start) / 1000000 ))
+  grep '^tac loops:' /tmp/matmul.$$ | sed 's/^/                       /'
+  rm -f /tmp/matmul.$$
+}
+
+echo "N = $N, tape $tape cells, ${CACHE_KB} KiB cache, checksum $expect"
+run "fused"
+run "fused, tiled by $TILE" --tile "$TILE"
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Optimizing-tier benchmark: bench/opt_loop.rr with the baseline JIT only
+# (--no-opt) and with the optimizing JIT, against bench/opt_loop.c built
+# with cc -O1. All three must print the same result.
+#
+# Usage: bench/opt.sh [runs]   (default 10; build first with ./build.sh)
+set -e
+
+cd "$(dirname "$0")/.." || exit 1
+
+RUNS=${1:-10}
+RRVM=./bin/rrvm
+CC=${CC:-cc}
+NATIVE=./bin/opt_loop
+
+if [ ! -x "$RRVM" ]; then
+  echo "missing $RRVM; run ./build.sh first" >&2
+  exit 1
+fi
+$CC -O1 -o $NATIVE bench/opt_loop.c
+
+expect=$($NATIVE)
+for mode in --no-opt "" --tier-sync; do
+  if [ "$($RRVM $mode bench/opt_loop.rr)" != "$expect" ]; then
+    echo "bench/opt_loop.rr ($mode) disagrees with bench/opt_loop.c" >&2
+    exit 1
+  fi
+done
+
+now_ns() { date +%s%N; }
+
+bench() {
+  start=$(now_ns)
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    "$@" >/dev/null
+    i=$((i + 1))
+  done
+  end=$(now_ns)
+  echo $(( (end - start) / RUNS / 1000 ))
+}
+
+base_us=$(bench $RRVM --no-opt bench/opt_loop.rr)
+opt_us=$(bench $RRVM bench/opt_loop.rr)
+native_us=$(bench $NATIVE)
+
+echo "runs:                 $RUNS"
+echo "baseline JIT only:    ${base_us} us/run"
+echo "optimizing JIT:       ${opt_us} us/run"
+echo "C at -O1:             ${native_us} us/run"
+if [ "$native_us" -gt 0 ]; then
+  echo "optimizing JIT / C:   $(( opt_us * 100 / native_us ))% (includes process start and warm-up)"
+fi
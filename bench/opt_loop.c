@@ -0,0 +1,25 @@
+/*
+ * bench/opt_loop.c
+ *
+ * C version of bench/opt_loop.rr, for bench/opt.sh to compare the
+ * optimizing tier against a C compiler at -O1. mix is kept out of line so
+ * the loop is compiled as a function called 20000 times, like the .rr one.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+static int64_t x = 12345, sum = 0;
+
+__attribute__((noinline)) static void mix(void) {
+    for (int64_t i = 0; i < 1000; ++i) {
+        x = (x * 1103515245 + 12345) & 2147483647;
+        sum = (((x >> 7) + sum) ^ i) & 4294967295;
+    }
+}
+
+int main(void) {
+    for (int c = 0; c < 20000; ++c) mix();
+    printf("%lld\n", (long long)sum);
+    return 0;
+}
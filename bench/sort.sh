@@ -0,0 +1,46 @@
+#!/bin/sh
+# Sort benchmark: native `sort` kernel vs. an insertion sort interpreted in .rr.
+# Both programs fill the same 700 pseudo-random i64 cells and print the same
+# three values, so the difference in wall time is the cost of the sort.
+#
+# Usage: bench/sort.sh [runs]   (default 50; build first with ./build.sh)
+set -e
+
+cd "$(dirname "$0")/.." || exit 1
+
+RUNS=${1:-50}
+RRVM=./bin/rrvm
+
+if [ ! -x "$RRVM" ]; then
+  echo "missing $RRVM; run ./build.sh first" >&2
+  exit 1
+fi
+
+# outputs must agree before timing means anything
+if [ "$($RRVM bench/sort_native.rr)" != "$($RRVM bench/sort_interp.rr)" ]; then
+  echo "sort_native.rr and sort_interp.rr disagree" >&2
+  exit 1
+fi
+
+now_ns() { date +%s%N; }
+
+bench() {
+  start=$(now_ns)
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    $RRVM "$1" >/dev/null
+    i=$((i + 1))
+  done
+  end=$(now_ns)
+  echo $(( (end - start) / RUNS / 1000 ))
+}
+
+native_us=$(bench bench/sort_native.rr)
+interp_us=$(bench bench/sort_interp.rr)
+
+echo "runs:                 $RUNS"
+echo "native sort (700):    ${native_us} us/run"
+echo "interpreted sort:     ${interp_us} us/run"
+if [ "$native_us" -gt 0 ]; then
+  echo "speedup:              $(( interp_us / native_us ))x (includes process start and fill)"
+fi
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Tiering benchmark, interpreted only (--no-tier) vs. with the tier manager
+# (without traces, background and --tier-sync):
+#   bench/tier_calls.rr  a hot function called many times (call counting)
+#   bench/osr_loop.rr    one call that runs a long loop (on-stack replacement)
+#   bench/trace_loop.rr  a top-level loop with a rarely taken arm (tracing)
+# All runs of a program must print the same result.
+#
+# Usage: bench/tier.sh [runs]   (default 10; build first with ./build.sh)
+set -e
+
+cd "$(dirname "$0")/.." || exit 1
+
+RUNS=${1:-10}
+RRVM=./bin/rrvm
+
+if [ ! -x "$RRVM" ]; then
+  echo "missing $RRVM; run ./build.sh first" >&2
+  exit 1
+fi
+
+for prog in bench/tier_calls.rr bench/osr_loop.rr bench/trace_loop.rr; do
+  expect=$($RRVM --no-tier $prog)
+  for mode in "" --no-trace --tier-sync; do
+    if [ "$($RRVM $mode $prog)" != "$expect" ]; then
+      echo "$prog: tiered run ($mode) disagrees with --no-tier" >&2
+      exit 1
+    fi
+  done
+done
+
+now_ns() { date +%s%N; }
+
+bench() {
+  prog=$1
+  shift
+  start=$(now_ns)
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    $RRVM "$@" $prog >/dev/null
+    i=$((i + 1))
+  done
+  end=$(now_ns)
+  echo $(( (end - start) / RUNS / 1000 ))
+}
+
+echo "runs:                 $RUNS"
+for prog in bench/tier_calls.rr bench/osr_loop.rr bench/trace_loop.rr; do
+  interp_us=$(bench $prog --no-tier)
+  notrace_us=$(bench $prog --no-trace)
+  tier_us=$(bench $prog)
+  sync_us=$(bench $prog --tier-sync)
+
+  echo "$prog"
+  echo "  interpreter only:     ${interp_us} us/run"
+  echo "  tiered, no traces:    ${notrace_us} us/run"
+  echo "  tiered (background):  ${tier_us} us/run"
+  echo "  tiered (sync):        ${sync_us} us/run"
+  if [ "$tier_us" -gt 0 ]; then
+    echo "  speedup:              $(( interp_us / tier_us ))x (includes process start)"
+  fi
+done
@@ -18,15 +18,19 @@ else
   exit 1
 fi
 
-# Common flags
-CFLAGS="-std=c11 -O2 -Wall -Wextra -I."
+# Common flags. _DEFAULT_SOURCE exposes the POSIX APIs (mmap, sigaction) used by
+# optional VM modes under -std=c11. Extra flags can be passed via RRVM_CFLAGS,
+# e.g. RRVM_CFLAGS="-DTAPE_GUARD=1" ./build.sh for the guard-page tape.
+CFLAGS="-std=c11 -O2 -Wall -Wextra -D_DEFAULT_SOURCE -I. ${RRVM_CFLAGS:-}"
 
 # Ensure output dir exists
 mkdir -p ./bin
 echo "Building rrvm with $CC $CFLAGS"
 
 # Compile C runtime/CLI.
-$CC $CFLAGS -o ./bin/rrvm frontend/main.c frontend/lexer/lexer.c frontend/parser/parser.c
+# The tier manager (frontend/tier) compiles hot functions on a worker thread.
+$CC $CFLAGS -pthread -o ./bin/rrvm frontend/main.c frontend/lexer/lexer.c frontend/parser/parser.c frontend/native/native.c \
+  frontend/tier/tier.c frontend/tier/jit.c frontend/tier/trace.c frontend/tier/opt.c frontend/tier/perf.c -lm
 
 if [ $? -eq 0 ]; then
   echo "C build succeeded: ./bin/rrvm"
@@ -35,6 +39,21 @@ else
   exit 1
 fi
 
+# Embedding library (frontend/rrvm.h): the same sources plus the API layer,
+# compiled position-independent for both the static and the shared library.
+mkdir -p ./bin/obj
+LIB_OBJS=""
+for src in frontend/rrvm.c frontend/lexer/lexer.c frontend/parser/parser.c frontend/native/native.c \
+           frontend/tier/tier.c frontend/tier/jit.c frontend/tier/trace.c frontend/tier/opt.c frontend/tier/perf.c; do
+  obj="./bin/obj/$(basename "$src" .c).o"
+  $CC $CFLAGS -pthread -fPIC -c -o "$obj" "$src"
+  LIB_OBJS="$LIB_OBJS $obj"
+done
+rm -f ./bin/librrvm.a
+ar rcs ./bin/librrvm.a $LIB_OBJS
+$CC -shared -pthread -o ./bin/librrvm.so $LIB_OBJS -lm
+echo "Library build succeeded: ./bin/librrvm.a ./bin/librrvm.so"
+
 # -----------------------------------------------------------------------
 # Attempt to build a single static/native GNU Prolog executable that embeds
 # the optimizer (opt/main.pl and opt/pass/*.pl). This produces ./bin/rrvm-opt.
@@ -0,0 +1,217 @@
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+/*
+ * rrvm/frontend/hashmap/hashmap.h
+ *
+ * Open-addressing hash map keyed by `word`, used by the hnew/hput/hget/hdel/
+ * hlen/hiter opcodes.
+ *
+ * Layout follows the SwissTable design: a control byte per slot holds either
+ * EMPTY, DELETED or the low 7 bits of the key's hash (h2). Slots are grouped
+ * by HM_GROUP; a lookup hashes to a group (h1), compares all control bytes of
+ * that group against h2 at once (SSE2 when available, SWAR otherwise) and
+ * only touches keys whose control byte matched. Groups are probed
+ * triangularly, which visits every group since the group count is a power of
+ * two. Values keep their TypeTag so hget pushes what hput stored.
+ *
+ * Keys are hashed with hash_word64 from kernels/hash.h. Byte strings and
+ * composite keys can be reduced to a word with hash64/hash64b first.
+ */
+
+#include "../vm/vm.h"
+#include "../kernels/hash.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define HM_GROUP 16
+#define HM_EMPTY ((uint8_t)0x80)
+#define HM_DELETED ((uint8_t)0xFE)
+
+typedef struct {
+    uint8_t *ctrl;    /* cap control bytes */
+    word *keys;
+    word *vals;
+    TypeTag *types;   /* value types */
+    size_t cap;       /* slots; power of two, multiple of HM_GROUP */
+    size_t count;     /* live entries */
+    size_t tombstones;
+
+    /* probe statistics (groups inspected per lookup/insert/delete) */
+    uint64_t lookups;
+    uint64_t probes;
+    size_t max_probe;
+} hm_table;
+
+static inline uint64_t hm_hash(word key) { return hash_word64(key); }
+
+/* bitmask (bit i = slot i of the group) of control bytes equal to b */
+static inline unsigned hm_group_match(const uint8_t *g, uint8_t b) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)b)));
+#else
+    unsigned m = 0;
+    for (int h = 0; h < HM_GROUP; h += 8) {
+        uint64_t w;
+        memcpy(&w, g + h, 8);
+        /* zero bytes of w ^ b*0x01.. mark matches (exact SWAR zero-byte test) */
+        uint64_t x = w ^ (0x0101010101010101ULL * b);
+        uint64_t z = ~(((x & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | x | 0x7F7F7F7F7F7F7F7FULL);
+        for (int i = 0; i < 8; ++i) if (z & (0x80ULL << (8 * i))) m |= 1u << (h + i);
+    }
+    return m;
+#endif
+}
+
+/* bitmask of EMPTY or DELETED slots (both have the high bit set) */
+static inline unsigned hm_group_free(const uint8_t *g) {
+#if defined(__SSE2__)
+    return (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+#else
+    unsigned m = 0;
+    for (int i = 0; i < HM_GROUP; ++i) if (g[i] & 0x80) m |= 1u << i;
+    return m;
+#endif
+}
+
+static inline int hm_ctz(unsigned m) { return __builtin_ctz(m); }
+
+static inline void hm_alloc(hm_table *t, size_t cap) {
+    t->cap = cap;
+    t->ctrl = (uint8_t*)malloc(cap);
+    t->keys = (word*)malloc(cap * sizeof(word));
+    t->vals = (word*)malloc(cap * sizeof(word));
+    t->types = (TypeTag*)malloc(cap * sizeof(TypeTag));
+    assert(t->ctrl && t->keys && t->vals && t->types && "hashmap: out of memory");
+    memset(t->ctrl, HM_EMPTY, cap);
+    t->count = 0;
+    t->tombstones = 0;
+}
+
+static inline void hm_init(hm_table *t) {
+    memset(t, 0, sizeof(*t));
+    hm_alloc(t, HM_GROUP);
+}
+
+static inline void hm_free(hm_table *t) {
+    free(t->ctrl);
+    free(t->keys);
+    free(t->vals);
+    free(t->types);
+    memset(t, 0, sizeof(*t));
+}
+
+static inline void hm_note_probe(hm_table *t, size_t groups) {
+    t->lookups++;
+    t->probes += groups;
+    if (groups > t->max_probe) t->max_probe = groups;
+}
+
+/* slot index of key, or -1 */
+static inline long hm_find(hm_table *t, word key) {
+    uint64_t h = hm_hash(key);
+    uint8_t h2 = (uint8_t)(h & 0x7F);
+    size_t mask = t->cap / HM_GROUP - 1;
+    size_t g = (size_t)(h >> 7) & mask;
+    for (size_t i = 1;; ++i) {
+        const uint8_t *grp = t->ctrl + g * HM_GROUP;
+        for (unsigned m = hm_group_match(grp, h2); m; m &= m - 1) {
+            size_t slot = g * HM_GROUP + (size_t)hm_ctz(m);
+            if (t->keys[slot] == key) { hm_note_probe(t, i); return (long)slot; }
+        }
+        /* an EMPTY byte ends the probe sequence: the key was never placed past it */
+        if (hm_group_match(grp, HM_EMPTY)) { hm_note_probe(t, i); return -1; }
+        g = (g + i) & mask;
+    }
+}
+
+/* first EMPTY/DELETED slot on key's probe sequence (table must have room) */
+static inline size_t hm_find_free(const hm_table *t, uint64_t h) {
+    size_t mask = t->cap / HM_GROUP - 1;
+    size_t g = (size_t)(h >> 7) & mask;
+    for (size_t i = 1;; ++i) {
+        unsigned m = hm_group_free(t->ctrl + g * HM_GROUP);
+        if (m) return g * HM_GROUP + (size_t)hm_ctz(m);
+        g = (g + i) & mask;
+    }
+}
+
+static inline void hm_rehash(hm_table *t, size_t new_cap) {
+    hm_table old = *t;
+    hm_alloc(t, new_cap);
+    for (size_t i = 0; i < old.cap; ++i) {
+        if (old.ctrl[i] & 0x80) continue;
+        uint64_t h = hm_hash(old.keys[i]);
+        size_t slot = hm_find_free(t, h);
+        t->ctrl[slot] = (uint8_t)(h & 0x7F);
+        t->keys[slot] = old.keys[i];
+        t->vals[slot] = old.vals[i];
+        t->types[slot] = old.types[i];
+        t->count++;
+    }
+    free(old.ctrl);
+    free(old.keys);
+    free(old.vals);
+    free(old.types);
+}
+
+/* insert or update; returns 1 if the key was new */
+static inline int hm_put(hm_table *t, word key, word val, TypeTag type) {
+    long at = hm_find(t, key);
+    if (at >= 0) {
+        t->vals[at] = val;
+        t->types[at] = type;
+        return 0;
+    }
+    /* keep live + deleted slots under 7/8; rehash in place if tombstones dominate */
+    if ((t->count + t->tombstones + 1) * 8 > t->cap * 7) {
+        hm_rehash(t, (t->count + 1) * 2 * 8 > t->cap * 7 ? t->cap * 2 : t->cap);
+    }
+    uint64_t h = hm_hash(key);
+    size_t slot = hm_find_free(t, h);
+    if (t->ctrl[slot] == HM_DELETED) t->tombstones--;
+    t->ctrl[slot] = (uint8_t)(h & 0x7F);
+    t->keys[slot] = key;
+    t->vals[slot] = val;
+    t->types[slot] = type;
+    t->count++;
+    return 1;
+}
+
+static inline int hm_get(hm_table *t, word key, word *val, TypeTag *type) {
+    long at = hm_find(t, key);
+    if (at < 0) return 0;
+    *val = t->vals[at];
+    *type = t->types[at];
+    return 1;
+}
+
+/* returns 1 if the key was present */
+static inline int hm_del(hm_table *t, word key) {
+    long at = hm_find(t, key);
+    if (at < 0) return 0;
+    t->ctrl[at] = HM_DELETED;
+    t->count--;
+    t->tombstones++;
+    return 1;
+}
+
+/* advance *pos to the next live slot; returns 0 when exhausted */
+static inline int hm_next(const hm_table *t, size_t *pos, size_t *slot) {
+    while (*pos < t->cap) {
+        size_t i = (*pos)++;
+        if (!(t->ctrl[i] & 0x80)) { *slot = i; return 1; }
+    }
+    return 0;
+}
+
+static inline void hm_print_stats(const hm_table *t, int id, FILE *out) {
+    fprintf(out, "map %d: len=%zu cap=%zu load=%.3f tombstones=%zu lookups=%" PRIu64 " avg_probe=%.3f max_probe=%zu\n",
+            id, t->count, t->cap, t->cap ? (double)t->count / (double)t->cap : 0.0, t->tombstones,
+            t->lookups, t->lookups ? (double)t->probes / (double)t->lookups : 0.0, t->max_probe);
+}
+
+#endif /* HASHMAP_H */
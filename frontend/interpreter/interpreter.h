@@ -2,6 +2,26 @@
 #define INTERP_H
 
 #include "../vm/vm.h"
+#include "../native/native.h"
+#include "../hashmap/hashmap.h"
+#include "../kernels/sort.h"
+#include "../kernels/text.h"
+#include "../kernels/simd.h"
+#include "../tier/tier.h"
+
+/* interpreter runtime state (vm->user_data) */
+typedef struct {
+    /* hash maps created by OP_HNEW; a handle is an index into this array */
+    hm_table *maps;
+    int maps_count;
+    int maps_cap;
+    /* hotness counters and compiled code (NULL with tiering disabled) */
+    tier_state *tier;
+} interp_state;
+
+static inline interp_state *interp_get_state(VM *vm) {
+    return (interp_state*)vm->user_data;
+}
 
 static inline word add_fn(word a, word b) {
     return a + b;
@@ -20,6 +40,14 @@ static inline word div_fn(word a, word b) {
     return a / b;
 }
 
+/* integer div and rem fault on a zero divisor (on top) and on WORD_MIN / -1 */
+static inline void interp_check_divisor(VM *vm) {
+    if (vm->sp < 2) return; /* interp_binary reports it */
+    word d = vm->stack[vm->sp - 1];
+    vm_check(vm, d != 0, "Division by zero");
+    vm_check(vm, d != -1 || vm->stack[vm->sp - 2] != WORD_MIN, "Division overflow");
+}
+
 static inline void interp_push(VM *vm, int type, word imm) {
     /* push a value and record its TypeTag in the parallel types array */
     vm_push(vm, imm);
@@ -28,14 +56,19 @@ static inline void interp_push(VM *vm, int type, word imm) {
 
 static inline void interp_move(VM *vm, word imm) {
     /* move tape pointer by imm (signed) */
+#if TAPE_GUARD
+    /* unchecked: an out-of-range tp faults on its next tape access */
+    vm->tp = vm_guard_step(vm, (int64_t)imm);
+#else
     if (imm < 0) {
         size_t step = (size_t)(-imm);
-        assert(vm->tp >= step && "Tape pointer underflow");
+        vm_check(vm, vm->tp >= step, "Tape pointer underflow");
         vm->tp -= step;
     } else {
         vm->tp += (size_t)imm;
-        assert(vm->tp < TAPE_SIZE && "Tape pointer overflow");
+        vm_check(vm, vm->tp < TAPE_SIZE, "Tape pointer overflow");
     }
+#endif
 }
 
 static inline void interp_load(VM *vm) {
@@ -46,7 +79,7 @@ static inline void interp_load(VM *vm) {
 
 static inline void interp_store(VM *vm) {
     /* pop value and propagate its type into the tape cell */
-    assert(vm->sp > 0 && "interp_store: empty stack");
+    vm_check(vm, vm->sp > 0, "interp_store: empty stack");
     TypeTag t = vm->types[vm->sp - 1];
     word val = vm_pop(vm);
     vm->tape[vm->tp] = val;
@@ -56,10 +89,10 @@ static inline void interp_store(VM *vm) {
 static inline void interp_binary(VM *vm, word (*fn)(word, word)) {
     /* binary ops must have two operands with identical types. The VM assumes
        well-typed input; mismatch causes an assert (fail-fast). */
-    assert(vm->sp >= 2 && "interp_binary: stack underflow");
+    vm_check(vm, vm->sp >= 2, "interp_binary: stack underflow");
     TypeTag top = vm->types[vm->sp - 1];
     TypeTag next = vm->types[vm->sp - 2];
-    assert(top == next && "interp_binary: type mismatch");
+    vm_check(vm, top == next, "interp_binary: type mismatch");
     word a = vm_pop(vm); /* top */
     word b = vm_pop(vm); /* next */
     word result = fn(b, a);
@@ -71,10 +104,10 @@ static inline void interp_add(VM *vm) {
     /* Support float-aware addition: if the operand types are f32 or f64,
        perform IEEE-754 addition by bit-casting to float/double, otherwise
        fall back to the integer binary path. */
-    assert(vm->sp >= 2 && "interp_add: stack underflow");
+    vm_check(vm, vm->sp >= 2, "interp_add: stack underflow");
     TypeTag top = vm->types[vm->sp - 1];
     TypeTag next = vm->types[vm->sp - 2];
-    assert(top == next && "interp_add: type mismatch");
+    vm_check(vm, top == next, "interp_add: type mismatch");
 
     if (top == TYPE_F32) {
         /* pop a (top), b (next) and compute b + a as f32 using union-based bit-casts */
@@ -105,10 +138,10 @@ static inline void interp_add(VM *vm) {
 
 static inline void interp_sub(VM *vm) {
     /* Support float-aware subtraction: b - a */
-    assert(vm->sp >= 2 && "interp_sub: stack underflow");
+    vm_check(vm, vm->sp >= 2, "interp_sub: stack underflow");
     TypeTag top = vm->types[vm->sp - 1];
     TypeTag next = vm->types[vm->sp - 2];
-    assert(top == next && "interp_sub: type mismatch");
+    vm_check(vm, top == next, "interp_sub: type mismatch");
 
     if (top == TYPE_F32) {
         word a_word = vm_pop(vm);
@@ -137,10 +170,10 @@ static inline void interp_sub(VM *vm) {
 
 static inline void interp_mul(VM *vm) {
     /* Support float-aware multiplication */
-    assert(vm->sp >= 2 && "interp_mul: stack underflow");
+    vm_check(vm, vm->sp >= 2, "interp_mul: stack underflow");
     TypeTag top = vm->types[vm->sp - 1];
     TypeTag next = vm->types[vm->sp - 2];
-    assert(top == next && "interp_mul: type mismatch");
+    vm_check(vm, top == next, "interp_mul: type mismatch");
 
     if (top == TYPE_F32) {
         word a_word = vm_pop(vm);
@@ -169,10 +202,10 @@ static inline void interp_mul(VM *vm) {
 
 static inline void interp_div(VM *vm) {
     /* Support float-aware division: b / a */
-    assert(vm->sp >= 2 && "interp_div: stack underflow");
+    vm_check(vm, vm->sp >= 2, "interp_div: stack underflow");
     TypeTag top = vm->types[vm->sp - 1];
     TypeTag next = vm->types[vm->sp - 2];
-    assert(top == next && "interp_div: type mismatch");
+    vm_check(vm, top == next, "interp_div: type mismatch");
 
     if (top == TYPE_F32) {
         word a_word = vm_pop(vm);
@@ -195,12 +228,13 @@ static inline void interp_div(VM *vm) {
         vm_push(vm, (word)ur.u);
         vm->types[vm->sp - 1] = TYPE_F64;
     } else {
+        interp_check_divisor(vm);
         interp_binary(vm, div_fn);
     }
 }
 
 static inline void interp_print(VM *vm) {
-    assert(vm->sp > 0 && "interp_print: empty stack");
+    vm_check(vm, vm->sp > 0, "interp_print: empty stack");
     TypeTag t = vm->types[vm->sp - 1];
     word value = vm_pop(vm);
 
@@ -210,13 +244,13 @@ static inline void interp_print(VM *vm) {
             union { uint32_t u; float f; } u;
             u.u = bits;
             /* upcast to double for consistent printf formatting */
-            printf("%f\n", (double)u.f);
+            fprintf(vm->out, "%f\n", (double)u.f);
             break;
         }
         case TYPE_F64: {
             union { uint64_t u; double d; } u;
             u.u = (uint64_t)value;
-            printf("%f\n", u.d);
+            fprintf(vm->out, "%f\n", u.d);
             break;
         }
         case TYPE_U8:
@@ -224,7 +258,7 @@ static inline void interp_print(VM *vm) {
         case TYPE_U32:
         case TYPE_U64: {
             uint64_t u = (uint64_t)value;
-            printf("%" PRIu64 "\n", u);
+            fprintf(vm->out, "%" PRIu64 "\n", u);
             break;
         }
         case TYPE_BOOL:
@@ -235,66 +269,97 @@ static inline void interp_print(VM *vm) {
         case TYPE_I64:
         default: {
             int64_t s = (int64_t)value;
-            printf("%" WORD_FMT "\n", s);
+            fprintf(vm->out, "%" WORD_FMT "\n", s);
             break;
         }
     }
 }
 
 /* print a single value as a character (no newline). The value is masked to
- * the lowest 8 bits and written as a single byte to stdout. This does not
+ * the lowest 8 bits and written as a single byte to vm->out. This does not
  * append a newline; callers must emit a newline byte if desired.
  */
 static inline void interp_print_char(VM *vm) {
-    assert(vm->sp > 0 && "interp_print_char: empty stack");
+    vm_check(vm, vm->sp > 0, "interp_print_char: empty stack");
     /* read type primarily for potential future behavior; we always convert to a byte */
     (void)vm->types[vm->sp - 1];
     word value = vm_pop(vm);
     unsigned char ch = (unsigned char)(value & 0xFFu);
     /* putchar returns EOF on error; ignore here but flush to keep output consistent */
-    putchar((int)ch);
-    fflush(stdout);
+    fputc((int)ch, vm->out);
+    fflush(vm->out);
 }
 
-static inline void inter_setup(VM *vm) { /* nothing for now */ }
+static inline void inter_setup(VM *vm) {
+    interp_state *st = (interp_state*)calloc(1, sizeof(interp_state));
+    vm_check(vm, st, "inter_setup: out of memory");
+    st->tier = tier_new(vm, &tier_defaults);
+    vm->user_data = st;
+}
 
-static inline void inter_finalize(VM *vm, word imm) { /* nothing */ }
+static inline void inter_finalize(VM *vm, word imm) {
+    (void)imm;
+    interp_state *st = interp_get_state(vm);
+    if (!st) return;
+    tier_free(st->tier);
+    for (int i = 0; i < st->maps_count; ++i) hm_free(&st->maps[i]);
+    free(st->maps);
+    free(st);
+    vm->user_data = NULL;
+}
 
-/* function recording: record function start ip */
-static inline void interp_function(VM *vm, word func_index) {
-    if ((size_t)func_index >= sizeof(vm->functions)/sizeof(vm->functions[0])) return;
-    /* record the function's start ip */
-    vm->functions[func_index] = vm->ip;
-    if (vm->functions_count <= (size_t)func_index) vm->functions_count = (size_t)func_index + 1;
-    /* skip over the function body at runtime until matching ENDBLOCK */
+static inline void inter_stats(VM *vm, FILE *out) {
+    interp_state *st = interp_get_state(vm);
+    if (!st) return;
+    for (int i = 0; i < st->maps_count; ++i) hm_print_stats(&st->maps[i], i, out);
+    if (st->tier) tier_print_stats(st->tier, out);
+}
+
+/* Skip code that is not executed, starting at vm->ip. Nested IF/WHILE/FUNCTION
+ * blocks are skipped whole (ELSE inside them does not change the depth).
+ * Stops after the matching ENDBLOCK, or after a same-level ELSE when
+ * stop_at_else is set, and returns the opcode it stopped on (OP_HALT if the
+ * code ran out). */
+static inline OpCode interp_skip_block(VM *vm, int stop_at_else) {
     size_t depth = 0;
     size_t i = vm->ip;
     while (i < vm->code_len) {
         OpCode op = (OpCode)vm->code[i++];
-        if (op == OP_FUNCTION || op == OP_IF || op == OP_WHILE) {
-            depth++;
-        } else if (op == OP_ENDBLOCK && depth == 0) {
-            vm->ip = i; /* position after ENDBLOCK */
-            return;
-        } else if (op == OP_ELSE || op == OP_ENDBLOCK) {
+        if (op == OP_ENDBLOCK) {
+            if (depth == 0) { vm->ip = i; return op; }
             depth--;
+        } else if (op == OP_ELSE) {
+            if (depth == 0 && stop_at_else) { vm->ip = i; return op; }
         } else {
-            /* skip immediates: OP_PUSH and OP_SET carry two immediates (type+imm).
-               OP_MOVE, OP_FUNCTION, OP_CALL, OP_WHILE carry one immediate. */
-            if (op == OP_PUSH || op == OP_SET) i += 2;
-            else if (op == OP_MOVE || op == OP_FUNCTION || op == OP_CALL || op == OP_WHILE) i++;
+            if (op == OP_IF || op == OP_WHILE || op == OP_FUNCTION) depth++;
+            /* skip immediates (typed PUSH/SET carry two, see vm_op_imm_count) */
+            i += (size_t)vm_op_imm_count(op);
         }
     }
-    vm->ip = vm->code_len; /* fallback */
+    vm->ip = vm->code_len;
+    return OP_HALT;
 }
 
-static inline void interp_call(VM *vm, word func_index) {
-    assert((size_t)vm->call_sp < CALL_STACK_SIZE && "call stack overflow");
+/* function recording: record function start ip */
+static inline void interp_function(VM *vm, word func_index) {
+    if ((size_t)func_index >= sizeof(vm->functions)/sizeof(vm->functions[0])) return;
+    /* record the function's start ip */
+    vm->functions[func_index] = vm->ip;
+    if (vm->functions_count <= (size_t)func_index) vm->functions_count = (size_t)func_index + 1;
+    /* skip over the function body at runtime until matching ENDBLOCK */
+    interp_skip_block(vm, 0);
+}
+
+/* push a call frame and jump to the start of function func_index */
+static inline void interp_call_frame(VM *vm, word func_index) {
+    vm_check(vm, (size_t)vm->call_sp < CALL_STACK_SIZE, "call stack overflow");
     size_t fi = (size_t)func_index;
-    assert(fi < vm->functions_count && "call to unknown function index");
-    /* push return ip and old fp */
+    vm_check(vm, fi < vm->functions_count, "call to unknown function index");
+    /* push return ip, old fp and the caller's arena watermark */
     vm->call_stack[vm->call_sp].return_ip = vm->ip;
     vm->call_stack[vm->call_sp].old_fp = vm->fp;
+    vm->call_stack[vm->call_sp].old_arena = vm->arena_top;
+    vm->call_stack[vm->call_sp].old_block_sp = vm->block_sp;
     vm->call_sp++;
     /* new frame begins at current sp */
     vm->fp = vm->sp;
@@ -302,21 +367,40 @@ static inline void interp_call(VM *vm, word func_index) {
     vm->ip = vm->functions[fi];
 }
 
+static inline void interp_call(VM *vm, word func_index) {
+    interp_call_frame(vm, func_index);
+    /* count the call; a compiled callee runs to its ret here */
+    interp_state *st = interp_get_state(vm);
+    if (st->tier) tier_enter(st->tier, vm, (size_t)func_index);
+}
+
 static inline void interp_return(VM *vm) {
-    assert(vm->call_sp > 0 && "return with empty call stack");
-    word ret = 0;
-    /* if there's a return value on the stack, pop it */
-    if (vm->sp > vm->fp) ret = vm_pop(vm);
+    vm_check(vm, vm->call_sp > 0, "return with empty call stack");
+    word ret[V128_SLOTS] = { 0 };
+    int nret = 1;
+    TypeTag ret_type = TYPE_I64;
+    /* if there's a return value on the stack, pop it (keeping its type; a
+       v128 moves all of its slots) */
+    if (vm->sp > vm->fp) {
+        ret_type = vm->types[vm->sp - 1];
+        if (ret_type == TYPE_V128) nret = V128_SLOTS;
+        vm_check(vm, vm->sp - vm->fp >= nret, "return: partial v128 on the stack");
+        vm->sp -= nret;
+        memcpy(ret, &vm->stack[vm->sp], (size_t)nret * sizeof(word));
+    }
     /* restore frame and return ip */
     vm->call_sp--;
     size_t ret_ip = vm->call_stack[vm->call_sp].return_ip;
     int old_fp = vm->call_stack[vm->call_sp].old_fp;
-    /* tear down locals */
+    /* tear down locals and release the frame's arena in one step */
+    vm->arena_top = vm->call_stack[vm->call_sp].old_arena;
+    /* drop markers of blocks the callee returned from inside */
+    vm->block_sp = vm->call_stack[vm->call_sp].old_block_sp;
     vm->sp = vm->fp;
     vm->fp = old_fp;
     vm->ip = ret_ip;
     /* push return value */
-    vm_push(vm, ret);
+    for (int i = 0; i < nret; ++i) interp_push(vm, ret_type, ret[i]);
 }
 
 /* simple block stack entry is defined in vm/vm.h */
@@ -324,32 +408,17 @@ static inline void interp_return(VM *vm) {
 static inline void interp_if(VM *vm) {
     word cond = vm_pop(vm);
     if (cond == 0) {
-        /* skip to matching ELSE or ENDBLOCK */
-        size_t depth = 0;
-        size_t i = vm->ip;
-        while (i < vm->code_len) {
-            OpCode op = (OpCode)vm->code[i++];
-            if (op == OP_IF || op == OP_WHILE) {
-                depth++;
-            } else if (op == OP_ELSE && depth == 0) {
-                vm->ip = i; /* execute after ELSE */
-                return;
-            } else if (op == OP_ENDBLOCK && depth == 0) {
-                vm->ip = i; /* execute after ENDBLOCK */
-                return;
-            } else if (op == OP_ELSE || op == OP_ENDBLOCK) {
-                depth--;
-            } else {
-                /* if op has immediate, skip it. account for new PUSH/SET formats. */
-                if (op == OP_PUSH || op == OP_SET) i += 2;
-                else if (op == OP_MOVE || op == OP_FUNCTION || op == OP_CALL || op == OP_WHILE) i++;
-            }
+        /* skip to matching ELSE or ENDBLOCK; entering the else arm pushes a
+           marker so its ENDBLOCK pops this block and not an enclosing one */
+        if (interp_skip_block(vm, 1) == OP_ELSE) {
+            vm_check(vm, vm->block_sp < 256, "block stack overflow");
+            vm->block_stack[vm->block_sp].type = OP_ELSE;
+            vm->block_stack[vm->block_sp].ip = vm->ip;
+            vm->block_sp++;
         }
-        /* not found -> end execution */
-        vm->ip = vm->code_len;
     } else {
         /* enter if: push a marker onto block stack */
-        assert(vm->block_sp < 256 && "block stack overflow");
+        vm_check(vm, vm->block_sp < 256, "block stack overflow");
         vm->block_stack[vm->block_sp].type = OP_IF;
         vm->block_stack[vm->block_sp].ip = vm->ip;
         vm->block_sp++;
@@ -357,38 +426,23 @@ static inline void interp_if(VM *vm) {
 }
 
 static inline void interp_else(VM *vm) {
-    /* skip to matching ENDBLOCK */
-    size_t depth = 0;
-    size_t i = vm->ip;
-    while (i < vm->code_len) {
-        OpCode op = (OpCode)vm->code[i++];
-        if (op == OP_IF || op == OP_WHILE) {
-            depth++;
-        } else if (op == OP_ENDBLOCK && depth == 0) {
-            vm->ip = i; /* execute after ENDBLOCK */
-            /* pop IF marker if present */
-            if (vm->block_sp > 0) vm->block_sp--;
-            return;
-        } else if (op == OP_ELSE || op == OP_ENDBLOCK) {
-            depth--;
-        } else {
-            /* skip immediates, accounting for typed PUSH/SET */
-            if (op == OP_PUSH || op == OP_SET) i += 2;
-            else if (op == OP_MOVE || op == OP_FUNCTION || op == OP_CALL || op == OP_WHILE) i++;
-        }
-    }
-    vm->ip = vm->code_len;
+    /* end of the taken then-arm: skip the else arm and pop the IF marker */
+    if (interp_skip_block(vm, 0) == OP_ENDBLOCK && vm->block_sp > 0) vm->block_sp--;
 }
 
 static inline void interp_endblock(VM *vm) {
-    /* if top of block stack is WHILE, loop back to its ip; otherwise pop marker */
+    /* if top of block stack is WHILE, pop it and loop back to the condition
+       (OP_WHILE pushes a fresh marker when it re-enters the body); otherwise
+       just pop the marker */
     if (vm->block_sp > 0) {
         int top = vm->block_sp - 1;
+        vm->block_sp--;
         if (vm->block_stack[top].type == OP_WHILE) {
-            /* loop back to condition: set ip to stored ip */
+            size_t end_ip = vm->ip - 1;
             vm->ip = vm->block_stack[top].ip;
-        } else {
-            vm->block_sp--;
+            /* count the back-edge; a compiled loop continues from here */
+            interp_state *st = interp_get_state(vm);
+            if (st->tier) tier_loop_edge(st->tier, vm, vm->ip, end_ip);
         }
     }
 }
@@ -402,27 +456,10 @@ static inline void interp_while(VM *vm, word cond_ip) {
     word cond = vm_pop(vm);
     if (cond == 0) {
         /* skip to ENDBLOCK */
-        size_t depth = 0;
-        size_t i = vm->ip;
-        while (i < vm->code_len) {
-            OpCode op = (OpCode)vm->code[i++];
-            if (op == OP_IF || op == OP_WHILE) {
-                depth++;
-            } else if (op == OP_ENDBLOCK && depth == 0) {
-                vm->ip = i;
-                return;
-            } else if (op == OP_ELSE || op == OP_ENDBLOCK) {
-                depth--;
-            } else {
-                /* typed PUSH/SET use two immediates; other ops use one */
-                if (op == OP_PUSH || op == OP_SET) i += 2;
-                else if (op == OP_MOVE || op == OP_FUNCTION || op == OP_CALL || op == OP_WHILE) i++;
-            }
-        }
-        vm->ip = vm->code_len;
+        interp_skip_block(vm, 0);
     } else {
         /* enter loop: push WHILE marker that stores the cond_ip provided by the emitter */
-        assert(vm->block_sp < 256 && "block stack overflow");
+        vm_check(vm, vm->block_sp < 256, "block stack overflow");
         vm->block_stack[vm->block_sp].type = OP_WHILE;
         vm->block_stack[vm->block_sp].ip = (size_t)cond_ip;
         vm->block_sp++;
@@ -433,8 +470,12 @@ static inline void interp_deref(VM *vm) {
     /* push current tp and set tp = tape[tp] (pointer chase) */
     vm_push_tp(vm, vm->tp);
     word new_tp = vm->tape[vm->tp];
-    assert(new_tp >= 0 && (size_t)new_tp < TAPE_SIZE && "DEREF produced invalid tape index");
+#if TAPE_GUARD
+    vm->tp = vm_guard_tp(vm, (int64_t)new_tp);
+#else
+    vm_check(vm, new_tp >= 0 && (size_t)new_tp < TAPE_SIZE, "DEREF produced invalid tape index");
     vm->tp = (int)new_tp;
+#endif
 }
 
 static inline void interp_refer(VM *vm) {
@@ -449,27 +490,35 @@ static inline void interp_where(VM *vm) {
 
 static inline void interp_offset(VM *vm, word imm) {
     /* adjust the tape pointer by signed immediate */
+#if TAPE_GUARD
+    vm->tp = vm_guard_step(vm, (int64_t)imm);
+#else
     if (imm < 0) {
         size_t step = (size_t)(-imm);
-        assert(vm->tp >= (int)step && "OFFSET underflow");
+        vm_check(vm, vm->tp >= (int)step, "OFFSET underflow");
         vm->tp -= (int)step;
     } else {
         vm->tp += (size_t)imm;
-        assert((size_t)vm->tp < TAPE_SIZE && "OFFSET overflow");
+        vm_check(vm, (size_t)vm->tp < TAPE_SIZE, "OFFSET overflow");
     }
+#endif
 }
 
 static inline void interp_index(VM *vm) {
     /* shift pointer by the value stored at tape[tp] */
     word delta = vm->tape[vm->tp];
+#if TAPE_GUARD
+    vm->tp = vm_guard_step(vm, (int64_t)delta);
+#else
     if (delta < 0) {
         size_t step = (size_t)(-delta);
-        assert(vm->tp >= (int)step && "INDEX underflow");
+        vm_check(vm, vm->tp >= (int)step, "INDEX underflow");
         vm->tp -= (int)step;
     } else {
         vm->tp += (size_t)delta;
-        assert((size_t)vm->tp < TAPE_SIZE && "INDEX overflow");
+        vm_check(vm, (size_t)vm->tp < TAPE_SIZE, "INDEX overflow");
     }
+#endif
 }
 
 static inline void interp_set(VM *vm, int type, word imm) {
@@ -493,6 +542,7 @@ static inline word rem_impl(word a, word b) {
 }
 
 static inline void interp_rem(VM *vm) {
+    interp_check_divisor(vm);
     interp_binary(vm, rem_impl);
 }
 
@@ -530,9 +580,473 @@ static inline void interp_gez(VM *vm) {
     vm_push(vm, v >= 0 ? 1 : 0);
 }
 
+/* SELECT/MIN/MAX/ABS choose through a mask rather than a branch, so a
+ * data-dependent choice cannot mispredict. Floats compare as floats
+ * (minsd/maxsd), the unsigned types as unsigned. */
+static inline word choose_impl(word c, word a, word b) {
+    word m = -(word)(c != 0);
+    return (a & m) | (b & ~m);
+}
+
+static inline int type_is_unsigned(TypeTag t) {
+    return t == TYPE_U8 || t == TYPE_U16 || t == TYPE_U32 || t == TYPE_U64;
+}
+
+static inline word minmax_impl(word a, word b, TypeTag t, int max) {
+    int lt;
+    if (t == TYPE_F32) {
+        union { uint32_t u; float f; } fa, fb;
+        fa.u = (uint32_t)a;
+        fb.u = (uint32_t)b;
+        lt = fa.f < fb.f;
+    } else if (t == TYPE_F64) {
+        union { uint64_t u; double d; } da, db;
+        da.u = (uint64_t)a;
+        db.u = (uint64_t)b;
+        lt = da.d < db.d;
+    } else if (type_is_unsigned(t)) {
+        lt = (uint64_t)a < (uint64_t)b;
+    } else {
+        lt = a < b;
+    }
+    return choose_impl(lt ^ max, a, b);
+}
+
+static inline word abs_impl(word a, TypeTag t) {
+    if (t == TYPE_F32) return a & (word)0x7FFFFFFF;
+    if (t == TYPE_F64) return a & (word)(~((uint64_t)1 << (WORD_BITS - 1)));
+    if (type_is_unsigned(t) || t == TYPE_BOOL || t == TYPE_PTR) return a;
+    word m = a >> (WORD_BITS - 1);
+    return (word)(((uint64_t)a ^ (uint64_t)m) - (uint64_t)m);
+}
+
+/* c a b -- r: the chosen value keeps its own type */
+static inline void interp_select(VM *vm) {
+    vm_check(vm, vm->sp >= 3, "interp_select: stack underflow");
+    TypeTag tb = vm->types[vm->sp - 1], ta = vm->types[vm->sp - 2];
+    word b = vm_pop(vm);
+    word a = vm_pop(vm);
+    word c = vm_pop(vm);
+    interp_push(vm, (int)choose_impl(c, ta, tb), choose_impl(c, a, b));
+}
+
+static inline void interp_minmax(VM *vm, int max) {
+    vm_check(vm, vm->sp >= 2, "interp_minmax: stack underflow");
+    TypeTag top = vm->types[vm->sp - 1];
+    vm_check(vm, top == vm->types[vm->sp - 2], "interp_minmax: type mismatch");
+    word b = vm_pop(vm);
+    word a = vm_pop(vm);
+    interp_push(vm, top, minmax_impl(a, b, top, max));
+}
+
+static inline void interp_min(VM *vm) { interp_minmax(vm, 0); }
+static inline void interp_max(VM *vm) { interp_minmax(vm, 1); }
+
+static inline void interp_abs(VM *vm) {
+    vm_check(vm, vm->sp >= 1, "interp_abs: stack underflow");
+    TypeTag t = vm->types[vm->sp - 1];
+    vm->stack[vm->sp - 1] = abs_impl(vm->stack[vm->sp - 1], t);
+}
+
+/* POPCNT/CLZ/CTZ/BSWAP/ROTL/ROTR/MULHI work on the low bits of the type
+ * (8, 16, 32 or WORD_BITS) and go through the compiler builtins, which
+ * lower to single instructions. Results that are bit patterns are extended
+ * back to a word as the type's signedness says. */
+static inline int type_bits(TypeTag t) {
+    switch (t) {
+        case TYPE_I8: case TYPE_U8: return 8;
+        case TYPE_I16: case TYPE_U16: return 16;
+        case TYPE_I32: case TYPE_U32: case TYPE_F32: return WORD_BITS < 32 ? WORD_BITS : 32;
+        default: return WORD_BITS;
+    }
+}
+
+static inline uint64_t bits_low(word a, int w) {
+    return w >= 64 ? (uint64_t)a : (uint64_t)a & ((UINT64_C(1) << w) - 1);
+}
+
+static inline word bits_extend(uint64_t v, int w, TypeTag t) {
+    if (w >= 64 || type_is_unsigned(t)) return (word)v;
+    return (word)((int64_t)(v << (64 - w)) >> (64 - w));
+}
+
+static inline word popcnt_impl(word a, TypeTag t) {
+    return (word)__builtin_popcountll(bits_low(a, type_bits(t)));
+}
+
+static inline word clz_impl(word a, TypeTag t) {
+    int w = type_bits(t);
+    uint64_t v = bits_low(a, w);
+    return v ? (word)(__builtin_clzll(v) - (64 - w)) : (word)w;
+}
+
+static inline word ctz_impl(word a, TypeTag t) {
+    int w = type_bits(t);
+    uint64_t v = bits_low(a, w);
+    return v ? (word)__builtin_ctzll(v) : (word)w;
+}
+
+static inline word bswap_impl(word a, TypeTag t) {
+    int w = type_bits(t);
+    uint64_t v = bits_low(a, w);
+    switch (w) {
+        case 16: v = __builtin_bswap16((uint16_t)v); break;
+        case 32: v = __builtin_bswap32((uint32_t)v); break;
+        case 64: v = __builtin_bswap64(v); break;
+        default: break;
+    }
+    return bits_extend(v, w, t);
+}
+
+static inline word rot_impl(word a, word n, TypeTag t, int right) {
+    int w = type_bits(t);
+    uint64_t v = bits_low(a, w);
+    unsigned k = (unsigned)((uint64_t)n & (uint64_t)(w - 1));
+    if (right && k) k = (unsigned)w - k;
+    if (k) v = bits_low((word)((v << k) | (v >> (w - (int)k))), w);
+    return bits_extend(v, w, t);
+}
+
+static inline word mulhi_impl(word a, word b, TypeTag t) {
+    int w = type_bits(t);
+    if (w < 64) {
+        /* both halves fit the 64-bit product */
+        if (type_is_unsigned(t)) return bits_extend((bits_low(a, w) * bits_low(b, w)) >> w, w, t);
+        int64_t p = (int64_t)bits_extend(bits_low(a, w), w, t) * (int64_t)bits_extend(bits_low(b, w), w, t);
+        return (word)(p >> w);
+    }
+#if WORD_BITS == 64
+    if (type_is_unsigned(t)) return (word)(((unsigned __int128)(uint64_t)a * (uint64_t)b) >> 64);
+    return (word)(((__int128)a * b) >> 64);
+#else
+    return 0; /* no type is wider than 32 bits here */
+#endif
+}
+
+static inline void interp_bits1(VM *vm, word (*fn)(word, TypeTag)) {
+    vm_check(vm, vm->sp >= 1, "interp_bits: stack underflow");
+    vm->stack[vm->sp - 1] = fn(vm->stack[vm->sp - 1], vm->types[vm->sp - 1]);
+}
+
+static inline void interp_popcnt(VM *vm) { interp_bits1(vm, popcnt_impl); }
+static inline void interp_clz(VM *vm) { interp_bits1(vm, clz_impl); }
+static inline void interp_ctz(VM *vm) { interp_bits1(vm, ctz_impl); }
+static inline void interp_bswap(VM *vm) { interp_bits1(vm, bswap_impl); }
+
+/* a n -- r and a b -- r: both operands have the type (see interp_binary) */
+static inline void interp_bits2(VM *vm, int op) {
+    vm_check(vm, vm->sp >= 2, "interp_bits: stack underflow");
+    TypeTag top = vm->types[vm->sp - 1];
+    vm_check(vm, top == vm->types[vm->sp - 2], "interp_bits: type mismatch");
+    word b = vm_pop(vm);
+    word a = vm_pop(vm);
+    interp_push(vm, top, op == OP_MULHI ? mulhi_impl(a, b, top) : rot_impl(a, b, top, op == OP_ROTR));
+}
+
+static inline void interp_rotl(VM *vm) { interp_bits2(vm, OP_ROTL); }
+static inline void interp_rotr(VM *vm) { interp_bits2(vm, OP_ROTR); }
+static inline void interp_mulhi(VM *vm) { interp_bits2(vm, OP_MULHI); }
+
+/* ARENA: bump-allocate n cells from the current frame's arena and push the
+ * base tape index as a ptr. Cells are not cleared; the whole block is
+ * released when the frame returns (see interp_return). */
+static inline void interp_arena(VM *vm, word n) {
+    vm_check(vm, n >= 0 && n <= (word)(TAPE_SIZE - vm->arena_top), "arena exhausted");
+    vm_push(vm, (word)vm->arena_top);
+    vm->types[vm->sp - 1] = TYPE_PTR;
+    vm->arena_top += (int)n;
+}
+
+/* NCALL: pop the intrinsic's arguments (pushed in order), check them against
+ * the declared signature and call it directly. A non-void result is pushed
+ * with the declared result type. */
+static inline void interp_ncall(VM *vm, word native_index) {
+    const NativeSig *sig = native_get((int)native_index);
+    vm_check(vm, sig, "ncall: unknown intrinsic index");
+    vm_check(vm, vm->sp >= sig->arity, "ncall: stack underflow");
+    int base = vm->sp - sig->arity;
+    for (int i = 0; i < sig->arity; ++i) {
+        vm_check(vm, sig->arg_types[i] == TYPE_UNKNOWN || vm->types[base + i] == sig->arg_types[i],
+                 "ncall: argument type mismatch");
+    }
+    word result = 0;
+    sig->fn(&vm->stack[base], &result, vm->out);
+    vm->sp = base;
+    if (sig->result_type != TYPE_VOID) {
+        vm_push(vm, result);
+        vm->types[vm->sp - 1] = sig->result_type;
+    }
+}
+
+/* --- hash maps --- */
+
+static inline hm_table *interp_map(VM *vm, word handle) {
+    interp_state *st = interp_get_state(vm);
+    vm_check(vm, handle >= 0 && handle < st->maps_count, "invalid hash map handle");
+    return &st->maps[handle];
+}
+
+static inline void interp_hnew(VM *vm) {
+    interp_state *st = interp_get_state(vm);
+    if (st->maps_count == st->maps_cap) {
+        st->maps_cap = st->maps_cap ? st->maps_cap * 2 : 4;
+        st->maps = (hm_table*)realloc(st->maps, (size_t)st->maps_cap * sizeof(hm_table));
+        vm_check(vm, st->maps, "hnew: out of memory");
+    }
+    hm_init(&st->maps[st->maps_count]);
+    vm_push(vm, (word)st->maps_count++);
+    vm->types[vm->sp - 1] = TYPE_I64;
+}
+
+static inline void interp_hput(VM *vm) {
+    vm_check(vm, vm->sp >= 3, "hput: stack underflow");
+    TypeTag vt = vm->types[vm->sp - 1];
+    word v = vm_pop(vm);
+    word k = vm_pop(vm);
+    word h = vm_pop(vm);
+    hm_put(interp_map(vm, h), k, v, vt);
+}
+
+static inline void interp_hget(VM *vm) {
+    word k = vm_pop(vm);
+    word h = vm_pop(vm);
+    word v = 0;
+    TypeTag vt = TYPE_I64;
+    hm_get(interp_map(vm, h), k, &v, &vt);
+    vm_push(vm, v);
+    vm->types[vm->sp - 1] = vt;
+}
+
+static inline void interp_hdel(VM *vm) {
+    word k = vm_pop(vm);
+    word h = vm_pop(vm);
+    vm_push(vm, (word)hm_del(interp_map(vm, h), k));
+    vm->types[vm->sp - 1] = TYPE_BOOL;
+}
+
+static inline void interp_hlen(VM *vm) {
+    word h = vm_pop(vm);
+    vm_push(vm, (word)interp_map(vm, h)->count);
+    vm->types[vm->sp - 1] = TYPE_I64;
+}
+
+/* HITER: write every key/value pair to consecutive tape cells starting at tp
+ * (key cells are typed i64, value cells keep their stored type) and push the
+ * pair count. tp itself is left unchanged. */
+static inline void interp_hiter(VM *vm) {
+    word h = vm_pop(vm);
+    hm_table *t = interp_map(vm, h);
+    vm_check(vm, (size_t)vm->tp + 2 * t->count <= TAPE_SIZE, "hiter: tape range overflow");
+    size_t pos = 0, slot, cell = (size_t)vm->tp;
+    while (hm_next(t, &pos, &slot)) {
+        vm->tape[cell] = t->keys[slot];
+        vm->tape_types[cell++] = TYPE_I64;
+        vm->tape[cell] = t->vals[slot];
+        vm->tape_types[cell++] = t->types[slot];
+    }
+    vm_push(vm, (word)t->count);
+    vm->types[vm->sp - 1] = TYPE_I64;
+}
+
+/* --- sort/search over tape[tp..tp+n) --- */
+
+/* element type of the range; the VM is strict, so all cells must agree */
+static inline TypeTag interp_range_type(VM *vm, word n) {
+    vm_check(vm, n >= 0 && vm->tp >= 0 && (size_t)vm->tp + (size_t)n <= TAPE_SIZE, "tape range out of bounds");
+    if (n == 0) return TYPE_UNKNOWN;
+    TypeTag t = vm->tape_types[vm->tp];
+    for (word i = 1; i < n; ++i) {
+        vm_check(vm, vm->tape_types[vm->tp + i] == t, "sort/search: mixed cell types in range");
+    }
+    return t;
+}
+
+static inline void interp_sort(VM *vm, word n) {
+    TypeTag t = interp_range_type(vm, n);
+    sort_cells(&vm->tape[vm->tp], (size_t)n, t);
+}
+
+static inline void interp_bsearch(VM *vm, word n) {
+    TypeTag t = interp_range_type(vm, n);
+    vm_check(vm, (n == 0 || vm->types[vm->sp - 1] == t), "bsearch: key type mismatch");
+    word key = vm_pop(vm);
+    vm_push(vm, sort_bsearch(&vm->tape[vm->tp], (size_t)n, key, t));
+    vm->types[vm->sp - 1] = TYPE_I64;
+}
+
+static inline void interp_lowerbound(VM *vm, word n) {
+    TypeTag t = interp_range_type(vm, n);
+    vm_check(vm, (n == 0 || vm->types[vm->sp - 1] == t), "lowerbound: key type mismatch");
+    word key = vm_pop(vm);
+    vm_push(vm, (word)sort_lower_bound(&vm->tape[vm->tp], (size_t)n, key, t));
+    vm->types[vm->sp - 1] = TYPE_I64;
+}
+
+/* --- text kernels over n bytes packed from tape[tp] --- */
+
+static inline uint8_t *interp_text(VM *vm, word n) {
+    vm_check(vm, n >= 0 && vm->tp >= 0, "text: negative region");
+    vm_check(vm, (size_t)vm->tp * sizeof(word) + (size_t)n <= TAPE_SIZE * sizeof(word), "text: region out of bounds");
+    return (uint8_t*)&vm->tape[vm->tp];
+}
+
+static inline size_t interp_text_pos(VM *vm, word n) {
+    word pos = vm_pop(vm);
+    vm_check(vm, pos >= 0 && pos <= n, "text: position outside region");
+    return (size_t)pos;
+}
+
+static inline void interp_pack(VM *vm, word n) {
+    vm_check(vm, n >= 0 && vm->tp >= 0 && (size_t)vm->tp + (size_t)n <= TAPE_SIZE, "pack: tape range out of bounds");
+    uint8_t *bytes = (uint8_t*)&vm->tape[vm->tp];
+    /* byte i lands in cell tp + i/sizeof(word), which has already been read */
+    for (word i = 0; i < n; ++i) bytes[i] = (uint8_t)(vm->tape[vm->tp + i] & 0xFF);
+    size_t cells = ((size_t)n + sizeof(word) - 1) / sizeof(word);
+    memset(bytes + n, 0, cells * sizeof(word) - (size_t)n);
+    for (size_t c = 0; c < cells; ++c) vm->tape_types[vm->tp + c] = WORD_BITS == 64 ? TYPE_U64 : TYPE_U32;
+    interp_push(vm, TYPE_I64, (word)cells);
+}
+
+static inline void interp_findbyte(VM *vm, word n) {
+    const uint8_t *s = interp_text(vm, n);
+    uint8_t b = (uint8_t)(vm_pop(vm) & 0xFF);
+    size_t at = text_findbyte(s, interp_text_pos(vm, n), (size_t)n, b);
+    interp_push(vm, TYPE_I64, at < (size_t)n ? (word)at : -1);
+}
+
+static inline void interp_findany(VM *vm, word n, word k) {
+    const uint8_t *s = interp_text(vm, n);
+    vm_check(vm, k >= 0 && k <= TEXT_SET_MAX, "findany: set size out of range");
+    uint8_t set[TEXT_SET_MAX];
+    for (word j = k - 1; j >= 0; --j) set[j] = (uint8_t)(vm_pop(vm) & 0xFF);
+    size_t at = text_findany(s, interp_text_pos(vm, n), (size_t)n, set, (int)k);
+    interp_push(vm, TYPE_I64, at < (size_t)n ? (word)at : -1);
+}
+
+static inline void interp_countlines(VM *vm, word n) {
+    interp_push(vm, TYPE_I64, (word)text_countlines(interp_text(vm, n), (size_t)n));
+}
+
+static inline void interp_splitlines(VM *vm, word n) {
+    const uint8_t *s = interp_text(vm, n);
+    word dst = vm_pop(vm);
+    size_t lines = n ? (size_t)text_countlines(s, (size_t)n) + (s[n - 1] != '\n') : 0;
+    size_t cells = ((size_t)n + sizeof(word) - 1) / sizeof(word);
+    vm_check(vm, dst >= 0 && (size_t)dst + lines <= TAPE_SIZE, "splitlines: offset array out of bounds");
+    vm_check(vm, (size_t)dst + lines <= (size_t)vm->tp || (size_t)dst >= (size_t)vm->tp + cells,
+             "splitlines: offset array overlaps the text");
+    text_splitlines(s, (size_t)n, &vm->tape[dst]);
+    for (size_t i = 0; i < lines; ++i) vm->tape_types[dst + i] = TYPE_I64;
+    interp_push(vm, TYPE_I64, (word)lines);
+}
+
+static inline void interp_parseint(VM *vm, word n) {
+    const uint8_t *s = interp_text(vm, n);
+    size_t end;
+    int64_t v = text_parseint(s, interp_text_pos(vm, n), (size_t)n, &end);
+    interp_push(vm, TYPE_I64, (word)v);
+    interp_push(vm, TYPE_I64, (word)end);
+}
+
+/* --- hashes/checksums over cells or packed bytes from tape[tp] --- */
+
+static inline const word *interp_cells(VM *vm, word n) {
+    vm_check(vm, n >= 0 && vm->tp >= 0 && (size_t)vm->tp + (size_t)n <= TAPE_SIZE, "tape range out of bounds");
+    return &vm->tape[vm->tp];
+}
+
+static inline void interp_hash64(VM *vm, word n) {
+    interp_push(vm, TYPE_U64, (word)hash_bytes64(interp_cells(vm, n), (size_t)n * sizeof(word), 0));
+}
+
+static inline void interp_hash64b(VM *vm, word n) {
+    interp_push(vm, TYPE_U64, (word)hash_bytes64(interp_text(vm, n), (size_t)n, 0));
+}
+
+static inline void interp_crc32c(VM *vm, word n) {
+    interp_push(vm, TYPE_U32, (word)hash_crc32c(0, interp_cells(vm, n), (size_t)n * sizeof(word)));
+}
+
+static inline void interp_crc32cb(VM *vm, word n) {
+    interp_push(vm, TYPE_U32, (word)hash_crc32c(0, interp_text(vm, n), (size_t)n));
+}
+
+/* --- 128-bit vectors: V128_SLOTS stack slots, all tagged TYPE_V128 --- */
+
+static inline TypeTag interp_lane(word lane) {
+    assert(simd_lanes((TypeTag)lane) && "vector: invalid lane type");
+    return (TypeTag)lane;
+}
+
+static inline v128 interp_vpop(VM *vm) {
+    vm_check(vm, vm->sp >= V128_SLOTS, "vector: stack underflow");
+    vm->sp -= V128_SLOTS;
+    for (int i = 0; i < V128_SLOTS; ++i) vm_check(vm, vm->types[vm->sp + i] == TYPE_V128, "vector: operand is not a v128");
+    v128 v;
+    memcpy(&v, &vm->stack[vm->sp], sizeof(v));
+    return v;
+}
+
+static inline void interp_vpush(VM *vm, v128 v) {
+    vm_check(vm, vm->sp + V128_SLOTS <= STACK_SIZE, "Stack overflow");
+    memcpy(&vm->stack[vm->sp], &v, sizeof(v));
+    for (int i = 0; i < V128_SLOTS; ++i) vm->types[vm->sp + i] = TYPE_V128;
+    vm->sp += V128_SLOTS;
+}
+
+static inline void interp_vload(VM *vm, word lane) {
+    TypeTag t = interp_lane(lane);
+    int lanes = simd_lanes(t);
+    vm_check(vm, vm->tp >= 0 && vm->tp + lanes <= TAPE_SIZE, "vload: tape range out of bounds");
+    for (int i = 0; i < lanes; ++i) vm_check(vm, vm->tape_types[vm->tp + i] == t, "vload: cell type does not match lane type");
+    interp_vpush(vm, simd_from_cells(&vm->tape[vm->tp], t));
+}
+
+static inline void interp_vstore(VM *vm, word lane) {
+    TypeTag t = interp_lane(lane);
+    int lanes = simd_lanes(t);
+    vm_check(vm, vm->tp >= 0 && vm->tp + lanes <= TAPE_SIZE, "vstore: tape range out of bounds");
+    simd_to_cells(&vm->tape[vm->tp], interp_vpop(vm), t);
+    for (int i = 0; i < lanes; ++i) vm->tape_types[vm->tp + i] = t;
+}
+
+static inline void interp_vsplat(VM *vm, word lane) {
+    TypeTag t = interp_lane(lane);
+    vm_check(vm, vm->sp > 0 && vm->types[vm->sp - 1] == t, "vsplat: scalar type does not match lane type");
+    interp_vpush(vm, simd_splat(vm_pop(vm), t));
+}
+
+static inline void interp_vbinary(VM *vm, OpCode op, word lane) {
+    v128 b = interp_vpop(vm); /* top */
+    v128 a = interp_vpop(vm); /* next */
+    switch (op) {
+        case OP_VADD: a = simd_add(a, b, interp_lane(lane)); break;
+        case OP_VSUB: a = simd_sub(a, b, interp_lane(lane)); break;
+        case OP_VMUL: a = simd_mul(a, b, interp_lane(lane)); break;
+        case OP_VMIN: a = simd_minmax(a, b, interp_lane(lane), 0); break;
+        case OP_VMAX: a = simd_minmax(a, b, interp_lane(lane), 1); break;
+        case OP_VAND: a = simd_bitwise(a, b, 0); break;
+        case OP_VOR: a = simd_bitwise(a, b, 1); break;
+        case OP_VXOR: a = simd_bitwise(a, b, 2); break;
+        default: assert(0 && "vbinary: not a vector op"); break;
+    }
+    interp_vpush(vm, a);
+}
+
+static inline void interp_vhsum(VM *vm, word lane) {
+    TypeTag t = interp_lane(lane);
+    interp_push(vm, simd_hsum_type(t), simd_hsum(interp_vpop(vm), t));
+}
+
+static inline void interp_vshuffle(VM *vm, word lane, word mask) {
+    TypeTag t = interp_lane(lane);
+    interp_vpush(vm, simd_shuffle(interp_vpop(vm), t, mask));
+}
+
 static const Backend __INTERPRETER = {
     .setup = inter_setup,
     .finalize = inter_finalize,
+    .stats = inter_stats,
     .op_push = interp_push,
     .op_add = interp_add,
     .op_sub = interp_sub,
@@ -572,6 +1086,49 @@ static const Backend __INTERPRETER = {
     .op_lrsh = interp_lrsh,
     .op_arsh = interp_arsh,
     .op_gez = interp_gez,
+
+    .op_arena = interp_arena,
+    .op_ncall = interp_ncall,
+
+    .op_hnew = interp_hnew,
+    .op_hput = interp_hput,
+    .op_hget = interp_hget,
+    .op_hdel = interp_hdel,
+    .op_hlen = interp_hlen,
+    .op_hiter = interp_hiter,
+
+    .op_sort = interp_sort,
+    .op_bsearch = interp_bsearch,
+    .op_lowerbound = interp_lowerbound,
+    .op_pack = interp_pack,
+    .op_findbyte = interp_findbyte,
+    .op_findany = interp_findany,
+    .op_countlines = interp_countlines,
+    .op_splitlines = interp_splitlines,
+    .op_parseint = interp_parseint,
+    .op_hash64 = interp_hash64,
+    .op_hash64b = interp_hash64b,
+    .op_crc32c = interp_crc32c,
+    .op_crc32cb = interp_crc32cb,
+    .op_vload = interp_vload,
+    .op_vstore = interp_vstore,
+    .op_vsplat = interp_vsplat,
+    .op_vbinary = interp_vbinary,
+    .op_vhsum = interp_vhsum,
+    .op_vshuffle = interp_vshuffle,
+
+    .op_select = interp_select,
+    .op_min = interp_min,
+    .op_max = interp_max,
+    .op_abs = interp_abs,
+
+    .op_popcnt = interp_popcnt,
+    .op_clz = interp_clz,
+    .op_ctz = interp_ctz,
+    .op_bswap = interp_bswap,
+    .op_rotl = interp_rotl,
+    .op_rotr = interp_rotr,
+    .op_mulhi = interp_mulhi,
 };
 
 #endif // INTERP_H
@@ -0,0 +1,194 @@
+#ifndef HASH_H
+#define HASH_H
+
+/*
+ * rrvm/frontend/kernels/hash.h
+ *
+ * Hash and checksum kernels over tape ranges (OP_HASH64, OP_HASH64B,
+ * OP_CRC32C, OP_CRC32CB) and the key hash used by hashmap/hashmap.h.
+ *
+ *  - hash_bytes64 is a wyhash-style hash: 48-byte blocks are folded through
+ *    three independent 64x64->128 multiply-xor lanes, short inputs are read
+ *    with a few overlapping loads. Not cryptographic.
+ *  - hash_word64 hashes a single word with one multiply-fold; the hash map
+ *    splits it into h1 (group) and h2 (control byte) bits.
+ *  - hash_crc32c is CRC-32C (Castagnoli, as in iSCSI/ext4). On x86-64 it
+ *    uses the SSE4.2 crc32 instruction when the CPU reports it at runtime,
+ *    otherwise slice-by-8 tables built once, on first use from any thread.
+ *
+ * Word mode hashes the cells' storage (n * sizeof(word) bytes, host byte
+ * order); byte mode hashes a packed byte region (see kernels/text.h).
+ */
+
+#include "../vm/vm.h"
+
+/* vm.h's __rem emit macro collides with a parameter name in pthread.h */
+#pragma push_macro("__rem")
+#undef __rem
+#include <pthread.h>
+#pragma pop_macro("__rem")
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HASH_X86 1
+/* vm.h's __index emit macro collides with parameter names in the intrinsic headers */
+#pragma push_macro("__index")
+#undef __index
+#include <immintrin.h>
+#pragma pop_macro("__index")
+#else
+#define HASH_X86 0
+#endif
+
+/* mixing constants (odd, roughly half the bits set) */
+static const uint64_t hash_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL,
+};
+
+/* 64x64 -> 128 multiply; low half to *a, high half to *b */
+static inline void hash_mum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t hash_r8(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t hash_r4(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+static inline uint64_t hash_bytes64(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = (const uint8_t*)data;
+    const uint64_t *s = hash_secret;
+    uint64_t a, b;
+    seed ^= hash_mix(seed ^ s[0], s[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            /* two overlapping 4-byte reads from each end cover 4..16 bytes */
+            size_t q = (len >> 3) << 2;
+            a = (hash_r4(p) << 32) | hash_r4(p + q);
+            b = (hash_r4(p + len - 4) << 32) | hash_r4(p + len - 4 - q);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = hash_mix(hash_r8(p) ^ s[1], hash_r8(p + 8) ^ seed);
+                see1 = hash_mix(hash_r8(p + 16) ^ s[2], hash_r8(p + 24) ^ see1);
+                see2 = hash_mix(hash_r8(p + 32) ^ s[3], hash_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash_mix(hash_r8(p) ^ s[1], hash_r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        /* the last 16 bytes, overlapping the previous block if needed */
+        a = hash_r8(p + i - 16);
+        b = hash_r8(p + i - 8);
+    }
+    a ^= s[1];
+    b ^= seed;
+    hash_mum(&a, &b);
+    return hash_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+static inline uint64_t hash_word64(word key) {
+    uint64_t a = (uint64_t)key ^ hash_secret[0], b = hash_secret[1];
+    hash_mum(&a, &b);
+    return hash_mix(a ^ hash_secret[0], b ^ hash_secret[1]);
+}
+
+/* --- CRC-32C --- */
+
+#define HASH_CRC32C_POLY 0x82F63B78u /* reflected Castagnoli polynomial */
+
+static uint32_t hash_crc_table[8][256];
+static pthread_once_t hash_crc_table_once = PTHREAD_ONCE_INIT;
+
+static inline void hash_crc_init_table(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (HASH_CRC32C_POLY & (0u - (c & 1)));
+        hash_crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int t = 1; t < 8; ++t) {
+            uint32_t c = hash_crc_table[t - 1][i];
+            hash_crc_table[t][i] = (c >> 8) ^ hash_crc_table[0][c & 0xFF];
+        }
+    }
+}
+
+/* table-driven CRC-32C update of the raw (non-inverted) register */
+static inline uint32_t hash_crc32c_sw(uint32_t crc, const uint8_t *p, size_t n) {
+    pthread_once(&hash_crc_table_once, hash_crc_init_table);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t w = hash_r8(p) ^ crc;
+        crc = hash_crc_table[7][w & 0xFF] ^ hash_crc_table[6][(w >> 8) & 0xFF] ^
+              hash_crc_table[5][(w >> 16) & 0xFF] ^ hash_crc_table[4][(w >> 24) & 0xFF] ^
+              hash_crc_table[3][(w >> 32) & 0xFF] ^ hash_crc_table[2][(w >> 40) & 0xFF] ^
+              hash_crc_table[1][(w >> 48) & 0xFF] ^ hash_crc_table[0][w >> 56];
+    }
+#endif
+    for (; n; --n, ++p) crc = (crc >> 8) ^ hash_crc_table[0][(crc ^ *p) & 0xFF];
+    return crc;
+}
+
+#if HASH_X86
+static int hash_sse42 = 0;
+static pthread_once_t hash_sse42_once = PTHREAD_ONCE_INIT;
+
+static inline void hash_detect_sse42(void) {
+    __builtin_cpu_init();
+    hash_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+}
+
+static inline int hash_have_sse42(void) {
+    pthread_once(&hash_sse42_once, hash_detect_sse42);
+    return hash_sse42;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t hash_crc32c_hw(uint32_t crc, const uint8_t *p, size_t n) {
+    uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8) c = _mm_crc32_u64(c, hash_r8(p));
+    crc = (uint32_t)c;
+    for (; n; --n, ++p) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+#endif
+
+/* CRC-32C of p[0..n) continuing from a previous result (0 to start) */
+static inline uint32_t hash_crc32c(uint32_t prev, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t*)data;
+    uint32_t crc = ~prev;
+#if HASH_X86
+    if (hash_have_sse42()) return ~hash_crc32c_hw(crc, p, n);
+#endif
+    return ~hash_crc32c_sw(crc, p, n);
+}
+
+#endif /* HASH_H */
@@ -0,0 +1,324 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * rrvm/frontend/kernels/simd.h
+ *
+ * Lane-wise kernels behind the V128 opcodes (OP_VLOAD .. OP_VSHUFFLE).
+ *
+ * A v128 holds 16 bytes viewed as 2 x i64/f64, 4 x i32/f32 or 16 x u8
+ * lanes; the lane type is an immediate of each opcode, not part of the
+ * value. Integer lanes wrap. With SSE2 (every x86-64) the arithmetic maps
+ * to one or a few instructions per op; the portable scalar path computes
+ * the same results, including min/max on NaN (the second operand wins, as
+ * minps/maxps do) and the f32 horizontal sum order (l0+l2)+(l1+l3). Only
+ * which payload a NaN op NaN returns may differ.
+ *
+ * On the tape a vector is `lanes` consecutive cells of the lane type, each
+ * holding one lane the way push stores a scalar of that type (f32 as its
+ * 32-bit pattern, i32 sign-extended, u8 zero-extended).
+ */
+
+#include "../vm/vm.h"
+
+#if defined(__SSE2__)
+#define SIMD_SSE2 1
+/* vm.h's __index emit macro collides with parameter names in the intrinsic headers */
+#pragma push_macro("__index")
+#undef __index
+#include <emmintrin.h>
+#pragma pop_macro("__index")
+#else
+#define SIMD_SSE2 0
+#endif
+
+typedef union {
+    int64_t i64[2];
+    double f64[2];
+    int32_t i32[4];
+    float f32[4];
+    uint8_t u8[16];
+} v128;
+
+/* lanes per vector for a lane type, 0 if the type cannot be a lane */
+static inline int simd_lanes(TypeTag t) {
+    switch (t) {
+        case TYPE_I64: case TYPE_F64: return 2;
+        case TYPE_I32: case TYPE_F32: return 4;
+        case TYPE_U8: return 16;
+        default: return 0;
+    }
+}
+
+#if SIMD_SSE2
+static inline __m128i simd_ld(v128 v) { return _mm_loadu_si128((const __m128i*)v.u8); }
+static inline v128 simd_st(__m128i x) { v128 r; _mm_storeu_si128((__m128i*)r.u8, x); return r; }
+static inline __m128 simd_ldps(v128 v) { return _mm_loadu_ps(v.f32); }
+static inline v128 simd_stps(__m128 x) { v128 r; _mm_storeu_ps(r.f32, x); return r; }
+static inline __m128d simd_ldpd(v128 v) { return _mm_loadu_pd(v.f64); }
+static inline v128 simd_stpd(__m128d x) { v128 r; _mm_storeu_pd(r.f64, x); return r; }
+
+/* low 32 bits of each 32-bit lane product (SSE2 has no pmulld) */
+static inline __m128i simd_mullo_epi32(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* low 8 bits of each byte product, via 16-bit multiplies */
+static inline __m128i simd_mullo_epu8(__m128i a, __m128i b) {
+    __m128i mask = _mm_set1_epi16(0xFF);
+    __m128i even = _mm_mullo_epi16(a, b);
+    __m128i odd = _mm_mullo_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    return _mm_or_si128(_mm_and_si128(even, mask), _mm_slli_epi16(odd, 8));
+}
+
+/* signed 32-bit select: gt ? a : b */
+static inline __m128i simd_select(__m128i gt, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#endif
+
+static inline v128 simd_add(v128 a, v128 b, TypeTag t) {
+#if SIMD_SSE2
+    switch (t) {
+        case TYPE_I64: return simd_st(_mm_add_epi64(simd_ld(a), simd_ld(b)));
+        case TYPE_I32: return simd_st(_mm_add_epi32(simd_ld(a), simd_ld(b)));
+        case TYPE_U8: return simd_st(_mm_add_epi8(simd_ld(a), simd_ld(b)));
+        case TYPE_F64: return simd_stpd(_mm_add_pd(simd_ldpd(a), simd_ldpd(b)));
+        case TYPE_F32: return simd_stps(_mm_add_ps(simd_ldps(a), simd_ldps(b)));
+        default: break;
+    }
+#else
+    switch (t) {
+        case TYPE_I64: for (int i = 0; i < 2; ++i) a.i64[i] = (int64_t)((uint64_t)a.i64[i] + (uint64_t)b.i64[i]); break;
+        case TYPE_I32: for (int i = 0; i < 4; ++i) a.i32[i] = (int32_t)((uint32_t)a.i32[i] + (uint32_t)b.i32[i]); break;
+        case TYPE_U8: for (int i = 0; i < 16; ++i) a.u8[i] = (uint8_t)(a.u8[i] + b.u8[i]); break;
+        case TYPE_F64: for (int i = 0; i < 2; ++i) a.f64[i] += b.f64[i]; break;
+        case TYPE_F32: for (int i = 0; i < 4; ++i) a.f32[i] += b.f32[i]; break;
+        default: break;
+    }
+#endif
+    return a;
+}
+
+static inline v128 simd_sub(v128 a, v128 b, TypeTag t) {
+#if SIMD_SSE2
+    switch (t) {
+        case TYPE_I64: return simd_st(_mm_sub_epi64(simd_ld(a), simd_ld(b)));
+        case TYPE_I32: return simd_st(_mm_sub_epi32(simd_ld(a), simd_ld(b)));
+        case TYPE_U8: return simd_st(_mm_sub_epi8(simd_ld(a), simd_ld(b)));
+        case TYPE_F64: return simd_stpd(_mm_sub_pd(simd_ldpd(a), simd_ldpd(b)));
+        case TYPE_F32: return simd_stps(_mm_sub_ps(simd_ldps(a), simd_ldps(b)));
+        default: break;
+    }
+#else
+    switch (t) {
+        case TYPE_I64: for (int i = 0; i < 2; ++i) a.i64[i] = (int64_t)((uint64_t)a.i64[i] - (uint64_t)b.i64[i]); break;
+        case TYPE_I32: for (int i = 0; i < 4; ++i) a.i32[i] = (int32_t)((uint32_t)a.i32[i] - (uint32_t)b.i32[i]); break;
+        case TYPE_U8: for (int i = 0; i < 16; ++i) a.u8[i] = (uint8_t)(a.u8[i] - b.u8[i]); break;
+        case TYPE_F64: for (int i = 0; i < 2; ++i) a.f64[i] -= b.f64[i]; break;
+        case TYPE_F32: for (int i = 0; i < 4; ++i) a.f32[i] -= b.f32[i]; break;
+        default: break;
+    }
+#endif
+    return a;
+}
+
+static inline v128 simd_mul(v128 a, v128 b, TypeTag t) {
+#if SIMD_SSE2
+    switch (t) {
+        case TYPE_I32: return simd_st(simd_mullo_epi32(simd_ld(a), simd_ld(b)));
+        case TYPE_U8: return simd_st(simd_mullo_epu8(simd_ld(a), simd_ld(b)));
+        case TYPE_F64: return simd_stpd(_mm_mul_pd(simd_ldpd(a), simd_ldpd(b)));
+        case TYPE_F32: return simd_stps(_mm_mul_ps(simd_ldps(a), simd_ldps(b)));
+        default: break; /* no 64-bit lane multiply before AVX-512 */
+    }
+    if (t == TYPE_I64) for (int i = 0; i < 2; ++i) a.i64[i] = (int64_t)((uint64_t)a.i64[i] * (uint64_t)b.i64[i]);
+#else
+    switch (t) {
+        case TYPE_I64: for (int i = 0; i < 2; ++i) a.i64[i] = (int64_t)((uint64_t)a.i64[i] * (uint64_t)b.i64[i]); break;
+        case TYPE_I32: for (int i = 0; i < 4; ++i) a.i32[i] = (int32_t)((uint32_t)a.i32[i] * (uint32_t)b.i32[i]); break;
+        case TYPE_U8: for (int i = 0; i < 16; ++i) a.u8[i] = (uint8_t)(a.u8[i] * b.u8[i]); break;
+        case TYPE_F64: for (int i = 0; i < 2; ++i) a.f64[i] *= b.f64[i]; break;
+        case TYPE_F32: for (int i = 0; i < 4; ++i) a.f32[i] *= b.f32[i]; break;
+        default: break;
+    }
+#endif
+    return a;
+}
+
+/* lane-wise min (max when is_max); float lanes follow minps: a < b ? a : b */
+static inline v128 simd_minmax(v128 a, v128 b, TypeTag t, int is_max) {
+#if SIMD_SSE2
+    switch (t) {
+        case TYPE_I32: {
+            __m128i x = simd_ld(a), y = simd_ld(b);
+            __m128i gt = _mm_cmpgt_epi32(x, y);
+            return simd_st(is_max ? simd_select(gt, x, y) : simd_select(gt, y, x));
+        }
+        case TYPE_U8:
+            return simd_st(is_max ? _mm_max_epu8(simd_ld(a), simd_ld(b)) : _mm_min_epu8(simd_ld(a), simd_ld(b)));
+        case TYPE_F64:
+            return simd_stpd(is_max ? _mm_max_pd(simd_ldpd(a), simd_ldpd(b)) : _mm_min_pd(simd_ldpd(a), simd_ldpd(b)));
+        case TYPE_F32:
+            return simd_stps(is_max ? _mm_max_ps(simd_ldps(a), simd_ldps(b)) : _mm_min_ps(simd_ldps(a), simd_ldps(b)));
+        default: break; /* no pcmpgtq in SSE2 */
+    }
+    if (t == TYPE_I64) {
+        for (int i = 0; i < 2; ++i) a.i64[i] = (is_max ? a.i64[i] > b.i64[i] : a.i64[i] < b.i64[i]) ? a.i64[i] : b.i64[i];
+    }
+#else
+    switch (t) {
+        case TYPE_I64:
+            for (int i = 0; i < 2; ++i) a.i64[i] = (is_max ? a.i64[i] > b.i64[i] : a.i64[i] < b.i64[i]) ? a.i64[i] : b.i64[i];
+            break;
+        case TYPE_I32:
+            for (int i = 0; i < 4; ++i) a.i32[i] = (is_max ? a.i32[i] > b.i32[i] : a.i32[i] < b.i32[i]) ? a.i32[i] : b.i32[i];
+            break;
+        case TYPE_U8:
+            for (int i = 0; i < 16; ++i) a.u8[i] = (is_max ? a.u8[i] > b.u8[i] : a.u8[i] < b.u8[i]) ? a.u8[i] : b.u8[i];
+            break;
+        case TYPE_F64:
+            for (int i = 0; i < 2; ++i) a.f64[i] = (is_max ? a.f64[i] > b.f64[i] : a.f64[i] < b.f64[i]) ? a.f64[i] : b.f64[i];
+            break;
+        case TYPE_F32:
+            for (int i = 0; i < 4; ++i) a.f32[i] = (is_max ? a.f32[i] > b.f32[i] : a.f32[i] < b.f32[i]) ? a.f32[i] : b.f32[i];
+            break;
+        default: break;
+    }
+#endif
+    return a;
+}
+
+/* bitwise ops ignore the lane type: 0 = and, 1 = or, 2 = xor */
+static inline v128 simd_bitwise(v128 a, v128 b, int which) {
+#if SIMD_SSE2
+    __m128i x = simd_ld(a), y = simd_ld(b);
+    return simd_st(which == 0 ? _mm_and_si128(x, y) : which == 1 ? _mm_or_si128(x, y) : _mm_xor_si128(x, y));
+#else
+    for (int i = 0; i < 2; ++i) {
+        uint64_t x = (uint64_t)a.i64[i], y = (uint64_t)b.i64[i];
+        a.i64[i] = (int64_t)(which == 0 ? x & y : which == 1 ? x | y : x ^ y);
+    }
+    return a;
+#endif
+}
+
+/* horizontal sum as a scalar of the lane type (u8 lanes sum to a u64);
+ * the result is the word a push of that type would hold */
+static inline word simd_hsum(v128 a, TypeTag t) {
+    switch (t) {
+        case TYPE_I64:
+            return (word)(int64_t)((uint64_t)a.i64[0] + (uint64_t)a.i64[1]);
+        case TYPE_I32: {
+#if SIMD_SSE2
+            __m128i x = simd_ld(a);
+            x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+            x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+            return (word)(int32_t)_mm_cvtsi128_si32(x);
+#else
+            uint32_t s = (uint32_t)a.i32[0] + (uint32_t)a.i32[1] + (uint32_t)a.i32[2] + (uint32_t)a.i32[3];
+            return (word)(int32_t)s;
+#endif
+        }
+        case TYPE_U8: {
+#if SIMD_SSE2
+            __m128i s = _mm_sad_epu8(simd_ld(a), _mm_setzero_si128());
+            return (word)(_mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8)));
+#else
+            word s = 0;
+            for (int i = 0; i < 16; ++i) s += a.u8[i];
+            return s;
+#endif
+        }
+        case TYPE_F64: {
+            union { double d; uint64_t u; } r;
+            r.d = a.f64[0] + a.f64[1];
+            return (word)r.u;
+        }
+        case TYPE_F32: {
+            union { float f; uint32_t u; } r;
+#if SIMD_SSE2
+            __m128 x = simd_ldps(a);
+            x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+            x = _mm_add_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+            r.f = _mm_cvtss_f32(x);
+#else
+            r.f = (a.f32[0] + a.f32[2]) + (a.f32[1] + a.f32[3]);
+#endif
+            return (word)r.u;
+        }
+        default:
+            return 0;
+    }
+}
+
+/* type of the scalar simd_hsum produces for a lane type */
+static inline TypeTag simd_hsum_type(TypeTag t) {
+    return t == TYPE_U8 ? TYPE_U64 : t;
+}
+
+/* Permute lanes: output lane i takes input lane (mask >> 4*i) & 15, taken
+ * modulo the lane count. The mask is an immediate, so 16 u8 lanes need a
+ * 64-bit word; with WORD_BITS=32 lanes 8..15 select lane 0. */
+static inline v128 simd_shuffle(v128 a, TypeTag t, word mask) {
+    uint64_t m = WORD_BITS == 64 ? (uint64_t)mask : (uint64_t)(uint32_t)mask;
+    int lanes = simd_lanes(t);
+    int size = lanes ? 16 / lanes : 16;
+    v128 r;
+    for (int i = 0; i < lanes; ++i) {
+        int src = (int)((m >> (4 * i)) & 15) % lanes;
+        memcpy(&r.u8[i * size], &a.u8[src * size], (size_t)size);
+    }
+    return r;
+}
+
+/* --- conversion between lanes and word-sized cells or scalars --- */
+
+/* one lane of type t, widened to the word a push of that type holds */
+static inline word simd_lane_word(const v128 *v, TypeTag t, int i) {
+    switch (t) {
+        case TYPE_I64: case TYPE_F64: return (word)v->i64[i];
+        case TYPE_I32: return (word)v->i32[i];
+        case TYPE_F32: { uint32_t u; memcpy(&u, &v->f32[i], 4); return (word)u; }
+        case TYPE_U8: return (word)v->u8[i];
+        default: return 0;
+    }
+}
+
+static inline void simd_set_lane(v128 *v, TypeTag t, int i, word w) {
+    switch (t) {
+        case TYPE_I64: case TYPE_F64: v->i64[i] = (int64_t)w; break;
+        case TYPE_I32: v->i32[i] = (int32_t)w; break;
+        case TYPE_F32: { uint32_t u = (uint32_t)w; memcpy(&v->f32[i], &u, 4); break; }
+        case TYPE_U8: v->u8[i] = (uint8_t)w; break;
+        default: break;
+    }
+}
+
+static inline v128 simd_from_cells(const word *cells, TypeTag t) {
+    v128 v;
+#if SIMD_SSE2 && WORD_BITS == 64
+    /* i64/f64 lanes are the cells themselves */
+    if (t == TYPE_I64 || t == TYPE_F64) return simd_st(_mm_loadu_si128((const __m128i*)cells));
+#endif
+    int lanes = simd_lanes(t);
+    for (int i = 0; i < lanes; ++i) simd_set_lane(&v, t, i, cells[i]);
+    return v;
+}
+
+static inline void simd_to_cells(word *cells, v128 v, TypeTag t) {
+    int lanes = simd_lanes(t);
+    for (int i = 0; i < lanes; ++i) cells[i] = simd_lane_word(&v, t, i);
+}
+
+static inline v128 simd_splat(word w, TypeTag t) {
+    v128 v;
+    int lanes = simd_lanes(t);
+    for (int i = 0; i < lanes; ++i) simd_set_lane(&v, t, i, w);
+    return v;
+}
+
+#endif /* SIMD_H */
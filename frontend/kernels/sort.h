@@ -0,0 +1,409 @@
+#ifndef SORT_H
+#define SORT_H
+
+/*
+ * rrvm/frontend/kernels/sort.h
+ *
+ * Sort and search kernels over tape ranges (OP_SORT, OP_BSEARCH,
+ * OP_LOWERBOUND). Cells are raw `word`s interpreted by a single TypeTag:
+ *
+ *  - integer-like types (i8..u64, bool, ptr, unknown) are sorted with an LSD
+ *    radix sort over 8-bit digits. Digits that are identical across the
+ *    whole range are skipped, so small value ranges cost few passes.
+ *  - f32/f64 are sorted with pattern-defeating quicksort (insertion sort for
+ *    short runs, ninther pivots, heapsort fallback on repeated bad
+ *    partitions). NaNs are ordered after every other value.
+ *
+ * With SORT_THREADS > 1 (requires -pthread) ranges of at least SORT_PAR_MIN
+ * cells are split into SORT_THREADS chunks, sorted concurrently and merged.
+ * That only pays off with a TAPE_SIZE far above the default.
+ */
+
+#include "../vm/vm.h"
+
+#ifndef SORT_THREADS
+#define SORT_THREADS 0
+#endif
+
+#ifndef SORT_PAR_MIN
+#define SORT_PAR_MIN 65536
+#endif
+
+#if SORT_THREADS > 1
+/* vm.h's __rem emit macro collides with a parameter name in glibc's time.h */
+#pragma push_macro("__rem")
+#undef __rem
+#include <pthread.h>
+#pragma pop_macro("__rem")
+#endif
+
+static inline int sort_type_is_float(TypeTag t) { return t == TYPE_F32 || t == TYPE_F64; }
+
+static inline int sort_type_is_unsigned(TypeTag t) {
+    return t == TYPE_U8 || t == TYPE_U16 || t == TYPE_U32 || t == TYPE_U64;
+}
+
+static inline double sort_as_double(word w, TypeTag t) {
+    if (t == TYPE_F32) {
+        union { uint32_t u; float f; } u;
+        u.u = (uint32_t)(w & 0xFFFFFFFFu);
+        return (double)u.f;
+    }
+    union { uint64_t u; double d; } u;
+    u.u = (uint64_t)w;
+    return u.d;
+}
+
+static inline word sort_from_double(double d, TypeTag t) {
+    if (t == TYPE_F32) {
+        union { uint32_t u; float f; } u;
+        u.f = (float)d;
+        return (word)u.u;
+    }
+    union { uint64_t u; double d; } u;
+    u.d = d;
+    return (word)u.u;
+}
+
+/* strict weak order on cells of type t; NaN sorts last */
+static inline int sort_less(word a, word b, TypeTag t) {
+    if (sort_type_is_float(t)) {
+        double x = sort_as_double(a, t), y = sort_as_double(b, t);
+        if (x != x) return 0;
+        if (y != y) return 1;
+        return x < y;
+    }
+    if (sort_type_is_unsigned(t)) return (uint64_t)a < (uint64_t)b;
+    return a < b;
+}
+
+/* --- LSD radix sort on unsigned 64-bit keys --- */
+
+static inline void sort_radix_u64(uint64_t *a, size_t n) {
+    if (n < 2) return;
+    if (n <= 32) {
+        for (size_t i = 1; i < n; ++i) {
+            uint64_t v = a[i];
+            size_t j = i;
+            while (j > 0 && v < a[j - 1]) { a[j] = a[j - 1]; j--; }
+            a[j] = v;
+        }
+        return;
+    }
+    /* all eight digit histograms in one pass */
+    size_t (*count)[256] = (size_t (*)[256])calloc(8 * 256, sizeof(size_t));
+    uint64_t *tmp = (uint64_t*)malloc(n * sizeof(uint64_t));
+    assert(count && tmp && "sort: out of memory");
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t k = a[i];
+        for (int d = 0; d < 8; ++d) count[d][(k >> (8 * d)) & 0xFF]++;
+    }
+    uint64_t *src = a, *dst = tmp;
+    for (int d = 0; d < 8; ++d) {
+        /* skip digits where every key has the same byte */
+        if (count[d][(src[0] >> (8 * d)) & 0xFF] == n) continue;
+        size_t sum = 0;
+        for (int b = 0; b < 256; ++b) {
+            size_t c = count[d][b];
+            count[d][b] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t k = src[i];
+            dst[count[d][(k >> (8 * d)) & 0xFF]++] = k;
+        }
+        uint64_t *t = src; src = dst; dst = t;
+    }
+    if (src != a) memcpy(a, src, n * sizeof(uint64_t));
+    free(tmp);
+    free(count);
+}
+
+/* --- pattern-defeating quicksort on doubles (no NaNs) --- */
+
+#define PDQ_INSERTION 24
+#define PDQ_NINTHER 128
+#define PDQ_PARTIAL_LIMIT 8
+
+static inline void pdq_swap(double *a, size_t i, size_t j) { double t = a[i]; a[i] = a[j]; a[j] = t; }
+
+static inline void pdq_sort2(double *a, size_t i, size_t j) { if (a[j] < a[i]) pdq_swap(a, i, j); }
+
+static inline void pdq_sort3(double *a, size_t i, size_t j, size_t k) {
+    pdq_sort2(a, i, j);
+    pdq_sort2(a, j, k);
+    pdq_sort2(a, i, j);
+}
+
+static inline void pdq_insertion(double *a, size_t lo, size_t hi) {
+    for (size_t i = lo + 1; i < hi; ++i) {
+        double v = a[i];
+        size_t j = i;
+        while (j > lo && v < a[j - 1]) { a[j] = a[j - 1]; j--; }
+        a[j] = v;
+    }
+}
+
+/* insertion sort that gives up after PDQ_PARTIAL_LIMIT element moves */
+static inline int pdq_partial_insertion(double *a, size_t lo, size_t hi) {
+    size_t moves = 0;
+    for (size_t i = lo + 1; i < hi; ++i) {
+        if (!(a[i] < a[i - 1])) continue;
+        double v = a[i];
+        size_t j = i;
+        do { a[j] = a[j - 1]; j--; } while (j > lo && v < a[j - 1]);
+        a[j] = v;
+        moves += i - j;
+        if (moves > PDQ_PARTIAL_LIMIT) return 0;
+    }
+    return 1;
+}
+
+static inline void pdq_sift(double *a, size_t lo, size_t root, size_t n) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= n) return;
+        if (child + 1 < n && a[lo + child] < a[lo + child + 1]) child++;
+        if (!(a[lo + root] < a[lo + child])) return;
+        pdq_swap(a, lo + root, lo + child);
+        root = child;
+    }
+}
+
+static inline void pdq_heapsort(double *a, size_t lo, size_t hi) {
+    size_t n = hi - lo;
+    for (size_t i = n / 2; i-- > 0;) pdq_sift(a, lo, i, n);
+    for (size_t end = n; end-- > 1;) {
+        pdq_swap(a, lo, lo + end);
+        pdq_sift(a, lo, 0, end);
+    }
+}
+
+/* partition around a[lo]; elements equal to the pivot go right */
+static inline size_t pdq_partition_right(double *a, size_t lo, size_t hi, int *already_partitioned) {
+    double pivot = a[lo];
+    size_t first = lo, last = hi;
+    while (a[++first] < pivot);
+    if (first - 1 == lo) while (first < last && !(a[--last] < pivot));
+    else while (!(a[--last] < pivot));
+    *already_partitioned = first >= last;
+    while (first < last) {
+        pdq_swap(a, first, last);
+        while (a[++first] < pivot);
+        while (!(a[--last] < pivot));
+    }
+    size_t pos = first - 1;
+    a[lo] = a[pos];
+    a[pos] = pivot;
+    return pos;
+}
+
+/* partition around a[lo]; elements equal to the pivot go left */
+static inline size_t pdq_partition_left(double *a, size_t lo, size_t hi) {
+    double pivot = a[lo];
+    size_t first = lo, last = hi;
+    while (pivot < a[--last]);
+    if (last + 1 == hi) while (first < last && !(pivot < a[++first]));
+    else while (!(pivot < a[++first]));
+    while (first < last) {
+        pdq_swap(a, first, last);
+        while (pivot < a[--last]);
+        while (!(pivot < a[++first]));
+    }
+    a[lo] = a[last];
+    a[last] = pivot;
+    return last;
+}
+
+static void pdq_loop(double *a, size_t lo, size_t hi, int bad_allowed, int leftmost) {
+    for (;;) {
+        size_t size = hi - lo;
+        if (size < PDQ_INSERTION) {
+            pdq_insertion(a, lo, hi);
+            return;
+        }
+        size_t s2 = size / 2;
+        if (size > PDQ_NINTHER) {
+            pdq_sort3(a, lo, lo + s2, hi - 1);
+            pdq_sort3(a, lo + 1, lo + s2 - 1, hi - 2);
+            pdq_sort3(a, lo + 2, lo + s2 + 1, hi - 3);
+            pdq_sort3(a, lo + s2 - 1, lo + s2, lo + s2 + 1);
+            pdq_swap(a, lo, lo + s2);
+        } else {
+            pdq_sort3(a, lo + s2, lo, hi - 1);
+        }
+
+        /* a run of values equal to the predecessor's pivot: put them all left */
+        if (!leftmost && !(a[lo - 1] < a[lo])) {
+            lo = pdq_partition_left(a, lo, hi) + 1;
+            continue;
+        }
+
+        int already;
+        size_t pos = pdq_partition_right(a, lo, hi, &already);
+        size_t l = pos - lo, r = hi - (pos + 1);
+        if (l < size / 8 || r < size / 8) {
+            if (--bad_allowed == 0) {
+                pdq_heapsort(a, lo, hi);
+                return;
+            }
+            /* break up patterns that produced the bad split */
+            if (l >= PDQ_INSERTION) {
+                pdq_swap(a, lo, lo + l / 4);
+                pdq_swap(a, pos - 1, pos - l / 4);
+                if (l > PDQ_NINTHER) {
+                    pdq_swap(a, lo + 1, lo + (l / 4 + 1));
+                    pdq_swap(a, lo + 2, lo + (l / 4 + 2));
+                    pdq_swap(a, pos - 2, pos - (l / 4 + 1));
+                    pdq_swap(a, pos - 3, pos - (l / 4 + 2));
+                }
+            }
+            if (r >= PDQ_INSERTION) {
+                pdq_swap(a, pos + 1, pos + 1 + r / 4);
+                pdq_swap(a, hi - 1, hi - r / 4);
+                if (r > PDQ_NINTHER) {
+                    pdq_swap(a, pos + 2, pos + 2 + r / 4);
+                    pdq_swap(a, pos + 3, pos + 3 + r / 4);
+                    pdq_swap(a, hi - 2, hi - (1 + r / 4));
+                    pdq_swap(a, hi - 3, hi - (2 + r / 4));
+                }
+            }
+        } else if (already && pdq_partial_insertion(a, lo, pos) && pdq_partial_insertion(a, pos + 1, hi)) {
+            return;
+        }
+
+        pdq_loop(a, lo, pos, bad_allowed, leftmost);
+        lo = pos + 1;
+        leftmost = 0;
+    }
+}
+
+static inline void sort_pdq_f64(double *a, size_t n) {
+    if (n < 2) return;
+    int log2n = 0;
+    while ((n >> log2n) > 1) log2n++;
+    pdq_loop(a, 0, n, log2n, 1);
+}
+
+/* --- optional parallel driver: sort chunks concurrently, then merge --- */
+
+#if SORT_THREADS > 1
+typedef struct { void *base; size_t n; void (*fn)(void *, size_t); } sort_task;
+
+static void *sort_task_run(void *p) {
+    sort_task *t = (sort_task*)p;
+    t->fn(t->base, t->n);
+    return NULL;
+}
+
+static void sort_run_u64(void *base, size_t n) { sort_radix_u64((uint64_t*)base, n); }
+static void sort_run_f64(void *base, size_t n) { sort_pdq_f64((double*)base, n); }
+
+static inline void sort_merge_u64(uint64_t *dst, const uint64_t *x, size_t nx, const uint64_t *y, size_t ny) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < nx && j < ny) dst[k++] = (y[j] < x[i]) ? y[j++] : x[i++];
+    while (i < nx) dst[k++] = x[i++];
+    while (j < ny) dst[k++] = y[j++];
+}
+
+static inline void sort_merge_f64(double *dst, const double *x, size_t nx, const double *y, size_t ny) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < nx && j < ny) dst[k++] = (y[j] < x[i]) ? y[j++] : x[i++];
+    while (i < nx) dst[k++] = x[i++];
+    while (j < ny) dst[k++] = y[j++];
+}
+
+/* elements are 8 bytes wide (uint64_t keys or doubles) */
+static void sort_parallel(void *base, size_t n, int is_float) {
+    size_t bounds[SORT_THREADS + 1];
+    sort_task tasks[SORT_THREADS];
+    pthread_t threads[SORT_THREADS];
+    int started[SORT_THREADS];
+    char *b = (char*)base;
+    for (int i = 0; i <= SORT_THREADS; ++i) bounds[i] = n * (size_t)i / SORT_THREADS;
+    for (int i = 0; i < SORT_THREADS; ++i) {
+        tasks[i] = (sort_task){ b + bounds[i] * 8, bounds[i + 1] - bounds[i], is_float ? sort_run_f64 : sort_run_u64 };
+        started[i] = pthread_create(&threads[i], NULL, sort_task_run, &tasks[i]) == 0;
+        if (!started[i]) sort_task_run(&tasks[i]); /* no thread available: sort inline */
+    }
+    for (int i = 0; i < SORT_THREADS; ++i) if (started[i]) pthread_join(threads[i], NULL);
+
+    /* bottom-up pairwise merge of the sorted chunks */
+    char *tmp = (char*)malloc(n * 8);
+    assert(tmp && "sort: out of memory");
+    for (int width = 1; width < SORT_THREADS; width *= 2) {
+        for (int i = 0; i + width < SORT_THREADS; i += 2 * width) {
+            int j = i + 2 * width < SORT_THREADS ? i + 2 * width : SORT_THREADS;
+            size_t lo = bounds[i], mid = bounds[i + width], hi = bounds[j];
+            if (is_float) sort_merge_f64((double*)(tmp + lo * 8), (double*)(b + lo * 8), mid - lo, (double*)(b + mid * 8), hi - mid);
+            else sort_merge_u64((uint64_t*)(tmp + lo * 8), (uint64_t*)(b + lo * 8), mid - lo, (uint64_t*)(b + mid * 8), hi - mid);
+            memcpy(b + lo * 8, tmp + lo * 8, (hi - lo) * 8);
+        }
+    }
+    free(tmp);
+}
+#endif
+
+/* --- entry points --- */
+
+/* sort n cells of type t in place */
+static inline void sort_cells(word *cells, size_t n, TypeTag t) {
+    if (n < 2) return;
+    if (!sort_type_is_float(t)) {
+        /* map to unsigned order: flipping the sign bit orders signed words */
+        uint64_t flip = sort_type_is_unsigned(t) ? 0 : (1ULL << 63);
+        uint64_t *keys = (uint64_t*)cells;
+        for (size_t i = 0; i < n; ++i) keys[i] ^= flip;
+#if SORT_THREADS > 1
+        if (n >= SORT_PAR_MIN) sort_parallel(keys, n, 0);
+        else
+#endif
+        sort_radix_u64(keys, n);
+        for (size_t i = 0; i < n; ++i) keys[i] ^= flip;
+        return;
+    }
+
+    /* move NaNs to the end (keeping their exact bits), sort the rest as doubles */
+    size_t m = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = sort_as_double(cells[i], t);
+        if (d == d) {
+            word w = cells[m]; cells[m] = cells[i]; cells[i] = w;
+            m++;
+        }
+    }
+    double *vals = (double*)malloc(m * sizeof(double) + 1);
+    assert(vals && "sort: out of memory");
+    for (size_t i = 0; i < m; ++i) vals[i] = sort_as_double(cells[i], t);
+#if SORT_THREADS > 1
+    if (m >= SORT_PAR_MIN) sort_parallel(vals, m, 1);
+    else
+#endif
+    sort_pdq_f64(vals, m);
+    for (size_t i = 0; i < m; ++i) cells[i] = sort_from_double(vals[i], t);
+    free(vals);
+}
+
+/* index of the first cell not less than key (n if none) */
+static inline size_t sort_lower_bound(const word *cells, size_t n, word key, TypeTag t) {
+    size_t lo = 0, len = n;
+    while (len > 0) {
+        size_t half = len / 2;
+        if (sort_less(cells[lo + half], key, t)) {
+            lo += half + 1;
+            len -= half + 1;
+        } else {
+            len = half;
+        }
+    }
+    return lo;
+}
+
+/* index of a cell equal to key, or -1 */
+static inline word sort_bsearch(const word *cells, size_t n, word key, TypeTag t) {
+    size_t i = sort_lower_bound(cells, n, key, t);
+    if (i < n && !sort_less(key, cells[i], t)) return (word)i;
+    return -1;
+}
+
+#endif /* SORT_H */
@@ -0,0 +1,249 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+/*
+ * rrvm/frontend/kernels/text.h
+ *
+ * Byte-scanning kernels over packed text regions (OP_PACK, OP_FINDBYTE,
+ * OP_FINDANY, OP_COUNTLINES, OP_SPLITLINES, OP_PARSEINT).
+ *
+ * A packed region of n bytes starting at cell c occupies
+ * ceil(n / sizeof(word)) cells; byte i is byte i of the tape storage from
+ * &tape[c] onwards (host byte order). OP_PACK builds one from n u8 cells.
+ *
+ * On x86 the scanners compare 16 bytes at a time with SSE2 and, when the
+ * CPU reports AVX2 at runtime, 32 bytes at a time. Other targets use 8-byte
+ * SWAR. No kernel reads past the n bytes it was given, so regions ending at
+ * a TAPE_GUARD page are safe. Integer parsing converts up to 8 digits per
+ * step with SWAR multiplies instead of one multiply-add per digit.
+ */
+
+#include "../vm/vm.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TEXT_X86 1
+/* vm.h's __index emit macro collides with parameter names in the intrinsic headers */
+#pragma push_macro("__index")
+#undef __index
+#include <immintrin.h>
+#pragma pop_macro("__index")
+#else
+#define TEXT_X86 0
+#endif
+
+#define TEXT_ONES 0x0101010101010101ULL
+#define TEXT_HIGHS 0x8080808080808080ULL
+
+static inline uint64_t text_load64(const uint8_t *p) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    return w;
+}
+
+/* high bit set in every zero byte of x (exact, no cross-byte carries) */
+static inline uint64_t text_zero_bytes(uint64_t x) {
+    return ~(((x & ~TEXT_HIGHS) + ~TEXT_HIGHS) | x | ~TEXT_HIGHS);
+}
+
+/* index of the lowest byte flagged by a text_zero_bytes mask (little-endian) */
+static inline size_t text_first_flag(uint64_t m) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (size_t)__builtin_clzll(m) / 8;
+#else
+    return (size_t)__builtin_ctzll(m) / 8;
+#endif
+}
+
+#if TEXT_X86
+static inline int text_have_avx2(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return cached;
+}
+
+__attribute__((target("avx2")))
+static size_t text_findbyte_avx2(const uint8_t *s, size_t i, size_t n, uint8_t b) {
+    __m256i needle = _mm256_set1_epi8((char)b);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t text_findany_avx2(const uint8_t *s, size_t i, size_t n, const uint8_t *set, int k) {
+    __m256i needles[TEXT_SET_MAX];
+    for (int j = 0; j < k; ++j) needles[j] = _mm256_set1_epi8((char)set[j]);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i hit = _mm256_setzero_si256();
+        for (int j = 0; j < k; ++j) hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, needles[j]));
+        unsigned m = (unsigned)_mm256_movemask_epi8(hit);
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+    return i;
+}
+
+/* newline count of s[*pi..) in 32-byte blocks; advances *pi past them */
+__attribute__((target("avx2")))
+static uint64_t text_countlines_avx2(const uint8_t *s, size_t *pi, size_t n) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    uint64_t count = 0;
+    size_t i = *pi;
+    while (i + 32 <= n) {
+        /* per-byte counters go down by one per hit (cmpeq yields -1) and are
+           flushed with a SAD before they can wrap */
+        __m256i acc = _mm256_setzero_si256();
+        for (int r = 0; r < 255 && i + 32 <= n; ++r, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, nl));
+        }
+        __m256i sad = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        count += (uint64_t)_mm256_extract_epi64(sad, 0) + (uint64_t)_mm256_extract_epi64(sad, 1)
+               + (uint64_t)_mm256_extract_epi64(sad, 2) + (uint64_t)_mm256_extract_epi64(sad, 3);
+    }
+    *pi = i;
+    return count;
+}
+#endif /* TEXT_X86 */
+
+/* offset of the first byte == b in s[i..n), or n */
+static inline size_t text_findbyte(const uint8_t *s, size_t i, size_t n, uint8_t b) {
+#if TEXT_X86
+    if (text_have_avx2()) i = text_findbyte_avx2(s, i, n, b);
+    __m128i needle = _mm_set1_epi8((char)b);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+#endif
+    uint64_t pattern = TEXT_ONES * b;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t m = text_zero_bytes(text_load64(s + i) ^ pattern);
+        if (m) return i + text_first_flag(m);
+    }
+    for (; i < n; ++i) if (s[i] == b) return i;
+    return n;
+}
+
+/* offset of the first byte in s[i..n) that is one of set[0..k), or n */
+static inline size_t text_findany(const uint8_t *s, size_t i, size_t n, const uint8_t *set, int k) {
+    assert(k >= 0 && k <= TEXT_SET_MAX && "findany: set too large");
+    if (k == 0) return n;
+    if (k == 1) return text_findbyte(s, i, n, set[0]);
+#if TEXT_X86
+    if (text_have_avx2()) i = text_findany_avx2(s, i, n, set, k);
+    __m128i needles[TEXT_SET_MAX];
+    for (int j = 0; j < k; ++j) needles[j] = _mm_set1_epi8((char)set[j]);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i hit = _mm_setzero_si128();
+        for (int j = 0; j < k; ++j) hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, needles[j]));
+        unsigned m = (unsigned)_mm_movemask_epi8(hit);
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+#endif
+    uint8_t member[256] = {0};
+    for (int j = 0; j < k; ++j) member[set[j]] = 1;
+    for (; i < n; ++i) if (member[s[i]]) return i;
+    return n;
+}
+
+/* number of '\n' bytes in s[0..n) */
+static inline uint64_t text_countlines(const uint8_t *s, size_t n) {
+    uint64_t count = 0;
+    size_t i = 0;
+#if TEXT_X86
+    if (text_have_avx2()) count += text_countlines_avx2(s, &i, n);
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        count += (uint64_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    }
+#endif
+    for (; i + 8 <= n; i += 8) {
+        count += (uint64_t)__builtin_popcountll(text_zero_bytes(text_load64(s + i) ^ (TEXT_ONES * '\n')));
+    }
+    for (; i < n; ++i) count += s[i] == '\n';
+    return count;
+}
+
+/*
+ * Start offsets of the lines of s[0..n) written to starts[] (which must hold
+ * text_countlines(s, n) + 1 entries). A trailing '\n' does not start an
+ * empty last line. Returns the number of lines.
+ */
+static inline size_t text_splitlines(const uint8_t *s, size_t n, word *starts) {
+    if (n == 0) return 0;
+    size_t lines = 0;
+    size_t at = 0;
+    while (at < n) {
+        starts[lines++] = (word)at;
+        at = text_findbyte(s, at, n, '\n') + 1;
+    }
+    return lines;
+}
+
+/*
+ * Convert the leading run of ASCII digits in the 8 bytes of `chunk` (first
+ * byte = most significant digit). Returns the digit count (0..8) and stores
+ * the value in *out.
+ */
+static inline int text_digits8(uint64_t chunk, uint64_t *out) {
+    /* a byte is a digit iff its high nibble is 3 and adding 6 keeps it 3;
+       carries only leak upwards past a non-digit, so the leading run is exact */
+    uint64_t t = ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+                  (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ^ 0x3333333333333333ULL;
+    uint64_t nonzero = ~text_zero_bytes(t) & TEXT_HIGHS;
+    int d = nonzero ? (int)text_first_flag(nonzero) : 8;
+    if (d == 0) { *out = 0; return 0; }
+    /* right-align the run and pad the vacated low bytes with '0' */
+    if (d < 8) chunk = (chunk << (8 * (8 - d))) | (0x3030303030303030ULL >> (8 * d));
+    uint64_t v = chunk - 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    *out = v;
+    return d;
+}
+
+/*
+ * Parse an optionally signed decimal integer at s[i..n), skipping leading
+ * spaces and tabs. Returns the value (wrapping like VM arithmetic on
+ * overflow) and stores the offset just past the last digit in *end; if no
+ * digits follow, the value is 0 and *end is i.
+ */
+static inline int64_t text_parseint(const uint8_t *s, size_t i, size_t n, size_t *end) {
+    size_t start = i;
+    while (i < n && (s[i] == ' ' || s[i] == '\t')) ++i;
+    int neg = 0;
+    if (i < n && (s[i] == '-' || s[i] == '+')) neg = s[i++] == '-';
+    size_t first = i;
+    uint64_t acc = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (; i < n && s[i] >= '0' && s[i] <= '9'; ++i) acc = acc * 10 + (uint64_t)(s[i] - '0');
+#else
+    static const uint64_t pow10[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+    for (;;) {
+        uint64_t chunk = 0; /* zero padding is a non-digit */
+        if (i + 8 <= n) chunk = text_load64(s + i);
+        else if (i < n) memcpy(&chunk, s + i, n - i);
+        uint64_t part;
+        int d = text_digits8(chunk, &part);
+        acc = acc * pow10[d] + part;
+        i += (size_t)d;
+        if (d < 8) break;
+    }
+#endif
+    if (i == first) { *end = start; return 0; }
+    *end = i;
+    return (int64_t)(neg ? 0 - acc : acc);
+}
+
+#endif /* TEXT_H */
@@ -6,13 +6,29 @@
  * Features:
  *  - Accepts a textual .rr program via --file <path> (or "-" for stdin).
  *  - Select backend at runtime: default interpreter; pass --tac to use TAC backend.
+ *  - The interpreter compiles hot functions to native code (tier/tier.h);
+ *    --no-tier, --tier-calls, --tier-loops, --tier-sync, --no-trace,
+ *    --trace-loops, --no-opt and --opt-calls configure it, and --perf-map /
+ *    --jitdump announce the compiled code to Linux perf (tier/perf.h).
+ *  - Unless --no-select, if/else diamonds that only choose a value are
+ *    turned into branch-free selects right after parsing (vm/select.h).
  *
  * Notes:
  *  - Whole-line comments in .rr files must start with '#' as the first
  *    non-whitespace character. Mid-line '#' characters are rejected by the
  *    lexer and will raise a parse error.
  *  - When running with the TAC backend on a parsed file, a TAC Prolog dump is
- *    written to "opt/tmp/raw/parsed.pl".
+ *    written to "opt/tmp/raw/parsed.pl", after loads and calls have been
+ *    typed (tac/types.h), functions specialized to the constant arguments
+ *    of their calls unless --no-spec (tac/spec.h), self tail calls made
+ *    loops unless --no-tail (tac/tail.h), and adjacent counted loops fused
+ *    (tac/loops.h);
+ *    --tile N tiles loop nests too. With --slots the temps are then
+ *    renumbered into reusable frame slots (tac/slots.h). Last, unless
+ *    --no-blocks, jumps are threaded and blocks merged and placed
+ *    (tac/blocks.h), by a profile run with --profile. --run executes the
+ *    lowered TAC in place of the dump, counting tape misses in a cache of
+ *    --cache-kb KiB (tac/exec.h).
  */
 
 #include <stdio.h>
@@ -22,8 +38,17 @@
 
 /* VM and backends */
 #include "vm/vm.h"
+#include "vm/select.h"
 #include "interpreter/interpreter.h"
 #include "tac/tac.h"
+#include "tac/types.h"
+#include "tac/spec.h"
+#include "tac/loads.h"
+#include "tac/tail.h"
+#include "tac/slots.h"
+#include "tac/loops.h"
+#include "tac/exec.h"
+#include "tac/blocks.h"
 
 /* Parser for .rr textual input */
 #include "parser/parser.h"
@@ -32,24 +57,112 @@
 
 static void print_usage(const char *prog) {
     fprintf(stderr,
-        "Usage: %s [--file <path>|-] [--tac] [--help]\n"
+        "Usage: %s [--file <path>|-] [--tac] [--stats] [tier options] [--help]\n"
         "  --file <path>   Parse and run the given .rr file. Use '-' to read stdin.\n"
         "  --tac           Use TAC backend (default: interpreter).\n"
+        "  --slots         With --tac: renumber temps into reusable frame slots before\n"
+        "                  the dump (which is then no longer SSA).\n"
+        "  --no-spec       With --tac: do not specialize functions to constant arguments.\n"
+        "  --no-tail       With --tac: do not turn self tail calls into loops.\n"
+        "  --tile N        With --tac: tile nests of counted loops by N iterations.\n"
+        "  --no-blocks     With --tac: do not thread jumps or merge and place blocks.\n"
+        "  --profile       With --tac: place blocks by a run of the program first.\n"
+        "  --run           With --tac: execute the TAC instead of dumping it.\n"
+        "  --cache-kb N    With --run: size of the modelled data cache (default 32).\n"
+        "  --no-select     Keep if/else diamonds that only choose a value as branches.\n"
+        "  --stats         Print backend statistics (e.g. hash map load/probes) to stderr.\n"
+        "  --no-tier       Interpret only: no hotness counters, no compilation.\n"
+        "  --tier-calls N  Compile a function after N calls (default %" PRIu64 ").\n"
+        "  --tier-loops N  ... or after N loop back-edges inside it; loops outside\n"
+        "                  functions compile on their own (default %" PRIu64 ").\n"
+        "  --tier-sync     Compile at the triggering call instead of on a worker thread.\n"
+        "  --no-trace      Do not record and compile traces of hot loops.\n"
+        "  --trace-loops N Trace a loop after N back-edges (default %" PRIu64 ").\n"
+        "  --no-opt        Do not recompile hot functions with the optimizing JIT.\n"
+        "  --opt-calls N   Optimize a function after N calls and back-edges together\n"
+"                  (default %" PRIu64 ").\n"
+        "  --perf-map      Write /tmp/perf-<pid>.map entries for compiled code.\n"
+        "  --jitdump       Write jit-<pid>.dump (in $JITDUMPDIR or .) for perf inject.\n"
         "  --help          Show this help message.\n\n"
         "If --file is not provided the built-in sample programs are executed (same\n"
         "behaviour as before).\n",
-        prog ?: "rrvm"
+        prog ?: "rrvm", tier_defaults.call_threshold, tier_defaults.loop_threshold, tier_defaults.trace_threshold,
+        tier_defaults.opt_threshold
     );
 }
 
 int main(int argc, char **argv) {
     bool use_tac = false;
+    bool use_slots = false;
+    bool show_stats = false;
+    bool run_tac = false;
+    bool use_spec = true;
+    bool use_tail = true;
+    bool use_blocks = true;
+    bool profile = false;
+    bool use_select = true;
+    int cache_kb = 32;
+    int tile = 0;
     const char *file_path = NULL;
 
     /* Simple argument parsing (no getopt to keep portability) */
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--tac") == 0) {
             use_tac = true;
+        } else if (strcmp(argv[i], "--slots") == 0) {
+            use_slots = true;
+        } else if (strcmp(argv[i], "--no-spec") == 0) {
+            use_spec = false;
+        } else if (strcmp(argv[i], "--no-tail") == 0) {
+            use_tail = false;
+        } else if (strcmp(argv[i], "--no-blocks") == 0) {
+            use_blocks = false;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--no-select") == 0) {
+            use_select = false;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run_tac = true;
+        } else if (strcmp(argv[i], "--cache-kb") == 0 || strcmp(argv[i], "--tile") == 0) {
+            char *end = NULL;
+            long n = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+            if (i + 1 >= argc || !end || *end || n <= 0 || n > (1 << 20)) {
+                fprintf(stderr, "error: %s requires a positive size\n", argv[i]);
+                print_usage(argv[0]);
+                return 2;
+            }
+            if (strcmp(argv[i], "--tile") == 0) tile = (int)n;
+            else cache_kb = (int)n;
+            ++i;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = true;
+        } else if (strcmp(argv[i], "--no-tier") == 0) {
+            tier_defaults.enabled = 0;
+        } else if (strcmp(argv[i], "--tier-sync") == 0) {
+            tier_defaults.background = 0;
+        } else if (strcmp(argv[i], "--no-trace") == 0) {
+            tier_defaults.trace = 0;
+        } else if (strcmp(argv[i], "--no-opt") == 0) {
+            tier_defaults.opt = 0;
+        } else if (strcmp(argv[i], "--perf-map") == 0) {
+            tier_defaults.perf |= PERF_MAP;
+        } else if (strcmp(argv[i], "--jitdump") == 0) {
+            tier_defaults.perf |= PERF_JITDUMP;
+        } else if (strcmp(argv[i], "--tier-calls") == 0 || strcmp(argv[i], "--tier-loops") == 0 ||
+                   strcmp(argv[i], "--trace-loops") == 0 || strcmp(argv[i], "--opt-calls") == 0) {
+            uint64_t *target = strcmp(argv[i], "--trace-loops") == 0 ? &tier_defaults.trace_threshold :
+                               strcmp(argv[i], "--opt-calls") == 0 ? &tier_defaults.opt_threshold :
+                               strcmp(argv[i], "--tier-calls") == 0 ? &tier_defaults.call_threshold :
+                               &tier_defaults.loop_threshold;
+            char *end = NULL;
+            unsigned long long n = i + 1 < argc ? strtoull(argv[i + 1], &end, 10) : 0;
+            if (i + 1 >= argc || !end || *end || n == 0) {
+                fprintf(stderr, "error: %s requires a positive count\n", argv[i]);
+                print_usage(argv[0]);
+                return 2;
+            }
+            *target = n;
+            ++i;
         } else if ((strcmp(argv[i], "--file") == 0 || strcmp(argv[i], "-f") == 0)) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "error: --file requires an argument\n");
@@ -76,8 +189,9 @@ int main(int argc, char **argv) {
     if (file_path) {
         /* Parse the provided .rr file (or stdin if "-") */
         VM vm_parsed;
+        ParserSymbols syms;
         char *err = NULL;
-        int r = parse_rr_file_to_vm(file_path, &vm_parsed, &err);
+        int r = parse_rr_file_with_symbols(file_path, &vm_parsed, &syms, &err);
         if (r != 0) {
             if (err) {
                 fprintf(stderr, "parse error: %s\n", err);
@@ -87,27 +201,58 @@ int main(int argc, char **argv) {
             }
             return 1;
         }
+        if (use_select) {
+            size_t len = vm_parsed.code_len;
+            vm_if_convert((word*)vm_parsed.code, &len, syms.lines);
+            vm_parsed.code_len = len;
+            syms.nlines = len;
+        }
 
         /* Run the parsed VM with the selected backend */
+        tier_defaults.symbols = &syms;
         run_vm(&vm_parsed, backend);
 
         /* If TAC backend, dump TAC and write prolog file for post-processing */
+        int stopped = 0;
         if (use_tac) {
+            tac_infer_types(&vm_parsed);
+            tac_points_to(&vm_parsed);
+            if (use_spec) tac_specialize_calls(&vm_parsed);
+            tac_forward_loads(&vm_parsed);
+            if (use_tail) tac_tail_calls(&vm_parsed);
+            tac_fuse_loops(&vm_parsed);
+            if (tile) tac_tile_loops(&vm_parsed, tile);
+            if (use_slots) tac_assign_slots(&vm_parsed);
+            if (use_blocks) tac_order_blocks(&vm_parsed, profile);
             tac_prog *prog = tac_get_prog(&vm_parsed);
-            if (prog) {
+            if (prog && run_tac) {
+                tac_dump_file(prog, file_path);
+                /* output so far is not the program's: say why it ends there */
+                if (tac_run(&vm_parsed, cache_kb) < 0) {
+                    fprintf(stderr, "tac run: stopped: %s\n", tac_state(&vm_parsed)->exec.why);
+                    stopped = 1;
+                }
+            } else if (prog) {
                 tac_dump(prog);
                 /* write to opt/tmp/raw/<input_basename>.pl where basename is the input filename (e.g. foo.rr -> foo.pl) */
                 tac_dump_file(prog, file_path);
             }
         }
 
+        if (show_stats && backend && backend->stats) backend->stats(&vm_parsed, stderr);
+
         /* finalize backend (free backend-specific user_data) */
         if (backend && backend->finalize) backend->finalize(&vm_parsed, 0);
 
-        /* free program code allocated by parser */
+        /* release the tape mapping (guarded mode) and program code allocated by parser */
+        vm_tape_release(&vm_parsed);
         parser_free_vm_code(&vm_parsed);
+        parser_free_symbols(&syms);
 
-        return 0;
+#if TAPE_GUARD
+        if (vm_parsed.trapped) return 1;
+#endif
+        return stopped;
     }
 
     /* No file provided: require explicit --file argument. */
@@ -0,0 +1,138 @@
+/*
+ * rrvm/frontend/native/native.c
+ *
+ * Native intrinsic registry implementation.
+ *
+ * See rrvm/frontend/native/native.h for API semantics. The table is a flat
+ * array searched linearly by name; lookups only happen at parse time, so
+ * there is no need for anything faster.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "native.h"
+
+static NativeSig registry[NATIVE_MAX];
+static int registry_count = 0;
+static pthread_once_t builtins_once = PTHREAD_ONCE_INIT;
+
+static void native_register_builtins(void);
+
+/* Names must be valid unquoted Prolog atoms since TAC dumps print them as-is. */
+static int valid_name(const char *s) {
+    if (!s || !(*s >= 'a' && *s <= 'z')) return 0;
+    for (; *s; ++s) {
+        if (!((*s >= 'a' && *s <= 'z') || (*s >= '0' && *s <= '9') || *s == '_')) return 0;
+    }
+    return 1;
+}
+
+static int find_index(const char *name) {
+    for (int i = 0; i < registry_count; ++i) {
+        if (strcmp(registry[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int registry_add(const NativeSig *sig) {
+    if (!sig || !sig->fn || !valid_name(sig->name)) return -1;
+    if (sig->arity < 0 || sig->arity > NATIVE_MAX_ARGS) return -1;
+    if (find_index(sig->name) >= 0) return -1;
+    if (registry_count >= NATIVE_MAX) return -1;
+
+    size_t n = strlen(sig->name);
+    char *name = (char*)malloc(n + 1);
+    if (!name) return -1;
+    memcpy(name, sig->name, n + 1);
+
+    registry[registry_count] = *sig;
+    registry[registry_count].name = name;
+    return registry_count++;
+}
+
+int native_register(const NativeSig *sig) {
+    pthread_once(&builtins_once, native_register_builtins);
+    return registry_add(sig);
+}
+
+int native_lookup(const char *name) {
+    pthread_once(&builtins_once, native_register_builtins);
+    if (!name) return -1;
+    return find_index(name);
+}
+
+const NativeSig *native_get(int index) {
+    pthread_once(&builtins_once, native_register_builtins);
+    if (index < 0 || index >= registry_count) return NULL;
+    return &registry[index];
+}
+
+int native_count(void) {
+    pthread_once(&builtins_once, native_register_builtins);
+    return registry_count;
+}
+
+/* --- built-in intrinsics --- */
+
+static double as_f64(word w) {
+    union { uint64_t u; double d; } u;
+    u.u = (uint64_t)w;
+    return u.d;
+}
+
+static word from_f64(double d) {
+    union { uint64_t u; double d; } u;
+    u.d = d;
+    return (word)u.u;
+}
+
+static void native_sqrt(const word *args, word *result, FILE *out) {
+    (void)out;
+    *result = from_f64(sqrt(as_f64(args[0])));
+}
+
+static void native_pow(const word *args, word *result, FILE *out) {
+    (void)out;
+    *result = from_f64(pow(as_f64(args[0]), as_f64(args[1])));
+}
+
+static void native_floor(const word *args, word *result, FILE *out) {
+    (void)out;
+    *result = from_f64(floor(as_f64(args[0])));
+}
+
+/* 64-bit finalizer (splitmix64/murmur3 fmix64 constants) */
+static void native_hash_u64(const word *args, word *result, FILE *out) {
+    (void)out;
+    uint64_t x = (uint64_t)args[0];
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    *result = (word)x;
+}
+
+static void native_print_hex(const word *args, word *result, FILE *out) {
+    (void)result;
+    fprintf(out, "0x%016" PRIx64 "\n", (uint64_t)args[0]);
+}
+
+static void native_register_builtins(void) {
+    static const NativeSig builtins[] = {
+        { "sqrt",      native_sqrt,      1, { TYPE_F64 },           TYPE_F64,  1 },
+        { "pow",       native_pow,       2, { TYPE_F64, TYPE_F64 }, TYPE_F64,  1 },
+        { "floor",     native_floor,     1, { TYPE_F64 },           TYPE_F64,  1 },
+        { "hash_u64",  native_hash_u64,  1, { TYPE_U64 },           TYPE_U64,  1 },
+        { "print_hex", native_print_hex, 1, { TYPE_UNKNOWN },       TYPE_VOID, 0 },
+    };
+    for (size_t i = 0; i < sizeof(builtins)/sizeof(builtins[0]); ++i) {
+        if (registry_add(&builtins[i]) < 0) {
+            fprintf(stderr, "native: failed to register built-in '%s'\n", builtins[i].name);
+        }
+    }
+}
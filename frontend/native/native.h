@@ -0,0 +1,88 @@
+#ifndef RR_NATIVE_H
+#define RR_NATIVE_H
+
+/*
+ * rrvm/frontend/native/native.h
+ *
+ * Registry of native intrinsics callable from .rr programs via `ncall <name>`.
+ *
+ * Responsibilities:
+ *  - Keep a process-wide table of C functions together with their typed
+ *    signatures (argument TypeTags, result TypeTag) and a purity flag.
+ *  - Resolve intrinsic names to stable indices. The parser resolves names at
+ *    load time and emits `OP_NCALL <index>`, so backends never look up names
+ *    while executing.
+ *
+ * Calling convention:
+ *  - A native receives its arguments in push order (args[0] was pushed
+ *    first) as raw `word` bit patterns, interpreted according to the
+ *    declared arg types (floats are bit-cast, see vm.h).
+ *  - If `result_type` is not TYPE_VOID the function writes exactly one
+ *    result word to `*result`, which the engine pushes with that type.
+ *  - `out` is the stream `print` writes to (stdout, or the capture buffer
+ *    of an embedding context); an intrinsic that prints uses it.
+ *
+ * Purity:
+ *  - A pure intrinsic has no side effects and its result depends only on
+ *    its arguments. The flag is carried into TAC so optimizer passes may
+ *    fold, hoist or drop such calls.
+ *
+ * Host applications may add their own intrinsics with `native_register`
+ * before parsing a program. The built-ins (sqrt, pow, floor, hash_u64,
+ * print_hex) are registered once, on first use of the registry from any
+ * thread. Registering is not synchronized otherwise: a host that calls
+ * native_register while other threads parse or run programs must hold a
+ * lock around all of them.
+ */
+
+#include "../vm/vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* maximum number of arguments an intrinsic may take */
+#ifndef NATIVE_MAX_ARGS
+#define NATIVE_MAX_ARGS 4
+#endif
+
+/* maximum number of registered intrinsics */
+#ifndef NATIVE_MAX
+#define NATIVE_MAX 256
+#endif
+
+typedef void (*native_fn)(const word *args, word *result, FILE *out);
+
+typedef struct {
+    const char *name;                    /* lowercase identifier, printed as a Prolog atom */
+    native_fn fn;
+    int arity;                           /* 0..NATIVE_MAX_ARGS */
+    TypeTag arg_types[NATIVE_MAX_ARGS];  /* TYPE_UNKNOWN accepts any type */
+    TypeTag result_type;                 /* TYPE_VOID if nothing is pushed */
+    int pure;
+} NativeSig;
+
+/*
+ * Register an intrinsic. The signature is copied (including the name).
+ *
+ * Return:
+ *  - the intrinsic index (>= 0) on success
+ *  - -1 if the signature is invalid, the name is already taken or the
+ *    registry is full
+ */
+int native_register(const NativeSig *sig);
+
+/* Resolve `name` to an intrinsic index, or -1 if it is not registered. */
+int native_lookup(const char *name);
+
+/* Signature for an index returned by native_register/native_lookup, or NULL. */
+const NativeSig *native_get(int index);
+
+/* Number of registered intrinsics (including built-ins). */
+int native_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RR_NATIVE_H */
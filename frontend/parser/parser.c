@@ -16,6 +16,19 @@
  *   if else end
  *   label <name>   (also supports `name:`)
  *   while <label>
+ *   arena <n>
+ *   ncall <name>   (native intrinsic, resolved via native/native.h)
+ *   hnew hput hget hdel hlen hiter
+ *   sort <n> | bsearch <n> | lowerbound <n>
+ *   pack <n> | findbyte <n> | findany <n> <k> | countlines <n>
+ *   splitlines <n> | parseint <n>   (n = bytes, see kernels/text.h)
+ *   hash64 <n> | crc32c <n>   (n cells) | hash64b <n> | crc32cb <n>   (n bytes)
+ *   vload vstore vsplat vadd vsub vmul vmin vmax vhsum <lane>
+ *   vand vor vxor | vshuffle <lane> <mask>
+ *     (lane = i64 f64 i32 f32 u8, or the vector shape i64x2 .. u8x16)
+ *   select min max abs   (c a b -- c ? a : b; a b -- min/max; a -- |a|)
+ *   popcnt clz ctz bswap | rotl rotr mulhi   (a -- r | a b -- r, on the
+ *     type's width)
  *   halt
  *
  * Comments:
@@ -32,6 +45,7 @@
 
 #include "parser.h"
 #include "../lexer/lexer.h"
+#include "../native/native.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -351,6 +365,19 @@ static int type_tag_from_str(const char *s) {
     return TYPE_UNKNOWN;
 }
 
+/* lane type of a vector op: a scalar type name or its vector shape; -1 if invalid */
+static int lane_type_from_str(const char *s) {
+    static const struct { const char *scalar, *shape; int type; } lanes[] = {
+        { "i64", "i64x2", TYPE_I64 }, { "f64", "f64x2", TYPE_F64 },
+        { "i32", "i32x4", TYPE_I32 }, { "f32", "f32x4", TYPE_F32 },
+        { "u8", "u8x16", TYPE_U8 },
+    };
+    for (size_t i = 0; i < sizeof(lanes) / sizeof(lanes[0]); ++i) {
+        if (strcasecmp(s, lanes[i].scalar) == 0 || strcasecmp(s, lanes[i].shape) == 0) return lanes[i].type;
+    }
+    return -1;
+}
+
 static char *lowerdup(const char *s) {
     if (!s) return NULL;
     size_t n = strlen(s);
@@ -372,7 +399,65 @@ static void free_labeltable_and_patches(LabelTable *lt, WhilePatchTable *wpt) {
 
 /* --- main parser implementation --- */
 
+/* next line of the buffer at *cur (split in place), NULL at the end; unlike
+ * strtok, empty lines are returned so line numbers stay right */
+static char *next_line(char **cur) {
+    char *line = *cur;
+    if (!line || !*line) return NULL;
+    char *nl = strchr(line, '\n');
+    if (nl) {
+        *nl = '\0';
+        *cur = nl + 1;
+    } else {
+        *cur = line + strlen(line);
+    }
+    return line;
+}
+
+/* source line `lineno` for code words [*nlines, code_len) */
+static int lines_fill(int **lines, size_t *nlines, size_t *cap, size_t code_len, size_t lineno) {
+    if (code_len > *cap) {
+        size_t nc = *cap ? *cap * 2 : 256;
+        while (nc < code_len) nc *= 2;
+        int *n = (int*)realloc(*lines, nc * sizeof(int));
+        if (!n) return -1;
+        *lines = n;
+        *cap = nc;
+    }
+    while (*nlines < code_len) (*lines)[(*nlines)++] = (int)lineno;
+    return 0;
+}
+
+/* move the function names into `syms`, ordered by index */
+static int func_table_export(FuncTable *t, ParserSymbols *syms, char **err) {
+    syms->count = t->next_index;
+    syms->names = (char**)calloc(t->next_index ? (size_t)t->next_index : 1, sizeof(char*));
+    if (!syms->names) { set_error_msg(err, "out of memory"); return -1; }
+    for (size_t i = 0; i < t->count; ++i) {
+        syms->names[t->arr[i].index] = t->arr[i].name;
+        t->arr[i].name = NULL;
+    }
+    return 0;
+}
+
+void parser_free_symbols(ParserSymbols *syms) {
+    if (!syms) return;
+    for (int i = 0; i < syms->count; ++i) free(syms->names[i]);
+    free(syms->names);
+    syms->names = NULL;
+    syms->count = 0;
+    free(syms->lines);
+    syms->lines = NULL;
+    syms->nlines = 0;
+    free(syms->source);
+    syms->source = NULL;
+}
+
 int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
+    return parse_rr_string_with_symbols(src, out_vm, NULL, err_msg);
+}
+
+int parse_rr_string_with_symbols(const char *src, VM *out_vm, ParserSymbols *syms, char **err_msg) {
     if (!src || !out_vm) {
         set_error_msg(err_msg, "internal: invalid arguments");
         return -1;
@@ -389,10 +474,23 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
     FuncTable funcs; func_table_init(&funcs);
     WhilePatchTable wpatches = {0};
 
-    char *line = strtok(buf, "\n");
+    char *cur = buf;
+    char *line = next_line(&cur);
     size_t lineno = 0;
+    int *lines = NULL;
+    size_t nlines = 0, lines_cap = 0;
 
     while (line) {
+        /* code emitted so far came from the previous line */
+        if (syms && lines_fill(&lines, &nlines, &lines_cap, code_len, lineno) < 0) {
+            set_error_msg(err_msg, "out of memory");
+            free(buf);
+            free_labeltable_and_patches(&labels, &wpatches);
+            func_table_free(&funcs);
+            free(code);
+            free(lines);
+            return -1;
+        }
         lineno++;
         /* Strip trailing CR if present (handle CRLF) */
         size_t ln = strlen(line);
@@ -400,7 +498,7 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
 
         /* Check for whole-line comment */
         if (lexer_is_comment_line(line)) {
-            line = strtok(NULL, "\n");
+            line = next_line(&cur);
             continue;
         }
 
@@ -412,9 +510,11 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
             free_labeltable_and_patches(&labels, &wpatches);
             func_table_free(&funcs);
             set_error_msg(err_msg, "line %zu: tokenization error", lineno);
+            free(code);
+            free(lines);
             return -1;
         }
-        if (ntok == 0) { lexer_free_tokens(tokens); line = strtok(NULL, "\n"); continue; }
+        if (ntok == 0) { lexer_free_tokens(tokens); line = next_line(&cur); continue; }
 
         /* helper to append opcode words */
         #define EMIT0(op) do { if (code_ensure(&code, code_len + 1, &code_cap) < 0) { set_error_msg(err_msg, "out of memory"); goto fail; } code[code_len++] = (word)(op); } while(0)
@@ -456,7 +556,7 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
             lexer_free_tokens(tokens); goto fail;
         }
         lexer_free_tokens(tokens);
-        line = strtok(NULL, "\n");
+        line = next_line(&cur);
         continue;
     }
 
@@ -572,6 +672,93 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
         } else if (strcasecmp(kwlow, "lrsh") == 0) { EMIT0(OP_LRSH);
         } else if (strcasecmp(kwlow, "arsh") == 0) { EMIT0(OP_ARSH);
         } else if (strcasecmp(kwlow, "gez") == 0) { EMIT0(OP_GEZ);
+        } else if (strcasecmp(kwlow, "select") == 0) { EMIT0(OP_SELECT);
+        } else if (strcasecmp(kwlow, "min") == 0) { EMIT0(OP_MIN);
+        } else if (strcasecmp(kwlow, "max") == 0) { EMIT0(OP_MAX);
+        } else if (strcasecmp(kwlow, "abs") == 0) { EMIT0(OP_ABS);
+        } else if (strcasecmp(kwlow, "popcnt") == 0) { EMIT0(OP_POPCNT);
+        } else if (strcasecmp(kwlow, "clz") == 0) { EMIT0(OP_CLZ);
+        } else if (strcasecmp(kwlow, "ctz") == 0) { EMIT0(OP_CTZ);
+        } else if (strcasecmp(kwlow, "bswap") == 0) { EMIT0(OP_BSWAP);
+        } else if (strcasecmp(kwlow, "rotl") == 0) { EMIT0(OP_ROTL);
+        } else if (strcasecmp(kwlow, "rotr") == 0) { EMIT0(OP_ROTR);
+        } else if (strcasecmp(kwlow, "mulhi") == 0) { EMIT0(OP_MULHI);
+        } else if (strcasecmp(kwlow, "arena") == 0) {
+            if (ntok != 2) { set_error_msg(err_msg, "line %zu: arena expects: arena <n>", lineno); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            word n; if (parse_int64(tokens[1], &n) < 0) { set_error_msg(err_msg, "line %zu: invalid immediate '%s'", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            if (n < 0 || n > ARENA_SIZE) { set_error_msg(err_msg, "line %zu: arena size %" WORD_FMT " out of range (0..%d)", lineno, n, ARENA_SIZE); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            EMIT1(OP_ARENA, n);
+        } else if (strcasecmp(kwlow, "ncall") == 0) {
+            if (ntok != 2) { set_error_msg(err_msg, "line %zu: ncall expects: ncall <name>", lineno); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            /* resolve the intrinsic now so engines dispatch on the index alone */
+            int idx = native_lookup(tokens[1]);
+            if (idx < 0) { set_error_msg(err_msg, "line %zu: unknown intrinsic '%s'", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            EMIT1(OP_NCALL, (word)idx);
+        } else if (strcasecmp(kwlow, "hnew") == 0) { EMIT0(OP_HNEW);
+        } else if (strcasecmp(kwlow, "hput") == 0) { EMIT0(OP_HPUT);
+        } else if (strcasecmp(kwlow, "hget") == 0) { EMIT0(OP_HGET);
+        } else if (strcasecmp(kwlow, "hdel") == 0) { EMIT0(OP_HDEL);
+        } else if (strcasecmp(kwlow, "hlen") == 0) { EMIT0(OP_HLEN);
+        } else if (strcasecmp(kwlow, "hiter") == 0) { EMIT0(OP_HITER);
+        } else if (strcasecmp(kwlow, "sort") == 0 || strcasecmp(kwlow, "bsearch") == 0 || strcasecmp(kwlow, "lowerbound") == 0) {
+            if (ntok != 2) { set_error_msg(err_msg, "line %zu: %s expects: %s <n>", lineno, kwlow, kwlow); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            word n; if (parse_int64(tokens[1], &n) < 0) { set_error_msg(err_msg, "line %zu: invalid immediate '%s'", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            if (n < 0 || n > TAPE_SIZE) { set_error_msg(err_msg, "line %zu: range length %" WORD_FMT " out of range (0..%d)", lineno, n, TAPE_SIZE); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            OpCode op = kwlow[0] == 's' ? OP_SORT : (kwlow[0] == 'b' ? OP_BSEARCH : OP_LOWERBOUND);
+            EMIT1(op, n);
+        } else if (strcasecmp(kwlow, "pack") == 0 || strcasecmp(kwlow, "findbyte") == 0 || strcasecmp(kwlow, "countlines") == 0 ||
+                   strcasecmp(kwlow, "splitlines") == 0 || strcasecmp(kwlow, "parseint") == 0) {
+            if (ntok != 2) { set_error_msg(err_msg, "line %zu: %s expects: %s <n>", lineno, kwlow, kwlow); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            word n; if (parse_int64(tokens[1], &n) < 0) { set_error_msg(err_msg, "line %zu: invalid immediate '%s'", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            /* pack reads n cells; the others read n bytes */
+            int is_pack = strcasecmp(kwlow, "pack") == 0;
+            word max = is_pack ? (word)TAPE_SIZE : (word)(TAPE_SIZE * sizeof(word));
+            if (n < 0 || n > max) { set_error_msg(err_msg, "line %zu: region length %" WORD_FMT " out of range (0..%" WORD_FMT ")", lineno, n, max); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            OpCode op = is_pack ? OP_PACK : kwlow[0] == 'p' ? OP_PARSEINT
+                      : kwlow[0] == 'f' ? OP_FINDBYTE : kwlow[0] == 'c' ? OP_COUNTLINES : OP_SPLITLINES;
+            EMIT1(op, n);
+        } else if (strcasecmp(kwlow, "hash64") == 0 || strcasecmp(kwlow, "hash64b") == 0 ||
+                   strcasecmp(kwlow, "crc32c") == 0 || strcasecmp(kwlow, "crc32cb") == 0) {
+            if (ntok != 2) { set_error_msg(err_msg, "line %zu: %s expects: %s <n>", lineno, kwlow, kwlow); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            word n; if (parse_int64(tokens[1], &n) < 0) { set_error_msg(err_msg, "line %zu: invalid immediate '%s'", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            /* the b forms count packed bytes, the others cells */
+            int bytes = kwlow[strlen(kwlow) - 1] == 'b';
+            word max = bytes ? (word)(TAPE_SIZE * sizeof(word)) : (word)TAPE_SIZE;
+            if (n < 0 || n > max) { set_error_msg(err_msg, "line %zu: range length %" WORD_FMT " out of range (0..%" WORD_FMT ")", lineno, n, max); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            OpCode op = kwlow[0] == 'h' ? (bytes ? OP_HASH64B : OP_HASH64) : (bytes ? OP_CRC32CB : OP_CRC32C);
+            EMIT1(op, n);
+        } else if (strcasecmp(kwlow, "findany") == 0) {
+            if (ntok != 3) { set_error_msg(err_msg, "line %zu: findany expects: findany <n> <k>", lineno); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            word n, k;
+            if (parse_int64(tokens[1], &n) < 0) { set_error_msg(err_msg, "line %zu: invalid immediate '%s'", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            if (parse_int64(tokens[2], &k) < 0) { set_error_msg(err_msg, "line %zu: invalid immediate '%s'", lineno, tokens[2]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            if (n < 0 || n > (word)(TAPE_SIZE * sizeof(word))) { set_error_msg(err_msg, "line %zu: region length %" WORD_FMT " out of range", lineno, n); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            if (k < 0 || k > TEXT_SET_MAX) { set_error_msg(err_msg, "line %zu: findany set size %" WORD_FMT " out of range (0..%d)", lineno, k, TEXT_SET_MAX); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            EMIT2(OP_FINDANY, n, k);
+        } else if (strcasecmp(kwlow, "vand") == 0) { EMIT0(OP_VAND);
+        } else if (strcasecmp(kwlow, "vor") == 0) { EMIT0(OP_VOR);
+        } else if (strcasecmp(kwlow, "vxor") == 0) { EMIT0(OP_VXOR);
+        } else if (strcasecmp(kwlow, "vload") == 0 || strcasecmp(kwlow, "vstore") == 0 || strcasecmp(kwlow, "vsplat") == 0 ||
+                   strcasecmp(kwlow, "vadd") == 0 || strcasecmp(kwlow, "vsub") == 0 || strcasecmp(kwlow, "vmul") == 0 ||
+                   strcasecmp(kwlow, "vmin") == 0 || strcasecmp(kwlow, "vmax") == 0 || strcasecmp(kwlow, "vhsum") == 0) {
+            if (ntok != 2) { set_error_msg(err_msg, "line %zu: %s expects: %s <lane type>", lineno, kwlow, kwlow); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            int lane = lane_type_from_str(tokens[1]);
+            if (lane < 0) { set_error_msg(err_msg, "line %zu: invalid lane type '%s' (i64, f64, i32, f32 or u8)", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            static const struct { const char *name; OpCode op; } vops[] = {
+                { "vload", OP_VLOAD }, { "vstore", OP_VSTORE }, { "vsplat", OP_VSPLAT }, { "vadd", OP_VADD },
+                { "vsub", OP_VSUB }, { "vmul", OP_VMUL }, { "vmin", OP_VMIN }, { "vmax", OP_VMAX }, { "vhsum", OP_VHSUM },
+            };
+            OpCode op = OP_NOP;
+            for (size_t vi = 0; vi < sizeof(vops) / sizeof(vops[0]); ++vi) {
+                if (strcmp(kwlow, vops[vi].name) == 0) op = vops[vi].op;
+            }
+            EMIT1(op, lane);
+        } else if (strcasecmp(kwlow, "vshuffle") == 0) {
+            if (ntok != 3) { set_error_msg(err_msg, "line %zu: vshuffle expects: vshuffle <lane type> <mask>", lineno); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            int lane = lane_type_from_str(tokens[1]);
+            if (lane < 0) { set_error_msg(err_msg, "line %zu: invalid lane type '%s' (i64, f64, i32, f32 or u8)", lineno, tokens[1]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            word mask; if (parse_int64(tokens[2], &mask) < 0) { set_error_msg(err_msg, "line %zu: invalid immediate '%s'", lineno, tokens[2]); free(kwlow); lexer_free_tokens(tokens); goto fail; }
+            EMIT2(OP_VSHUFFLE, lane, mask);
         } else {
             set_error_msg(err_msg, "line %zu: unknown keyword '%s'", lineno, tokens[0]);
             free(kwlow);
@@ -582,7 +769,7 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
         free(kwlow);
         lexer_free_tokens(tokens);
 
-        line = strtok(NULL, "\n");
+        line = next_line(&cur);
         continue;
 
     fail:
@@ -592,11 +779,20 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
         whilepatch_free(&wpatches);
         func_table_free(&funcs);
         free(code);
+        free(lines);
         return -1;
     }
 
     /* finished reading lines */
     free(buf);
+    if (syms && lines_fill(&lines, &nlines, &lines_cap, code_len, lineno) < 0) {
+        set_error_msg(err_msg, "out of memory");
+        free_labeltable_and_patches(&labels, &wpatches);
+        func_table_free(&funcs);
+        free(code);
+        free(lines);
+        return -1;
+    }
 
     /* backpatch remaining while patches */
     for (size_t i = 0; i < wpatches.count; ++i) {
@@ -607,6 +803,7 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
             free_labeltable_and_patches(&labels, &wpatches);
             func_table_free(&funcs);
             free(code);
+            free(lines);
             return -1;
         }
         code[wp->imm_pos] = (word)le->pos;
@@ -620,6 +817,7 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
             whilepatch_free(&wpatches);
             func_table_free(&funcs);
             free(code);
+            free(lines);
             return -1;
         }
     }
@@ -635,8 +833,23 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
     out_vm->fp = 0;
     out_vm->functions_count = 0;
     out_vm->user_data = NULL;
+    out_vm->out = stdout;
     /* Note: vm->functions table will be filled at runtime when OP_FUNCTION hooks run (backends). */
 
+    if (syms && func_table_export(&funcs, syms, err_msg) < 0) {
+        label_table_free(&labels);
+        whilepatch_free(&wpatches);
+        func_table_free(&funcs);
+        free(code);
+        free(lines);
+        return -1;
+    }
+    if (syms) {
+        syms->lines = lines;
+        syms->nlines = nlines;
+        syms->source = NULL;
+    }
+
     /* cleanup tables (retain code) */
     label_table_free(&labels);
     whilepatch_free(&wpatches);
@@ -646,6 +859,10 @@ int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg) {
 }
 
 int parse_rr_file_to_vm(const char *path, VM *out_vm, char **err_msg) {
+    return parse_rr_file_with_symbols(path, out_vm, NULL, err_msg);
+}
+
+int parse_rr_file_with_symbols(const char *path, VM *out_vm, ParserSymbols *syms, char **err_msg) {
     if (!path || !out_vm) {
         set_error_msg(err_msg, "invalid arguments");
         return -1;
@@ -695,8 +912,9 @@ int parse_rr_file_to_vm(const char *path, VM *out_vm, char **err_msg) {
     }
     buf[len] = '\0';
 
-    int ret = parse_rr_string_to_vm(buf, out_vm, err_msg);
+    int ret = parse_rr_string_with_symbols(buf, out_vm, syms, err_msg);
     free(buf);
+    if (ret == 0 && syms) syms->source = xstrdup(from_stdin ? "<stdin>" : path);
     return ret;
 }
 
@@ -61,6 +61,30 @@ int parse_rr_file_to_vm(const char *path, VM *out_vm, char **err_msg);
  */
 int parse_rr_string_to_vm(const char *src, VM *out_vm, char **err_msg);
 
+/*
+ * Symbols of a parsed program: names[i] is the `func` whose
+ * OP_FUNCTION/OP_CALL index is i, lines[ip] the source line (1-based) of
+ * the instruction that code word ip belongs to, and source the path given
+ * to parse_rr_file_with_symbols (NULL for strings). Filled by the
+ * *_with_symbols variants and released with parser_free_symbols.
+ */
+typedef struct ParserSymbols {
+    char **names;
+    int count;
+    int *lines;   /* nlines == code_len entries */
+    size_t nlines;
+    char *source;
+} ParserSymbols;
+
+/*
+ * Same as parse_rr_file_to_vm / parse_rr_string_to_vm, additionally
+ * returning the function symbol table in `*syms` on success.
+ */
+int parse_rr_file_with_symbols(const char *path, VM *out_vm, ParserSymbols *syms, char **err_msg);
+int parse_rr_string_with_symbols(const char *src, VM *out_vm, ParserSymbols *syms, char **err_msg);
+
+void parser_free_symbols(ParserSymbols *syms);
+
 /*
  * Utility: free resources produced by parse_* functions on the VM.
  * This currently only frees `out_vm->code` if non-NULL and zeroes fields
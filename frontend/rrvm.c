@@ -0,0 +1,333 @@
+/*
+ * rrvm/frontend/rrvm.c
+ *
+ * Embedding API implementation (see rrvm/frontend/rrvm.h).
+ *
+ * A context wraps one VM driven by the interpreter backend. vm_reset runs
+ * once in rrvm_context_new; runs and calls only reposition ip/stack state
+ * and re-enter vm_dispatch. A host call pushes a frame whose return ip is
+ * code_len, so the callee's `ret` lands past the end of the code and the
+ * dispatch loop exits with the result on top of the stack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rrvm.h"
+#include "vm/vm.h"
+#include "vm/select.h"
+#include "interpreter/interpreter.h"
+#include "parser/parser.h"
+#include "native/native.h"
+
+_Static_assert(RRVM_VOID == (int)TYPE_VOID && RRVM_PTR == (int)TYPE_PTR && RRVM_F64 == (int)TYPE_F64 &&
+               RRVM_V128 == (int)TYPE_V128,
+               "rrvm_type must mirror TypeTag");
+
+#define RRVM_MAX_FUNCS (sizeof(((VM*)0)->functions) / sizeof(size_t))
+
+struct rrvm_program {
+    word *code;
+    size_t code_len;
+#if WORD_BITS != 64
+    int64_t *code64; /* rrvm_program_bytecode view */
+#endif
+    size_t fn_ip[RRVM_MAX_FUNCS]; /* SIZE_MAX if the index has no body */
+    size_t fn_count;
+    ParserSymbols syms;
+};
+
+struct rrvm_context {
+    VM vm;
+    const rrvm_program *prog;
+    FILE *capture; /* open_memstream over buf/buf_len */
+    char *buf;
+    size_t buf_len;
+};
+
+static void set_err(char **err, const char *msg) {
+    if (!err) return;
+    size_t n = strlen(msg);
+    *err = (char*)malloc(n + 1);
+    if (*err) memcpy(*err, msg, n + 1);
+}
+
+/* --- programs --- */
+
+static rrvm_program *program_finish(rrvm_program *prog, char **err) {
+    for (size_t i = 0; i < RRVM_MAX_FUNCS; ++i) prog->fn_ip[i] = SIZE_MAX;
+    prog->fn_count = vm_scan_functions(prog->code, prog->code_len, prog->fn_ip, RRVM_MAX_FUNCS);
+#if WORD_BITS != 64
+    prog->code64 = (int64_t*)malloc((prog->code_len ? prog->code_len : 1) * sizeof(int64_t));
+    if (!prog->code64) { set_err(err, "out of memory"); rrvm_program_free(prog); return NULL; }
+    for (size_t i = 0; i < prog->code_len; ++i) prog->code64[i] = prog->code[i];
+#else
+    (void)err;
+#endif
+    return prog;
+}
+
+static rrvm_program *program_parse(const char *text, int is_path, char **err) {
+    if (!text) { set_err(err, "invalid arguments"); return NULL; }
+    rrvm_program *prog = (rrvm_program*)calloc(1, sizeof(*prog));
+    if (!prog) { set_err(err, "out of memory"); return NULL; }
+    VM *vm = (VM*)malloc(sizeof(VM));
+    if (!vm) { free(prog); set_err(err, "out of memory"); return NULL; }
+    char *msg = NULL;
+    int r = is_path ? parse_rr_file_with_symbols(text, vm, &prog->syms, &msg)
+                    : parse_rr_string_with_symbols(text, vm, &prog->syms, &msg);
+    if (r != 0) {
+        if (err) *err = msg;
+        else free(msg);
+        free(vm);
+        free(prog);
+        return NULL;
+    }
+    prog->code = (word*)vm->code;
+    prog->code_len = vm->code_len;
+    free(vm);
+    vm_if_convert(prog->code, &prog->code_len, prog->syms.lines);
+    prog->syms.nlines = prog->code_len;
+    return program_finish(prog, err);
+}
+
+rrvm_program *rrvm_program_from_source(const char *src, char **err) { return program_parse(src, 0, err); }
+rrvm_program *rrvm_program_from_file(const char *path, char **err) { return program_parse(path, 1, err); }
+
+/* reject bytecode the dispatch loop would misread */
+static int bytecode_valid(const word *code, size_t len) {
+    size_t ip = 0;
+    while (ip < len) {
+        word op = code[ip++];
+        if (op < 0 || op > OP_HALT) return 0;
+        size_t imms = (size_t)vm_op_imm_count((OpCode)op);
+        if (len - ip < imms) return 0;
+        if ((op == OP_FUNCTION || op == OP_CALL) && (code[ip] < 0 || (size_t)code[ip] >= RRVM_MAX_FUNCS)) return 0;
+        if (op == OP_NCALL && !native_get((int)code[ip])) return 0;
+        if (op == OP_WHILE && (code[ip] < 0 || (size_t)code[ip] >= len)) return 0;
+        ip += imms;
+    }
+    return 1;
+}
+
+rrvm_program *rrvm_program_from_bytecode(const int64_t *code, size_t len,
+                                         const char *const *names, int name_count, char **err) {
+    if ((!code && len) || name_count < 0 || (name_count && !names)) { set_err(err, "invalid arguments"); return NULL; }
+    rrvm_program *prog = (rrvm_program*)calloc(1, sizeof(*prog));
+    if (!prog) { set_err(err, "out of memory"); return NULL; }
+    prog->code = (word*)malloc((len ? len : 1) * sizeof(word));
+    prog->syms.names = (char**)calloc(name_count ? (size_t)name_count : 1, sizeof(char*));
+    if (!prog->code || !prog->syms.names) { set_err(err, "out of memory"); rrvm_program_free(prog); return NULL; }
+    prog->syms.count = name_count;
+    prog->code_len = len;
+    for (size_t i = 0; i < len; ++i) prog->code[i] = (word)code[i];
+    if (!bytecode_valid(prog->code, len)) { set_err(err, "malformed bytecode"); rrvm_program_free(prog); return NULL; }
+    for (int i = 0; i < name_count; ++i) {
+        if (!names[i]) continue;
+        size_t n = strlen(names[i]);
+        prog->syms.names[i] = (char*)malloc(n + 1);
+        if (!prog->syms.names[i]) { set_err(err, "out of memory"); rrvm_program_free(prog); return NULL; }
+        memcpy(prog->syms.names[i], names[i], n + 1);
+    }
+    return program_finish(prog, err);
+}
+
+const int64_t *rrvm_program_bytecode(const rrvm_program *prog, size_t *len) {
+    if (!prog) return NULL;
+    if (len) *len = prog->code_len;
+#if WORD_BITS != 64
+    return prog->code64;
+#else
+    return (const int64_t*)prog->code;
+#endif
+}
+
+void rrvm_program_free(rrvm_program *prog) {
+    if (!prog) return;
+    free(prog->code);
+#if WORD_BITS != 64
+    free(prog->code64);
+#endif
+    parser_free_symbols(&prog->syms);
+    free(prog);
+}
+
+int rrvm_function_index(const rrvm_program *prog, const char *name) {
+    if (!prog || !name) return -1;
+    for (int i = 0; i < prog->syms.count; ++i) {
+        if (prog->syms.names[i] && strcmp(prog->syms.names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+int rrvm_function_count(const rrvm_program *prog) {
+    return prog ? (int)prog->fn_count : 0;
+}
+
+const char *rrvm_function_name(const rrvm_program *prog, int index) {
+    if (!prog || index < 0 || index >= prog->syms.count) return NULL;
+    return prog->syms.names[index];
+}
+
+/* --- contexts --- */
+
+rrvm_context *rrvm_context_new(const rrvm_program *prog) {
+    if (!prog) return NULL;
+    rrvm_context *ctx = (rrvm_context*)calloc(1, sizeof(*ctx));
+    if (!ctx) return NULL;
+    ctx->prog = prog;
+    ctx->capture = open_memstream(&ctx->buf, &ctx->buf_len);
+    if (!ctx->capture) { free(ctx); return NULL; }
+
+    VM *vm = &ctx->vm;
+    vm->code = prog->code;
+    vm->code_len = prog->code_len;
+    vm_reset(vm, &__INTERPRETER);
+    tier_state *tier = interp_get_state(vm)->tier;
+    if (tier) tier->cfg.symbols = &prog->syms;
+    memcpy(vm->functions, prog->fn_ip, sizeof(vm->functions));
+    vm->functions_count = prog->fn_count;
+    vm->out = ctx->capture;
+    return ctx;
+}
+
+void rrvm_context_free(rrvm_context *ctx) {
+    if (!ctx) return;
+    if (__INTERPRETER.finalize) __INTERPRETER.finalize(&ctx->vm, 0);
+    vm_tape_release(&ctx->vm);
+    fclose(ctx->capture);
+    free(ctx->buf);
+    free(ctx);
+}
+
+/* clear transient execution state; tape, maps and functions persist */
+static void context_unwind(VM *vm) {
+    vm->sp = 0;
+    vm->tp = 0;
+    vm->tp_sp = 0;
+    vm->call_sp = 0;
+    vm->fp = 0;
+    vm->block_sp = 0;
+    vm->arena_top = TAPE_SIZE - ARENA_SIZE;
+}
+
+static int context_trapped(VM *vm) {
+#if TAPE_GUARD
+    if (vm->trapped) { context_unwind(vm); return 1; }
+#else
+    (void)vm;
+#endif
+    return 0;
+}
+
+/* dispatch from vm->ip, first entering function fi (if >= 0) the way
+ * interp_call does: counting the call and running compiled code for it.
+ * A guest fault unwinds the context and returns 1. */
+static int context_dispatch(VM *vm, int fi) {
+    jmp_buf env;
+    vm->fault = NULL;
+    vm->fault_env = &env;
+    if (setjmp(env)) {
+        vm->fault_env = NULL;
+#if TAPE_GUARD
+        vm_guard()->vm = NULL;
+#endif
+        context_unwind(vm);
+        return 1;
+    }
+    interp_state *st = interp_get_state(vm);
+    if (fi >= 0 && st->tier) tier_enter(st->tier, vm, (size_t)fi);
+    vm_dispatch(vm, &__INTERPRETER);
+    vm->fault_env = NULL;
+    return 0;
+}
+
+int rrvm_run(rrvm_context *ctx) {
+    if (!ctx) return RRVM_ERR_ARGS;
+    VM *vm = &ctx->vm;
+    context_unwind(vm);
+    vm->ip = 0;
+    if (context_dispatch(vm, -1)) return RRVM_ERR_FAULT;
+    if (context_trapped(vm)) return RRVM_ERR_TRAP;
+    /* the top level may leave values behind; they are not a result */
+    context_unwind(vm);
+    return RRVM_OK;
+}
+
+int rrvm_call_index(rrvm_context *ctx, int index, const rrvm_value *args, int nargs, rrvm_value *result) {
+    if (!ctx || nargs < 0 || (nargs && !args)) return RRVM_ERR_ARGS;
+    const rrvm_program *prog = ctx->prog;
+    if (index < 0 || (size_t)index >= prog->fn_count || prog->fn_ip[index] == SIZE_MAX) return RRVM_ERR_NOFUNC;
+    VM *vm = &ctx->vm;
+    if (vm->call_sp >= CALL_STACK_SIZE || vm->sp + nargs > STACK_SIZE) return RRVM_ERR_ARGS;
+    for (int i = 0; i < nargs; ++i) {
+        if (args[i].type == RRVM_V128) return RRVM_ERR_ARGS;
+    }
+
+    /* frame as interp_call builds it, returning to code_len */
+    int call_sp = vm->call_sp;
+    int base = vm->sp;
+    vm->call_stack[call_sp].return_ip = vm->code_len;
+    vm->call_stack[call_sp].old_fp = vm->fp;
+    vm->call_stack[call_sp].old_arena = vm->arena_top;
+    vm->call_stack[call_sp].old_block_sp = vm->block_sp;
+    vm->call_sp = call_sp + 1;
+    vm->fp = base;
+    for (int i = 0; i < nargs; ++i) {
+        vm->stack[vm->sp] = (word)args[i].bits;
+        vm->types[vm->sp++] = (TypeTag)args[i].type;
+    }
+    vm->ip = prog->fn_ip[index];
+    if (context_dispatch(vm, index)) return RRVM_ERR_FAULT;
+    if (context_trapped(vm)) return RRVM_ERR_TRAP;
+
+    if (vm->call_sp != call_sp || vm->sp != base + 1) {
+        /* halted (or ran off the end) inside the callee: drop its frame */
+        vm->fp = vm->call_stack[call_sp].old_fp;
+        vm->arena_top = vm->call_stack[call_sp].old_arena;
+        vm->block_sp = vm->call_stack[call_sp].old_block_sp;
+        vm->call_sp = call_sp;
+        vm->sp = base;
+        return RRVM_ERR_NORETURN;
+    }
+    vm->sp = base;
+    if (result) {
+        result->type = (rrvm_type)vm->types[base];
+        result->bits = (int64_t)vm->stack[base];
+    }
+    return RRVM_OK;
+}
+
+int rrvm_call(rrvm_context *ctx, const char *name, const rrvm_value *args, int nargs, rrvm_value *result) {
+    if (!ctx || !name) return RRVM_ERR_ARGS;
+    int index = rrvm_function_index(ctx->prog, name);
+    if (index < 0) return RRVM_ERR_NOFUNC;
+    return rrvm_call_index(ctx, index, args, nargs, result);
+}
+
+const char *rrvm_error(const rrvm_context *ctx) {
+    return ctx ? ctx->vm.fault : NULL;
+}
+
+/* --- output --- */
+
+const char *rrvm_output(rrvm_context *ctx, size_t *len) {
+    if (!ctx) return NULL;
+    fflush(ctx->capture);
+    /* after a clear the stream overwrites in place without re-terminating */
+    if (ctx->buf) ctx->buf[ctx->buf_len] = '\0';
+    if (len) *len = ctx->buf_len;
+    return ctx->buf ? ctx->buf : "";
+}
+
+void rrvm_output_clear(rrvm_context *ctx) {
+    if (!ctx) return;
+    fseeko(ctx->capture, 0, SEEK_SET);
+    fflush(ctx->capture);
+}
+
+void rrvm_set_output(rrvm_context *ctx, FILE *out) {
+    if (!ctx) return;
+    ctx->vm.out = out ? out : ctx->capture;
+}
@@ -0,0 +1,165 @@
+#ifndef RRVM_H
+#define RRVM_H
+
+/*
+ * rrvm/frontend/rrvm.h
+ *
+ * Embedding API (librrvm.a / librrvm.so, built by build.sh).
+ *
+ * Model:
+ *  - An rrvm_program is parsed (or loaded from bytecode) once and is
+ *    immutable afterwards. Any number of contexts may share it; it must
+ *    outlive them.
+ *  - An rrvm_context is one interpreter instance: data stack, tape, hash
+ *    maps and output stream. It is set up once by rrvm_context_new and keeps
+ *    its state (tape contents, maps) across runs and calls.
+ *  - rrvm_call enters a `func` directly, without running the top-level code;
+ *    use rrvm_run first if functions rely on state the top level sets up.
+ *
+ * Calling convention:
+ *  - Arguments are pushed onto the callee's own stack in order, so the
+ *    function body sees args[nargs-1] on top (`func add2` with body `add;
+ *    ret` adds two arguments).
+ *  - The value on top of the callee's stack at `ret` is the result, with
+ *    its type. A function that returns nothing yields 0:i64. Functions
+ *    taking or returning v128 vectors cannot be called from the host.
+ *  - Resolve names once with rrvm_function_index and use rrvm_call_index on
+ *    hot paths; a call then costs a frame push and the dispatch loop, with
+ *    no parsing or setup.
+ *
+ * Output from print/printchar is captured per context (rrvm_output) unless
+ * redirected with rrvm_set_output. A guest fault (operand type mismatch,
+ * stack or tape out of bounds, division by zero) ends the run or call with
+ * RRVM_ERR_FAULT and rrvm_error says which; the context stays usable. Misuse
+ * of the API itself is still caught by assert.
+ *
+ * Contexts tier up like the CLI (see tier/tier.h, tier_defaults): hot
+ * functions and loops are compiled on a worker thread owned by the
+ * context, which rrvm_context_free joins. Link with -pthread.
+ *
+ * A context must only be used by one thread at a time. With TAPE_GUARD the
+ * trap handler is process-wide, so only one context may run at a time.
+ * Programs may be loaded on several threads at once, but registering an
+ * intrinsic (native/native.h) meanwhile needs a lock around both.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* value types; numerically identical to the VM's TypeTag */
+typedef enum {
+    RRVM_UNKNOWN = 0,
+    RRVM_I8,
+    RRVM_U8,
+    RRVM_I16,
+    RRVM_U16,
+    RRVM_I32,
+    RRVM_U32,
+    RRVM_I64,
+    RRVM_U64,
+    RRVM_F32,
+    RRVM_F64,
+    RRVM_BOOL,
+    RRVM_PTR,
+    RRVM_VOID,
+    RRVM_V128, /* vectors stay inside the guest: not an argument or result type */
+} rrvm_type;
+
+/* a typed value; floats are stored as their IEEE bit pattern */
+typedef struct {
+    rrvm_type type;
+    int64_t bits;
+} rrvm_value;
+
+/* status codes */
+enum {
+    RRVM_OK = 0,
+    RRVM_ERR_ARGS = -1,     /* bad argument (NULL, too many args, ...) */
+    RRVM_ERR_NOFUNC = -2,   /* unknown function name or index */
+    RRVM_ERR_NORETURN = -3, /* the function halted or ran off the code without ret */
+    RRVM_ERR_TRAP = -4,     /* tape access out of bounds (TAPE_GUARD builds) */
+    RRVM_ERR_FAULT = -5,    /* the guest broke a run-time check (see rrvm_error) */
+};
+
+typedef struct rrvm_program rrvm_program;
+typedef struct rrvm_context rrvm_context;
+
+/*
+ * Load a program from .rr source text or a file path ("-" for stdin).
+ * On failure NULL is returned and, if err is non-NULL, *err is set to a
+ * malloc'ed message the caller must free().
+ */
+rrvm_program *rrvm_program_from_source(const char *src, char **err);
+rrvm_program *rrvm_program_from_file(const char *path, char **err);
+
+/*
+ * Load a program from bytecode as returned by rrvm_program_bytecode (the
+ * code is copied). `names` (may be NULL) gives function names by index.
+ */
+rrvm_program *rrvm_program_from_bytecode(const int64_t *code, size_t len,
+                                         const char *const *names, int name_count, char **err);
+
+/* The program's bytecode; valid until rrvm_program_free. */
+const int64_t *rrvm_program_bytecode(const rrvm_program *prog, size_t *len);
+
+void rrvm_program_free(rrvm_program *prog);
+
+/* Function lookup: index for `name` or -1; name for an index or NULL. */
+int rrvm_function_index(const rrvm_program *prog, const char *name);
+int rrvm_function_count(const rrvm_program *prog);
+const char *rrvm_function_name(const rrvm_program *prog, int index);
+
+rrvm_context *rrvm_context_new(const rrvm_program *prog);
+void rrvm_context_free(rrvm_context *ctx);
+
+/* Run the program's top-level code from the start. */
+int rrvm_run(rrvm_context *ctx);
+
+/*
+ * Call a function with `nargs` typed arguments. On RRVM_OK the result is
+ * stored in *result (if non-NULL).
+ */
+int rrvm_call(rrvm_context *ctx, const char *name, const rrvm_value *args, int nargs, rrvm_value *result);
+int rrvm_call_index(rrvm_context *ctx, int index, const rrvm_value *args, int nargs, rrvm_value *result);
+
+/* Message of the guest fault that ended the last run or call, or NULL. */
+const char *rrvm_error(const rrvm_context *ctx);
+
+/*
+ * Captured output since the last rrvm_output_clear. The buffer is
+ * NUL-terminated and valid until the next run/call/clear.
+ */
+const char *rrvm_output(rrvm_context *ctx, size_t *len);
+void rrvm_output_clear(rrvm_context *ctx);
+
+/* Send output to `out` instead of the capture buffer (NULL restores capture). */
+void rrvm_set_output(rrvm_context *ctx, FILE *out);
+
+/* value helpers */
+static inline rrvm_value rrvm_i64(int64_t v) { rrvm_value r = { RRVM_I64, v }; return r; }
+static inline rrvm_value rrvm_u64(uint64_t v) { rrvm_value r = { RRVM_U64, (int64_t)v }; return r; }
+static inline rrvm_value rrvm_bool(int v) { rrvm_value r = { RRVM_BOOL, v != 0 }; return r; }
+
+static inline rrvm_value rrvm_f64(double v) {
+    union { double d; int64_t i; } u;
+    u.d = v;
+    rrvm_value r = { RRVM_F64, u.i };
+    return r;
+}
+
+static inline double rrvm_as_f64(rrvm_value v) {
+    union { double d; int64_t i; } u;
+    u.i = v.bits;
+    return u.d;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RRVM_H */
@@ -0,0 +1,598 @@
+#ifndef TAC_ALIAS_H
+#define TAC_ALIAS_H
+
+/*
+ * rrvm/frontend/tac/alias.h
+ *
+ * Points-to analysis for lowered TAC. Every tape access is relative to tp,
+ * and deref, index and a call can move tp anywhere, so without this a pass
+ * has to assume that any store (or call) touches any cell. tac_points_to
+ * gives each instruction the abstract location tp has when it runs, and
+ * each temp the location its value addresses (a tac_loc: a cell of the
+ * tape, of the function's entry frame or of an arena block, or a set of
+ * those), with a forward dataflow over each function:
+ *  - the state is tp, the pointers deref saved for refer, and the pointer
+ *    values of the cells the function wrote at a known offset. Where paths
+ *    meet, what they disagree on becomes a whole space or any cell;
+ *  - where and arena produce a pointer to tp and to a new block, constants
+ *    within the tape are cell indices, and adding one to a pointer moves
+ *    it. move and offset move tp, deref sets it to the pointer its cell
+ *    holds and refer restores it, index moves it by the cell's value;
+ *  - a write forgets the values of the cells it may reach.
+ * Across calls the summary is flow-insensitive, in the manner of Andersen's
+ * analysis: each function's mod set is the hull of the cells its writes and
+ * its callees' mod sets cover (relative to its entry, and absolute), solved
+ * together with the dataflow by repeating it until nothing changes. A call
+ * forgets the cells its callee's mod set reaches from the caller's tp, and
+ * moves tp as the callee's rets agree to.
+ *
+ * The result stays in tac_backend_state.alias for other passes, through
+ * tac_may_alias, tac_must_alias and tac_may_clobber over instruction
+ * indices. Passes that move instructions must run tac_points_to again
+ * before asking.
+ */
+
+#include "tac.h"
+
+enum {
+    TAC_PT_DEPTH = 4,             /* deref nesting tracked */
+    TAC_PT_CELLS = 3 * TAPE_SIZE, /* cell offsets -TAPE_SIZE .. 2*TAPE_SIZE-1 */
+    TAC_PT_WIDEN = 4,             /* a mod set that grew this often is made unbounded */
+};
+
+static const tac_loc tac_loc_none = { TAC_LOC_NONE, 0 };
+static const tac_loc tac_loc_any = { TAC_LOC_ANY, 0 };
+
+typedef struct {
+    tac_loc tp;
+    int depth; /* pointers saved by deref, -1 if not known */
+    tac_loc saved[TAC_PT_DEPTH];
+} tac_pt_tp;
+
+/* state on entry to a label: tp and the cells with a known pointer value */
+typedef struct {
+    int reached, queued;
+    tac_pt_tp tp;
+    int ncells;
+    int32_t *cell;
+    tac_loc *val;
+} tac_pt_entry;
+
+typedef struct {
+    tac_backend_state *s;
+    tac_alias *a;
+    int *next, *label_at;
+    int *def;         /* per temp: the frame defining it */
+    uint8_t *grown;   /* per frame: rounds its mod set grew in */
+    tac_pt_entry *at; /* per label */
+    int *work, nwork;
+    int changed;      /* a location or a summary moved this round */
+    tac_pt_tp tp;
+    int ncells;       /* cells of the frame's own space with a known value, by offset */
+    int32_t cell[TAC_PT_CELLS];
+    tac_loc val[TAC_PT_CELLS];
+} tac_pt_ctx;
+
+static inline int tac_loc_eq(tac_loc a, tac_loc b) {
+    return a.base == b.base && a.off == b.off;
+}
+
+/* NONE < a cell < a whole space < any cell */
+static inline tac_loc tac_loc_join(tac_loc a, tac_loc b) {
+    if (tac_loc_eq(a, b) || b.base == TAC_LOC_NONE) return a;
+    if (a.base == TAC_LOC_NONE) return b;
+    if (a.base == b.base) return (tac_loc){ a.base, TAC_OFF_ANY };
+    return tac_loc_any;
+}
+
+static inline tac_loc tac_loc_shift(tac_loc l, word d) {
+    if (l.base == TAC_LOC_NONE || l.base == TAC_LOC_ANY || l.off == TAC_OFF_ANY) return l;
+    word off = (word)l.off + d;
+    return (tac_loc){ l.base, off > -TAPE_SIZE && off < 2 * TAPE_SIZE ? (int32_t)off : TAC_OFF_ANY };
+}
+
+/* the integer a pointer value stands for, when it is a known tape index */
+static inline int tac_loc_int(tac_loc l, word *k) {
+    if (l.base != TAC_LOC_ABS || l.off == TAC_OFF_ANY) return 0;
+    *k = l.off;
+    return 1;
+}
+
+/*
+ * May [a, a+an) and [b, b+bn) share a cell, both in one activation of a
+ * function? An extent of -1 runs to the end of the tape. REL cells are
+ * somewhere on the tape, arena blocks are disjoint from each other and in
+ * the last ARENA_SIZE cells.
+ */
+static inline int tac_loc_may_alias(tac_loc a, word an, tac_loc b, word bn) {
+    if (a.base == TAC_LOC_NONE || b.base == TAC_LOC_NONE || !an || !bn) return 0;
+    if (a.base == TAC_LOC_ANY || b.base == TAC_LOC_ANY) return 1;
+    if (a.base != b.base) {
+        if (a.base >= 0 && b.base >= 0) return 0;
+        if (b.base >= 0) { tac_loc l = a; a = b; b = l; word n = an; an = bn; bn = n; }
+        if (a.base >= 0 && b.base == TAC_LOC_ABS)
+            return b.off == TAC_OFF_ANY || bn < 0 || (word)b.off + bn > TAPE_SIZE - ARENA_SIZE;
+        return 1;
+    }
+    if (a.off == TAC_OFF_ANY || b.off == TAC_OFF_ANY) return 1;
+    return (bn < 0 || (word)a.off < (word)b.off + bn) && (an < 0 || (word)b.off < (word)a.off + an);
+}
+
+/*
+ * The cells a call to a function with summary m writes, seen from a caller
+ * whose tp is `tp`: up to two ranges in loc/cells, or one ANY. Returns how
+ * many.
+ */
+static inline int tac_mod_at(const tac_frame_mod *m, tac_loc tp, tac_loc *loc, word *cells) {
+    int n = 0;
+    if (m->any) { loc[0] = tac_loc_any; cells[0] = -1; return 1; }
+    if (m->lo[0] < m->hi[0]) {
+        if (tp.base == TAC_LOC_ANY) { loc[0] = tac_loc_any; cells[0] = -1; return 1; }
+        if (m->lo[0] == TAC_OFF_ANY) { loc[n] = (tac_loc){ tp.base, TAC_OFF_ANY }; cells[n++] = -1; }
+        else { loc[n] = tac_loc_shift(tp, m->lo[0]); cells[n++] = (word)m->hi[0] - m->lo[0]; }
+    }
+    if (m->lo[1] < m->hi[1]) {
+        if (m->lo[1] == TAC_OFF_ANY) { loc[n] = (tac_loc){ TAC_LOC_ABS, TAC_OFF_ANY }; cells[n++] = -1; }
+        else { loc[n] = (tac_loc){ TAC_LOC_ABS, m->lo[1] }; cells[n++] = (word)m->hi[1] - m->lo[1]; }
+    }
+    return n;
+}
+
+/* widen m to cover [l, l+cells) */
+static inline int tac_mod_add(tac_frame_mod *m, tac_loc l, word cells) {
+    tac_frame_mod old = *m;
+    if (l.base == TAC_LOC_NONE || !cells) return 0;
+    if (l.base >= 0) l = (tac_loc){ TAC_LOC_ABS, TAPE_SIZE - ARENA_SIZE }, cells = ARENA_SIZE;
+    if (l.base == TAC_LOC_ANY) {
+        m->any = 1;
+    } else {
+        int k = l.base == TAC_LOC_ABS;
+        if (l.off == TAC_OFF_ANY || cells < 0 || m->lo[k] == TAC_OFF_ANY) {
+            m->lo[k] = TAC_OFF_ANY;
+            m->hi[k] = INT32_MAX;
+        } else if (m->lo[k] >= m->hi[k]) {
+            m->lo[k] = l.off;
+            m->hi[k] = (int32_t)(l.off + cells);
+        } else {
+            if (l.off < m->lo[k]) m->lo[k] = l.off;
+            if (l.off + cells > m->hi[k]) m->hi[k] = (int32_t)(l.off + cells);
+            if ((word)m->hi[k] - m->lo[k] > TAPE_SIZE) m->lo[k] = TAC_OFF_ANY, m->hi[k] = INT32_MAX;
+        }
+    }
+    return memcmp(&old, m, sizeof(old)) != 0;
+}
+
+/* locations that mean the same in every frame: REL cells and
+   arena blocks are only meaningful inside their frame */
+static inline int tac_alias_shared(tac_loc l) {
+    return l.base == TAC_LOC_ABS || l.base == TAC_LOC_ANY || l.base == TAC_LOC_NONE;
+}
+
+/* the space a frame's own cells live in: the top level starts at tape cell 0 */
+static inline int32_t tac_pt_home(int frame) {
+    return frame ? TAC_LOC_REL : TAC_LOC_ABS;
+}
+
+static inline int tac_pt_find(const tac_pt_ctx *c, int32_t cell) {
+    int lo = 0, hi = c->ncells;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (c->cell[mid] < cell) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* the pointer value of the cell at l */
+static inline tac_loc tac_pt_read(const tac_pt_ctx *c, int frame, tac_loc l) {
+    if (l.base != tac_pt_home(frame) || l.off == TAC_OFF_ANY) return tac_loc_any;
+    int k = tac_pt_find(c, l.off);
+    return k < c->ncells && c->cell[k] == l.off ? c->val[k] : tac_loc_any;
+}
+
+/* forget the cells [l, l+cells) may reach */
+static inline void tac_pt_kill(tac_pt_ctx *c, int frame, tac_loc l, word cells) {
+    int n = 0;
+    for (int k = 0; k < c->ncells; ++k) {
+        if (tac_loc_may_alias((tac_loc){ tac_pt_home(frame), c->cell[k] }, 1, l, cells)) continue;
+        c->cell[n] = c->cell[k];
+        c->val[n++] = c->val[k];
+    }
+    c->ncells = n;
+}
+
+static inline void tac_pt_write(tac_pt_ctx *c, int frame, tac_loc l, tac_loc v) {
+    tac_pt_kill(c, frame, l, 1);
+    if (l.base != tac_pt_home(frame) || l.off == TAC_OFF_ANY || v.base == TAC_LOC_ANY || v.base == TAC_LOC_NONE) return;
+    int k = tac_pt_find(c, l.off);
+    memmove(&c->cell[k + 1], &c->cell[k], (size_t)(c->ncells - k) * sizeof(int32_t));
+    memmove(&c->val[k + 1], &c->val[k], (size_t)(c->ncells - k) * sizeof(tac_loc));
+    c->cell[k] = l.off;
+    c->val[k] = v;
+    c->ncells++;
+}
+
+static inline void tac_pt_def(tac_pt_ctx *c, int temp, tac_loc v) {
+    if (temp < 0) return;
+    tac_loc j = tac_loc_join(c->a->pts[temp], v);
+    if (!tac_loc_eq(j, c->a->pts[temp])) { c->a->pts[temp] = j; c->changed = 1; }
+}
+
+/* the pointer value of temp as seen from `frame`: a body may use temps of
+   the code that calls it, whose frame cells and arena blocks are not its own */
+static inline tac_loc tac_pt_of(const tac_pt_ctx *c, int frame, int temp) {
+    if (temp < 0) return tac_loc_any;
+    tac_loc v = c->a->pts[temp];
+    return c->def[temp] == frame || tac_alias_shared(v) ? v : tac_loc_any;
+}
+
+static inline void tac_pt_lose_tp(tac_pt_ctx *c) {
+    c->tp.tp = tac_loc_any;
+    c->tp.depth = -1;
+}
+
+/* widen the mod set of `frame`; one that keeps growing (a recursive
+   function writing further each level) covers its whole space at once */
+static inline void tac_pt_mod(tac_pt_ctx *c, int frame, tac_loc l, word cells) {
+    tac_frame_mod *m = &c->a->mod[frame];
+    if (!tac_mod_add(m, l, cells)) return;
+    c->changed = 1;
+    if (++c->grown[frame] < TAC_PT_WIDEN) return;
+    for (int k = 0; k < 2; ++k) if (m->lo[k] < m->hi[k]) m->lo[k] = TAC_OFF_ANY, m->hi[k] = INT32_MAX;
+}
+
+/* join the current state into the entry of `label`, queueing it on change */
+static inline void tac_pt_merge(tac_pt_ctx *c, int label) {
+    tac_pt_entry *e = &c->at[label];
+    int changed = 0;
+    if (!e->reached) {
+        e->reached = changed = 1;
+        e->tp = c->tp;
+        e->ncells = c->ncells;
+        e->cell = (int32_t*)malloc((size_t)(c->ncells ? c->ncells : 1) * sizeof(int32_t));
+        e->val = (tac_loc*)malloc((size_t)(c->ncells ? c->ncells : 1) * sizeof(tac_loc));
+        memcpy(e->cell, c->cell, (size_t)c->ncells * sizeof(int32_t));
+        memcpy(e->val, c->val, (size_t)c->ncells * sizeof(tac_loc));
+    } else {
+        tac_loc tp = tac_loc_join(e->tp.tp, c->tp.tp);
+        if (!tac_loc_eq(tp, e->tp.tp)) { e->tp.tp = tp; changed = 1; }
+        if (e->tp.depth != c->tp.depth && e->tp.depth >= 0) { e->tp.depth = -1; changed = 1; }
+        for (int d = 0; d < e->tp.depth; ++d) {
+            tac_loc p = tac_loc_join(e->tp.saved[d], c->tp.saved[d]);
+            if (!tac_loc_eq(p, e->tp.saved[d])) { e->tp.saved[d] = p; changed = 1; }
+        }
+        /* keep the cells both know, with their values joined */
+        int n = 0;
+        for (int k = 0; k < e->ncells; ++k) {
+            int at = tac_pt_find(c, e->cell[k]);
+            tac_loc v = at < c->ncells && c->cell[at] == e->cell[k] ? tac_loc_join(e->val[k], c->val[at]) : tac_loc_any;
+            if (!tac_loc_eq(v, e->val[k])) changed = 1;
+            if (v.base == TAC_LOC_ANY) continue;
+            e->cell[n] = e->cell[k];
+            e->val[n++] = v;
+        }
+        e->ncells = n;
+    }
+    if (changed && !e->queued) {
+        e->queued = 1;
+        c->work[c->nwork++] = label;
+    }
+}
+
+/* a ret (or the end of a body) of `frame` */
+static inline void tac_pt_return(tac_pt_ctx *c, int frame) {
+    tac_frame_mod *m = &c->a->mod[frame];
+    tac_loc exit = tac_loc_join(m->exit, c->tp.tp);
+    int balanced = m->balanced && c->tp.depth == 0;
+    if (!tac_loc_eq(exit, m->exit) || balanced != m->balanced) {
+        m->exit = exit;
+        m->balanced = balanced;
+        c->changed = 1;
+    }
+}
+
+/* apply callee g at a call from `frame`; 0 if g has not returned yet */
+static inline int tac_pt_call(tac_pt_ctx *c, int frame, int g) {
+    const tac_frame_mod *m = &c->a->mod[g];
+    tac_loc loc[2];
+    word cells[2];
+    int n = tac_mod_at(m, c->tp.tp, loc, cells);
+    for (int k = 0; k < n; ++k) {
+        tac_pt_kill(c, frame, loc[k], cells[k]);
+        tac_pt_mod(c, frame, loc[k], cells[k]);
+    }
+    if (m->exit.base == TAC_LOC_NONE) return 0;
+    if (m->exit.base == TAC_LOC_REL) {
+        if (c->tp.tp.base == TAC_LOC_ANY) c->tp.tp = tac_loc_any;
+        else if (m->exit.off == TAC_OFF_ANY) c->tp.tp.off = TAC_OFF_ANY;
+        else c->tp.tp = tac_loc_shift(c->tp.tp, m->exit.off);
+    } else {
+        /* an absolute tp, or an arena block of the callee's, gone at its ret */
+        c->tp.tp = m->exit.base == TAC_LOC_ABS ? m->exit : tac_loc_any;
+    }
+    if (!m->balanced) c->tp.depth = -1;
+    return 1;
+}
+
+/* apply instruction i; 0 when no path continues past it */
+static inline int tac_pt_step(tac_pt_ctx *c, size_t i) {
+    tac_prog *t = &c->s->prog;
+    tac_alias *a = c->a;
+    TacOp op = tac_op(t, i);
+    int dst = tac_dst(t, i), lhs = tac_lhs(t, i), rhs = tac_rhs(t, i), frame = a->owner[i];
+    word imm = tac_imm(t, i), k;
+
+    tac_loc at = tac_loc_join(a->at[i], c->tp.tp);
+    if (!tac_loc_eq(at, a->at[i])) { a->at[i] = at; c->changed = 1; }
+    word cells;
+    unsigned mem = tac_tape_access(op, imm, &cells);
+    if (mem & TAC_MEM_WRITE) {
+        tac_pt_mod(c, frame, c->tp.tp, cells);
+        if (op != TAC_STORE && op != TAC_SET) tac_pt_kill(c, frame, c->tp.tp, cells);
+    }
+    if (mem & TAC_MEM_FAR) {
+        tac_pt_mod(c, frame, tac_loc_any, -1);
+        c->ncells = 0;
+    }
+
+    switch (op) {
+        case TAC_CONST: {
+            int ty = tac_dst_type(t, i);
+            tac_pt_def(c, dst, ty != TYPE_F32 && ty != TYPE_F64 && imm >= 0 && imm < TAPE_SIZE
+                               ? (tac_loc){ TAC_LOC_ABS, (int32_t)imm } : tac_loc_any);
+            return 1;
+        }
+        case TAC_WHERE:
+            tac_pt_def(c, dst, c->tp.tp);
+            return 1;
+        case TAC_ARENA:
+            tac_pt_def(c, dst, (tac_loc){ (int32_t)i, 0 });
+            return 1;
+        case TAC_ADD: {
+            tac_loc l = tac_pt_of(c, frame, lhs), r = tac_pt_of(c, frame, rhs);
+            if (l.base == TAC_LOC_NONE || r.base == TAC_LOC_NONE) return 1;
+            tac_pt_def(c, dst, tac_loc_int(r, &k) ? tac_loc_shift(l, k) : tac_loc_int(l, &k) ? tac_loc_shift(r, k) : tac_loc_any);
+            return 1;
+        }
+        case TAC_SUB: {
+            tac_loc l = tac_pt_of(c, frame, lhs), r = tac_pt_of(c, frame, rhs);
+            if (l.base == TAC_LOC_NONE || r.base == TAC_LOC_NONE) return 1;
+            tac_pt_def(c, dst, tac_loc_int(r, &k) ? tac_loc_shift(l, -k) : tac_loc_any);
+            return 1;
+        }
+        case TAC_COPY: {
+            tac_loc l = tac_pt_of(c, frame, lhs);
+            if (l.base != TAC_LOC_NONE) tac_pt_def(c, dst, l);
+            return 1;
+        }
+        case TAC_LOAD:
+            tac_pt_def(c, dst, tac_pt_read(c, frame, c->tp.tp));
+            return 1;
+        case TAC_STORE: case TAC_SET: {
+            tac_loc v = tac_pt_of(c, frame, op == TAC_STORE ? lhs : rhs);
+            tac_pt_write(c, frame, c->tp.tp, v.base == TAC_LOC_NONE ? tac_loc_any : v);
+            return 1;
+        }
+        case TAC_MOVE: case TAC_OFFSET:
+            /* the interpreter moves tp for offset too */
+            c->tp.tp = tac_loc_shift(c->tp.tp, imm);
+            if (op == TAC_OFFSET) tac_pt_def(c, dst, c->tp.tp);
+            return 1;
+        case TAC_DEREF: {
+            tac_loc to = tac_pt_read(c, frame, c->tp.tp);
+            if (c->tp.depth >= 0 && c->tp.depth < TAC_PT_DEPTH) c->tp.saved[c->tp.depth++] = c->tp.tp;
+            else c->tp.depth = -1;
+            c->tp.tp = to;
+            tac_pt_def(c, dst, c->tp.tp);
+            return 1;
+        }
+        case TAC_REFER:
+            if (c->tp.depth > 0) c->tp.tp = c->tp.saved[--c->tp.depth];
+            else tac_pt_lose_tp(c);
+            tac_pt_def(c, dst, c->tp.tp);
+            return 1;
+        case TAC_INDEX:
+            if (tac_loc_int(tac_pt_read(c, frame, c->tp.tp), &k)) c->tp.tp = tac_loc_shift(c->tp.tp, k);
+            else if (c->tp.tp.base != TAC_LOC_ANY) c->tp.tp.off = TAC_OFF_ANY;
+            tac_pt_def(c, dst, c->tp.tp);
+            return 1;
+        case TAC_CALL: {
+            int g = rhs >= 0 && rhs < 256 ? a->callee[rhs] : -1;
+            tac_pt_def(c, dst, tac_loc_any);
+            if (g >= 0) return tac_pt_call(c, frame, g);
+            c->ncells = 0;
+            tac_pt_lose_tp(c);
+            tac_pt_mod(c, frame, tac_loc_any, -1);
+            return 1;
+        }
+        case TAC_RET:
+            tac_pt_return(c, frame);
+            return 0;
+        case TAC_JMP:
+            tac_pt_merge(c, (int)imm);
+            return 0;
+        case TAC_JZ: case TAC_JNZ:
+            tac_pt_merge(c, (int)imm);
+            return 1;
+        default: {
+            unsigned f = tac_temp_fields(op);
+            if (f & TAC_F_DST) tac_pt_def(c, dst, tac_loc_any);
+            if (f & TAC_F_RHS_DEF) tac_pt_def(c, rhs, tac_loc_any);
+            return 1;
+        }
+    }
+}
+
+/* walk from instruction i (a label or a frame entry) to the end of its block */
+static inline void tac_pt_walk(tac_pt_ctx *c, size_t i) {
+    tac_prog *t = &c->s->prog;
+    for (;;) {
+        if (!tac_pt_step(c, i)) return;
+        int j = c->next[i];
+        if (j < 0) {
+            if (c->a->owner[i]) tac_pt_return(c, c->a->owner[i]);
+            return;
+        }
+        if (tac_op(t, (size_t)j) == TAC_LABEL) {
+            tac_pt_merge(c, (int)tac_imm(t, (size_t)j));
+            return;
+        }
+        i = (size_t)j;
+    }
+}
+
+static inline void tac_pt_enter(tac_pt_ctx *c, size_t i, int frame) {
+    tac_prog *t = &c->s->prog;
+    c->ncells = 0;
+    c->tp = (tac_pt_tp){ .tp = { tac_pt_home(frame), 0 }, .depth = 0 };
+    if (tac_op(t, i) == TAC_LABEL) tac_pt_merge(c, (int)tac_imm(t, i));
+    else tac_pt_walk(c, i);
+}
+
+/*
+ * Compute the points-to sets of the program (see above) into s->alias,
+ * replacing any earlier result. The result comes from the program's arena;
+ * the walk's scratch is malloc'd and freed before returning, since the pass
+ * reruns. Returns the number of tape accesses at a known cell.
+ */
+static inline int tac_points_to(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    tac_alias *a = &s->alias;
+    size_t n = t->count;
+    int nt = s->next_temp, nframes = s->nfuncs + 1, nlabels = s->label_counter + 1;
+
+    a->count = n;
+    a->owner = tac_frame_owner(s);
+    a->callee = tac_callee_frames(s);
+    a->at = (tac_loc*)tac_mem_alloc(&t->arena, (n + 1) * sizeof(tac_loc));
+    a->pts = (tac_loc*)tac_mem_alloc(&t->arena, (size_t)(nt + 1) * sizeof(tac_loc));
+    a->mod = (tac_frame_mod*)tac_mem_alloc(&t->arena, (size_t)nframes * sizeof(tac_frame_mod));
+    for (size_t i = 0; i < n; ++i) a->at[i] = tac_loc_none;
+    for (int v = 0; v < nt; ++v) a->pts[v] = tac_loc_none;
+    for (int f = 0; f < nframes; ++f) a->mod[f] = (tac_frame_mod){ .exit = tac_loc_none, .balanced = 1 };
+
+    tac_pt_ctx *c = (tac_pt_ctx*)calloc(1, sizeof(tac_pt_ctx));
+    c->s = s;
+    c->a = a;
+    c->label_at = tac_label_index(s);
+    c->next = (int*)malloc((n + 1) * sizeof(int));
+    int *last = (int*)malloc((size_t)nframes * sizeof(int));
+    for (int f = 0; f < nframes; ++f) last[f] = -1;
+    for (size_t i = 0; i < n; ++i) {
+        int o = a->owner[i];
+        if (last[o] >= 0) c->next[last[o]] = (int)i;
+        last[o] = (int)i;
+        c->next[i] = -1;
+    }
+    free(last);
+    c->grown = (uint8_t*)calloc((size_t)nframes, 1);
+    c->def = (int*)malloc((size_t)(nt + 1) * sizeof(int));
+    for (int v = 0; v < nt; ++v) c->def[v] = -1;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned f = tac_temp_fields(tac_op(t, i));
+        if ((f & TAC_F_DST) && tac_dst(t, i) >= 0 && tac_dst(t, i) < nt) c->def[tac_dst(t, i)] = a->owner[i];
+        if ((f & TAC_F_RHS_DEF) && tac_rhs(t, i) >= 0 && tac_rhs(t, i) < nt) c->def[tac_rhs(t, i)] = a->owner[i];
+    }
+    c->at = (tac_pt_entry*)calloc((size_t)nlabels, sizeof(tac_pt_entry));
+    c->work = (int*)malloc((size_t)nlabels * sizeof(int));
+
+    int top = -1;
+    for (size_t i = 0; i < n && top < 0; ++i) if (a->owner[i] == 0) top = (int)i;
+    do {
+        c->changed = 0;
+        if (top >= 0) tac_pt_enter(c, (size_t)top, 0);
+        for (int f = 0; f < s->nfuncs; ++f) if (s->funcs[f].start < n) tac_pt_enter(c, s->funcs[f].start, f + 1);
+        while (c->nwork) {
+            int l = c->work[--c->nwork];
+            tac_pt_entry *e = &c->at[l];
+            e->queued = 0;
+            c->tp = e->tp;
+            c->ncells = e->ncells;
+            memcpy(c->cell, e->cell, (size_t)e->ncells * sizeof(int32_t));
+            memcpy(c->val, e->val, (size_t)e->ncells * sizeof(tac_loc));
+            if (c->label_at[l] >= 0) tac_pt_walk(c, (size_t)c->label_at[l]);
+        }
+        for (int l = 0; l < nlabels; ++l) {
+            free(c->at[l].cell);
+            free(c->at[l].val);
+        }
+        memset(c->at, 0, (size_t)nlabels * sizeof(tac_pt_entry));
+    } while (c->changed);
+
+    /* temps defined on no path, or only from other frames, address anything */
+    for (int v = 0; v < nt; ++v) if (a->pts[v].base == TAC_LOC_NONE) a->pts[v] = tac_loc_any;
+
+    int known = 0;
+    for (size_t i = 0; i < n; ++i) {
+        word cells;
+        if (tac_tape_access(tac_op(t, i), tac_imm(t, i), &cells) && a->at[i].base != TAC_LOC_ANY &&
+            a->at[i].base != TAC_LOC_NONE && a->at[i].off != TAC_OFF_ANY) known++;
+    }
+    free(c->label_at);
+    free(c->next);
+    free(c->grown);
+    free(c->def);
+    free(c->at);
+    free(c->work);
+    free(c);
+    return known;
+}
+
+/* --- queries; i and j are instruction indices of the analysed program --- */
+
+/* may the tape cells instructions i and j access overlap? */
+static inline int tac_may_alias(const tac_backend_state *s, size_t i, size_t j) {
+    const tac_alias *a = &s->alias;
+    const tac_prog *t = &s->prog;
+    word ni, nj;
+    unsigned mi = tac_tape_access(tac_op(t, i), tac_imm(t, i), &ni);
+    unsigned mj = tac_tape_access(tac_op(t, j), tac_imm(t, j), &nj);
+    if (!mi || !mj) return 0;
+    if ((mi | mj) & TAC_MEM_FAR) return 1;
+    if (a->owner[i] != a->owner[j] && (!tac_alias_shared(a->at[i]) || !tac_alias_shared(a->at[j]))) {
+        return a->at[i].base != TAC_LOC_NONE && a->at[j].base != TAC_LOC_NONE;
+    }
+    return tac_loc_may_alias(a->at[i], ni, a->at[j], nj);
+}
+
+/* do i and j access exactly the same cells, every time both run in one
+   activation of their function? */
+static inline int tac_must_alias(const tac_backend_state *s, size_t i, size_t j) {
+    const tac_alias *a = &s->alias;
+    const tac_prog *t = &s->prog;
+    word ni, nj;
+    unsigned mi = tac_tape_access(tac_op(t, i), tac_imm(t, i), &ni);
+    unsigned mj = tac_tape_access(tac_op(t, j), tac_imm(t, j), &nj);
+    if (!mi || !mj || ((mi | mj) & TAC_MEM_FAR) || ni != nj || ni <= 0) return 0;
+    if (a->owner[i] != a->owner[j] && a->at[i].base != TAC_LOC_ABS) return 0;
+    return (a->at[i].base == TAC_LOC_ABS || a->at[i].base == TAC_LOC_REL) && a->at[i].off != TAC_OFF_ANY &&
+           tac_loc_eq(a->at[i], a->at[j]);
+}
+
+/* may running i change a cell j accesses? i being a call asks its callee */
+static inline int tac_may_clobber(const tac_backend_state *s, size_t i, size_t j) {
+    const tac_alias *a = &s->alias;
+    const tac_prog *t = &s->prog;
+    word ni, nj;
+    unsigned mj = tac_tape_access(tac_op(t, j), tac_imm(t, j), &nj);
+    if (!mj) return 0;
+    if (tac_op(t, i) == TAC_CALL) {
+        int g = tac_rhs(t, i) >= 0 && tac_rhs(t, i) < 256 ? a->callee[tac_rhs(t, i)] : -1;
+        if (g < 0 || a->owner[i] != a->owner[j]) return 1;
+        tac_loc loc[2];
+        word cells[2];
+        int n = tac_mod_at(&a->mod[g], a->at[i], loc, cells);
+        for (int k = 0; k < n; ++k) if (tac_loc_may_alias(loc[k], cells[k], a->at[j], nj)) return 1;
+        return 0;
+    }
+    unsigned mi = tac_tape_access(tac_op(t, i), tac_imm(t, i), &ni);
+    return (mi & (TAC_MEM_WRITE | TAC_MEM_FAR)) && tac_may_alias(s, i, j);
+}
+
+/* the cell the value of `temp` addresses, in the frame defining it */
+static inline tac_loc tac_points_to_of(const tac_backend_state *s, int temp) {
+    return s->alias.pts && temp >= 0 && temp < s->next_temp ? s->alias.pts[temp] : tac_loc_any;
+}
+
+#endif /* TAC_ALIAS_H */
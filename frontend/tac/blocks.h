@@ -0,0 +1,343 @@
+#ifndef TAC_BLOCKS_H
+#define TAC_BLOCKS_H
+
+/*
+ * rrvm/frontend/tac/blocks.h
+ *
+ * Jump threading, block merging and block placement, the last pass before
+ * the dump or the executor. Lowering leaves many blocks that only fall
+ * through or jump: the body label of every while, the jmp over an else
+ * arm to its end label, end labels nothing jumps to. Each is a dispatch
+ * more for the executor. tac_order_blocks:
+ *  - threads jumps: a jmp, jz or jnz to a label that only jumps on goes
+ *    where that jump goes (a jz to a jz on the same temp too), and a jmp
+ *    to a ret becomes that ret;
+ *  - drops code after a jmp or ret that no label makes reachable, jumps to
+ *    the next instruction, and labels nothing jumps to, which merges a
+ *    block into the one falling into it;
+ *  - places blocks: a block nothing falls into moves, with the blocks it
+ *    falls through to up to a jmp or ret, behind a block that jumps to
+ *    it, whose jmp then goes. With a profile, a jz that jumps more often
+ *    than it falls through becomes a jnz to the other side, so its target
+ *    is placed after it instead. Hotter jumps are placed first.
+ * The profile is a run of the program by tac/exec.h, with its output
+ * discarded. Blocks only move within the stretch of one function's code
+ * between function boundaries they were lowered in.
+ *
+ * It runs after tac_assign_slots. Moving code does not change which value
+ * flows where, but the slot pass takes loops to be contiguous.
+ */
+
+#include "alias.h"
+#include "exec.h"
+
+#define TAC_BLOCK_HOPS 8   /* jumps followed when threading one */
+#define TAC_BLOCK_ROUNDS 4 /* cleanups repeated while they find more */
+
+/* a block and its place in the layout */
+typedef struct {
+    size_t start, end;
+    int region;
+    int next, prev; /* in the layout, -1 at either end */
+    int label;      /* label emitted at its start, -1 if none */
+    int invert;     /* its jz becomes a jnz to this label, -1 if not */
+} tac_block;
+
+/* a jump to place behind */
+typedef struct { int from, to; uint64_t weight; int invert; } tac_block_edge;
+
+static inline int tac_block_falls(TacOp op) {
+    return op != TAC_JMP && op != TAC_RET;
+}
+
+/* per instruction: its stretch of code, cut at each function's entry label
+   and end (malloc'd, like the rest of the pass's tables: it reruns) */
+static inline int *tac_block_regions(tac_backend_state *s) {
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    uint8_t *cut = (uint8_t*)calloc(n + 2, 1);
+    int *region = (int*)malloc((n + 1) * sizeof(int));
+    for (int f = 0; f < s->nfuncs; ++f) {
+        if (s->funcs[f].start < n) { cut[s->funcs[f].start] = 1; cut[s->funcs[f].start + 1] = 1; }
+        if (s->funcs[f].end < n) cut[s->funcs[f].end] = 1;
+    }
+    int r = 0;
+    for (size_t i = 0; i < n; ++i) region[i] = r += i && cut[i];
+    region[n] = r + 1;
+    free(cut);
+    return region;
+}
+
+/* the first instruction at or after i that is not a label, n if none in i's region */
+static inline size_t tac_block_skip(const tac_prog *t, const int *region, size_t i) {
+    size_t n = t->count;
+    int r = region[i];
+    while (i < n && region[i] == r && tac_op(t, i) == TAC_LABEL) i++;
+    return i < n && region[i] == r ? i : n;
+}
+
+/* labels that must stay: function entries and call targets (malloc'd) */
+static inline uint8_t *tac_block_kept(tac_backend_state *s) {
+    tac_prog *t = &s->prog;
+    int nl = s->label_counter + 1;
+    uint8_t *keep = (uint8_t*)calloc((size_t)nl, 1);
+    for (int f = 0; f < s->nfuncs; ++f) if (s->funcs[f].label >= 0 && s->funcs[f].label < nl) keep[s->funcs[f].label] = 1;
+    for (size_t k = 0; k < sizeof(s->func_label) / sizeof(s->func_label[0]); ++k) {
+        if (s->func_label[k] >= 0 && s->func_label[k] < nl) keep[s->func_label[k]] = 1;
+    }
+    for (size_t i = 0; i < t->count; ++i) {
+        word l = tac_imm(t, i);
+        if (tac_op(t, i) == TAC_CALL && l >= 0 && l < nl) keep[l] = 1;
+    }
+    return keep;
+}
+
+/* one round of threading and dropping (see above); the number of changes */
+static inline int tac_blocks_clean(tac_backend_state *s) {
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    int nl = s->label_counter + 1;
+    int *label_at = tac_label_index(s);
+    int *region = tac_block_regions(s);
+    uint8_t *keep = tac_block_kept(s);
+    int changes = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        TacOp op = tac_op(t, i);
+        if (op != TAC_JMP && op != TAC_JZ && op != TAC_JNZ) continue;
+        word l = tac_imm(t, i), was = l;
+        for (int hop = 0; hop < TAC_BLOCK_HOPS && l >= 0 && l < nl && label_at[l] >= 0; ++hop) {
+            size_t j = tac_block_skip(t, region, (size_t)label_at[l]);
+            if (j >= n || region[j] != region[i] || j == i) break;
+            TacOp to = tac_op(t, j);
+            if (to == TAC_JMP || (to == op && tac_lhs(t, j) == tac_lhs(t, i))) {
+                l = tac_imm(t, j);
+                continue;
+            }
+            if (op == TAC_JMP && to == TAC_RET) {
+                tac_chunk *c = TAC_AT(t, i);
+                c->op[TAC_SLOT(i)] = TAC_RET;
+                c->dst[TAC_SLOT(i)] = -1;
+                c->lhs[TAC_SLOT(i)] = tac_lhs(t, j);
+                c->imm[TAC_SLOT(i)] = 0;
+                s->blocks.threaded++;
+                changes++;
+            }
+            break;
+        }
+        if (tac_op(t, i) != TAC_RET && l != was) {
+            TAC_AT(t, i)->imm[TAC_SLOT(i)] = l;
+            s->blocks.threaded++;
+            changes++;
+        }
+    }
+
+    int *refs = (int*)calloc((size_t)nl, sizeof(int));
+    uint8_t *drop = (uint8_t*)calloc(n + 1, 1);
+    for (size_t i = 0; i < n; ++i) {
+        TacOp op = tac_op(t, i);
+        word l = tac_imm(t, i);
+        if ((op == TAC_JMP || op == TAC_JZ || op == TAC_JNZ) && l >= 0 && l < nl) refs[l]++;
+    }
+    /* what follows a jmp or ret runs only from a label something jumps to */
+    int live = 1;
+    for (size_t i = 0; i < n; ++i) {
+        TacOp op = tac_op(t, i);
+        word l = tac_imm(t, i);
+        if (i && region[i] != region[i - 1]) live = 1;
+        if (op == TAC_LABEL && l >= 0 && l < nl && (refs[l] || keep[l])) live = 1;
+        if (!live) {
+            drop[i] = 1;
+            s->blocks.dead++;
+            changes++;
+            if ((op == TAC_JMP || op == TAC_JZ || op == TAC_JNZ) && l >= 0 && l < nl) refs[l]--;
+            continue;
+        }
+        if (!tac_block_falls(op)) live = 0;
+    }
+    /* jumps to the next instruction */
+    for (size_t i = 0; i < n; ++i) {
+        TacOp op = tac_op(t, i);
+        word l = tac_imm(t, i);
+        if (drop[i] || (op != TAC_JMP && op != TAC_JZ && op != TAC_JNZ)) continue;
+        size_t j = i + 1;
+        for (; j < n && region[j] == region[i]; ++j) {
+            if (drop[j]) continue;
+            if (tac_op(t, j) != TAC_LABEL || tac_imm(t, j) == l) break;
+        }
+        if (j < n && region[j] == region[i] && tac_op(t, j) == TAC_LABEL && tac_imm(t, j) == l) {
+            drop[i] = 1;
+            refs[l]--;
+            s->blocks.jumps++;
+            changes++;
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        word l = tac_imm(t, i);
+        if (drop[i] || tac_op(t, i) != TAC_LABEL || l < 0 || l >= nl || refs[l] || keep[l]) continue;
+        drop[i] = 1;
+        s->blocks.labels++;
+        changes++;
+    }
+    tac_compact(s, drop);
+    free(label_at);
+    free(region);
+    free(keep);
+    free(refs);
+    free(drop);
+    return changes;
+}
+
+static int tac_block_edge_cmp(const void *pa, const void *pb) {
+    const tac_block_edge *a = (const tac_block_edge*)pa, *b = (const tac_block_edge*)pb;
+    if (a->weight != b->weight) return a->weight < b->weight ? 1 : -1;
+    return a->from - b->from;
+}
+
+/* move blocks behind the jumps to them (see above); the blocks moved */
+static inline int tac_blocks_place(tac_backend_state *s, const uint64_t *count, const uint64_t *taken) {
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    int nl = s->label_counter + 1;
+    if (!n) return 0;
+    int *label_at = tac_label_index(s);
+    int *region = tac_block_regions(s);
+
+    /* blocks start at a run of labels, after a jump or ret and at a region */
+    int *block_of = (int*)malloc((n + 1) * sizeof(int));
+    int nb = 0;
+    for (size_t i = 0; i < n; ++i) {
+        TacOp prev = i ? tac_op(t, i - 1) : TAC_LABEL;
+        int starts = !i || region[i] != region[i - 1] || prev == TAC_JMP || prev == TAC_JZ || prev == TAC_JNZ ||
+                     prev == TAC_RET || (tac_op(t, i) == TAC_LABEL && prev != TAC_LABEL);
+        nb += starts;
+        block_of[i] = nb - 1;
+    }
+    tac_block *b = (tac_block*)malloc((size_t)nb * sizeof(tac_block));
+    for (size_t i = 0; i < n; ++i) {
+        tac_block *B = &b[block_of[i]];
+        if (!i || block_of[i] != block_of[i - 1]) {
+            *B = (tac_block){ .start = i, .region = region[i], .next = block_of[i] + 1 < nb ? block_of[i] + 1 : -1,
+                              .prev = block_of[i] - 1, .label = -1, .invert = -1 };
+        }
+        B->end = i + 1;
+    }
+
+    /* the jumps worth placing: a jmp, and with a profile a jz that mostly jumps */
+    tac_block_edge *edge = (tac_block_edge*)malloc((size_t)nb * sizeof(tac_block_edge));
+    int ne = 0;
+    for (int k = 0; k < nb; ++k) {
+        size_t last = b[k].end - 1;
+        TacOp op = tac_op(t, last);
+        word l = tac_imm(t, last);
+        if ((op != TAC_JMP && op != TAC_JZ) || l < 0 || l >= nl || label_at[l] < 0) continue;
+        int to = block_of[label_at[l]];
+        if (to == k || b[to].region != b[k].region || (to && b[to - 1].region != b[to].region)) continue;
+        if (op == TAC_JMP) {
+            edge[ne++] = (tac_block_edge){ k, to, count ? count[last] : 1, 0 };
+        } else if (count && taken[last] > count[last] - taken[last] && k + 1 < nb && b[k + 1].region == b[k].region) {
+            edge[ne++] = (tac_block_edge){ k, to, taken[last], 1 };
+        }
+    }
+    qsort(edge, (size_t)ne, sizeof(tac_block_edge), tac_block_edge_cmp);
+
+    int moved = 0;
+    for (int e = 0; e < ne; ++e) {
+        int from = edge[e].from, to = edge[e].to, p = b[to].prev;
+        /* nothing may fall into it, and it must not be there already */
+        if (p < 0 || b[p].region != b[to].region || b[from].next == to) continue;
+        if (tac_block_falls(tac_op(t, b[p].end - 1))) continue;
+        if (edge[e].invert && b[from].invert >= 0) continue;
+        /* it and the blocks it falls through to, up to a jmp or ret */
+        int u = to, ok = 1;
+        for (;;) {
+            if (u == from) { ok = 0; break; }
+            if (!tac_block_falls(tac_op(t, b[u].end - 1))) break;
+            u = b[u].next;
+            if (u < 0 || b[u].region != b[to].region) { ok = 0; break; }
+        }
+        if (!ok) continue;
+        if (edge[e].invert) {
+            /* the jz jumps to where it fell through instead */
+            int f = b[from].next;
+            if (f < 0 || f == to) continue;
+            if (tac_op(t, b[f].start) == TAC_LABEL) b[from].invert = (int)tac_imm(t, b[f].start);
+            else if (b[f].label >= 0) b[from].invert = b[f].label;
+            else b[from].invert = b[f].label = tac_new_label(s);
+            s->blocks.inverted++;
+        }
+        int q = b[u].next, after = b[from].next;
+        b[p].next = q;
+        if (q >= 0) b[q].prev = p;
+        b[from].next = to;
+        b[to].prev = from;
+        b[u].next = after;
+        if (after >= 0) b[after].prev = u;
+        moved++;
+    }
+    s->blocks.moved += moved;
+    free(label_at);
+    free(region);
+    free(edge);
+    if (!moved) {
+        free(block_of);
+        free(b);
+        return 0;
+    }
+
+    int extra = 0;
+    for (int k = 0; k < nb; ++k) extra += b[k].label >= 0;
+    tac_instr *out = (tac_instr*)malloc((n + (size_t)extra + 1) * sizeof(tac_instr));
+    size_t *to = (size_t*)malloc((n + 1) * sizeof(size_t));
+    size_t k = 0;
+    for (int x = 0; x >= 0; x = b[x].next) {
+        if (b[x].label >= 0) out[k++] = (tac_instr){ .op = TAC_LABEL, .imm = b[x].label };
+        for (size_t i = b[x].start; i < b[x].end; ++i) {
+            to[i] = k;
+            out[k] = tac_get(t, i);
+            if (i + 1 == b[x].end && b[x].invert >= 0) {
+                out[k].op = TAC_JNZ;
+                out[k].imm = b[x].invert;
+            }
+            k++;
+        }
+    }
+    to[n] = k;
+    tac_rewrite(s, out, k, to);
+    free(out);
+    free(to);
+    free(block_of);
+    free(b);
+    return moved;
+}
+
+/*
+ * Thread jumps, merge and place blocks (see above), placing by a profile
+ * run if `profile` is set; the alias result is recomputed. Returns the
+ * number of instructions the program lost.
+ */
+static inline int tac_order_blocks(VM *vm, int profile) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    for (int r = 0; r < TAC_BLOCK_ROUNDS && tac_blocks_clean(s); ++r) {}
+    const uint64_t *count = NULL, *taken = NULL;
+    if (profile) {
+        FILE *sink = fopen("/dev/null", "w");
+        if (sink) {
+            tac_run_to(vm, 32, sink);
+            fclose(sink);
+            count = s->exec.count;
+            taken = s->exec.taken;
+            s->blocks.profiled = 1;
+            memset(&s->exec, 0, sizeof(s->exec));
+        }
+    }
+    if (tac_blocks_place(s, count, taken)) {
+        for (int r = 0; r < TAC_BLOCK_ROUNDS && tac_blocks_clean(s); ++r) {}
+    }
+    tac_points_to(vm);
+    return (int)(n - t->count);
+}
+
+#endif /* TAC_BLOCKS_H */
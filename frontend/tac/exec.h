@@ -0,0 +1,365 @@
+#ifndef TAC_EXEC_H
+#define TAC_EXEC_H
+
+/*
+ * rrvm/frontend/tac/exec.h
+ *
+ * Run lowered TAC, so that what a pass did to a program can be checked
+ * against the interpreter and measured. A temp holds a value and a type
+ * like a VM stack slot, and arithmetic and prints go through the
+ * interpreter's own handlers on a scratch stack. Results and output
+ * therefore match it bit for bit. The executor has its own tape:
+ *  - deref and refer keep a pointer stack;
+ *  - a call gets a copy of its caller's temps, because a body reads the
+ *    temps that were on the virtual stack where it was lowered;
+ *  - the arena blocks a call allocates go at its ret.
+ * Hash maps, kernels, intrinsics and vectors are not run: the executor
+ * stops at the first one and says so. It also stops at a read of a temp
+ * that was not written on the path taken, rather than use a stale value.
+ *
+ * Every tape cell read or written also goes through a model of a data
+ * cache: TAC_EXEC_LINE-byte lines, set-associative with LRU replacement.
+ * A pass that reorders accesses, like tiling in tac/loops.h, can then
+ * report the misses it saves. The counts land in tac_backend_state.exec,
+ * with how often each instruction ran and each jz or jnz jumped: the
+ * profile tac/blocks.h places blocks by.
+ */
+
+#include "tac.h"
+#include "../interpreter/interpreter.h"
+
+#define TAC_EXEC_LINE 64 /* bytes per cache line */
+#define TAC_EXEC_WAYS 8
+
+typedef struct {
+    int64_t *tag;   /* per set and way: the line it holds, -1 if none */
+    uint64_t *used; /* per set and way: when it was last touched */
+    size_t sets;
+    int ways;
+    uint64_t clock;
+} tac_cache;
+
+static inline void tac_cache_init(tac_cache *c, int kb, int ways) {
+    size_t lines = (size_t)kb * 1024 / TAC_EXEC_LINE;
+    c->ways = ways;
+    c->sets = lines / (size_t)ways ? lines / (size_t)ways : 1;
+    c->tag = (int64_t*)malloc(c->sets * (size_t)ways * sizeof(int64_t));
+    c->used = (uint64_t*)calloc(c->sets * (size_t)ways, sizeof(uint64_t));
+    for (size_t k = 0; k < c->sets * (size_t)ways; ++k) c->tag[k] = -1;
+    c->clock = 0;
+}
+
+/* touch the line holding cell; 1 on a miss */
+static inline int tac_cache_touch(tac_cache *c, size_t cell) {
+    int64_t line = (int64_t)(cell * sizeof(word) / TAC_EXEC_LINE);
+    size_t base = (size_t)line % c->sets * (size_t)c->ways;
+    int64_t *tag = c->tag + base;
+    uint64_t *used = c->used + base;
+    int victim = 0;
+    for (int w = 0; w < c->ways; ++w) {
+        if (tag[w] == line) { used[w] = ++c->clock; return 0; }
+        if (used[w] < used[victim]) victim = w;
+    }
+    tag[victim] = line;
+    used[victim] = ++c->clock;
+    return 1;
+}
+
+/* a caller's temps and where to go back to */
+typedef struct {
+    size_t ret;
+    int dst, func, arena_top;
+    word *val;
+    uint8_t *type, *set;
+} tac_exec_frame;
+
+/* push the operands on the scratch stack, run the handler, pop the result */
+static inline void tac_exec_op(VM *sv, void (*fn)(VM*), int nops, const word *v, const uint8_t *ty, word *r,
+                               uint8_t *rt) {
+    for (int k = 0; k < nops; ++k) interp_push(sv, ty[k], v[k]);
+    fn(sv);
+    *rt = (uint8_t)sv->types[sv->sp - 1];
+    *r = vm_pop(sv);
+}
+
+static inline void (*tac_exec_handler(TacOp op))(VM*) {
+    switch (op) {
+        case TAC_ADD: return interp_add;
+        case TAC_SUB: return interp_sub;
+        case TAC_MUL: return interp_mul;
+        case TAC_DIV: return interp_div;
+        case TAC_REM: return interp_rem;
+        case TAC_BITAND: return interp_bitand;
+        case TAC_BITOR: return interp_bitor;
+        case TAC_BITXOR: return interp_bitxor;
+        case TAC_LSH: return interp_lsh;
+        case TAC_LRSH: return interp_lrsh;
+        case TAC_ARSH: return interp_arsh;
+        case TAC_OR: return interp_orassign;
+        case TAC_AND: return interp_andassign;
+        case TAC_NOT: return interp_not;
+        case TAC_GEZ: return interp_gez;
+        case TAC_MIN: return interp_min;
+        case TAC_MAX: return interp_max;
+        case TAC_ABS: return interp_abs;
+        case TAC_POPCNT: return interp_popcnt;
+        case TAC_CLZ: return interp_clz;
+        case TAC_CTZ: return interp_ctz;
+        case TAC_BSWAP: return interp_bswap;
+        case TAC_ROTL: return interp_rotl;
+        case TAC_ROTR: return interp_rotr;
+        case TAC_MULHI: return interp_mulhi;
+        default: return NULL;
+    }
+}
+
+/* handlers that take one operand (lhs) */
+static inline int tac_exec_unary(TacOp op) {
+    return op == TAC_NOT || op == TAC_GEZ || op == TAC_ABS || op == TAC_POPCNT || op == TAC_CLZ || op == TAC_CTZ ||
+           op == TAC_BSWAP;
+}
+
+/*
+ * Run the program from its first instruction with a zeroed tape, modelling
+ * a cache_kb KiB cache. Program output goes to out. Returns 0 if it ran
+ * to the end, -1 if it stopped early (s->exec.why says why).
+ */
+static inline int tac_run_to(VM *vm, int cache_kb, FILE *out) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    tac_exec *e = &s->exec;
+    size_t n = t->count;
+    int nt = s->next_temp;
+    int *label_at = tac_label_index(s);
+    int *callee = tac_callee_frames(s);
+    int *fn_at = (int*)malloc((n + 1) * sizeof(int));
+    for (size_t i = 0; i <= n; ++i) fn_at[i] = -1;
+    for (int f = 0; f < s->nfuncs; ++f) {
+        if (s->funcs[f].start < n) fn_at[s->funcs[f].start] = f;
+    }
+
+    VM *sv = (VM*)calloc(1, sizeof(VM));
+    word *tape = (word*)calloc(TAPE_SIZE, sizeof(word));
+    uint8_t *ttype = (uint8_t*)calloc(TAPE_SIZE, 1);
+    int *saved_tp = (int*)malloc(TAPE_SIZE * sizeof(int));
+    tac_exec_frame *frames = (tac_exec_frame*)malloc(CALL_STACK_SIZE * sizeof(tac_exec_frame));
+    word *val = (word*)calloc((size_t)nt + 1, sizeof(word));
+    uint8_t *type = (uint8_t*)calloc((size_t)nt + 1, 1);
+    uint8_t *set = (uint8_t*)calloc((size_t)nt + 1, 1); /* per temp: written yet */
+    tac_cache cache;
+    tac_cache_init(&cache, cache_kb, TAC_EXEC_WAYS);
+    memset(e, 0, sizeof(*e));
+    e->kb = cache_kb;
+    e->ways = TAC_EXEC_WAYS;
+    e->count = (uint64_t*)tac_mem_alloc(&t->arena, (n + 1) * sizeof(uint64_t));
+    e->taken = (uint64_t*)tac_mem_alloc(&t->arena, (n + 1) * sizeof(uint64_t));
+    e->len = n;
+    memset(e->count, 0, (n + 1) * sizeof(uint64_t));
+    memset(e->taken, 0, (n + 1) * sizeof(uint64_t));
+    sv->out = out;
+
+    size_t tp = 0, pc = 0;
+    int nsaved = 0, depth = 0, arena_top = TAPE_SIZE - ARENA_SIZE;
+#define TAC_EXEC_TEMP(x) ((x) >= 0 && (x) < nt)
+#define TAC_EXEC_TOUCH() (e->accesses++, e->misses += (uint64_t)tac_cache_touch(&cache, tp))
+    while (pc < n && !e->why) {
+        /* falling into a body defines it: skip it. Falling off the end of
+           the running one returns without a value */
+        if (fn_at[pc] >= 0) {
+            size_t end = s->funcs[fn_at[pc]].end;
+            pc = end == (size_t)-1 ? n : end;
+            continue;
+        }
+        TacOp op = tac_op(t, pc);
+        if (depth && (pc == s->funcs[frames[depth - 1].func].end)) op = TAC_RET;
+        int dst = tac_dst(t, pc), lhs = tac_lhs(t, pc), rhs = tac_rhs(t, pc);
+        word imm = tac_imm(t, pc);
+        size_t next = pc + 1;
+        e->executed++;
+        e->count[pc]++;
+        void (*fn)(VM*) = tac_exec_handler(op);
+        if (!fn && op > TAC_RET && op != TAC_SELECT && op != TAC_COPY) {
+            e->why = "unsupported instruction";
+            break;
+        }
+        /* a ret's value is optional */
+        unsigned f = op == TAC_RET ? 0 : tac_temp_fields(op);
+        if (((f & TAC_F_DST) && !TAC_EXEC_TEMP(dst)) || ((f & TAC_F_LHS) && !TAC_EXEC_TEMP(lhs)) ||
+            ((f & TAC_F_RHS) && !TAC_EXEC_TEMP(rhs))) {
+            e->why = "temp out of range";
+            break;
+        }
+        /* a value used before the path taken wrote it. A pointer temp that
+           only passes through or is returned (and a set's target) may be
+           unwritten: so is the temp it goes to */
+        unsigned use = op == TAC_SET ? TAC_F_RHS
+                     : fn || op == TAC_STORE || op == TAC_PRINT || op == TAC_PRINTCHAR || op == TAC_JZ ||
+                       op == TAC_JNZ || op == TAC_SELECT ? f : 0;
+        if (((use & TAC_F_LHS) && !set[lhs]) || ((use & TAC_F_RHS) && !set[rhs])) {
+            e->why = "undefined temp";
+            break;
+        }
+        if (f & TAC_F_DST) {
+            set[dst] = op == TAC_COPY || op == TAC_DEREF || op == TAC_REFER || op == TAC_OFFSET ? set[lhs]
+                     : op == TAC_INDEX ? set[rhs] : 1;
+        }
+        if (fn) {
+            int unary = tac_exec_unary(op);
+            word v[2] = { val[lhs], unary ? 0 : val[rhs] };
+            uint8_t ty[2] = { type[lhs], unary ? 0 : type[rhs] };
+            tac_exec_op(sv, fn, unary ? 1 : 2, v, ty, &val[dst], &type[dst]);
+            pc = next;
+            continue;
+        }
+        switch (op) {
+            case TAC_CONST:
+                val[dst] = imm;
+                type[dst] = (uint8_t)tac_dst_type(t, pc);
+                break;
+            case TAC_LOAD:
+                TAC_EXEC_TOUCH();
+                val[dst] = tape[tp];
+                type[dst] = ttype[tp];
+                break;
+            case TAC_STORE:
+                TAC_EXEC_TOUCH();
+                tape[tp] = val[lhs];
+                ttype[tp] = type[lhs];
+                break;
+            case TAC_SELECT:
+                if (!TAC_EXEC_TEMP(imm)) { e->why = "temp out of range"; break; }
+                if (!set[imm]) { e->why = "undefined temp"; break; }
+                val[dst] = choose_impl(val[lhs], val[rhs], val[imm]);
+                type[dst] = (uint8_t)choose_impl(val[lhs], type[rhs], type[imm]);
+                break;
+            case TAC_COPY:
+                val[dst] = val[lhs];
+                type[dst] = type[lhs];
+                break;
+            case TAC_SET:
+                TAC_EXEC_TOUCH();
+                tape[tp] = val[rhs];
+                ttype[tp] = type[rhs];
+                break;
+            case TAC_MOVE: case TAC_OFFSET: case TAC_INDEX: {
+                word by = imm;
+                if (op == TAC_INDEX) { TAC_EXEC_TOUCH(); by = tape[tp]; }
+                if (by < -(word)tp || by >= (word)(TAPE_SIZE - tp)) { e->why = "tape pointer out of range"; break; }
+                tp = (size_t)((word)tp + by);
+                /* the pointer temp passes through, as the VM's stack keeps it */
+                int from = op == TAC_INDEX ? rhs : lhs;
+                if (op != TAC_MOVE) { val[dst] = val[from]; type[dst] = type[from]; }
+                break;
+            }
+            case TAC_DEREF:
+                TAC_EXEC_TOUCH();
+                if (tape[tp] < 0 || tape[tp] >= TAPE_SIZE || nsaved == TAPE_SIZE) { e->why = "deref out of range"; break; }
+                saved_tp[nsaved++] = (int)tp;
+                tp = (size_t)tape[tp];
+                val[dst] = val[lhs];
+                type[dst] = type[lhs];
+                break;
+            case TAC_REFER:
+                if (!nsaved) { e->why = "refer without deref"; break; }
+                tp = (size_t)saved_tp[--nsaved];
+                val[dst] = val[lhs];
+                type[dst] = type[lhs];
+                break;
+            case TAC_WHERE:
+                val[dst] = (word)tp;
+                type[dst] = TYPE_PTR;
+                break;
+            case TAC_ARENA:
+                if (imm < 0 || imm > (word)(TAPE_SIZE - arena_top)) { e->why = "arena exhausted"; break; }
+                val[dst] = arena_top;
+                type[dst] = TYPE_PTR;
+                arena_top += (int)imm;
+                break;
+            case TAC_PRINT: case TAC_PRINTCHAR:
+                interp_push(sv, type[lhs], val[lhs]);
+                if (op == TAC_PRINT) interp_print(sv);
+                else interp_print_char(sv);
+                break;
+            case TAC_LABEL:
+                break;
+            case TAC_JZ: case TAC_JNZ:
+                if ((val[lhs] != 0) == (op == TAC_JZ)) break;
+                e->taken[pc]++;
+                /* fall through */
+            case TAC_JMP:
+                if (imm < 0 || imm > s->label_counter || label_at[imm] < 0) { e->why = "jump to a missing label"; break; }
+                next = (size_t)label_at[imm];
+                break;
+            case TAC_CALL: {
+                int fr = rhs >= 0 && rhs < 256 ? callee[rhs] : -1;
+                if (fr < 1) { e->why = "call to a function without a body"; break; }
+                if (depth == CALL_STACK_SIZE) { e->why = "call stack overflow"; break; }
+                frames[depth++] = (tac_exec_frame){ .ret = next, .dst = dst, .func = fr - 1, .arena_top = arena_top,
+                                                    .val = val, .type = type, .set = set };
+                word *cv = (word*)malloc(((size_t)nt + 1) * sizeof(word));
+                uint8_t *ct = (uint8_t*)malloc((size_t)nt + 1);
+                uint8_t *cs = (uint8_t*)malloc((size_t)nt + 1);
+                memcpy(cv, val, ((size_t)nt + 1) * sizeof(word));
+                memcpy(ct, type, (size_t)nt + 1);
+                memcpy(cs, set, (size_t)nt + 1);
+                val = cv;
+                type = ct;
+                set = cs;
+                next = s->funcs[fr - 1].start + 1;
+                break;
+            }
+            case TAC_RET: {
+                if (!depth) { next = n; break; }
+                /* a body that left nothing returns 0, as interp_return does */
+                int has = pc != s->funcs[frames[depth - 1].func].end && TAC_EXEC_TEMP(lhs);
+                word rv = has ? val[lhs] : 0;
+                uint8_t rt = has ? type[lhs] : TYPE_I64, rs = has ? set[lhs] : 1;
+                tac_exec_frame *c = &frames[--depth];
+                free(val);
+                free(type);
+                free(set);
+                val = c->val;
+                type = c->type;
+                set = c->set;
+                arena_top = c->arena_top;
+                if (TAC_EXEC_TEMP(c->dst)) { val[c->dst] = rv; type[c->dst] = rt; set[c->dst] = rs; }
+                next = c->ret;
+                break;
+            }
+            default:
+                break;
+        }
+        pc = next;
+    }
+#undef TAC_EXEC_TOUCH
+#undef TAC_EXEC_TEMP
+    fflush(out);
+    while (depth > 0) {
+        free(val);
+        free(type);
+        free(set);
+        val = frames[--depth].val;
+        type = frames[depth].type;
+        set = frames[depth].set;
+    }
+    e->ran = 1;
+    free(cache.tag);
+    free(cache.used);
+    free(fn_at);
+    free(label_at);
+    free(val);
+    free(type);
+    free(set);
+    free(frames);
+    free(saved_tp);
+    free(ttype);
+    free(tape);
+    free(sv);
+    return e->why ? -1 : 0;
+}
+
+static inline int tac_run(VM *vm, int cache_kb) {
+    return tac_run_to(vm, cache_kb, stdout);
+}
+
+#endif /* TAC_EXEC_H */
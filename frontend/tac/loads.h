@@ -0,0 +1,94 @@
+#ifndef TAC_LOADS_H
+#define TAC_LOADS_H
+
+/*
+ * rrvm/frontend/tac/loads.h
+ *
+ * Redundant load elimination over lowered TAC, using the points-to result
+ * of tac/alias.h. Within a basic block, a load of a cell that an earlier
+ * load read, or an earlier store wrote, is replaced by that value: uses of
+ * its temp are renamed and the load is removed. The value stays available
+ * until an instruction that may write the cell (a store, a kernel, a call
+ * whose callee's mod set reaches it) runs. A load takes the type of its
+ * cell and a store writes its value's, so the forwarded temp has the type
+ * the load had. Run it before tac_assign_slots: it relies on temps being
+ * single-assignment.
+ */
+
+#include "alias.h"
+
+#define TAC_FWD_MAX 64 /* values kept available at once */
+
+/*
+ * Forward loads (see above); the alias result is recomputed over the
+ * compacted program. Returns the number of loads removed.
+ */
+static inline int tac_forward_loads(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    int nt = s->next_temp;
+    if (!s->alias.at || s->alias.count != n) tac_points_to(vm);
+    const int *owner = s->alias.owner;
+
+    int *repl = (int*)tac_mem_alloc(&t->arena, (size_t)(nt + 1) * sizeof(int));
+    uint8_t *drop = (uint8_t*)tac_mem_alloc(&t->arena, n + 1);
+    for (int v = 0; v < nt; ++v) repl[v] = v;
+    memset(drop, 0, n + 1);
+
+    /* values available at this point of the block: the access that
+       produced them and the temp holding them */
+    size_t from[TAC_FWD_MAX];
+    int val[TAC_FWD_MAX], navail = 0, removed = 0;
+    for (size_t i = 0; i < n; ++i) {
+        TacOp op = tac_op(t, i);
+        word cells;
+        if (op == TAC_LABEL || (i && owner[i] != owner[i - 1])) navail = 0;
+        if (op == TAC_LOAD) {
+            int k = 0;
+            while (k < navail && !tac_must_alias(s, from[k], i)) k++;
+            int dst = tac_dst(t, i);
+            if (k < navail && dst >= 0 && dst < nt) {
+                repl[dst] = val[k];
+                drop[i] = 1;
+                removed++;
+                continue;
+            }
+            if (dst >= 0 && navail < TAC_FWD_MAX) { from[navail] = i; val[navail++] = dst; }
+        } else if (op == TAC_CALL || (tac_tape_access(op, tac_imm(t, i), &cells) & (TAC_MEM_WRITE | TAC_MEM_FAR))) {
+            int k = 0;
+            for (int m = 0; m < navail; ++m) {
+                if (tac_may_clobber(s, i, from[m])) continue;
+                from[k] = from[m];
+                val[k++] = val[m];
+            }
+            navail = k;
+            int v = tac_lhs(t, i);
+            if (op == TAC_STORE && v >= 0 && v < nt && navail < TAC_FWD_MAX) { from[navail] = i; val[navail++] = repl[v]; }
+        }
+        if (op == TAC_JMP || op == TAC_RET) navail = 0;
+    }
+    if (!removed) return 0;
+
+    /* rename the uses of the removed loads' temps */
+    for (size_t i = 0; i < n; ++i) {
+        tac_chunk *c = TAC_AT(t, i);
+        size_t k = TAC_SLOT(i);
+        unsigned f = tac_temp_fields(tac_op(t, i));
+        if ((f & TAC_F_LHS) && c->lhs[k] >= 0 && c->lhs[k] < nt) c->lhs[k] = repl[c->lhs[k]];
+        if ((f & TAC_F_RHS) && c->rhs[k] >= 0 && c->rhs[k] < nt) c->rhs[k] = repl[c->rhs[k]];
+        if ((f & TAC_F_IMM) && !(c->op[k] & TAC_WIDE) && c->imm[k] >= 0 && c->imm[k] < nt) c->imm[k] = repl[c->imm[k]];
+        if (f & TAC_F_ARGS) {
+            for (int a = 0; a < c->rhs[k]; ++a) {
+                int *p = &t->args[c->lhs[k] + a];
+                if (*p >= 0 && *p < nt) *p = repl[*p];
+            }
+        }
+    }
+    tac_compact(s, drop);
+    s->alias.forwarded += removed;
+    tac_points_to(vm);
+    return removed;
+}
+
+#endif /* TAC_LOADS_H */
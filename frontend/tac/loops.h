@@ -0,0 +1,933 @@
+#ifndef TAC_LOOPS_H
+#define TAC_LOOPS_H
+
+/*
+ * rrvm/frontend/tac/loops.h
+ *
+ * Loop fusion and loop tiling over lowered TAC, for the locality of loops
+ * that walk arrays on the tape. Both work on counted loops: a while whose
+ * condition is `cell < bound` (the load; push; sub; gez; not of the
+ * lowering) for a cell at a known place, which is set to a constant just
+ * before the loop and stepped by a constant at the end of its body. A
+ * symbolic walk over a nest of them follows the counters, the temps and the
+ * pointer cells deref reads, giving each tape access an address affine in
+ * the counters; a nest with an access it cannot place is left alone.
+ *
+ *  - tac_fuse_loops merges adjacent top-level counted loops with the same
+ *    trip count into one. The code between them, which may only set up
+ *    cells the first loop does not touch, moves ahead of the first.
+ *  - tac_tile_loops tiles perfect nests of counted loops with constant
+ *    bounds. Every loop but the outermost is cut into tiles of `tile`
+ *    iterations, and the loops over the tiles are unrolled into copies of
+ *    the nest bounded to one tile each, so the outermost loop sweeps a
+ *    tile's worth of the inner ones at a time.
+ *
+ * Legality is proven by enumeration instead of a dependence test:
+ *  - the accesses of the loops are generated in their original order,
+ *    each with the position the new order gives it;
+ *  - every access to a cell must come after the cell's last write in the
+ *    new order, and a write after its last access. Prints count as writes
+ *    to one more cell.
+ * Cells each iteration writes before it reads them (a pointer set up for a
+ * deref, a value parked for later) are private to the iteration and left
+ * out. Both orders end with the same iteration, so such cells end up
+ * holding what they did. The enumeration stops at TAC_LOOP_EVENTS
+ * accesses; a bigger nest is not transformed.
+ */
+
+#include "alias.h"
+
+#define TAC_LOOP_DEPTH 8          /* counters an address may depend on */
+#define TAC_LOOP_CELLS 64         /* cells with a known value during the walk */
+#define TAC_LOOP_EVENTS (1 << 24) /* accesses enumerated to prove one transformation */
+#define TAC_LOOP_COPIES 256       /* copies of a nest tiling may make */
+
+/* c + k[0]*iv0 + k[1]*iv1 ... over the counters of a nest, outermost first */
+typedef struct { int ok; word c; word k[TAC_LOOP_DEPTH]; } tac_aff;
+
+static inline tac_aff tac_aff_const(word c) {
+    tac_aff a;
+    memset(&a, 0, sizeof(a));
+    a.ok = 1;
+    a.c = c;
+    return a;
+}
+
+static inline int tac_aff_is_const(const tac_aff *a) {
+    for (int d = 0; d < TAC_LOOP_DEPTH; ++d) if (a->k[d]) return 0;
+    return a->ok;
+}
+
+/* a + m*b */
+static inline tac_aff tac_aff_add(tac_aff a, tac_aff b, word m) {
+    if (!a.ok || !b.ok) return (tac_aff){ 0 };
+    a.c += m * b.c;
+    for (int d = 0; d < TAC_LOOP_DEPTH; ++d) a.k[d] += m * b.k[d];
+    return a;
+}
+
+static inline word tac_aff_eval(const tac_aff *a, const word *iv) {
+    word v = a->c;
+    for (int d = 0; d < TAC_LOOP_DEPTH; ++d) v += a->k[d] * iv[d];
+    return v;
+}
+
+typedef struct {
+    size_t head, jz, latch; /* the condition's LABEL, its JZ and the JMP back; the body
+                               label is at jz+1, the exit label at latch+1 */
+    int parent;             /* innermost loop around it, -1 at the top */
+    int counted;
+    int32_t cell;           /* the counter's tape cell */
+    size_t init, inc;       /* the STOREs setting it before the loop and stepping it */
+    size_t bound;           /* the SUB comparing it in the condition */
+    word lo, step;
+    word hi;                /* bound: hi, plus the counter of loop hi_loop if >= 0 */
+    int hi_loop;
+} tac_loop;
+
+typedef struct {
+    tac_backend_state *s;
+    int *def;       /* per temp: the instruction defining it, -1 if none */
+    int *inner;     /* per instruction: the innermost loop around it, -1 if none */
+    int *label_at;
+    int ntemps;     /* temps when it was made; later ones are a rewrite's */
+    tac_loop *loop; /* by head */
+    int nloops;
+} tac_loopset;
+
+/* loop l runs instruction i (its condition included) */
+static inline int tac_loop_has(const tac_loopset *ls, int l, size_t i) {
+    return l >= 0 && ls->loop[l].head <= i && i <= ls->loop[l].latch;
+}
+
+static inline int tac_loop_known(tac_loc l) {
+    return l.base == TAC_LOC_ABS && l.off != TAC_OFF_ANY;
+}
+
+static inline word tac_loop_trips(word lo, word hi, word step) {
+    return lo < hi ? (hi - lo + step - 1) / step : 0;
+}
+
+/* is loop l counted? fills in its counter */
+static inline int tac_loop_counted(tac_loopset *ls, int l) {
+    tac_backend_state *s = ls->s;
+    tac_prog *t = &s->prog;
+    const tac_loc *at = s->alias.at;
+    tac_loop *L = &ls->loop[l];
+    if (!tac_loop_known(at[L->head]) || !tac_loc_eq(at[L->head], at[L->latch])) return 0;
+
+    /* the condition: not(gez(sub(load X, bound))) and nothing else with effects */
+    for (size_t i = L->head + 1; i < L->jz; ++i) {
+        TacOp op = tac_op(t, i);
+        if (op != TAC_MOVE && op != TAC_LOAD && op != TAC_CONST && op != TAC_SUB && op != TAC_GEZ && op != TAC_NOT)
+            return 0;
+    }
+    int v = tac_lhs(t, L->jz), d;
+#define TAC_LOOP_DEF(v, want) ((v) >= 0 && (v) < ls->ntemps && (d = ls->def[v]) > (int)L->head && \
+                               (size_t)d < L->jz && tac_op(t, (size_t)d) == (want))
+    if (!TAC_LOOP_DEF(v, TAC_NOT)) return 0;
+    v = tac_lhs(t, (size_t)d);
+    if (!TAC_LOOP_DEF(v, TAC_GEZ)) return 0;
+    v = tac_lhs(t, (size_t)d);
+    if (!TAC_LOOP_DEF(v, TAC_SUB)) return 0;
+    L->bound = (size_t)d;
+    int cv = tac_lhs(t, L->bound), bv = tac_rhs(t, L->bound);
+    if (!TAC_LOOP_DEF(cv, TAC_LOAD) || !tac_loop_known(at[d])) return 0;
+    L->cell = at[d].off;
+    L->hi_loop = -1;
+    if (bv >= 0 && bv < ls->ntemps && ls->def[bv] >= 0 && tac_op(t, (size_t)ls->def[bv]) == TAC_CONST) {
+        L->hi = tac_imm(t, (size_t)ls->def[bv]);
+    } else if (TAC_LOOP_DEF(bv, TAC_LOAD) && tac_loop_known(at[d])) {
+        /* the counter of a loop around */
+        for (int p = L->parent; p >= 0 && L->hi_loop < 0; p = ls->loop[p].parent) {
+            if (ls->loop[p].counted && ls->loop[p].cell == at[d].off) L->hi_loop = p;
+        }
+        if (L->hi_loop < 0) return 0;
+        L->hi = 0;
+    } else {
+        return 0;
+    }
+#undef TAC_LOOP_DEF
+    for (size_t i = L->head + 1; i < L->jz; ++i) {
+        if (tac_op(t, i) != TAC_LOAD) continue;
+        if (at[i].off != L->cell && (L->hi_loop < 0 || at[i].off != ls->loop[L->hi_loop].cell)) return 0;
+    }
+
+    /* the init: a constant stored to the cell in the straight code before it */
+    size_t i = L->head;
+    for (;;) {
+        if (i == 0) return 0;
+        TacOp op = tac_op(t, --i);
+        if (op == TAC_LABEL || op == TAC_JMP || op == TAC_JZ || op == TAC_CALL || op == TAC_RET) return 0;
+        word cells;
+        unsigned acc = tac_tape_access(op, tac_imm(t, i), &cells);
+        if (!(acc & (TAC_MEM_WRITE | TAC_MEM_FAR))) continue;
+        if (op != TAC_STORE || !tac_loop_known(at[i])) return 0;
+        if (at[i].off == L->cell) break;
+    }
+    int iv = tac_lhs(t, i);
+    if (iv < 0 || iv >= ls->ntemps || ls->def[iv] < 0 || tac_op(t, (size_t)ls->def[iv]) != TAC_CONST) return 0;
+    L->init = i;
+    L->lo = tac_imm(t, (size_t)ls->def[iv]);
+
+    /* the step: the one store to the cell in the body, of load + constant, in its
+       last block and followed by no access */
+    L->inc = 0;
+    for (i = L->jz + 2; i < L->latch; ++i) {
+        TacOp op = tac_op(t, i);
+        word cells;
+        unsigned acc = tac_tape_access(op, tac_imm(t, i), &cells);
+        if (op == TAC_LABEL || acc) L->inc = L->inc && op == TAC_LABEL ? (size_t)-1 : L->inc;
+        if (L->inc && L->inc != (size_t)-1 && acc) return 0;
+        if (op != TAC_STORE || ls->inner[i] != l || !tac_loop_known(at[i]) || at[i].off != L->cell) continue;
+        if (L->inc) return 0;
+        L->inc = i;
+    }
+    if (!L->inc || L->inc == (size_t)-1) return 0;
+    int sv = tac_lhs(t, L->inc);
+    int sd = sv >= 0 && sv < ls->ntemps ? ls->def[sv] : -1;
+    if (sd <= (int)L->jz || tac_op(t, (size_t)sd) != TAC_ADD) return 0;
+    int a = tac_lhs(t, (size_t)sd), b = tac_rhs(t, (size_t)sd);
+    int da = a >= 0 && a < ls->ntemps ? ls->def[a] : -1, db = b >= 0 && b < ls->ntemps ? ls->def[b] : -1;
+    if (da < 0 || db < 0) return 0;
+    if (tac_op(t, (size_t)da) == TAC_CONST) { int x = da; da = db; db = x; }
+    if (tac_op(t, (size_t)db) != TAC_CONST || tac_op(t, (size_t)da) != TAC_LOAD || ls->inner[da] != l ||
+        !tac_loop_known(at[da]) || at[da].off != L->cell)
+        return 0;
+    L->step = tac_imm(t, (size_t)db);
+    return L->step > 0;
+}
+
+/* find the loops of the program (from the arena) */
+static inline void tac_find_loops(tac_loopset *ls, VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    int nt = s->next_temp;
+    if (!s->alias.at || s->alias.count != n) tac_points_to(vm);
+    ls->s = s;
+    ls->label_at = tac_label_index(s);
+    ls->ntemps = nt;
+    ls->def = (int*)tac_mem_alloc(&t->arena, (size_t)(nt + 1) * sizeof(int));
+    ls->inner = (int*)tac_mem_alloc(&t->arena, (n + 1) * sizeof(int));
+    for (int v = 0; v < nt; ++v) ls->def[v] = -1;
+    for (size_t i = 0; i < n; ++i) {
+        ls->inner[i] = -1;
+        unsigned f = tac_temp_fields(tac_op(t, i));
+        int dst = tac_dst(t, i);
+        if ((f & TAC_F_DST) && dst >= 0 && dst < nt) ls->def[dst] = (int)i;
+    }
+
+    /* a while is the only backward jump: LABEL c; cond; JZ e; LABEL b; body; JMP c; LABEL e */
+    int cap = 16;
+    ls->loop = (tac_loop*)tac_mem_alloc(&t->arena, (size_t)cap * sizeof(tac_loop));
+    ls->nloops = 0;
+    for (size_t i = 0; i + 1 < n; ++i) {
+        if (tac_op(t, i) != TAC_JMP) continue;
+        word lb = tac_imm(t, i);
+        if (lb < 0 || lb > s->label_counter || ls->label_at[lb] < 0 || (size_t)ls->label_at[lb] >= i) continue;
+        size_t head = (size_t)ls->label_at[lb];
+        if (tac_op(t, i + 1) != TAC_LABEL || s->alias.owner[head] != s->alias.owner[i]) continue;
+        word exit = tac_imm(t, i + 1);
+        size_t jz = head + 1;
+        while (jz < i && !(tac_op(t, jz) == TAC_JZ && tac_imm(t, jz) == exit)) jz++;
+        if (jz >= i || tac_op(t, jz + 1) != TAC_LABEL) continue;
+        if (ls->nloops == cap) {
+            ls->loop = (tac_loop*)tac_mem_grow(&t->arena, ls->loop, (size_t)cap * sizeof(tac_loop),
+                                               (size_t)cap * 2 * sizeof(tac_loop));
+            cap *= 2;
+        }
+        ls->loop[ls->nloops++] = (tac_loop){ .head = head, .jz = jz, .latch = i, .parent = -1 };
+    }
+    /* by head, so that a loop comes before the loops inside it */
+    for (int a = 1; a < ls->nloops; ++a) {
+        tac_loop x = ls->loop[a];
+        int b = a;
+        while (b > 0 && ls->loop[b - 1].head > x.head) { ls->loop[b] = ls->loop[b - 1]; b--; }
+        ls->loop[b] = x;
+    }
+    for (int l = 0; l < ls->nloops; ++l) {
+        tac_loop *L = &ls->loop[l];
+        for (int p = l - 1; p >= 0; --p) {
+            if (ls->loop[p].head < L->head && L->latch < ls->loop[p].latch) { L->parent = p; break; }
+        }
+        for (size_t i = L->head; i <= L->latch + 1; ++i) ls->inner[i] = l;
+    }
+    for (int l = 0; l < ls->nloops; ++l) ls->loop[l].counted = tac_loop_counted(ls, l);
+}
+
+/* --- the walk over a nest --- */
+
+enum { TAC_ACC_DATA, TAC_ACC_COUNTER, TAC_ACC_PRIVATE };
+#define TAC_LOOP_PRINT 8 /* kind of a print: a write to the output */
+
+typedef struct {
+    size_t at;
+    int loop;     /* the innermost loop around it */
+    uint8_t kind; /* TAC_MEM_READ, TAC_MEM_WRITE or TAC_LOOP_PRINT */
+    uint8_t cond; /* under an if of its loop's body */
+    uint8_t role; /* TAC_ACC_* */
+    tac_aff addr;
+} tac_acc;
+
+/* the accesses of the nest under loop `root`, in program order */
+typedef struct {
+    int root;
+    int *depth;       /* per loop: how deep in the nest, -1 outside it */
+    int *first, *end; /* per loop: its accesses from its body on are acc[first .. end) */
+    tac_acc *acc;
+    int nacc, cap;
+    uint8_t *scalar;  /* per cell: accessed at a constant address */
+} tac_nest;
+
+static inline void tac_nest_free(tac_nest *w) {
+    free(w->depth);
+    free(w->first);
+    free(w->end);
+    free(w->acc);
+    free(w->scalar);
+}
+
+/*
+ * Walk the nest under loop root, which must be counted with all the loops
+ * in it, and place its accesses; cells a deref or an index reads must hold
+ * a known pointer. Then give each access its role, privatizing cells to
+ * the iterations of loop `priv`. Returns 0 if the nest is beyond it.
+ */
+static inline int tac_walk_nest(tac_loopset *ls, int root, int priv, tac_nest *w) {
+    tac_backend_state *s = ls->s;
+    tac_prog *t = &s->prog;
+    const tac_loc *at = s->alias.at;
+    int nt = ls->ntemps, ok = 1;
+    const tac_loop *R = &ls->loop[root];
+    memset(w, 0, sizeof(*w));
+    w->root = root;
+    w->depth = (int*)malloc((size_t)ls->nloops * sizeof(int));
+    w->first = (int*)calloc((size_t)ls->nloops, sizeof(int));
+    w->end = (int*)calloc((size_t)ls->nloops, sizeof(int));
+    w->scalar = (uint8_t*)calloc(TAPE_SIZE + 1, 1);
+    for (int l = 0; l < ls->nloops; ++l) {
+        int d = 0, p = l;
+        while (p >= 0 && p != root) { p = ls->loop[p].parent; d++; }
+        w->depth[l] = p == root ? d : -1;
+        if (w->depth[l] >= TAC_LOOP_DEPTH || (w->depth[l] >= 0 && !ls->loop[l].counted)) return 0;
+        if (w->depth[l] > 0 && ls->loop[l].hi_loop >= 0 && w->depth[ls->loop[l].hi_loop] < 0) return 0;
+    }
+
+    tac_aff *val = (tac_aff*)calloc((size_t)nt + 1, sizeof(tac_aff));
+    uint8_t *have = (uint8_t*)calloc((size_t)nt + 1, 1);
+    tac_aff tp = tac_aff_const(0), ptr[TAC_PT_DEPTH];
+    int nptr = 0, ncells = 0, npending = 0;
+    int32_t cell[TAC_LOOP_CELLS];
+    tac_aff cval[TAC_LOOP_CELLS];
+    word pending[32];
+
+    for (size_t i = R->head; i <= R->latch && ok; ++i) {
+        TacOp op = tac_op(t, i);
+        int dst = tac_dst(t, i), lhs = tac_lhs(t, i), rhs = tac_rhs(t, i);
+        word imm = tac_imm(t, i);
+        if (s->alias.owner[i] != s->alias.owner[R->head]) { ok = 0; break; }
+        /* a temp, as this point sees it: one set inside a loop that is over is gone */
+#define TAC_LOOP_TEMP(v) ((v) >= 0 && (v) < nt && have[v] && (ls->inner[ls->def[v]] < 0 || \
+                          !tac_loop_has(ls, ls->inner[ls->def[v]], ls->def[v]) || \
+                          tac_loop_has(ls, ls->inner[ls->def[v]], i)) ? val[v] : \
+                          (v) >= 0 && (v) < nt && ls->def[v] >= 0 && tac_op(t, (size_t)ls->def[v]) == TAC_CONST && \
+                          !have[v] ? tac_aff_const(tac_imm(t, (size_t)ls->def[v])) : (tac_aff){ 0 })
+        int k;
+        tac_aff r = { 0 };
+        switch (op) {
+            case TAC_LABEL: {
+                /* what is known here: where tp is, and the counters of the loops around */
+                if (!tac_loop_known(at[i]) || nptr) { ok = 0; break; }
+                tp = tac_aff_const(at[i].off);
+                ncells = 0;
+                for (int l = 0; l < ls->nloops; ++l) {
+                    if (w->depth[l] < 0 || !tac_loop_has(ls, l, i)) continue;
+                    cell[ncells] = ls->loop[l].cell;
+                    cval[ncells] = tac_aff_const(0);
+                    cval[ncells++].k[w->depth[l]] = 1;
+                }
+                for (k = 0; k < npending && pending[k] != imm; ++k) {}
+                if (k < npending) pending[k] = pending[--npending];
+                break;
+            }
+            case TAC_JMP: case TAC_JZ: {
+                int l = ls->inner[i];
+                if (l >= 0 && w->depth[l] >= 0 && (i == ls->loop[l].latch || i == ls->loop[l].jz)) break;
+                /* an if: forward, within the nest */
+                int to = imm >= 0 && imm <= s->label_counter ? ls->label_at[imm] : -1;
+                if (to <= (int)i || (size_t)to > R->latch || npending == 32) { ok = 0; break; }
+                pending[npending++] = imm;
+                break;
+            }
+            case TAC_CONST:
+                val[dst] = tac_aff_const(imm);
+                have[dst] = 1;
+                break;
+            case TAC_ADD: case TAC_SUB: case TAC_MUL: case TAC_LSH: {
+                tac_aff a = TAC_LOOP_TEMP(lhs), b = TAC_LOOP_TEMP(rhs);
+                if (op == TAC_ADD) r = tac_aff_add(a, b, 1);
+                else if (op == TAC_SUB) r = tac_aff_add(a, b, -1);
+                else if (op == TAC_MUL && tac_aff_is_const(&b)) r = tac_aff_add(tac_aff_const(0), a, b.c);
+                else if (op == TAC_MUL && tac_aff_is_const(&a)) r = tac_aff_add(tac_aff_const(0), b, a.c);
+                else if (op == TAC_LSH && tac_aff_is_const(&b) && b.c >= 0 && b.c < 32)
+                    r = tac_aff_add(tac_aff_const(0), a, (word)1 << b.c);
+                val[dst] = r;
+                have[dst] = 1;
+                break;
+            }
+            case TAC_DIV: case TAC_REM: case TAC_BITAND: case TAC_BITOR: case TAC_BITXOR: case TAC_LRSH:
+            case TAC_ARSH: case TAC_OR: case TAC_AND: case TAC_NOT: case TAC_GEZ:
+                val[dst] = (tac_aff){ 0 };
+                have[dst] = 1;
+                break;
+            case TAC_MOVE:
+                tp.c += imm;
+                break;
+            case TAC_WHERE:
+                val[dst] = tp;
+                have[dst] = 1;
+                break;
+            case TAC_OFFSET: case TAC_REFER:
+                if (op == TAC_OFFSET) tp.c += imm;
+                else if (!nptr) { ok = 0; break; }
+                else tp = ptr[--nptr];
+                val[dst] = TAC_LOOP_TEMP(lhs);
+                have[dst] = 1;
+                break;
+            case TAC_LOAD: case TAC_STORE: case TAC_SET: case TAC_DEREF: case TAC_INDEX:
+            case TAC_PRINT: case TAC_PRINTCHAR: {
+                int print = op == TAC_PRINT || op == TAC_PRINTCHAR;
+                if (!print && !tp.ok) { ok = 0; break; }
+                if (w->nacc == w->cap) {
+                    w->cap = w->cap ? w->cap * 2 : 64;
+                    w->acc = (tac_acc*)realloc(w->acc, (size_t)w->cap * sizeof(tac_acc));
+                }
+                w->acc[w->nacc++] = (tac_acc){ .at = i, .loop = ls->inner[i], .cond = npending > 0,
+                                               .kind = print ? TAC_LOOP_PRINT : op == TAC_STORE || op == TAC_SET ?
+                                                       TAC_MEM_WRITE : TAC_MEM_READ,
+                                               .addr = print ? tac_aff_const(0) : tp };
+                if (print) break;
+                int cst = tac_aff_is_const(&tp);
+                if (cst && (tp.c < 0 || tp.c >= TAPE_SIZE)) { ok = 0; break; }
+                if (cst) w->scalar[tp.c] = 1;
+                for (k = 0; cst && k < ncells && cell[k] != tp.c; ++k) {}
+                tac_aff here = cst && k < ncells ? cval[k] : (tac_aff){ 0 };
+                if (op == TAC_LOAD) {
+                    val[dst] = here;
+                    have[dst] = 1;
+                } else if (op == TAC_STORE || op == TAC_SET) {
+                    tac_aff v = TAC_LOOP_TEMP(op == TAC_STORE ? lhs : rhs);
+                    if (!cst) break;
+                    if (k == ncells && ncells < TAC_LOOP_CELLS) cell[ncells++] = (int32_t)tp.c;
+                    if (k < ncells) cval[k] = v;
+                } else if (op == TAC_DEREF) {
+                    if (!here.ok || nptr == TAC_PT_DEPTH) { ok = 0; break; }
+                    ptr[nptr++] = tp;
+                    tp = here;
+                    val[dst] = TAC_LOOP_TEMP(lhs);
+                    have[dst] = 1;
+                } else {
+                    if (!here.ok) { ok = 0; break; }
+                    tp = tac_aff_add(tp, here, 1);
+                    val[dst] = TAC_LOOP_TEMP(rhs);
+                    have[dst] = 1;
+                }
+                break;
+            }
+            default:
+                ok = 0;
+                break;
+        }
+#undef TAC_LOOP_TEMP
+    }
+    free(val);
+    free(have);
+    if (!ok) return 0;
+
+    /* roles: the counters' own loads and stores, then cells private to priv's iterations */
+    for (int a = 0; a < w->nacc; ++a) {
+        tac_acc *x = &w->acc[a];
+        if (x->kind == TAC_LOOP_PRINT || !tac_aff_is_const(&x->addr)) continue;
+        int counter = 0, own = 0;
+        for (int l = 0; l < ls->nloops; ++l) {
+            const tac_loop *L = &ls->loop[l];
+            if (w->depth[l] < 0 || L->cell != x->addr.c) continue;
+            counter = 1;
+            if (x->kind == TAC_MEM_READ && tac_op(t, x->at) == TAC_LOAD && tac_loop_has(ls, l, x->at)) own = 1;
+            if (x->kind == TAC_MEM_WRITE && (x->at == L->inc || x->at == L->init)) own = 1;
+        }
+        if (counter && !own) return 0;
+        if (counter) x->role = TAC_ACC_COUNTER;
+    }
+    const tac_loop *P = &ls->loop[priv];
+    for (int a = 0; a < w->nacc; ++a) {
+        tac_acc *x = &w->acc[a];
+        if (x->role != TAC_ACC_DATA || x->kind != TAC_MEM_WRITE || !tac_aff_is_const(&x->addr)) continue;
+        int first = 1, inside = 1;
+        for (int b = 0; b < w->nacc; ++b) {
+            const tac_acc *y = &w->acc[b];
+            if (y->role != TAC_ACC_DATA || y->kind == TAC_LOOP_PRINT || !tac_aff_is_const(&y->addr) ||
+                y->addr.c != x->addr.c)
+                continue;
+            if (y->at <= P->jz || y->at >= P->latch) inside = 0;
+            if (b < a) first = 0;
+        }
+        if (!first || !inside || x->loop != priv || x->cond) continue;
+        for (int b = 0; b < w->nacc; ++b) {
+            tac_acc *y = &w->acc[b];
+            if (y->role == TAC_ACC_DATA && y->kind != TAC_LOOP_PRINT && tac_aff_is_const(&y->addr) &&
+                y->addr.c == x->addr.c)
+                y->role = TAC_ACC_PRIVATE;
+        }
+    }
+    for (int l = 0; l < ls->nloops; ++l) {
+        if (w->depth[l] < 0) continue;
+        int a = 0;
+        while (a < w->nacc && w->acc[a].at <= ls->loop[l].jz) a++;
+        w->first[l] = a;
+        while (a < w->nacc && w->acc[a].at < ls->loop[l].latch) a++;
+        w->end[l] = a;
+    }
+    return 1;
+}
+
+/* --- enumeration --- */
+
+enum { TAC_CELL_NONE, TAC_CELL_COUNTER, TAC_CELL_PRIVATE, TAC_CELL_DATA };
+
+/*
+ * The accesses of a nest in their original order, each checked against the
+ * position the new order gives it. A rank orders the new sequence: for
+ * fusion, iteration t of the first loop and then of the second; for tiling,
+ * the tiles of the inner loops, then the outer counter, then the positions
+ * within the tiles.
+ */
+typedef struct {
+    tac_loopset *ls;
+    tac_nest *w;
+    word iv[TAC_LOOP_DEPTH];
+    uint64_t events, seq;
+    uint64_t *last_write, *last_any; /* per cell and the output: ranks, 0 if none */
+    uint8_t *cls;                    /* per cell: how this nest uses it, TAC_CELL_* */
+    int ok;
+    int tiled;                       /* tiling, else fusion */
+    int which;                       /* fusion: the first loop or the second */
+    int reset;                       /* depth whose iterations restart seq */
+    /* tiling: the nest's depth, trip counts and first counter values, the tile
+       counts and accesses per innermost iteration */
+    int d;
+    word n[TAC_LOOP_DEPTH], lo[TAC_LOOP_DEPTH], nt[TAC_LOOP_DEPTH], tile;
+    uint64_t per;
+} tac_enum;
+
+static inline uint64_t tac_enum_rank(const tac_enum *e) {
+    const tac_loop *R = &e->ls->loop[e->w->root];
+    if (!e->tiled) {
+        uint64_t it = (uint64_t)((e->iv[0] - R->lo) / R->step);
+        return ((it * 2 + (uint64_t)e->which) << 32) + e->seq;
+    }
+    uint64_t key = 0;
+    for (int m = 1; m < e->d; ++m) key = key * (uint64_t)e->nt[m] + (uint64_t)((e->iv[m] - e->lo[m]) / e->tile);
+    key = key * (uint64_t)e->n[0] + (uint64_t)((e->iv[0] - e->lo[0]) / R->step);
+    for (int m = 1; m < e->d; ++m) key = key * (uint64_t)e->tile + (uint64_t)((e->iv[m] - e->lo[m]) % e->tile);
+    return key * e->per + e->seq;
+}
+
+static inline void tac_enum_access(tac_enum *e, const tac_acc *x) {
+    word c = TAPE_SIZE;
+    if (x->kind != TAC_LOOP_PRINT) {
+        c = tac_aff_eval(&x->addr, e->iv);
+        /* an array access may not reach a cell the walk kept a value for */
+        if (c < 0 || c >= TAPE_SIZE || (!tac_aff_is_const(&x->addr) && e->w->scalar[c])) { e->ok = 0; return; }
+    }
+    uint8_t cls = x->role == TAC_ACC_COUNTER ? TAC_CELL_COUNTER : x->role == TAC_ACC_PRIVATE ? TAC_CELL_PRIVATE :
+                  TAC_CELL_DATA;
+    if (e->cls[c] && e->cls[c] != cls) { e->ok = 0; return; }
+    e->cls[c] = cls;
+    if (x->role != TAC_ACC_DATA) return;
+    if (++e->events > TAC_LOOP_EVENTS) { e->ok = 0; return; }
+    e->seq++;
+    uint64_t rank = tac_enum_rank(e);
+    if (x->kind == TAC_MEM_READ) {
+        if (rank < e->last_write[c]) { e->ok = 0; return; }
+    } else {
+        if (rank < e->last_any[c]) { e->ok = 0; return; }
+        if (rank > e->last_write[c]) e->last_write[c] = rank;
+    }
+    if (rank > e->last_any[c]) e->last_any[c] = rank;
+}
+
+static inline void tac_enum_loop(tac_enum *e, int l) {
+    const tac_loop *L = &e->ls->loop[l];
+    const tac_nest *w = e->w;
+    int d = w->depth[l];
+    word hi = L->hi + (L->hi_loop >= 0 ? e->iv[w->depth[L->hi_loop]] : 0);
+    for (word v = L->lo; v < hi && e->ok; v += L->step) {
+        e->iv[d] = v;
+        if (d == e->reset) e->seq = 0;
+        if (++e->events > TAC_LOOP_EVENTS) { e->ok = 0; return; }
+        for (int a = w->first[l]; a < w->end[l] && e->ok; ) {
+            const tac_acc *x = &w->acc[a];
+            if (x->loop == l) { tac_enum_access(e, x); a++; continue; }
+            /* the loop inside this one that holds it */
+            int c = x->loop;
+            while (c >= 0 && e->ls->loop[c].parent != l) c = e->ls->loop[c].parent;
+            if (c < 0) { e->ok = 0; return; }
+            /* its condition reads the counter; the rest is its body */
+            for (int b = a; b < w->first[c]; ++b) tac_enum_access(e, &w->acc[b]);
+            tac_enum_loop(e, c);
+            a = w->end[c];
+            while (a < w->end[l] && w->acc[a].at <= e->ls->loop[c].latch) a++;
+        }
+    }
+}
+
+static inline void tac_enum_init(tac_enum *e, tac_loopset *ls, tac_nest *w, uint64_t *last_write,
+                                 uint64_t *last_any, uint8_t *cls) {
+    memset(e, 0, sizeof(*e));
+    e->ls = ls;
+    e->w = w;
+    e->last_write = last_write;
+    e->last_any = last_any;
+    e->cls = cls;
+    e->ok = 1;
+}
+
+/* --- fusion --- */
+
+/* is the code between two loops [from, to) only moving tp and setting cells?
+   marks the cells it touches in use */
+static inline int tac_loop_between(tac_loopset *ls, size_t from, size_t to, uint8_t *use) {
+    tac_prog *t = &ls->s->prog;
+    const tac_loc *at = ls->s->alias.at;
+    for (size_t i = from; i < to; ++i) {
+        TacOp op = tac_op(t, i);
+        if (ls->s->alias.owner[i]) return 0;
+        switch (op) {
+            case TAC_CONST: case TAC_MOVE: case TAC_ADD: case TAC_SUB: case TAC_MUL: case TAC_NOT: case TAC_GEZ:
+                break;
+            case TAC_LOAD: case TAC_STORE:
+                if (!tac_loop_known(at[i]) || at[i].off < 0 || at[i].off >= TAPE_SIZE) return 0;
+                use[at[i].off] |= op == TAC_STORE ? TAC_MEM_WRITE : TAC_MEM_READ;
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/* how many jumps go to each label (from the arena) */
+static inline int *tac_loop_refs(tac_backend_state *s) {
+    int *refs = (int*)tac_mem_alloc(&s->prog.arena, (size_t)(s->label_counter + 1) * sizeof(int));
+    memset(refs, 0, (size_t)(s->label_counter + 1) * sizeof(int));
+    for (size_t i = 0; i < s->prog.count; ++i) {
+        TacOp op = tac_op(&s->prog, i);
+        word l = tac_imm(&s->prog, i);
+        if ((op == TAC_JMP || op == TAC_JZ) && l >= 0 && l <= s->label_counter) refs[l]++;
+    }
+    return refs;
+}
+
+static inline void tac_loop_move(tac_instr *out, size_t *n, word by) {
+    if (by) out[(*n)++] = (tac_instr){ .op = TAC_MOVE, .dst = -1, .lhs = -1, .rhs = -1, .imm = by };
+}
+
+/* try to fuse loop b into loop a, the one before it */
+static inline int tac_fuse_pair(tac_loopset *ls, int a, int b) {
+    tac_backend_state *s = ls->s;
+    tac_prog *t = &s->prog;
+    const tac_loc *at = s->alias.at;
+    const tac_loop *A = &ls->loop[a], *B = &ls->loop[b];
+    size_t n = t->count;
+    if (!A->counted || !B->counted || A->hi_loop >= 0 || B->hi_loop >= 0 || s->alias.owner[A->head]) return 0;
+    word trips = tac_loop_trips(A->lo, A->hi, A->step);
+    if (!trips || trips != tac_loop_trips(B->lo, B->hi, B->step)) return 0;
+    int same = A->cell == B->cell;
+    if (same && (A->lo != B->lo || A->step != B->step)) return 0;
+    int *refs = tac_loop_refs(s);
+    if (refs[tac_imm(t, B->head)] != 1 || refs[tac_imm(t, B->latch + 1)] != 1 || refs[tac_imm(t, B->jz + 1)])
+        return 0;
+
+    int ok = 0;
+    uint8_t *between = (uint8_t*)calloc(TAPE_SIZE + 1, 1);
+    uint8_t *cls[2] = { (uint8_t*)calloc(TAPE_SIZE + 1, 1), (uint8_t*)calloc(TAPE_SIZE + 1, 1) };
+    uint64_t *last_write = (uint64_t*)calloc(TAPE_SIZE + 1, sizeof(uint64_t));
+    uint64_t *last_any = (uint64_t*)calloc(TAPE_SIZE + 1, sizeof(uint64_t));
+    tac_nest w[2];
+    int walked = 0;
+    if (!tac_loop_between(ls, A->latch + 2, B->head, between)) goto done;
+    if (!tac_walk_nest(ls, a, a, &w[0])) { walked = 1; goto done; }
+    walked = 1;
+    if (!tac_walk_nest(ls, b, b, &w[1])) { walked = 2; goto done; }
+    walked = 2;
+    for (int k = 0; k < 2; ++k) {
+        tac_enum e;
+        tac_enum_init(&e, ls, &w[k], last_write, last_any, cls[k]);
+        e.which = k;
+        tac_enum_loop(&e, k ? b : a);
+        if (!e.ok) goto done;
+    }
+    /* what one loop keeps to itself the other may not touch; the counters
+       of the loops inside them are set before each use */
+    for (word c = 0; c <= TAPE_SIZE; ++c) {
+        uint8_t x = cls[0][c], y = cls[1][c];
+        if (x && y && x != y) goto done;
+        if (x == TAC_CELL_COUNTER && y == TAC_CELL_COUNTER && (c == A->cell || c == B->cell) && !same) goto done;
+        if (x && between[c] && !(same && c == A->cell && between[c] == TAC_MEM_WRITE)) goto done;
+    }
+    if (!same && (cls[0][B->cell] || cls[1][A->cell])) goto done;
+    if (same && (tac_lhs(t, B->init) < 0 || B->init <= A->latch)) goto done;
+    ok = 1;
+done:
+    free(between);
+    free(cls[0]);
+    free(cls[1]);
+    free(last_write);
+    free(last_any);
+    for (int k = 0; k < walked; ++k) tac_nest_free(&w[k]);
+    if (!ok) return 0;
+
+    /* LABEL ca; cond a; JZ ea; LABEL ba; body a; body b; JMP ca; LABEL ea, with the code
+       between them first. Moves bridge where tp was for each piece */
+    tac_instr *out = (tac_instr*)malloc((n + 8) * sizeof(tac_instr));
+    size_t *to = (size_t*)malloc((n + 1) * sizeof(size_t));
+    size_t k = 0;
+    word ta = at[A->head].off, tb = at[B->head].off;
+    for (size_t i = 0; i < A->head; ++i) { to[i] = k; out[k++] = tac_get(t, i); }
+    tac_loop_move(out, &k, at[A->latch + 1].off - ta);
+    for (size_t i = A->latch + 2; i < B->head; ++i) {
+        to[i] = k;
+        if (same && i == B->init) continue; /* the counter already starts there */
+        out[k++] = tac_get(t, i);
+    }
+    tac_loop_move(out, &k, ta - tb);
+    for (size_t i = A->head; i < A->latch; ++i) {
+        to[i] = k;
+        if (same && i == A->inc) continue; /* b steps it */
+        out[k++] = tac_get(t, i);
+    }
+    tac_loop_move(out, &k, at[B->jz + 1].off - ta);
+    for (size_t i = B->head; i <= B->jz + 1; ++i) to[i] = k;
+    for (size_t i = B->jz + 2; i < B->latch; ++i) { to[i] = k; out[k++] = tac_get(t, i); }
+    tac_loop_move(out, &k, ta - tb);
+    to[A->latch] = to[B->latch] = k;
+    out[k++] = tac_get(t, A->latch);
+    to[A->latch + 1] = k;
+    out[k++] = tac_get(t, A->latch + 1);
+    tac_loop_move(out, &k, at[B->latch + 1].off - at[A->latch + 1].off);
+    to[B->latch + 1] = k;
+    for (size_t i = B->latch + 2; i < n; ++i) { to[i] = k; out[k++] = tac_get(t, i); }
+    to[n] = k;
+    tac_rewrite(s, out, k, to);
+    free(out);
+    free(to);
+    return 1;
+}
+
+/*
+ * Fuse adjacent top-level counted loops (see above), repeatedly, so a run
+ * of them becomes one. The alias result is recomputed. Returns the number
+ * of loops merged away.
+ */
+static inline int tac_fuse_loops(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    int fused = 0, again = 1;
+    while (again) {
+        again = 0;
+        tac_loopset ls;
+        tac_find_loops(&ls, vm);
+        if (!s->loops.counted) for (int l = 0; l < ls.nloops; ++l) s->loops.counted += ls.loop[l].counted;
+        for (int a = 0; a + 1 < ls.nloops && !again; ++a) {
+            if (ls.loop[a].parent >= 0) continue;
+            int b = a + 1;
+            while (b < ls.nloops && ls.loop[b].parent >= 0) b++;
+            if (b == ls.nloops) break;
+            /* adjacent: nothing but straight code between them */
+            if (tac_fuse_pair(&ls, a, b)) {
+                fused++;
+                again = 1;
+                tac_points_to(vm);
+            }
+        }
+        free(ls.label_at);
+    }
+    s->loops.fused += fused;
+    return fused;
+}
+
+/* --- tiling --- */
+
+/* copy the nest [head, exit] of chain[0] with fresh temps and labels, the
+   inner loops starting at start[m] and bounded by end[m]; temps from nt on
+   are the copies' own */
+static inline void tac_tile_copy(tac_loopset *ls, const int *chain, int d, const word *start, const word *end,
+                                 int nt, int *temp, tac_instr *out, size_t *k) {
+    tac_backend_state *s = ls->s;
+    tac_prog *t = &s->prog;
+    const tac_loop *R = &ls->loop[chain[0]];
+    int *label = (int*)calloc((size_t)s->label_counter + 1, sizeof(int));
+    for (int v = 0; v < nt; ++v) temp[v] = -1;
+    for (size_t i = R->head; i <= R->latch + 1; ++i) {
+        if (tac_op(t, i) == TAC_LABEL) label[tac_imm(t, i)] = tac_new_label(s);
+    }
+    for (size_t i = R->head; i <= R->latch + 1; ++i) {
+        tac_instr in = tac_get(t, i);
+        unsigned f = tac_temp_fields(in.op);
+        if (in.op == TAC_LABEL || in.op == TAC_JMP || in.op == TAC_JZ) in.imm = label[in.imm];
+        if ((f & TAC_F_LHS) && in.lhs >= 0 && in.lhs < nt && temp[in.lhs] >= 0) in.lhs = temp[in.lhs];
+        if ((f & TAC_F_RHS) && in.rhs >= 0 && in.rhs < nt && temp[in.rhs] >= 0) in.rhs = temp[in.rhs];
+        for (int m = 1; m < d; ++m) {
+            const tac_loop *L = &ls->loop[chain[m]];
+            if (i != L->init && i != L->bound) continue;
+            int from = i == L->init ? in.lhs : in.rhs;
+            int c = tac_new_temp(s, (TypeTag)s->temp_types[from]);
+            out[(*k)++] = (tac_instr){ .op = TAC_CONST, .dst = c, .lhs = -1, .rhs = -1,
+                                       .imm = i == L->init ? start[m] : end[m], .dst_type = s->temp_types[from] };
+            if (i == L->init) in.lhs = c;
+            else in.rhs = c;
+        }
+        if ((f & TAC_F_DST) && in.dst >= 0 && in.dst < nt) {
+            int c = tac_new_temp(s, (TypeTag)s->temp_types[in.dst]);
+            temp[in.dst] = c;
+            in.dst = c;
+        }
+        out[(*k)++] = in;
+    }
+    free(label);
+}
+
+/* try to tile the nest under top-level loop r */
+static inline int tac_tile_nest(tac_loopset *ls, int r, int tile) {
+    tac_backend_state *s = ls->s;
+    tac_prog *t = &s->prog;
+    const tac_loc *at = s->alias.at;
+    size_t n = t->count;
+    int chain[TAC_LOOP_DEPTH], d = 0;
+    word lo[TAC_LOOP_DEPTH], trips[TAC_LOOP_DEPTH], tiles[TAC_LOOP_DEPTH];
+    if (s->alias.owner[ls->loop[r].head]) return 0;
+
+    /* the loops of a perfect nest, each the only one in the one before */
+    for (int l = r; l >= 0; ) {
+        const tac_loop *L = &ls->loop[l];
+        if (d == TAC_LOOP_DEPTH || !L->counted || L->hi_loop >= 0 || (d && L->step != 1)) return 0;
+        chain[d] = l;
+        lo[d] = L->lo;
+        trips[d] = tac_loop_trips(L->lo, L->hi, L->step);
+        if (!trips[d]) return 0;
+        tiles[d] = (trips[d] + tile - 1) / tile;
+        d++;
+        int child = -1;
+        for (int c = l + 1; c < ls->nloops && ls->loop[c].head < L->latch; ++c) {
+            if (ls->loop[c].parent != l) continue;
+            if (child >= 0) return 0;
+            child = c;
+        }
+        l = child;
+    }
+    if (d < 2) return 0;
+    word copies = 1;
+    for (int m = 1; m < d; ++m) {
+        copies *= tiles[m];
+        if (copies > TAC_LOOP_COPIES) return 0;
+    }
+    if (copies == 1) return 0;
+
+    int inner = chain[d - 1], ok = 0;
+    tac_nest w;
+    if (!tac_walk_nest(ls, r, inner, &w)) { tac_nest_free(&w); return 0; }
+    uint64_t per = 1;
+    for (int a = 0; a < w.nacc; ++a) {
+        if (w.acc[a].role == TAC_ACC_COUNTER) continue;
+        if (w.acc[a].loop != inner) goto done;
+        per++;
+    }
+    uint64_t *last_write = (uint64_t*)calloc(TAPE_SIZE + 1, sizeof(uint64_t));
+    uint64_t *last_any = (uint64_t*)calloc(TAPE_SIZE + 1, sizeof(uint64_t));
+    uint8_t *cls = (uint8_t*)calloc(TAPE_SIZE + 1, 1);
+    tac_enum e;
+    tac_enum_init(&e, ls, &w, last_write, last_any, cls);
+    e.tiled = 1;
+    e.reset = d - 1;
+    e.d = d;
+    e.tile = tile;
+    e.per = per;
+    for (int m = 0; m < d; ++m) { e.n[m] = trips[m]; e.lo[m] = lo[m]; e.nt[m] = tiles[m]; }
+    tac_enum_loop(&e, r);
+    ok = e.ok;
+    free(last_write);
+    free(last_any);
+    free(cls);
+done:
+    tac_nest_free(&w);
+    if (!ok) return 0;
+
+    /* one copy of the nest per tile of the inner loops, the outer counter set
+       again before each but the first */
+    const tac_loop *R = &ls->loop[r];
+    size_t len = R->latch + 2 - R->head;
+    tac_instr *out = (tac_instr*)malloc((n + (size_t)copies * (len + 2 * TAC_LOOP_DEPTH + 6)) * sizeof(tac_instr));
+    size_t *to = (size_t*)malloc((n + 1) * sizeof(size_t));
+    int nt = s->next_temp;
+    int *temp = (int*)malloc(((size_t)nt + 1) * sizeof(int));
+    size_t k = 0;
+    for (size_t i = 0; i < R->head; ++i) { to[i] = k; out[k++] = tac_get(t, i); }
+    for (size_t i = R->head; i <= R->latch + 1; ++i) to[i] = k;
+    word head = at[R->head].off, exit = at[R->latch + 1].off;
+    int init = tac_lhs(t, R->init);
+    word idx[TAC_LOOP_DEPTH] = { 0 };
+    for (word c = 0; c < copies; ++c) {
+        word start[TAC_LOOP_DEPTH], end[TAC_LOOP_DEPTH];
+        for (int m = 1; m < d; ++m) {
+            start[m] = lo[m] + idx[m] * tile;
+            end[m] = idx[m] == tiles[m] - 1 ? ls->loop[chain[m]].hi : start[m] + tile;
+        }
+        if (c) {
+            int v = tac_new_temp(s, (TypeTag)s->temp_types[init]);
+            tac_loop_move(out, &k, R->cell - exit);
+            out[k++] = (tac_instr){ .op = TAC_CONST, .dst = v, .lhs = -1, .rhs = -1, .imm = R->lo,
+                                    .dst_type = s->temp_types[init] };
+            out[k++] = (tac_instr){ .op = TAC_STORE, .dst = -1, .lhs = v, .rhs = 0 };
+            tac_loop_move(out, &k, head - R->cell);
+        }
+        tac_tile_copy(ls, chain, d, start, end, nt, temp, out, &k);
+        for (int m = d - 1; m >= 1; --m) {
+            if (++idx[m] < tiles[m]) break;
+            idx[m] = 0;
+        }
+    }
+    for (size_t i = R->latch + 2; i < n; ++i) { to[i] = k; out[k++] = tac_get(t, i); }
+    to[n] = k;
+    tac_rewrite(s, out, k, to);
+    free(out);
+    free(to);
+    free(temp);
+    return 1;
+}
+
+/*
+ * Tile the perfect nests of counted loops at the top level by `tile`
+ * iterations (see above). The alias result is recomputed. Returns the
+ * number of nests tiled.
+ */
+static inline int tac_tile_loops(VM *vm, int tile) {
+    tac_backend_state *s = tac_state(vm);
+    int tiled = 0;
+    s->loops.tile = tile;
+    if (tile < 1) return 0;
+    tac_loopset ls;
+    tac_find_loops(&ls, vm);
+    if (!s->loops.counted) for (int l = 0; l < ls.nloops; ++l) s->loops.counted += ls.loop[l].counted;
+    /* last first, so the heads of the ones before stay put */
+    for (int r = ls.nloops - 1; r >= 0; --r) {
+        if (ls.loop[r].parent >= 0) continue;
+        tiled += tac_tile_nest(&ls, r, tile);
+    }
+    free(ls.label_at);
+    if (tiled) tac_points_to(vm);
+    s->loops.tiled += tiled;
+    return tiled;
+}
+
+#endif /* TAC_LOOPS_H */
@@ -0,0 +1,95 @@
+#ifndef TAC_MEM_H
+#define TAC_MEM_H
+
+/*
+ * rrvm/frontend/tac/mem.h
+ *
+ * Arena (bump) allocator for one TAC lowering. Everything a tac_prog owns
+ * (the instruction chunks, the immediate and operand pools) and the
+ * backend's per-lowering tables (temp types, vm_ip maps) come from its
+ * arena and go away with one tac_mem_free; nothing is freed individually.
+ * Blocks start small and double, so short lowerings (a single function for
+ * the optimizing JIT) stay cheap; requests larger than a block get a block
+ * of their own.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAC_MEM_MIN_BLOCK ((size_t)16 << 10)
+#define TAC_MEM_MAX_BLOCK ((size_t)1 << 20)
+#define TAC_MEM_ALIGN 16
+
+typedef struct tac_mem_block {
+    struct tac_mem_block *next;
+    size_t used, cap;
+    _Alignas(TAC_MEM_ALIGN) unsigned char data[];
+} tac_mem_block;
+
+typedef struct {
+    tac_mem_block *head; /* current block; older ones follow */
+    size_t next_cap;     /* size of the next regular block */
+    size_t bytes;        /* bytes handed out */
+    size_t reserved;     /* bytes in blocks */
+} tac_mem;
+
+static inline void tac_mem_init(tac_mem *a) {
+    a->head = NULL;
+    a->next_cap = TAC_MEM_MIN_BLOCK;
+    a->bytes = a->reserved = 0;
+}
+
+static inline void *tac_mem_alloc(tac_mem *a, size_t n) {
+    n = (n + TAC_MEM_ALIGN - 1) & ~(size_t)(TAC_MEM_ALIGN - 1);
+    tac_mem_block *b = a->head;
+    if (!b || b->cap - b->used < n) {
+        size_t cap = n > a->next_cap ? n : a->next_cap;
+        b = (tac_mem_block*)malloc(sizeof(tac_mem_block) + cap);
+        assert(b && "tac_mem: out of memory");
+        b->used = 0;
+        b->cap = cap;
+        if (cap == a->next_cap && a->next_cap < TAC_MEM_MAX_BLOCK) a->next_cap *= 2;
+        /* an oversized block is filled at once: keep bumping in the current one */
+        if (a->head && cap > a->next_cap) {
+            b->next = a->head->next;
+            a->head->next = b;
+        } else {
+            b->next = a->head;
+            a->head = b;
+        }
+        a->reserved += cap;
+    }
+    void *p = b->data + b->used;
+    b->used += n;
+    a->bytes += n;
+    return p;
+}
+
+/* resize an allocation; the last one in the current block grows in place */
+static inline void *tac_mem_grow(tac_mem *a, void *old, size_t oldn, size_t n) {
+    oldn = (oldn + TAC_MEM_ALIGN - 1) & ~(size_t)(TAC_MEM_ALIGN - 1);
+    size_t an = (n + TAC_MEM_ALIGN - 1) & ~(size_t)(TAC_MEM_ALIGN - 1);
+    tac_mem_block *b = a->head;
+    if (old && b && (unsigned char*)old + oldn == b->data + b->used && b->cap - b->used >= an - oldn) {
+        b->used += an - oldn;
+        a->bytes += an - oldn;
+        return old;
+    }
+    void *p = tac_mem_alloc(a, n);
+    if (old && oldn) memcpy(p, old, oldn < n ? oldn : n);
+    return p;
+}
+
+static inline void tac_mem_free(tac_mem *a) {
+    tac_mem_block *b = a->head;
+    while (b) {
+        tac_mem_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    tac_mem_init(a);
+}
+
+#endif /* TAC_MEM_H */
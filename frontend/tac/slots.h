@@ -0,0 +1,207 @@
+#ifndef TAC_SLOTS_H
+#define TAC_SLOTS_H
+
+/*
+ * rrvm/frontend/tac/slots.h
+ *
+ * Frame slot assignment for lowered TAC. The lowering gives every value a
+ * fresh temp, so a long program has as many temps as instructions; an
+ * executor with one frame cell per temp would need frames that size.
+ * tac_assign_slots renumbers the temps of each function (and of the top
+ * level) into as few slots as the values live at once need, and rewrites
+ * the program to use slots instead of temps:
+ *  - each temp's live range is the span from its first to its last
+ *    reference, in instruction order within its function;
+ *  - a range that enters or leaves a while loop (the span from the
+ *    condition label to the jmp back to it) is widened to the whole loop,
+ *    innermost loops first, since the value must survive every iteration;
+ *  - a linear scan in order of range start hands each temp a slot that no
+ *    live range holds any more. A slot read by an instruction is not
+ *    reused by that instruction's own results.
+ * Temps referenced from more than one function (values a body takes from
+ * the stack below it) are pinned: they keep slots [0, pinned) in every
+ * frame and no other temp uses those.
+ *
+ * The SSA temp -> slot map stays in tac_backend_state.slots for
+ * debugging, with the size of each frame. After the pass temp numbers in
+ * the program (and in the dump) name slots, and a slot may be assigned
+ * more than once: the program is no longer in SSA form.
+ */
+
+#include "tac.h"
+
+/* run body with `temp` set to each temp instruction i references */
+#define TAC_FOR_TEMPS(t, i, temp, body) do { \
+        unsigned f_ = tac_temp_fields(tac_op(t, i)); \
+        int temp; \
+        if ((f_ & TAC_F_DST) && (temp = tac_dst(t, i)) >= 0) { body; } \
+        if ((f_ & TAC_F_LHS) && (temp = tac_lhs(t, i)) >= 0) { body; } \
+        if ((f_ & (TAC_F_RHS | TAC_F_RHS_DEF)) && (temp = tac_rhs(t, i)) >= 0) { body; } \
+        if ((f_ & TAC_F_IMM) && (temp = (int)tac_imm(t, i)) >= 0) { body; } \
+        if (f_ & TAC_F_ARGS) { \
+            for (int a_ = 0; a_ < tac_rhs(t, i); ++a_) { temp = (t)->args[tac_lhs(t, i) + a_]; { body; } } \
+        } \
+    } while (0)
+
+/* min-heap of temps by range end */
+static inline void tac_heap_push(int *heap, int *n, const int *end, int temp) {
+    int k = (*n)++;
+    while (k > 0 && end[heap[(k - 1) / 2]] > end[temp]) {
+        heap[k] = heap[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    heap[k] = temp;
+}
+
+static inline int tac_heap_pop(int *heap, int *n, const int *end) {
+    int top = heap[0], last = heap[--(*n)], k = 0;
+    for (;;) {
+        int c = 2 * k + 1;
+        if (c >= *n) break;
+        if (c + 1 < *n && end[heap[c + 1]] < end[heap[c]]) c++;
+        if (end[heap[c]] >= end[last]) break;
+        heap[k] = heap[c];
+        k = c;
+    }
+    if (*n) heap[k] = last;
+    return top;
+}
+
+/* the slot map, one "tN -> sM" line per referenced temp */
+static inline void tac_dump_slots(const tac_backend_state *s, FILE *out) {
+    for (int v = 0; v < s->slots.ntemps; ++v) {
+        if (s->slots.slot_of[v] >= 0) fprintf(out, "t%d -> s%d\n", v, s->slots.slot_of[v]);
+    }
+}
+
+/*
+ * Renumber the temps of the lowered program into frame slots (see above).
+ * Scratch space and the result come from the program's arena. Returns the
+ * number of slots of the largest frame; running it twice is a no-op.
+ */
+static inline int tac_assign_slots(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    tac_mem *m = &t->arena;
+    size_t n = t->count;
+    int nt = s->next_temp;
+    if (s->slots.slot_of) {
+        int max = 0;
+        for (int f = 0; f < s->slots.nframes; ++f) if (s->slots.frames[f].slots > max) max = s->slots.frames[f].slots;
+        return max;
+    }
+
+    int *owner = tac_frame_owner(s);
+
+    /* live ranges [start, end] and frames of the temps */
+    int *start = (int*)tac_mem_alloc(m, (size_t)(nt + 1) * sizeof(int));
+    int *end = (int*)tac_mem_alloc(m, (size_t)(nt + 1) * sizeof(int));
+    int *frame = (int*)tac_mem_alloc(m, (size_t)(nt + 1) * sizeof(int));
+    int *slot_of = (int*)tac_mem_alloc(m, (size_t)(nt + 1) * sizeof(int));
+    for (int v = 0; v < nt; ++v) { start[v] = -1; end[v] = -1; frame[v] = -1; slot_of[v] = -1; }
+    for (size_t i = 0; i < n; ++i) {
+        TAC_FOR_TEMPS(t, i, v, {
+            if (v < nt) {
+                if (start[v] < 0) { start[v] = (int)i; frame[v] = owner[i]; }
+                else if (frame[v] != owner[i]) frame[v] = -2; /* pinned */
+                end[v] = (int)i;
+            }
+        });
+    }
+
+    /* loops: a jmp back to a label of the same frame; widen ranges crossing
+       them, smallest loops first so widening carries to the loops around */
+    int *label_at = tac_label_index(s);
+    int nloops = 0;
+    for (size_t j = 0; j < n; ++j) {
+        if (tac_op(t, j) != TAC_JMP) continue;
+        word l = tac_imm(t, j);
+        if (l >= 0 && l <= s->label_counter && label_at[l] >= 0 && (size_t)label_at[l] < j) nloops++;
+    }
+    int *lo = (int*)tac_mem_alloc(m, (size_t)(nloops + 1) * sizeof(int));
+    int *hi = (int*)tac_mem_alloc(m, (size_t)(nloops + 1) * sizeof(int));
+    nloops = 0;
+    for (size_t j = 0; j < n; ++j) {
+        if (tac_op(t, j) != TAC_JMP) continue;
+        word l = tac_imm(t, j);
+        if (l < 0 || l > s->label_counter || label_at[l] < 0 || (size_t)label_at[l] >= j) continue;
+        /* insertion by size */
+        int k = nloops++;
+        while (k > 0 && hi[k - 1] - lo[k - 1] > (int)j - label_at[l]) { lo[k] = lo[k - 1]; hi[k] = hi[k - 1]; k--; }
+        lo[k] = label_at[l];
+        hi[k] = (int)j;
+    }
+    free(label_at);
+    for (int k = 0; k < nloops; ++k) {
+        for (int i = lo[k]; i <= hi[k]; ++i) {
+            if (owner[i] != owner[lo[k]]) continue;
+            TAC_FOR_TEMPS(t, (size_t)i, v, {
+                if (v < nt && (start[v] < lo[k] || end[v] > hi[k])) {
+                    if (start[v] > lo[k]) start[v] = lo[k];
+                    if (end[v] < hi[k]) end[v] = hi[k];
+                }
+            });
+        }
+    }
+
+    /* pinned temps first */
+    int pinned = 0;
+    for (int v = 0; v < nt; ++v) if (frame[v] == -2) slot_of[v] = pinned++;
+
+    /* temps by frame, then by range start (two stable counting sorts) */
+    int nframes = s->nfuncs + 1;
+    int *order = (int*)tac_mem_alloc(m, (size_t)(nt + 1) * sizeof(int));
+    int *tmp = (int*)tac_mem_alloc(m, (size_t)(nt + 1) * sizeof(int));
+    int *cnt = (int*)tac_mem_alloc(m, ((n > (size_t)nframes ? n : (size_t)nframes) + 2) * sizeof(int));
+    int nlocal = 0;
+    memset(cnt, 0, (n + 2) * sizeof(int));
+    for (int v = 0; v < nt; ++v) if (frame[v] >= 0) cnt[start[v] + 1]++;
+    for (size_t i = 0; i < n; ++i) cnt[i + 1] += cnt[i];
+    for (int v = 0; v < nt; ++v) if (frame[v] >= 0) { tmp[cnt[start[v]]++] = v; nlocal++; }
+    memset(cnt, 0, ((size_t)nframes + 2) * sizeof(int));
+    for (int k = 0; k < nlocal; ++k) cnt[frame[tmp[k]] + 1]++;
+    for (int f = 0; f < nframes; ++f) cnt[f + 1] += cnt[f];
+    int *first = (int*)tac_mem_alloc(m, ((size_t)nframes + 1) * sizeof(int));
+    for (int f = 0; f <= nframes; ++f) first[f] = cnt[f];
+    for (int k = 0; k < nlocal; ++k) order[cnt[frame[tmp[k]]]++] = tmp[k];
+
+    /* linear scan per frame */
+    tac_frame *frames = (tac_frame*)tac_mem_alloc(m, (size_t)nframes * sizeof(tac_frame));
+    int *heap = tmp; /* active ranges, reusing the sort scratch */
+    int *free_slots = (int*)tac_mem_alloc(m, (size_t)(nt + 1) * sizeof(int));
+    int largest = pinned;
+    for (int f = 0; f < nframes; ++f) {
+        int nactive = 0, nfree = 0, next = pinned;
+        for (int k = first[f]; k < first[f + 1]; ++k) {
+            int v = order[k];
+            while (nactive && end[heap[0]] < start[v]) free_slots[nfree++] = slot_of[tac_heap_pop(heap, &nactive, end)];
+            slot_of[v] = nfree ? free_slots[--nfree] : next++;
+            tac_heap_push(heap, &nactive, end, v);
+        }
+        frames[f] = (tac_frame){ .label = f ? s->funcs[f - 1].label : -1, .temps = first[f + 1] - first[f], .slots = next };
+        if (next > largest) largest = next;
+    }
+
+    /* rewrite the temps; every args range belongs to one instruction */
+    for (size_t i = 0; i < n; ++i) {
+        tac_chunk *c = TAC_AT(t, i);
+        size_t k = TAC_SLOT(i);
+        unsigned f = tac_temp_fields(tac_op(t, i));
+        if ((f & TAC_F_DST) && c->dst[k] >= 0 && c->dst[k] < nt) c->dst[k] = slot_of[c->dst[k]];
+        if ((f & TAC_F_LHS) && c->lhs[k] >= 0 && c->lhs[k] < nt) c->lhs[k] = slot_of[c->lhs[k]];
+        if ((f & (TAC_F_RHS | TAC_F_RHS_DEF)) && c->rhs[k] >= 0 && c->rhs[k] < nt) c->rhs[k] = slot_of[c->rhs[k]];
+        if ((f & TAC_F_IMM) && !(c->op[k] & TAC_WIDE) && c->imm[k] >= 0 && c->imm[k] < nt) c->imm[k] = slot_of[c->imm[k]];
+        if (f & TAC_F_ARGS) {
+            for (int a = 0; a < c->rhs[k]; ++a) {
+                int *p = &t->args[c->lhs[k] + a];
+                if (*p >= 0 && *p < nt) *p = slot_of[*p];
+            }
+        }
+    }
+
+    s->slots = (tac_slots){ .slot_of = slot_of, .ntemps = nt, .pinned = pinned, .frames = frames, .nframes = nframes };
+    if (TAC_DEBUG) tac_dump_slots(s, stderr);
+    return largest;
+}
+
+#endif /* TAC_SLOTS_H */
@@ -0,0 +1,500 @@
+#ifndef TAC_SPEC_H
+#define TAC_SPEC_H
+
+/*
+ * rrvm/frontend/tac/spec.h
+ *
+ * Interprocedural constant propagation by specialization: a function that a
+ * call passes constants to gets a copy of its body made for those values.
+ * Arguments go on the tape, so a constant argument is a cell that a store
+ * of a constant set, in the block of the call, at a known distance from tp.
+ * It counts if the callee loads that cell relative to where it was entered
+ * and its mod set (tac/alias.h) shows that nothing in the call can write
+ * it.
+ *
+ * The copy has those loads replaced by constants. Arithmetic on constants
+ * is folded through the interpreter's handlers (tac/exec.h), so the values
+ * match it bit for bit. A branch on a constant becomes a jump or goes, and
+ * code that no longer runs or computes unused values is dropped. A copy is
+ * kept only if it comes out at least TAC_SPEC_GAIN instructions shorter
+ * than the original. Together the copies may grow the program by
+ * TAC_SPEC_GROWTH percent (at least TAC_SPEC_BUDGET instructions). Calls
+ * with the same constants share a copy.
+ *
+ * Each copy is a function of its own, with a free VM function index, placed
+ * after its original; the calls are sent to it. It runs before
+ * tac_forward_loads, so the copies go through the rest of the pipeline like
+ * any other function.
+ */
+
+#include "alias.h"
+#include "exec.h"
+
+#define TAC_SPEC_ARGS 8     /* constant cells considered per call */
+#define TAC_SPEC_GAIN 4     /* instructions a copy must save */
+#define TAC_SPEC_GROWTH 50  /* percent the copies may add to the program */
+#define TAC_SPEC_BUDGET 256 /* ... or this many instructions, if more */
+#define TAC_SPEC_COPIES 8   /* copies of one function */
+#define TAC_SPEC_STORES 64  /* constant stores kept track of at once */
+
+/* a constant argument: the cell, relative to the callee's tp on entry */
+typedef struct { int32_t cell; uint8_t type; word value; } tac_spec_arg;
+
+typedef struct {
+    int func;      /* index in funcs of the original */
+    int nargs;
+    tac_spec_arg arg[TAC_SPEC_ARGS];
+    tac_instr *code; /* the body, NULL if it did not pay */
+    size_t len;
+    int label, index;
+} tac_spec_copy;
+
+typedef struct {
+    tac_backend_state *s;
+    VM *sv;          /* scratch stack for folding */
+    int *def;        /* per temp: its one defining instruction, -1 if none, -2 if several */
+    uint8_t *escape; /* per temp: used outside the function defining it */
+    int *label_at;
+    uint8_t *known;  /* per temp, for the body being specialized */
+    word *kval;
+    uint8_t *ktype;
+    int *uses;
+} tac_spec_ctx;
+
+/* a cell of the tape or of the frame's own space, at a known offset */
+static inline int tac_spec_known(tac_loc l) {
+    return (l.base == TAC_LOC_ABS || l.base == TAC_LOC_REL) && l.off != TAC_OFF_ANY;
+}
+
+static inline int tac_spec_const(const tac_spec_ctx *c, int v, word *val, uint8_t *type) {
+    const tac_prog *t = &c->s->prog;
+    if (v < 0 || v >= c->s->next_temp) return 0;
+    if (c->known[v]) { *val = c->kval[v]; *type = c->ktype[v]; return 1; }
+    if (c->def[v] < 0 || tac_op(t, (size_t)c->def[v]) != TAC_CONST) return 0;
+    *val = tac_imm(t, (size_t)c->def[v]);
+    *type = (uint8_t)tac_dst_type(t, (size_t)c->def[v]);
+    return 1;
+}
+
+/* fold op on constants the way the interpreter would; 0 if it would trap or
+   the operands do not fit it */
+static inline int tac_spec_fold(tac_spec_ctx *c, TacOp op, const word *v, const uint8_t *ty, word *r, uint8_t *rt) {
+    void (*fn)(VM*) = tac_exec_handler(op);
+    int unary = tac_exec_unary(op);
+    if (!fn) return 0;
+    if (!unary) {
+        if (ty[0] != ty[1] || ty[0] == TYPE_UNKNOWN || ty[0] == TYPE_V128) return 0;
+        if ((op == TAC_DIV || op == TAC_REM) && (v[1] == 0 || v[1] == -1)) return 0;
+        if ((op == TAC_LSH || op == TAC_LRSH || op == TAC_ARSH) && (v[1] < 0 || v[1] >= WORD_BITS)) return 0;
+    }
+    tac_exec_op(c->sv, fn, unary ? 1 : 2, v, ty, r, rt);
+    return 1;
+}
+
+static inline int tac_spec_pure(TacOp op) {
+    switch (op) {
+        case TAC_CONST: case TAC_LOAD: case TAC_WHERE: case TAC_ADD: case TAC_SUB: case TAC_MUL: case TAC_BITAND:
+        case TAC_BITOR: case TAC_BITXOR: case TAC_LSH: case TAC_LRSH: case TAC_ARSH: case TAC_OR: case TAC_AND:
+        case TAC_NOT: case TAC_GEZ: case TAC_SELECT: case TAC_MIN: case TAC_MAX: case TAC_ABS:
+        case TAC_POPCNT: case TAC_CLZ: case TAC_CTZ: case TAC_BSWAP: case TAC_ROTL: case TAC_ROTR: case TAC_MULHI:
+        case TAC_COPY:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* does the constant in arg reach every load of its cell in frame g? */
+static inline int tac_spec_safe(const tac_backend_state *s, int g, tac_loc call, int32_t cell) {
+    const tac_frame_mod *m = &s->alias.mod[g];
+    if (m->any) return 0;
+    if (m->lo[0] < m->hi[0] && (m->lo[0] == TAC_OFF_ANY || (cell >= m->lo[0] && cell < m->hi[0]))) return 0;
+    if (m->lo[1] < m->hi[1]) {
+        /* the callee writes the tape itself: fine if the cell is elsewhere */
+        if (call.base != TAC_LOC_ABS || m->lo[1] == TAC_OFF_ANY) return 0;
+        word abs = (word)call.off + cell;
+        if (abs >= m->lo[1] && abs < m->hi[1]) return 0;
+    }
+    return 1;
+}
+
+/*
+ * The body of function f with the loads of args replaced and folded, in
+ * the original numbering; NULL if it saves fewer than TAC_SPEC_GAIN
+ * instructions. *len gets its length.
+ */
+static inline tac_instr *tac_spec_body(tac_spec_ctx *c, int f, const tac_spec_copy *cp, size_t *len) {
+    tac_backend_state *s = c->s;
+    tac_prog *t = &s->prog;
+    const tac_func_span *F = &s->funcs[f];
+    size_t st = F->start, n = F->end - F->start;
+    int g = f + 1, nt = s->next_temp;
+    tac_instr *code = (tac_instr*)malloc(n * sizeof(tac_instr));
+    uint8_t *keep = (uint8_t*)calloc(n, 1);
+    size_t *work = (size_t*)malloc((n + 1) * sizeof(size_t));
+    for (size_t j = 0; j < n; ++j) code[j] = tac_get(t, st + j);
+
+    /* replace and fold, in order: temps have one definition each */
+    for (size_t j = 0; j < n; ++j) {
+        tac_instr *in = &code[j];
+        word v[2], r;
+        uint8_t ty[2], rt;
+        int dst = in->dst;
+        if ((tac_temp_fields(in->op) & TAC_F_DST) && (dst < 0 || dst >= nt || c->def[dst] != (int)(st + j))) continue;
+        if (in->op == TAC_LOAD && s->alias.owner[st + j] == g && s->alias.at[st + j].base == TAC_LOC_REL) {
+            for (int a = 0; a < cp->nargs; ++a) {
+                if (cp->arg[a].cell != s->alias.at[st + j].off) continue;
+                *in = (tac_instr){ .op = TAC_CONST, .dst = dst, .lhs = -1, .rhs = -1, .imm = cp->arg[a].value,
+                                   .dst_type = cp->arg[a].type };
+                break;
+            }
+        }
+        if (in->op == TAC_CONST) {
+            c->known[dst] = 1;
+            c->kval[dst] = in->imm;
+            c->ktype[dst] = (uint8_t)in->dst_type;
+        } else if (tac_exec_handler(in->op) && tac_spec_const(c, in->lhs, &v[0], &ty[0]) &&
+                   (tac_exec_unary(in->op) || tac_spec_const(c, in->rhs, &v[1], &ty[1])) &&
+                   tac_spec_fold(c, in->op, v, ty, &r, &rt)) {
+            *in = (tac_instr){ .op = TAC_CONST, .dst = dst, .lhs = -1, .rhs = -1, .imm = r, .dst_type = rt };
+            c->known[dst] = 1;
+            c->kval[dst] = r;
+            c->ktype[dst] = rt;
+        } else if (in->op == TAC_JZ && tac_spec_const(c, in->lhs, &v[0], &ty[0])) {
+            /* decided: a jump, or a no-op dropped below */
+            if (v[0]) *in = (tac_instr){ .op = TAC_MOVE, .dst = -1, .lhs = -1, .rhs = -1, .imm = 0 };
+            else *in = (tac_instr){ .op = TAC_JMP, .dst = -1, .lhs = -1, .rhs = -1, .imm = in->imm };
+        }
+    }
+
+    /* what still runs, from the entry */
+    size_t nw = 0;
+    keep[0] = 1;
+    work[nw++] = 0;
+    while (nw) {
+        size_t j = work[--nw];
+        TacOp op = code[j].op;
+        size_t to[2];
+        int nto = 0;
+        if (op == TAC_JMP || op == TAC_JZ) {
+            word l = code[j].imm;
+            int at = l >= 0 && l <= s->label_counter ? c->label_at[l] : -1;
+            if (at >= (int)st && (size_t)at < st + n) to[nto++] = (size_t)at - st;
+        }
+        if (op != TAC_JMP && op != TAC_RET && j + 1 < n) to[nto++] = j + 1;
+        for (int k = 0; k < nto; ++k) {
+            if (keep[to[k]]) continue;
+            keep[to[k]] = 1;
+            work[nw++] = to[k];
+        }
+    }
+    for (size_t j = 0; j < n; ++j) {
+        if (keep[j] && code[j].op == TAC_MOVE && !code[j].imm) keep[j] = 0;
+    }
+
+    /* values nothing uses any more */
+    for (size_t j = 0; j < n; ++j) {
+        unsigned fl = tac_temp_fields(code[j].op);
+        if (!keep[j]) continue;
+        if ((fl & TAC_F_LHS) && code[j].lhs >= 0 && code[j].lhs < nt) c->uses[code[j].lhs]++;
+        if ((fl & TAC_F_RHS) && code[j].rhs >= 0 && code[j].rhs < nt) c->uses[code[j].rhs]++;
+        if ((fl & TAC_F_IMM) && code[j].imm >= 0 && code[j].imm < nt) c->uses[code[j].imm]++;
+        if (code[j].op == TAC_RET && code[j].lhs >= 0 && code[j].lhs < nt) c->uses[code[j].lhs]++;
+    }
+    for (int again = 1; again; ) {
+        again = 0;
+        for (size_t j = n; j-- > 1; ) {
+            int dst = code[j].dst;
+            if (!keep[j] || !tac_spec_pure(code[j].op) || dst < 0 || dst >= nt || c->uses[dst] || c->escape[dst])
+                continue;
+            keep[j] = 0;
+            again = 1;
+            unsigned fl = tac_temp_fields(code[j].op);
+            if ((fl & TAC_F_LHS) && code[j].lhs >= 0 && code[j].lhs < nt) c->uses[code[j].lhs]--;
+            if ((fl & TAC_F_RHS) && code[j].rhs >= 0 && code[j].rhs < nt) c->uses[code[j].rhs]--;
+        }
+    }
+
+    size_t k = 0;
+    for (size_t j = 0; j < n; ++j) {
+        unsigned fl = tac_temp_fields(code[j].op);
+        if (keep[j]) {
+            if ((fl & TAC_F_LHS) && code[j].lhs >= 0 && code[j].lhs < nt) c->uses[code[j].lhs]--;
+            if ((fl & TAC_F_RHS) && code[j].rhs >= 0 && code[j].rhs < nt) c->uses[code[j].rhs]--;
+            if ((fl & TAC_F_IMM) && code[j].imm >= 0 && code[j].imm < nt) c->uses[code[j].imm]--;
+            if (code[j].op == TAC_RET && code[j].lhs >= 0 && code[j].lhs < nt) c->uses[code[j].lhs]--;
+            code[k++] = code[j];
+        }
+        int dst = tac_dst(t, st + j);
+        if ((tac_temp_fields(tac_op(t, st + j)) & TAC_F_DST) && dst >= 0 && dst < nt) c->known[dst] = 0;
+    }
+    free(keep);
+    free(work);
+    *len = k;
+    if (n - k < TAC_SPEC_GAIN) { free(code); return NULL; }
+    return code;
+}
+
+/* give the copy of f its own temps and labels */
+static inline void tac_spec_rename(tac_backend_state *s, tac_spec_copy *cp, int nt) {
+    int *temp = (int*)malloc(((size_t)nt + 1) * sizeof(int));
+    int *label = (int*)malloc(((size_t)s->label_counter + 1) * sizeof(int));
+    int nl = s->label_counter;
+    for (int v = 0; v < nt; ++v) temp[v] = -1;
+    for (int l = 0; l < nl; ++l) label[l] = -1;
+    for (size_t j = 0; j < cp->len; ++j) {
+        tac_instr *in = &cp->code[j];
+        unsigned fl = tac_temp_fields(in->op);
+        if (in->op == TAC_LABEL && in->imm >= 0 && in->imm < nl) label[in->imm] = tac_new_label(s);
+        if ((fl & TAC_F_DST) && in->dst >= 0 && in->dst < nt) {
+            temp[in->dst] = tac_new_temp(s, in->op == TAC_CONST ? (TypeTag)in->dst_type : (TypeTag)s->temp_types[in->dst]);
+        }
+        if ((fl & TAC_F_RHS_DEF) && in->rhs >= 0 && in->rhs < nt) temp[in->rhs] = tac_new_temp(s, (TypeTag)s->temp_types[in->rhs]);
+    }
+    for (size_t j = 0; j < cp->len; ++j) {
+        tac_instr *in = &cp->code[j];
+        unsigned fl = tac_temp_fields(in->op);
+#define TAC_SPEC_MAP(x) if ((x) >= 0 && (x) < nt && temp[x] >= 0) (x) = temp[x]
+        if (fl & TAC_F_DST) TAC_SPEC_MAP(in->dst);
+        if (fl & (TAC_F_LHS | TAC_F_RHS_DEF) || in->op == TAC_RET) TAC_SPEC_MAP(in->lhs);
+        if (fl & (TAC_F_RHS | TAC_F_RHS_DEF)) TAC_SPEC_MAP(in->rhs);
+        if (fl & TAC_F_IMM) { word v = in->imm; if (v >= 0 && v < nt && temp[v] >= 0) in->imm = temp[v]; }
+#undef TAC_SPEC_MAP
+        if ((in->op == TAC_LABEL || in->op == TAC_JMP || in->op == TAC_JZ) && in->imm >= 0 && in->imm < nl &&
+            label[in->imm] >= 0)
+            in->imm = label[in->imm];
+    }
+    cp->label = (int)cp->code[0].imm;
+    free(temp);
+    free(label);
+}
+
+/* can f be copied? its body is whole and holds no other function */
+static inline int tac_spec_copyable(const tac_backend_state *s, int f) {
+    const tac_func_span *F = &s->funcs[f];
+    if (F->end == (size_t)-1 || F->end <= F->start || F->index < 0) return 0;
+    for (int h = 0; h < s->nfuncs; ++h) {
+        if (h != f && s->funcs[h].start > F->start && s->funcs[h].start < F->end) return 0;
+    }
+    for (size_t i = F->start; i < F->end; ++i) {
+        if (tac_temp_fields(tac_op(&s->prog, i)) & TAC_F_ARGS) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Specialize functions to the constant arguments of their calls (see
+ * above); the alias result is recomputed. Returns the number of calls sent
+ * to a specialized copy.
+ */
+static inline int tac_specialize_calls(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    int nt = s->next_temp, nfuncs = s->nfuncs;
+    if (nfuncs <= 0) return 0;
+    if (!s->alias.at || s->alias.count != n) tac_points_to(vm);
+    const tac_loc *at = s->alias.at;
+    const int *owner = s->alias.owner;
+
+    tac_spec_ctx c = { .s = s };
+    c.sv = (VM*)calloc(1, sizeof(VM));
+    c.sv->out = stdout;
+    c.def = (int*)tac_mem_alloc(&t->arena, (size_t)(nt + 1) * sizeof(int));
+    c.escape = (uint8_t*)tac_mem_alloc(&t->arena, (size_t)nt + 1);
+    c.known = (uint8_t*)calloc((size_t)nt + 1, 1);
+    c.kval = (word*)calloc((size_t)nt + 1, sizeof(word));
+    c.ktype = (uint8_t*)calloc((size_t)nt + 1, 1);
+    c.uses = (int*)calloc((size_t)nt + 1, sizeof(int));
+    c.label_at = tac_label_index(s);
+    memset(c.escape, 0, (size_t)nt + 1);
+    for (int v = 0; v < nt; ++v) c.def[v] = -1;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned fl = tac_temp_fields(tac_op(t, i));
+        int d = tac_dst(t, i);
+        if ((fl & TAC_F_DST) && d >= 0 && d < nt) c.def[d] = c.def[d] == -1 ? (int)i : -2;
+        d = tac_rhs(t, i);
+        if ((fl & TAC_F_RHS_DEF) && d >= 0 && d < nt) c.def[d] = -2;
+    }
+    /* temps read outside the function that defines them */
+    for (size_t i = 0; i < n; ++i) {
+        unsigned fl = tac_temp_fields(tac_op(t, i));
+        int u[3] = { (fl & TAC_F_LHS) || tac_op(t, i) == TAC_RET ? tac_lhs(t, i) : -1,
+                     fl & TAC_F_RHS ? tac_rhs(t, i) : -1, -1 };
+        if ((fl & TAC_F_IMM) && !(TAC_AT(t, i)->op[TAC_SLOT(i)] & TAC_WIDE)) u[2] = (int)tac_imm(t, i);
+        for (int k = 0; k < 3; ++k) {
+            int v = u[k];
+            if (v < 0 || v >= nt) continue;
+            if (c.def[v] < 0 || owner[c.def[v]] != owner[i]) c.escape[v] = 1;
+        }
+        if (fl & TAC_F_ARGS) {
+            for (int a = 0; a < tac_rhs(t, i); ++a) {
+                int v = t->args[tac_lhs(t, i) + a];
+                if (v >= 0 && v < nt) c.escape[v] = 1;
+            }
+        }
+    }
+    uint8_t used_index[256] = { 0 };
+    for (int f = 0; f < nfuncs; ++f) {
+        if (s->funcs[f].index >= 0 && s->funcs[f].index < 256) used_index[s->funcs[f].index] = 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        int r = tac_rhs(t, i);
+        if (tac_op(t, i) == TAC_CALL && r >= 0 && r < 256) used_index[r] = 1;
+    }
+    uint8_t *copyable = (uint8_t*)calloc((size_t)nfuncs, 1);
+    for (int f = 0; f < nfuncs; ++f) copyable[f] = (uint8_t)tac_spec_copyable(s, f);
+
+    tac_spec_copy *copy = NULL;
+    int ncopies = 0, cap = 0;
+    int *site = (int*)tac_mem_alloc(&t->arena, (n + 1) * sizeof(int)); /* per call: its copy, -1 if none */
+    size_t budget = n * TAC_SPEC_GROWTH / 100, grown = 0;
+    if (budget < TAC_SPEC_BUDGET) budget = TAC_SPEC_BUDGET;
+
+    /* stores of constants still in their cells at this point of the block */
+    size_t from[TAC_SPEC_STORES];
+    int navail = 0;
+    for (size_t i = 0; i < n; ++i) {
+        TacOp op = tac_op(t, i);
+        word cells;
+        site[i] = -1;
+        if (op == TAC_LABEL || (i && owner[i] != owner[i - 1])) navail = 0;
+        if (op == TAC_CALL) {
+            int r = tac_rhs(t, i);
+            int g = r >= 0 && r < 256 ? s->alias.callee[r] : -1, f = g - 1;
+            tac_spec_copy want = { .func = f, .label = -1, .index = -1 };
+            if (g >= 1 && copyable[f] && tac_spec_known(at[i])) {
+                for (int m = 0; m < navail && want.nargs < TAC_SPEC_ARGS; ++m) {
+                    if (at[from[m]].base != at[i].base || at[from[m]].off == TAC_OFF_ANY) continue;
+                    int32_t cell = at[from[m]].off - at[i].off;
+                    if (!tac_spec_safe(s, g, at[i], cell)) continue;
+                    /* read by the callee? */
+                    size_t j = s->funcs[f].start;
+                    while (j < s->funcs[f].end && !(tac_op(t, j) == TAC_LOAD && owner[j] == g &&
+                           at[j].base == TAC_LOC_REL && at[j].off == cell)) j++;
+                    if (j == s->funcs[f].end) continue;
+                    int v = tac_lhs(t, from[m]);
+                    size_t d = (size_t)c.def[v];
+                    int k = want.nargs++;
+                    /* in cell order, so equal constants compare equal */
+                    while (k && want.arg[k - 1].cell > cell) { want.arg[k] = want.arg[k - 1]; k--; }
+                    want.arg[k] = (tac_spec_arg){ cell, (uint8_t)tac_dst_type(t, d), tac_imm(t, d) };
+                }
+            }
+            if (want.nargs) {
+                s->spec.sites++;
+                int k = 0, made = 0;
+                for (; k < ncopies; ++k) {
+                    made += copy[k].func == f;
+                    if (copy[k].func == f && copy[k].nargs == want.nargs &&
+                        !memcmp(copy[k].arg, want.arg, (size_t)want.nargs * sizeof(tac_spec_arg)))
+                        break;
+                }
+                if (k == ncopies && made < TAC_SPEC_COPIES) {
+                    if (ncopies == cap) {
+                        cap = cap ? cap * 2 : 8;
+                        copy = (tac_spec_copy*)realloc(copy, (size_t)cap * sizeof(tac_spec_copy));
+                    }
+                    copy[ncopies] = want;
+                    copy[ncopies].code = tac_spec_body(&c, f, &want, &copy[ncopies].len);
+                    int index = 0;
+                    while (index < 256 && used_index[index]) index++;
+                    if (copy[ncopies].code && (grown + copy[ncopies].len > budget || index == 256)) {
+                        free(copy[ncopies].code);
+                        copy[ncopies].code = NULL;
+                    }
+                    if (copy[ncopies].code) {
+                        grown += copy[ncopies].len;
+                        used_index[index] = 1;
+                        copy[ncopies].index = index;
+                        tac_spec_rename(s, &copy[ncopies], nt);
+                        s->func_label[index] = copy[ncopies].label;
+                        s->spec.cloned++;
+                        s->spec.removed += (int)(s->funcs[f].end - s->funcs[f].start - copy[ncopies].len);
+                    }
+                    ncopies++;
+                }
+                if (k < ncopies && copy[k].code) {
+                    site[i] = k;
+                    s->spec.calls++;
+                }
+            }
+        }
+        if (op == TAC_CALL || (tac_tape_access(op, tac_imm(t, i), &cells) & (TAC_MEM_WRITE | TAC_MEM_FAR))) {
+            int k = 0;
+            for (int m = 0; m < navail; ++m) {
+                if (!tac_may_clobber(s, i, from[m])) from[k++] = from[m];
+            }
+            navail = k;
+            int v = tac_lhs(t, i);
+            if (op == TAC_STORE && v >= 0 && v < nt && c.def[v] >= 0 && tac_op(t, (size_t)c.def[v]) == TAC_CONST &&
+                tac_spec_known(at[i]) && navail < TAC_SPEC_STORES)
+                from[navail++] = i;
+        }
+        if (op == TAC_JMP || op == TAC_RET) navail = 0;
+    }
+
+    int calls = 0;
+    if (grown) {
+        /* each copy after its original; the calls go to it */
+        tac_instr *out = (tac_instr*)malloc((n + grown + 1) * sizeof(tac_instr));
+        size_t *to = (size_t*)malloc((n + 1) * sizeof(size_t));
+        size_t *end = (size_t*)malloc((size_t)nfuncs * sizeof(size_t));
+        size_t k = 0;
+        int nspans = 0;
+        tac_func_span *spans = (tac_func_span*)malloc((size_t)(ncopies + 1) * sizeof(tac_func_span));
+        for (size_t i = 0; i <= n; ++i) {
+            for (int f = 0; f < nfuncs; ++f) {
+                if (s->funcs[f].end != i) continue;
+                end[f] = k;
+                for (int m = 0; m < ncopies; ++m) {
+                    if (copy[m].func != f || !copy[m].code) continue;
+                    spans[nspans++] = (tac_func_span){ .label = copy[m].label, .index = copy[m].index, .start = k,
+                                                       .end = k + copy[m].len, .sp = s->funcs[f].sp };
+                    memcpy(out + k, copy[m].code, copy[m].len * sizeof(tac_instr));
+                    k += copy[m].len;
+                }
+            }
+            to[i] = k;
+            if (i == n) break;
+            tac_instr in = tac_get(t, i);
+            if (site[i] >= 0) {
+                in.imm = copy[site[i]].label;
+                in.rhs = copy[site[i]].index;
+                calls++;
+            }
+            out[k++] = in;
+        }
+        tac_rewrite(s, out, k, to);
+        for (int f = 0; f < nfuncs; ++f) if (s->funcs[f].end != (size_t)-1) s->funcs[f].end = end[f];
+        for (int m = 0; m < nspans; ++m) {
+            if (s->nfuncs == s->funcs_cap) {
+                int nc = s->funcs_cap ? s->funcs_cap * 2 : 8;
+                s->funcs = (tac_func_span*)tac_mem_grow(&t->arena, s->funcs, (size_t)s->funcs_cap * sizeof(tac_func_span),
+                                                        (size_t)nc * sizeof(tac_func_span));
+                s->funcs_cap = nc;
+            }
+            /* in program order */
+            int f = s->nfuncs++;
+            while (f && s->funcs[f - 1].start > spans[m].start) { s->funcs[f] = s->funcs[f - 1]; f--; }
+            s->funcs[f] = spans[m];
+        }
+        free(out);
+        free(to);
+        free(end);
+        free(spans);
+        tac_points_to(vm);
+    }
+    for (int m = 0; m < ncopies; ++m) free(copy[m].code);
+    free(copy);
+    free(copyable);
+    free(c.sv);
+    free(c.known);
+    free(c.kval);
+    free(c.ktype);
+    free(c.uses);
+    free(c.label_at);
+    return calls;
+}
+
+#endif /* TAC_SPEC_H */
@@ -2,6 +2,10 @@
 #define TAC_BACKEND_H
 
 #include "../vm/vm.h"
+#include "../native/native.h"
+#include "../kernels/simd.h"
+#include "mem.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -15,7 +19,7 @@
 #define TAC_DEBUG 0
 #endif
 
-static void create_dir(const char *path) {
+static inline void create_dir(const char *path) {
     char tmp[256];
     strncpy(tmp, path, sizeof(tmp)-1);
     tmp[sizeof(tmp)-1] = '\0';
@@ -67,15 +71,84 @@ typedef enum {
     TAC_OFFSET,/* lhs = pointer temp, rhs = offset temp, dst = result pointer temp */
     TAC_INDEX, /* lhs = pointer temp, rhs = index/temp, dst = result temp (load from indexed slot) */
     TAC_SET,   /* lhs = pointer/temp (target), rhs = value temp (source) -> store */
+    TAC_ARENA, /* imm = cell count, dst = ptr temp to a frame-local block. The cells die at
+                  the enclosing ret, so passes may keep their contents in temps instead. */
 
     /* control-flow / labels / calls */
     TAC_LABEL, /* imm = label id */
     TAC_JMP,   /* imm = target label */
     TAC_JZ,    /* lhs = cond temp, imm = target label */
+    TAC_JNZ,   /* lhs = cond temp, imm = target label (only made by tac/blocks.h) */
     TAC_CALL,  /* imm = function index or label */
     TAC_RET,
+
+    /* native intrinsics */
+    TAC_NCALL, /* imm = intrinsic index, lhs = offset of the arg temps in tac_prog.args,
+                  rhs = arity, dst = result temp (-1 if void) */
+
+    /* hash maps (runtime handles; not foldable) */
+    TAC_HNEW,  /* dst = handle temp */
+    TAC_HPUT,  /* lhs = handle, rhs = key, imm = value temp */
+    TAC_HGET,  /* dst = value temp, lhs = handle, rhs = key */
+    TAC_HDEL,  /* dst = bool temp, lhs = handle, rhs = key */
+    TAC_HLEN,  /* dst = count temp, lhs = handle */
+    TAC_HITER, /* dst = count temp, lhs = handle; writes pairs to the tape at tp */
+
+    /* sort/search over the tape range [tp, tp+imm) */
+    TAC_SORT,       /* imm = n; rewrites the range in place */
+    TAC_BSEARCH,    /* dst = offset or -1, lhs = key temp, imm = n */
+    TAC_LOWERBOUND, /* dst = offset of first cell >= key, lhs = key temp, imm = n */
+
+    /* text kernels over imm bytes packed from tp; offsets are i64 */
+    TAC_PACK,       /* dst = packed cell count */
+    TAC_FINDBYTE,   /* dst = offset or -1, lhs = pos temp, rhs = byte temp */
+    TAC_FINDANY,    /* dst = offset or -1, lhs = offset of [pos, bytes...] in tac_prog.args,
+                       rhs = operand count */
+    TAC_COUNTLINES, /* dst = newline count */
+    TAC_SPLITLINES, /* dst = line count, lhs = destination cell temp */
+    TAC_PARSEINT,   /* dst = value temp, rhs = end offset temp, lhs = pos temp */
+
+    /* hashes/checksums over imm cells (or imm packed bytes for the *B forms) */
+    TAC_HASH64,     /* dst = u64 hash */
+    TAC_HASH64B,
+    TAC_CRC32C,     /* dst = u32 checksum */
+    TAC_CRC32CB,
+
+    /* 128-bit vectors: vector temps are typed v128, imm = lane type */
+    TAC_VLOAD,      /* dst = vector loaded from tape[tp..] */
+    TAC_VSTORE,     /* lhs = vector stored to tape[tp..] */
+    TAC_VSPLAT,     /* dst = vector, lhs = scalar temp */
+    TAC_VADD,       /* dst = lhs op rhs, lane-wise */
+    TAC_VSUB,
+    TAC_VMUL,
+    TAC_VMIN,
+    TAC_VMAX,
+    TAC_VAND,       /* bitwise; imm unused */
+    TAC_VOR,
+    TAC_VXOR,
+    TAC_VHSUM,      /* dst = scalar sum of lhs's lanes */
+    TAC_VSHUFFLE,   /* dst = permuted lhs; imm = lane mask, rhs = lane type */
+
+    /* branch-free choices */
+    TAC_SELECT,     /* dst = lhs ? rhs : imm (imm = temp) */
+    TAC_MIN,        /* dst = min(lhs, rhs) */
+    TAC_MAX,
+    TAC_ABS,        /* dst = |lhs| */
+
+    /* bit manipulation on the type's width */
+    TAC_POPCNT,     /* dst = set bits of lhs */
+    TAC_CLZ,
+    TAC_CTZ,
+    TAC_BSWAP,
+    TAC_ROTL,       /* dst = lhs rotated by rhs */
+    TAC_ROTR,
+    TAC_MULHI,      /* dst = high half of lhs * rhs */
+
+    /* joins */
+    TAC_COPY,       /* dst = lhs: the arms of an if leave a value they replace in one temp */
 } TacOp;
 
+/* one instruction, unpacked: what tac_emit takes and tac_get returns */
 typedef struct {
     TacOp op;
     int dst;
@@ -88,15 +161,295 @@ typedef struct {
     int dst_type;
 } tac_instr;
 
+/*
+ * Instructions are stored column-wise in chunks of TAC_CHUNK: one byte each
+ * for the opcode and the destination type, 32-bit temps and a 32-bit
+ * immediate, 18 bytes per instruction against 32 for a tac_instr. An
+ * immediate that does not fit 32 bits lives in the `wide` pool; its opcode
+ * byte then has TAC_WIDE set and imm is the pool index. Chunks never move,
+ * so the program grows without copying, and a pass reading one field scans
+ * a dense array. All storage comes from the program's arena (mem.h).
+ */
+#define TAC_CHUNK_BITS 9
+#define TAC_CHUNK ((size_t)1 << TAC_CHUNK_BITS)
+#define TAC_WIDE 0x80
+
+_Static_assert(TAC_VSHUFFLE < TAC_WIDE, "TAC opcodes must fit below the wide-immediate bit");
+
 typedef struct {
-    tac_instr *code;
+    uint8_t op[TAC_CHUNK];
+    uint8_t type[TAC_CHUNK];
+    int32_t dst[TAC_CHUNK];
+    int32_t lhs[TAC_CHUNK];
+    int32_t rhs[TAC_CHUNK];
+    int32_t imm[TAC_CHUNK];
+} tac_chunk;
+
+typedef struct {
+    tac_chunk **chunks;
+    size_t nchunks, chunks_cap;
     size_t count;
-    size_t cap;
+
+    /* immediates wider than 32 bits */
+    word *wide;
+    size_t wide_count;
+    size_t wide_cap;
+
+    /* operand pool for instructions with more than two temp operands (NCALL) */
+    int *args;
+    size_t args_count;
+    size_t args_cap;
+
+    tac_mem arena;
 } tac_prog;
 
+#define TAC_AT(t, i) ((t)->chunks[(i) >> TAC_CHUNK_BITS])
+#define TAC_SLOT(i) ((i) & (TAC_CHUNK - 1))
+
+static inline TacOp tac_op(const tac_prog *t, size_t i) {
+    return (TacOp)(TAC_AT(t, i)->op[TAC_SLOT(i)] & ~TAC_WIDE);
+}
+
+static inline int tac_dst(const tac_prog *t, size_t i) { return TAC_AT(t, i)->dst[TAC_SLOT(i)]; }
+static inline int tac_lhs(const tac_prog *t, size_t i) { return TAC_AT(t, i)->lhs[TAC_SLOT(i)]; }
+static inline int tac_rhs(const tac_prog *t, size_t i) { return TAC_AT(t, i)->rhs[TAC_SLOT(i)]; }
+static inline int tac_dst_type(const tac_prog *t, size_t i) { return TAC_AT(t, i)->type[TAC_SLOT(i)]; }
+
+static inline word tac_imm(const tac_prog *t, size_t i) {
+    const tac_chunk *c = TAC_AT(t, i);
+    int32_t v = c->imm[TAC_SLOT(i)];
+    return (c->op[TAC_SLOT(i)] & TAC_WIDE) ? t->wide[v] : (word)v;
+}
+
+static inline tac_instr tac_get(const tac_prog *t, size_t i) {
+    return (tac_instr){ .op = tac_op(t, i), .dst = tac_dst(t, i), .lhs = tac_lhs(t, i), .rhs = tac_rhs(t, i),
+                        .imm = tac_imm(t, i), .dst_type = tac_dst_type(t, i) };
+}
+
+/* store instr at index i (< chunks allocated) */
+static inline void tac_put(tac_prog *t, size_t i, tac_instr instr) {
+    tac_chunk *c = TAC_AT(t, i);
+    size_t k = TAC_SLOT(i);
+    uint8_t op = (uint8_t)instr.op;
+    int32_t imm = (int32_t)instr.imm;
+    if ((word)imm != instr.imm) {
+        if (t->wide_count == t->wide_cap) {
+            size_t nc = t->wide_cap ? t->wide_cap * 2 : 16;
+            t->wide = (word*)tac_mem_grow(&t->arena, t->wide, t->wide_cap * sizeof(word), nc * sizeof(word));
+            t->wide_cap = nc;
+        }
+        imm = (int32_t)t->wide_count;
+        t->wide[t->wide_count++] = instr.imm;
+        op |= TAC_WIDE;
+    }
+    c->op[k] = op;
+    c->type[k] = (uint8_t)instr.dst_type;
+    c->dst[k] = instr.dst;
+    c->lhs[k] = instr.lhs;
+    c->rhs[k] = instr.rhs;
+    c->imm[k] = imm;
+}
+
+/* which fields of an instruction name temps */
+enum {
+    TAC_F_DST = 1,      /* dst is defined (NCALL: unless -1) */
+    TAC_F_LHS = 2,      /* lhs is read */
+    TAC_F_RHS = 4,      /* rhs is read */
+    TAC_F_IMM = 8,      /* imm is read (HPUT's value, SELECT's second choice) */
+    TAC_F_ARGS = 16,    /* args[lhs .. lhs+rhs) are read */
+    TAC_F_RHS_DEF = 32, /* rhs is defined too (PARSEINT's end offset) */
+};
+
+static inline unsigned tac_temp_fields(TacOp op) {
+    switch (op) {
+        case TAC_ADD: case TAC_SUB: case TAC_MUL: case TAC_DIV: case TAC_REM:
+        case TAC_BITAND: case TAC_BITOR: case TAC_BITXOR: case TAC_LSH: case TAC_LRSH: case TAC_ARSH:
+        case TAC_OR: case TAC_AND: case TAC_INDEX: case TAC_HGET: case TAC_HDEL: case TAC_FINDBYTE:
+        case TAC_VADD: case TAC_VSUB: case TAC_VMUL: case TAC_VMIN: case TAC_VMAX:
+        case TAC_VAND: case TAC_VOR: case TAC_VXOR: case TAC_MIN: case TAC_MAX:
+        case TAC_ROTL: case TAC_ROTR: case TAC_MULHI:
+            return TAC_F_DST | TAC_F_LHS | TAC_F_RHS;
+        case TAC_NOT: case TAC_GEZ: case TAC_DEREF: case TAC_REFER: case TAC_OFFSET:
+        case TAC_HLEN: case TAC_HITER: case TAC_BSEARCH: case TAC_LOWERBOUND: case TAC_SPLITLINES:
+        case TAC_VSPLAT: case TAC_VHSUM: case TAC_VSHUFFLE: case TAC_ABS:
+        case TAC_POPCNT: case TAC_CLZ: case TAC_CTZ: case TAC_BSWAP: case TAC_COPY:
+            return TAC_F_DST | TAC_F_LHS;
+        case TAC_CONST: case TAC_LOAD: case TAC_WHERE: case TAC_ARENA: case TAC_CALL: case TAC_HNEW:
+        case TAC_PACK: case TAC_COUNTLINES: case TAC_HASH64: case TAC_HASH64B: case TAC_CRC32C: case TAC_CRC32CB:
+        case TAC_VLOAD:
+            return TAC_F_DST;
+        case TAC_STORE: case TAC_PRINT: case TAC_PRINTCHAR: case TAC_JZ: case TAC_JNZ: case TAC_VSTORE:
+        case TAC_RET: /* the returned value, -1 if the body left none */
+            return TAC_F_LHS;
+        case TAC_SET:
+            return TAC_F_LHS | TAC_F_RHS;
+        case TAC_HPUT:
+            return TAC_F_LHS | TAC_F_RHS | TAC_F_IMM;
+        case TAC_SELECT:
+            return TAC_F_DST | TAC_F_LHS | TAC_F_RHS | TAC_F_IMM;
+        case TAC_NCALL: case TAC_FINDANY:
+            return TAC_F_DST | TAC_F_ARGS;
+        case TAC_PARSEINT:
+            return TAC_F_DST | TAC_F_LHS | TAC_F_RHS_DEF;
+        default:
+            return 0;
+    }
+}
+
+/* how an instruction touches the tape */
+enum {
+    TAC_MEM_READ = 1,  /* reads cells from tp */
+    TAC_MEM_WRITE = 2, /* writes cells from tp */
+    TAC_MEM_FAR = 4,   /* also writes cells away from tp (SPLITLINES' destination) */
+};
+
+/* flags for op, with the number of cells from tp it covers in *cells (-1
+   when only known at run time: HITER writes two per entry) */
+static inline unsigned tac_tape_access(TacOp op, word imm, word *cells) {
+    word bytes = (imm + (word)sizeof(word) - 1) / (word)sizeof(word);
+    *cells = 0;
+    switch (op) {
+        case TAC_LOAD: case TAC_DEREF: case TAC_INDEX:
+            *cells = 1;
+            return TAC_MEM_READ;
+        case TAC_STORE: case TAC_SET:
+            *cells = 1;
+            return TAC_MEM_WRITE;
+        case TAC_VLOAD:
+            *cells = simd_lanes((TypeTag)imm);
+            return TAC_MEM_READ;
+        case TAC_VSTORE:
+            *cells = simd_lanes((TypeTag)imm);
+            return TAC_MEM_WRITE;
+        case TAC_SORT:
+            *cells = imm;
+            return TAC_MEM_READ | TAC_MEM_WRITE;
+        case TAC_BSEARCH: case TAC_LOWERBOUND: case TAC_HASH64: case TAC_CRC32C:
+            *cells = imm;
+            return TAC_MEM_READ;
+        case TAC_PACK:
+            *cells = bytes;
+            return TAC_MEM_READ | TAC_MEM_WRITE;
+        case TAC_FINDBYTE: case TAC_FINDANY: case TAC_COUNTLINES: case TAC_PARSEINT:
+        case TAC_HASH64B: case TAC_CRC32CB:
+            *cells = bytes;
+            return TAC_MEM_READ;
+        case TAC_SPLITLINES:
+            *cells = bytes;
+            return TAC_MEM_READ | TAC_MEM_FAR;
+        case TAC_HITER:
+            *cells = -1;
+            return TAC_MEM_WRITE;
+        default:
+            return 0;
+    }
+}
+
+/* bytes the program holds (arena blocks) */
+static inline size_t tac_prog_bytes(const tac_prog *t) {
+    return t->arena.reserved;
+}
+
 // --- TAC backend state ---
 
-typedef struct { OpCode type; int start_label; int else_label; int end_label; /* VM ip (size_t) for the condition start; (size_t)-1 if not set */ size_t cond_vm_ip; } tac_block_entry;
+typedef struct { OpCode type; int start_label; int else_label; int end_label; /* VM ip (size_t) for the condition start; (size_t)-1 if not set */ size_t cond_vm_ip; /* FUNCTION: index in tac_backend_state.funcs */ int func;
+    /* IF/ELSE: offset in tac_backend_state.join of the virtual stack at the if (if_sp temps), followed after
+       the else by the if arm's (arm_sp temps); the if arm's jmp to the end, and whether it returned instead */
+    int saved, if_sp, arm_sp, arm_dead; size_t arm_jmp; } tac_block_entry;
+
+/* TAC instructions [start, end) of VM function `index`, start being its
+   label, and the depth of the virtual stack the body starts from */
+typedef struct { int label; int index; size_t start; size_t end; int sp; } tac_func_span;
+
+/* frame of one function (label -1: the top level) after tac_assign_slots */
+typedef struct { int label; int temps; int slots; } tac_frame;
+
+/* result of tac_assign_slots (tac/slots.h); slot_of is NULL until it runs */
+typedef struct {
+    int *slot_of;      /* per SSA temp: its slot, -1 if the temp is never referenced */
+    int ntemps;
+    int pinned;        /* temps referenced from more than one function hold slots [0, pinned) */
+    tac_frame *frames; /* top level first, then functions in program order */
+    int nframes;
+} tac_slots;
+
+/* an abstract tape location (tac/alias.h): cell off of the space `base` */
+typedef struct { int32_t base, off; } tac_loc;
+enum {
+    TAC_LOC_NONE = -4, /* not reached */
+    TAC_LOC_ANY = -3,  /* any cell */
+    TAC_LOC_ABS = -2,  /* the tape itself */
+    TAC_LOC_REL = -1,  /* relative to where tp was when the function was entered */
+    /* >= 0: the block allocated by the TAC_ARENA at that instruction */
+};
+#define TAC_OFF_ANY INT32_MIN /* some cell of the space */
+
+/* what calling a function does to the tape, over its body and its callees */
+typedef struct {
+    tac_loc exit;         /* tp at its rets: REL(k) is k cells from where it was entered */
+    int balanced;         /* its rets leave the deref stack as they found it */
+    int any;              /* may write anywhere */
+    int32_t lo[2], hi[2]; /* cells it may write, [0] REL and [1] ABS; empty if lo >= hi,
+                             lo == TAC_OFF_ANY if not bounded */
+} tac_frame_mod;
+
+/* result of tac_points_to (tac/alias.h); at is NULL until it runs */
+typedef struct {
+    tac_loc *at;        /* per instruction: where tp points when it runs, NONE if never reached */
+    tac_loc *pts;       /* per temp: the cell its value addresses, ANY if not a known pointer */
+    tac_frame_mod *mod; /* per frame, 0 being the top level */
+    int *owner;         /* per instruction: its frame */
+    int *callee;        /* per VM function index: its frame, -1 if not lowered */
+    size_t count;       /* instructions analysed */
+    int forwarded;      /* loads removed by tac_forward_loads (tac/loads.h) */
+} tac_alias;
+
+/* what tac/loops.h did to the program */
+typedef struct {
+    int counted; /* loops found counting a cell up to a bound */
+    int fused;   /* loops merged into the one before them */
+    int tiled;   /* nests tiled */
+    int tile;    /* iterations per tile, 0: no tiling */
+} tac_loops;
+
+/* what tac/spec.h did to the program */
+typedef struct {
+    int sites;   /* calls with constant arguments the callee reads */
+    int cloned;  /* specialized copies made */
+    int calls;   /* calls sent to one */
+    int removed; /* instructions the copies have fewer than their originals */
+} tac_spec;
+
+/* what tac/tail.h did to the program */
+typedef struct {
+    int calls; /* self tail calls turned into jumps */
+    int funcs; /* functions they loop in */
+    int acc;   /* of the calls, those folded into an accumulator */
+} tac_tail;
+
+/* what tac/blocks.h did to the program */
+typedef struct {
+    int threaded; /* jumps sent past a jump, or made the ret they went to */
+    int dead;     /* unreachable instructions dropped */
+    int jumps;    /* jumps to the next instruction dropped */
+    int labels;   /* labels nothing jumps to dropped (blocks merged) */
+    int moved;    /* blocks placed behind a jump to them */
+    int inverted; /* of those, behind a jz made a jnz */
+    int profiled; /* placed by a profile run */
+} tac_blocks;
+
+/* result of tac_run (tac/exec.h); ran is 0 until it runs */
+typedef struct {
+    int ran;
+    const char *why;    /* why it stopped early, NULL if the program ended */
+    uint64_t executed;  /* instructions */
+    uint64_t accesses;  /* tape cells read or written */
+    uint64_t misses;    /* of those, missing the modelled cache */
+    int kb, ways;       /* the model: kb KiB of 64-byte lines, ways-way LRU */
+    uint64_t *count;    /* per instruction: times run (from the arena) */
+    uint64_t *taken;    /* per instruction: times a jz or jnz jumped */
+    size_t len;         /* instructions counted */
+} tac_exec;
 
 typedef struct {
     tac_prog prog;
@@ -120,45 +473,88 @@ typedef struct {
     int *vm_ip_to_tac_label;
     size_t vm_code_len;
 
-    /* per-temp type information (TypeTag stored as int). Dynamically grown as temps are allocated. */
-    int *temp_types;
+    /* per-temp TypeTag, grown in the program's arena as temps are allocated */
+    uint8_t *temp_types;
     int temp_cap;
+
+    /* function bodies, in the order their FUNCTION ops were lowered */
+    tac_func_span *funcs;
+    int nfuncs, funcs_cap;
+    size_t body_end; /* where the last body ended */
+
+    /* virtual stacks saved by the open ifs (see tac_block_entry), innermost last */
+    int *join;
+    int join_len, join_cap;
+
+    tac_slots slots;
+    tac_alias alias;
+    tac_spec spec;
+    tac_tail tail;
+    tac_loops loops;
+    tac_blocks blocks;
+    tac_exec exec;
 } tac_backend_state;
 
 // --- Helpers ---
 static inline void tac_init(tac_prog *t) {
-    t->code = NULL;
+    t->chunks = NULL;
+    t->nchunks = t->chunks_cap = 0;
     t->count = 0;
-    t->cap = 0;
+    t->wide = NULL;
+    t->wide_count = t->wide_cap = 0;
+    t->args = NULL;
+    t->args_count = t->args_cap = 0;
+    tac_mem_init(&t->arena);
 }
 
 static inline void tac_free(tac_prog *t) {
-    free(t->code);
-    t->code = NULL;
-    t->count = t->cap = 0;
+    tac_mem_free(&t->arena);
+    tac_init(t);
+}
+
+/* append n temps to the operand pool and return the offset of the first one */
+static inline int tac_add_args(tac_prog *t, const int *temps, int n) {
+    if (t->args_count + (size_t)n > t->args_cap) {
+        size_t nc = t->args_cap ? t->args_cap * 2 : 16;
+        while (nc < t->args_count + (size_t)n) nc *= 2;
+        t->args = (int*)tac_mem_grow(&t->arena, t->args, t->args_cap * sizeof(int), nc * sizeof(int));
+        t->args_cap = nc;
+    }
+    int off = (int)t->args_count;
+    for (int i = 0; i < n; ++i) t->args[t->args_count++] = temps[i];
+    return off;
 }
 
 static inline void tac_emit(tac_prog *t, tac_instr instr) {
-    if (t->count == t->cap) {
-        t->cap = t->cap ? t->cap * 2 : 8;
-        t->code = (tac_instr*)realloc(t->code, t->cap * sizeof(tac_instr));
+    if (t->count == t->nchunks * TAC_CHUNK) {
+        if (t->nchunks == t->chunks_cap) {
+            size_t nc = t->chunks_cap ? t->chunks_cap * 2 : 4;
+            t->chunks = (tac_chunk**)tac_mem_grow(&t->arena, t->chunks, t->chunks_cap * sizeof(tac_chunk*),
+                                                    nc * sizeof(tac_chunk*));
+            t->chunks_cap = nc;
+        }
+        t->chunks[t->nchunks++] = (tac_chunk*)tac_mem_alloc(&t->arena, sizeof(tac_chunk));
     }
-    t->code[t->count++] = instr;
+    tac_put(t, t->count++, instr);
 }
 
 /* insert a tac instruction at index 'idx' shifting the rest forward */
 static void tac_insert_at(tac_prog *t, size_t idx, tac_instr instr) {
     if (idx > t->count) idx = t->count;
-    if (t->count + 1 > t->cap) {
-        t->cap = t->cap ? t->cap * 2 : 8;
-        t->code = (tac_instr*)realloc(t->code, t->cap * sizeof(tac_instr));
-    }
-    /* shift elements right */
-    for (size_t i = t->count; i > idx; --i) {
-        t->code[i] = t->code[i - 1];
+    /* append a slot, then move each column up by one from the end; wide
+       immediates keep their pool index, so the columns move as they are */
+    tac_emit(t, (tac_instr){0});
+    for (size_t i = t->count - 1; i > idx; --i) {
+        tac_chunk *d = TAC_AT(t, i), *c = TAC_AT(t, i - 1);
+        size_t kd = TAC_SLOT(i), kc = TAC_SLOT(i - 1);
+        d->op[kd] = c->op[kc];
+        d->type[kd] = c->type[kc];
+        d->dst[kd] = c->dst[kc];
+        d->lhs[kd] = c->lhs[kc];
+        d->rhs[kd] = c->rhs[kc];
+        d->imm[kd] = c->imm[kc];
     }
-    t->code[idx] = instr;
-    t->count++;
+    tac_put(t, idx, instr);
 }
 
 // --- Backend functions ---
@@ -172,27 +568,38 @@ static void tac_setup(VM *vm) {
     s->vm_code_len = vm->code_len;
     s->temp_types = NULL;
     s->temp_cap = 0;
+    s->funcs = NULL;
+    s->nfuncs = s->funcs_cap = 0;
+    s->body_end = (size_t)-1;
+    s->join = NULL;
+    s->join_len = s->join_cap = 0;
+    memset(&s->slots, 0, sizeof(s->slots));
+    memset(&s->alias, 0, sizeof(s->alias));
+    memset(&s->spec, 0, sizeof(s->spec));
+    memset(&s->tail, 0, sizeof(s->tail));
+    memset(&s->loops, 0, sizeof(s->loops));
+    memset(&s->blocks, 0, sizeof(s->blocks));
+    memset(&s->exec, 0, sizeof(s->exec));
     /* init func_label mapping to -1 (unused) */
     for (size_t i = 0; i < sizeof(s->func_label)/sizeof(s->func_label[0]); ++i) s->func_label[i] = -1;
-    /* allocate vm_ip -> tac index map and vm_ip -> tac label map and initialize to -1 */
+    tac_init(&s->prog);
+    /* allocate vm_ip -> tac index map and vm_ip -> tac label map (in the arena) and initialize to -1 */
     if (s->vm_code_len) {
-        s->vm_ip_to_tac_index = (int*)malloc(sizeof(int) * s->vm_code_len);
-        s->vm_ip_to_tac_label = (int*)malloc(sizeof(int) * s->vm_code_len);
+        s->vm_ip_to_tac_index = (int*)tac_mem_alloc(&s->prog.arena, sizeof(int) * s->vm_code_len);
+        s->vm_ip_to_tac_label = (int*)tac_mem_alloc(&s->prog.arena, sizeof(int) * s->vm_code_len);
         for (size_t i = 0; i < s->vm_code_len; ++i) { s->vm_ip_to_tac_index[i] = -1; s->vm_ip_to_tac_label[i] = -1; }
     } else {
         s->vm_ip_to_tac_index = NULL;
         s->vm_ip_to_tac_label = NULL;
     }
-    tac_init(&s->prog);
     vm->user_data = s;
 }
 
 static void tac_finalize(VM *vm, word imm) {
     tac_backend_state *s = (tac_backend_state*)vm->user_data;
+    /* the arena holds the program, the vm_ip maps and temp_types */
     tac_free(&s->prog);
-    free(s->vm_ip_to_tac_index);
-    free(s->vm_ip_to_tac_label);
-    free(s->temp_types);
+    free(s->join);
     free(s);
     vm->user_data = NULL;
 }
@@ -201,6 +608,167 @@ static tac_backend_state *tac_state(VM *vm) {
     return (tac_backend_state*)vm->user_data;
 }
 
+/* index of each label's TAC_LABEL, -1 where not emitted (malloc'd: passes
+   rerun, so their scratch stays out of the arena; the caller frees it) */
+static inline int *tac_label_index(tac_backend_state *s) {
+    int *at = (int*)malloc((size_t)(s->label_counter + 1) * sizeof(int));
+    for (int l = 0; l <= s->label_counter; ++l) at[l] = -1;
+    for (size_t i = 0; i < s->prog.count; ++i) {
+        if (tac_op(&s->prog, i) != TAC_LABEL) continue;
+        word l = tac_imm(&s->prog, i);
+        if (l >= 0 && l <= s->label_counter) at[l] = (int)i;
+    }
+    return at;
+}
+
+/* innermost function around each instruction (from the arena): frame 0 is
+   the top level, frame f+1 the body funcs[f] (spans nest, later ones inside
+   earlier) */
+static inline int *tac_frame_owner(tac_backend_state *s) {
+    size_t n = s->prog.count;
+    int *owner = (int*)tac_mem_alloc(&s->prog.arena, (n + 1) * sizeof(int));
+    for (size_t i = 0; i < n; ++i) owner[i] = 0;
+    for (int f = 0; f < s->nfuncs; ++f) {
+        size_t end = s->funcs[f].end == (size_t)-1 ? n : s->funcs[f].end;
+        for (size_t i = s->funcs[f].start; i < end && i < n; ++i) owner[i] = f + 1;
+    }
+    return owner;
+}
+
+/* frame of each VM function index (256 entries, from the arena), -1 where
+   it has no body: the callee of a call, whose rhs holds the index */
+static inline int *tac_callee_frames(tac_backend_state *s) {
+    int *frame = (int*)tac_mem_alloc(&s->prog.arena, 256 * sizeof(int));
+    for (int k = 0; k < 256; ++k) frame[k] = -1;
+    for (int f = 0; f < s->nfuncs; ++f) {
+        if (s->funcs[f].index >= 0 && s->funcs[f].index < 256) frame[s->funcs[f].index] = f + 1;
+    }
+    return frame;
+}
+
+/*
+ * Remove the instructions with drop[i] set, moving the rest down. Function
+ * spans and the vm_ip map follow; a vm_ip whose instruction went points at
+ * the one after it. Temps are not renumbered. Returns the instructions
+ * removed.
+ */
+static inline size_t tac_compact(tac_backend_state *s, const uint8_t *drop) {
+    tac_prog *t = &s->prog;
+    size_t n = t->count, k = 0;
+    size_t *to = (size_t*)malloc((n + 1) * sizeof(size_t));
+    for (size_t i = 0; i < n; ++i) {
+        to[i] = k;
+        if (drop[i]) continue;
+        if (k != i) {
+            tac_chunk *d = TAC_AT(t, k), *c = TAC_AT(t, i);
+            size_t kd = TAC_SLOT(k), kc = TAC_SLOT(i);
+            d->op[kd] = c->op[kc];
+            d->type[kd] = c->type[kc];
+            d->dst[kd] = c->dst[kc];
+            d->lhs[kd] = c->lhs[kc];
+            d->rhs[kd] = c->rhs[kc];
+            d->imm[kd] = c->imm[kc];
+        }
+        k++;
+    }
+    to[n] = k;
+    t->count = k;
+    for (int f = 0; f < s->nfuncs; ++f) {
+        s->funcs[f].start = to[s->funcs[f].start < n ? s->funcs[f].start : n];
+        if (s->funcs[f].end != (size_t)-1) s->funcs[f].end = to[s->funcs[f].end < n ? s->funcs[f].end : n];
+    }
+    for (size_t ip = 0; s->vm_ip_to_tac_index && ip < s->vm_code_len; ++ip) {
+        int i = s->vm_ip_to_tac_index[ip];
+        if (i >= 0) s->vm_ip_to_tac_index[ip] = (int)to[(size_t)i < n ? (size_t)i : n];
+    }
+    free(to);
+    return n - k;
+}
+
+/*
+ * Replace the program with the n instructions of `with`. to[i] is where
+ * old instruction i went (the one after it if it went, to[old count] the
+ * new end), for the function spans and the vm_ip map as in tac_compact.
+ * Wide immediates are pooled again; the operand pool stays.
+ */
+static inline void tac_rewrite(tac_backend_state *s, const tac_instr *with, size_t n, const size_t *to) {
+    tac_prog *t = &s->prog;
+    size_t old = t->count;
+    t->count = 0;
+    t->wide_count = 0;
+    for (size_t i = 0; i < n; ++i) tac_emit(t, with[i]);
+    for (int f = 0; f < s->nfuncs; ++f) {
+        s->funcs[f].start = to[s->funcs[f].start < old ? s->funcs[f].start : old];
+        if (s->funcs[f].end != (size_t)-1) s->funcs[f].end = to[s->funcs[f].end < old ? s->funcs[f].end : old];
+    }
+    for (size_t ip = 0; s->vm_ip_to_tac_index && ip < s->vm_code_len; ++ip) {
+        int i = s->vm_ip_to_tac_index[ip];
+        if (i >= 0) s->vm_ip_to_tac_index[ip] = (int)to[(size_t)i < old ? (size_t)i : old];
+    }
+}
+
+static inline void tac_stats(VM *vm, FILE *out) {
+    tac_backend_state *s = tac_state(vm);
+    const tac_prog *t = &s->prog;
+    size_t ins = t->nchunks * sizeof(tac_chunk) + t->wide_cap * sizeof(word);
+    fprintf(out, "tac: %zu instructions in %zu bytes (%.1f per instruction, %zu wide immediates), %d temps, "
+            "arena %zu bytes\n", t->count, ins, t->count ? (double)ins / (double)t->count : 0.0, t->wide_count,
+            s->next_temp, t->arena.reserved);
+    int typed = 0;
+    for (int v = 0; v < s->next_temp && v < s->temp_cap; ++v) typed += s->temp_types[v] != TYPE_UNKNOWN;
+    fprintf(out, "tac types: %d of %d temps typed\n", typed, s->next_temp);
+    if (s->alias.at && s->alias.count == t->count) {
+        int accesses = 0, known = 0;
+        for (size_t i = 0; i < t->count; ++i) {
+            word cells;
+            if (!tac_tape_access(tac_op(t, i), tac_imm(t, i), &cells)) continue;
+            accesses++;
+            known += s->alias.at[i].base >= TAC_LOC_ABS && s->alias.at[i].off != TAC_OFF_ANY;
+        }
+        fprintf(out, "tac alias: %d of %d tape accesses at a known cell, %d loads forwarded\n", known, accesses,
+                s->alias.forwarded);
+    }
+    if (s->spec.sites) {
+        fprintf(out, "tac spec: %d calls with constant arguments, %d sent to %d specialized copies (%d instructions "
+                "fewer)\n", s->spec.sites, s->spec.calls, s->spec.cloned, s->spec.removed);
+    }
+    if (s->tail.calls) {
+        fprintf(out, "tac tail: %d self tail calls made jumps in %d functions, %d through an accumulator\n",
+                s->tail.calls, s->tail.funcs, s->tail.acc);
+    }
+    if (s->loops.counted) {
+        fprintf(out, "tac loops: %d counted, %d fused, %d nests tiled", s->loops.counted, s->loops.fused,
+                s->loops.tiled);
+        if (s->loops.tile) fprintf(out, " by %d", s->loops.tile);
+        fputc('\n', out);
+    }
+    if (s->blocks.threaded || s->blocks.dead || s->blocks.jumps || s->blocks.labels || s->blocks.moved) {
+        fprintf(out, "tac blocks: %d jumps threaded, %d dead, %d jumps and %d labels dropped, %d blocks placed "
+                "(%d by inverting a jz)%s\n", s->blocks.threaded, s->blocks.dead, s->blocks.jumps, s->blocks.labels,
+                s->blocks.moved, s->blocks.inverted, s->blocks.profiled ? ", from a profile" : "");
+    }
+    if (s->exec.ran) {
+        const tac_exec *e = &s->exec;
+        fprintf(out, "tac run: %" PRIu64 " instructions, %" PRIu64 " tape accesses, %" PRIu64 " misses in %d KiB "
+                "%d-way (%.2f%%)%s%s\n", e->executed, e->accesses, e->misses, e->kb, e->ways,
+                e->accesses ? 100.0 * (double)e->misses / (double)e->accesses : 0.0, e->why ? ", stopped: " : "",
+                e->why ? e->why : "");
+    }
+    if (!s->slots.slot_of) return;
+    int largest = 0, nused = 0;
+    for (int f = 0; f < s->slots.nframes; ++f) {
+        nused += s->slots.frames[f].temps;
+        if (s->slots.frames[f].slots > largest) largest = s->slots.frames[f].slots;
+    }
+    fprintf(out, "tac slots: %d temps -> largest frame %d slots (%zu bytes), %d pinned\n", nused + s->slots.pinned,
+            largest, (size_t)largest * sizeof(word), s->slots.pinned);
+    for (int f = 0; f < s->slots.nframes; ++f) {
+        const tac_frame *fr = &s->slots.frames[f];
+        if (fr->label < 0) fprintf(out, "frame top: %d temps -> %d slots\n", fr->temps, fr->slots);
+        else fprintf(out, "frame l%d: %d temps -> %d slots\n", fr->label, fr->temps, fr->slots);
+    }
+}
+
 /* record the mapping from vm opcode ip -> tac instr index */
 static inline void tac_record_vm_ip(tac_backend_state *s, size_t vm_ip, int tac_index) {
     if (!s->vm_ip_to_tac_index) return;
@@ -226,6 +794,11 @@ static void tac_fix_vm_map_after_insert(tac_backend_state *s, size_t idx) {
             s->vm_ip_to_tac_index[i]++;
         }
     }
+    /* a label inserted right at the end of a body is a loop condition after it */
+    for (int f = 0; f < s->nfuncs; ++f) {
+        if (s->funcs[f].start >= idx) s->funcs[f].start++;
+        if (s->funcs[f].end != (size_t)-1 && s->funcs[f].end > idx) s->funcs[f].end++;
+    }
 
     /* diagnostic: print after fix */
     if (TAC_DEBUG) {
@@ -241,12 +814,19 @@ static inline void tac_ensure_temp_capacity(tac_backend_state *s, int needed) {
     if (needed < s->temp_cap) return;
     int newcap = s->temp_cap ? s->temp_cap * 2 : 16;
     while (newcap <= needed) newcap *= 2;
-    s->temp_types = (int*)realloc(s->temp_types, sizeof(int) * newcap);
+    s->temp_types = (uint8_t*)tac_mem_grow(&s->prog.arena, s->temp_types, (size_t)s->temp_cap, (size_t)newcap);
     /* initialize new slots to TYPE_UNKNOWN */
     for (int i = s->temp_cap; i < newcap; ++i) s->temp_types[i] = TYPE_UNKNOWN;
     s->temp_cap = newcap;
 }
 
+static inline int tac_new_temp(tac_backend_state *s, TypeTag type) {
+    int t = s->next_temp++;
+    tac_ensure_temp_capacity(s, t);
+    s->temp_types[t] = (uint8_t)type;
+    return t;
+}
+
 static inline void tac_push(VM *vm, int type, word imm) {
     tac_backend_state *s = tac_state(vm);
     /* compute opcode ip: PUSH consumes opcode + type + imm -> vm->ip - 3 */
@@ -256,7 +836,7 @@ static inline void tac_push(VM *vm, int type, word imm) {
     int tmp = s->next_temp++;
     /* ensure temp_types can hold this temp id */
     tac_ensure_temp_capacity(s, tmp);
-    s->temp_types[tmp] = type;
+    s->temp_types[tmp] = (uint8_t)type;
     tac_emit(&s->prog, (tac_instr){.op=TAC_CONST, .dst=tmp, .imm=imm, .dst_type=type});
     s->stack[s->sp++] = tmp;
 }
@@ -275,7 +855,7 @@ static inline void tac_binary(VM *vm, TacOp op) {
     tac_ensure_temp_capacity(s, dst);
     int inferred_type = TYPE_UNKNOWN;
     if (lhs >= 0 && lhs < s->temp_cap) inferred_type = s->temp_types[lhs];
-    s->temp_types[dst] = inferred_type;
+    s->temp_types[dst] = (uint8_t)inferred_type;
     tac_emit(&s->prog, (tac_instr){.op=op, .dst=dst, .lhs=lhs, .rhs=rhs, .dst_type=inferred_type});
     s->stack[s->sp++] = dst;
 }
@@ -298,8 +878,9 @@ static void tac_not(VM *vm) {
 
     assert(s->sp >= 1 && "tac_not: missing operand temp");
     int lhs = s->stack[--s->sp];
-    int dst = s->next_temp++;
-    tac_emit(&s->prog, (tac_instr){.op=TAC_NOT, .dst=dst, .lhs=lhs});
+    /* the result keeps the operand's tag, as in the interpreter */
+    int dst = tac_new_temp(s, (TypeTag)s->temp_types[lhs]);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_NOT, .dst=dst, .lhs=lhs, .dst_type=s->temp_types[lhs]});
     s->stack[s->sp++] = dst;
 }
 
@@ -310,8 +891,9 @@ static void tac_gez(VM *vm) {
 
     assert(s->sp >= 1 && "tac_gez: missing operand temp");
     int lhs = s->stack[--s->sp];
-    int dst = s->next_temp++;
-    tac_emit(&s->prog, (tac_instr){.op=TAC_GEZ, .dst=dst, .lhs=lhs});
+    /* the result keeps the operand's tag, as in the interpreter */
+    int dst = tac_new_temp(s, (TypeTag)s->temp_types[lhs]);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_GEZ, .dst=dst, .lhs=lhs, .dst_type=s->temp_types[lhs]});
     s->stack[s->sp++] = dst;
 }
 
@@ -354,7 +936,8 @@ static void tac_load(VM *vm) {
     size_t opcode_ip = vm->ip > 0 ? vm->ip - 1 : 0;
     tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
 
-    int dst = s->next_temp++;
+    /* the cell's type is filled in by tac_infer_types (tac/types.h) */
+    int dst = tac_new_temp(s, TYPE_UNKNOWN);
     tac_emit(&s->prog, (tac_instr){.op=TAC_LOAD, .dst=dst});
     s->stack[s->sp++] = dst;
 }
@@ -395,8 +978,8 @@ static void tac_deref(VM *vm) {
     /* explicit pointer path only: require a pointer temp on the virtual stack */
     assert(s->sp >= 1 && "tac_deref: missing pointer temp on virtual stack");
     int lhs = s->stack[--s->sp];
-    int dst = s->next_temp++;
-    tac_emit(&s->prog, (tac_instr){.op=TAC_DEREF, .dst=dst, .lhs=lhs});
+    int dst = tac_new_temp(s, TYPE_PTR);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_DEREF, .dst=dst, .lhs=lhs, .dst_type=TYPE_PTR});
     s->stack[s->sp++] = dst;
 }
 
@@ -408,8 +991,8 @@ static void tac_refer(VM *vm) {
     /* explicit value -> pointer: require a value temp on the virtual stack */
     assert(s->sp >= 1 && "tac_refer: missing value temp on virtual stack");
     int lhs = s->stack[--s->sp];
-    int dst = s->next_temp++;
-    tac_emit(&s->prog, (tac_instr){.op=TAC_REFER, .dst=dst, .lhs=lhs});
+    int dst = tac_new_temp(s, TYPE_PTR);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_REFER, .dst=dst, .lhs=lhs, .dst_type=TYPE_PTR});
     s->stack[s->sp++] = dst;
 }
 
@@ -419,8 +1002,8 @@ static void tac_where(VM *vm) {
     tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
 
     /* produce an explicit address/temp */
-    int dst = s->next_temp++;
-    tac_emit(&s->prog, (tac_instr){.op=TAC_WHERE, .dst=dst});
+    int dst = tac_new_temp(s, TYPE_PTR);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_WHERE, .dst=dst, .dst_type=TYPE_PTR});
     s->stack[s->sp++] = dst;
 }
 
@@ -432,8 +1015,8 @@ static void tac_offset(VM *vm, word imm) {
     /* explicit pointer path only: require a pointer temp on the virtual stack */
     assert(s->sp >= 1 && "tac_offset: missing pointer temp on virtual stack");
     int lhs = s->stack[--s->sp];
-    int dst = s->next_temp++;
-    tac_emit(&s->prog, (tac_instr){.op=TAC_OFFSET, .dst=dst, .lhs=lhs, .imm=imm});
+    int dst = tac_new_temp(s, TYPE_PTR);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_OFFSET, .dst=dst, .lhs=lhs, .imm=imm, .dst_type=TYPE_PTR});
     s->stack[s->sp++] = dst;
 }
 
@@ -446,8 +1029,8 @@ static void tac_index(VM *vm) {
     assert(s->sp >= 2 && "tac_index: missing pointer/index temps on virtual stack");
     int rhs = s->stack[--s->sp];
     int lhs = s->stack[--s->sp];
-    int dst = s->next_temp++;
-    tac_emit(&s->prog, (tac_instr){TAC_INDEX, dst, lhs, rhs, 0});
+    int dst = tac_new_temp(s, TYPE_PTR);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_INDEX, .dst=dst, .lhs=lhs, .rhs=rhs, .dst_type=TYPE_PTR});
     s->stack[s->sp++] = dst;
 }
 
@@ -460,7 +1043,7 @@ static void tac_set(VM *vm, int type, word imm) {
     /* create a temp for the immediate value with proper type */
     int valtmp = s->next_temp++;
     tac_ensure_temp_capacity(s, valtmp);
-    s->temp_types[valtmp] = type;
+    s->temp_types[valtmp] = (uint8_t)type;
     tac_emit(&s->prog, (tac_instr){.op=TAC_CONST, .dst=valtmp, .imm=imm, .dst_type=type});
 
     /* Prefer using an explicit pointer temp from the virtual stack. If none is present,
@@ -484,6 +1067,243 @@ static void tac_set(VM *vm, int type, word imm) {
     tac_emit(&s->prog, (tac_instr){.op=TAC_SET, .lhs=lhs, .rhs=valtmp});
 }
 
+static void tac_arena(VM *vm, word n) {
+    tac_backend_state *s = tac_state(vm);
+    /* ARENA consumes opcode+imm -> vm->ip - 2 */
+    size_t opcode_ip = vm->ip >= 2 ? vm->ip - 2 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    int dst = s->next_temp++;
+    tac_ensure_temp_capacity(s, dst);
+    s->temp_types[dst] = TYPE_PTR;
+    tac_emit(&s->prog, (tac_instr){.op=TAC_ARENA, .dst=dst, .imm=n, .dst_type=TYPE_PTR});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_ncall(VM *vm, word native_index) {
+    tac_backend_state *s = tac_state(vm);
+    /* NCALL consumes opcode+imm -> vm->ip - 2 */
+    size_t opcode_ip = vm->ip >= 2 ? vm->ip - 2 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    const NativeSig *sig = native_get((int)native_index);
+    assert(sig && "tac_ncall: unknown intrinsic index");
+    assert(s->sp >= sig->arity && "tac_ncall: missing argument temps on virtual stack");
+    /* arguments stay in push order, matching the native calling convention */
+    s->sp -= sig->arity;
+    int off = tac_add_args(&s->prog, &s->stack[s->sp], sig->arity);
+
+    int dst = -1;
+    if (sig->result_type != TYPE_VOID) {
+        dst = s->next_temp++;
+        tac_ensure_temp_capacity(s, dst);
+        s->temp_types[dst] = (uint8_t)sig->result_type;
+    }
+    tac_emit(&s->prog, (tac_instr){.op=TAC_NCALL, .dst=dst, .lhs=off, .rhs=sig->arity, .imm=native_index, .dst_type=sig->result_type});
+    if (dst >= 0) s->stack[s->sp++] = dst;
+}
+
+/* shared lowering for the hash map ops: pop `nops` operand temps (handle
+ * first) and, if dst_type is not TYPE_VOID, produce a result temp */
+static void tac_hmap(VM *vm, TacOp op, int nops, int dst_type) {
+    tac_backend_state *s = tac_state(vm);
+    size_t opcode_ip = vm->ip > 0 ? vm->ip - 1 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= nops && "tac_hmap: missing operand temps on virtual stack");
+    int ops[3] = { -1, -1, -1 };
+    for (int i = nops - 1; i >= 0; --i) ops[i] = s->stack[--s->sp];
+
+    int dst = -1;
+    if (dst_type != TYPE_VOID) {
+        dst = s->next_temp++;
+        tac_ensure_temp_capacity(s, dst);
+        s->temp_types[dst] = (uint8_t)dst_type;
+    }
+    tac_emit(&s->prog, (tac_instr){.op=op, .dst=dst, .lhs=ops[0], .rhs=ops[1], .imm=(word)ops[2], .dst_type=dst_type});
+    if (dst >= 0) s->stack[s->sp++] = dst;
+}
+
+static void tac_hnew(VM *vm) { tac_hmap(vm, TAC_HNEW, 0, TYPE_I64); }
+static void tac_hput(VM *vm) { tac_hmap(vm, TAC_HPUT, 3, TYPE_VOID); }
+/* value type is only known at runtime */
+static void tac_hget(VM *vm) { tac_hmap(vm, TAC_HGET, 2, TYPE_UNKNOWN); }
+static void tac_hdel(VM *vm) { tac_hmap(vm, TAC_HDEL, 2, TYPE_BOOL); }
+static void tac_hlen(VM *vm) { tac_hmap(vm, TAC_HLEN, 1, TYPE_I64); }
+static void tac_hiter(VM *vm) { tac_hmap(vm, TAC_HITER, 1, TYPE_I64); }
+
+static void tac_sort(VM *vm, word n) {
+    tac_backend_state *s = tac_state(vm);
+    /* SORT consumes opcode+imm -> vm->ip - 2 */
+    size_t opcode_ip = vm->ip >= 2 ? vm->ip - 2 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    tac_emit(&s->prog, (tac_instr){.op=TAC_SORT, .dst=-1, .imm=n});
+}
+
+static void tac_search(VM *vm, TacOp op, word n) {
+    tac_backend_state *s = tac_state(vm);
+    size_t opcode_ip = vm->ip >= 2 ? vm->ip - 2 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= 1 && "tac_search: missing key temp on virtual stack");
+    int key = s->stack[--s->sp];
+    int dst = s->next_temp++;
+    tac_ensure_temp_capacity(s, dst);
+    s->temp_types[dst] = TYPE_I64;
+    tac_emit(&s->prog, (tac_instr){.op=op, .dst=dst, .lhs=key, .imm=n, .dst_type=TYPE_I64});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_bsearch(VM *vm, word n) { tac_search(vm, TAC_BSEARCH, n); }
+static void tac_lowerbound(VM *vm, word n) { tac_search(vm, TAC_LOWERBOUND, n); }
+
+/* shared lowering for the text and hash kernels taking n alone: pop `nops`
+ * operand temps (first pushed in lhs) and produce one result temp */
+static void tac_text(VM *vm, TacOp op, word n, int nops, TypeTag type) {
+    tac_backend_state *s = tac_state(vm);
+    size_t opcode_ip = vm->ip >= 2 ? vm->ip - 2 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= nops && "tac_text: missing operand temps on virtual stack");
+    int ops[2] = { -1, -1 };
+    for (int i = nops - 1; i >= 0; --i) ops[i] = s->stack[--s->sp];
+    int dst = tac_new_temp(s, type);
+    tac_emit(&s->prog, (tac_instr){.op=op, .dst=dst, .lhs=ops[0], .rhs=ops[1], .imm=n, .dst_type=type});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_pack(VM *vm, word n) { tac_text(vm, TAC_PACK, n, 0, TYPE_I64); }
+static void tac_findbyte(VM *vm, word n) { tac_text(vm, TAC_FINDBYTE, n, 2, TYPE_I64); }
+static void tac_countlines(VM *vm, word n) { tac_text(vm, TAC_COUNTLINES, n, 0, TYPE_I64); }
+static void tac_splitlines(VM *vm, word n) { tac_text(vm, TAC_SPLITLINES, n, 1, TYPE_I64); }
+static void tac_hash64(VM *vm, word n) { tac_text(vm, TAC_HASH64, n, 0, TYPE_U64); }
+static void tac_hash64b(VM *vm, word n) { tac_text(vm, TAC_HASH64B, n, 0, TYPE_U64); }
+static void tac_crc32c(VM *vm, word n) { tac_text(vm, TAC_CRC32C, n, 0, TYPE_U32); }
+static void tac_crc32cb(VM *vm, word n) { tac_text(vm, TAC_CRC32CB, n, 0, TYPE_U32); }
+
+static void tac_findany(VM *vm, word n, word k) {
+    tac_backend_state *s = tac_state(vm);
+    /* FINDANY consumes opcode+n+k -> vm->ip - 3 */
+    size_t opcode_ip = vm->ip >= 3 ? vm->ip - 3 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    int nops = (int)k + 1;
+    assert(s->sp >= nops && "tac_findany: missing operand temps on virtual stack");
+    s->sp -= nops;
+    int off = tac_add_args(&s->prog, &s->stack[s->sp], nops);
+    int dst = tac_new_temp(s, TYPE_I64);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_FINDANY, .dst=dst, .lhs=off, .rhs=nops, .imm=n, .dst_type=TYPE_I64});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_parseint(VM *vm, word n) {
+    tac_backend_state *s = tac_state(vm);
+    size_t opcode_ip = vm->ip >= 2 ? vm->ip - 2 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= 1 && "tac_parseint: missing pos temp on virtual stack");
+    int pos = s->stack[--s->sp];
+    int val = tac_new_temp(s, TYPE_I64);
+    int end = tac_new_temp(s, TYPE_I64);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_PARSEINT, .dst=val, .lhs=pos, .rhs=end, .imm=n, .dst_type=TYPE_I64});
+    s->stack[s->sp++] = val;
+    s->stack[s->sp++] = end;
+}
+
+/* --- 128-bit vectors --- */
+
+static void tac_vector(VM *vm, TacOp op, int nops, word lane, size_t nimm) {
+    tac_backend_state *s = tac_state(vm);
+    size_t opcode_ip = vm->ip > nimm ? vm->ip - 1 - nimm : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= nops && "tac_vector: missing operand temps on virtual stack");
+    int ops[2] = { -1, -1 };
+    for (int i = nops - 1; i >= 0; --i) ops[i] = s->stack[--s->sp];
+    if (op == TAC_VSTORE) {
+        tac_emit(&s->prog, (tac_instr){.op=op, .dst=-1, .lhs=ops[0], .imm=lane, .dst_type=TYPE_VOID});
+        return;
+    }
+    TypeTag type = op == TAC_VHSUM ? simd_hsum_type((TypeTag)lane) : TYPE_V128;
+    int dst = tac_new_temp(s, type);
+    tac_emit(&s->prog, (tac_instr){.op=op, .dst=dst, .lhs=ops[0], .rhs=ops[1], .imm=lane, .dst_type=type});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_vload(VM *vm, word lane) { tac_vector(vm, TAC_VLOAD, 0, lane, 1); }
+static void tac_vstore(VM *vm, word lane) { tac_vector(vm, TAC_VSTORE, 1, lane, 1); }
+static void tac_vsplat(VM *vm, word lane) { tac_vector(vm, TAC_VSPLAT, 1, lane, 1); }
+static void tac_vhsum(VM *vm, word lane) { tac_vector(vm, TAC_VHSUM, 1, lane, 1); }
+
+static void tac_vbinary(VM *vm, OpCode op, word lane) {
+    switch (op) {
+        case OP_VADD: tac_vector(vm, TAC_VADD, 2, lane, 1); break;
+        case OP_VSUB: tac_vector(vm, TAC_VSUB, 2, lane, 1); break;
+        case OP_VMUL: tac_vector(vm, TAC_VMUL, 2, lane, 1); break;
+        case OP_VMIN: tac_vector(vm, TAC_VMIN, 2, lane, 1); break;
+        case OP_VMAX: tac_vector(vm, TAC_VMAX, 2, lane, 1); break;
+        case OP_VAND: tac_vector(vm, TAC_VAND, 2, TYPE_V128, 0); break;
+        case OP_VOR: tac_vector(vm, TAC_VOR, 2, TYPE_V128, 0); break;
+        case OP_VXOR: tac_vector(vm, TAC_VXOR, 2, TYPE_V128, 0); break;
+        default: assert(0 && "tac_vbinary: not a vector op"); break;
+    }
+}
+
+static void tac_vshuffle(VM *vm, word lane, word mask) {
+    tac_backend_state *s = tac_state(vm);
+    /* VSHUFFLE consumes opcode+lane+mask -> vm->ip - 3 */
+    size_t opcode_ip = vm->ip >= 3 ? vm->ip - 3 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= 1 && "tac_vshuffle: missing vector temp on virtual stack");
+    int src = s->stack[--s->sp];
+    int dst = tac_new_temp(s, TYPE_V128);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_VSHUFFLE, .dst=dst, .lhs=src, .rhs=(int)lane, .imm=mask, .dst_type=TYPE_V128});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_select(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    size_t opcode_ip = vm->ip > 0 ? vm->ip - 1 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= 3 && "tac_select: missing operand temps on virtual stack");
+    int b = s->stack[--s->sp];
+    int a = s->stack[--s->sp];
+    int c = s->stack[--s->sp];
+    /* typed only if both choices have the same type */
+    int ty = s->temp_types[a] == s->temp_types[b] ? s->temp_types[a] : TYPE_UNKNOWN;
+    int dst = tac_new_temp(s, (TypeTag)ty);
+    tac_emit(&s->prog, (tac_instr){.op=TAC_SELECT, .dst=dst, .lhs=c, .rhs=a, .imm=(word)b, .dst_type=ty});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_min(VM *vm) { tac_binary(vm, TAC_MIN); }
+static void tac_max(VM *vm) { tac_binary(vm, TAC_MAX); }
+
+/* a -- r keeping a's type: abs and the one-operand bit ops */
+static inline void tac_unary_typed(VM *vm, TacOp op) {
+    tac_backend_state *s = tac_state(vm);
+    size_t opcode_ip = vm->ip > 0 ? vm->ip - 1 : 0;
+    tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
+
+    assert(s->sp >= 1 && "tac_unary_typed: missing operand temp");
+    int lhs = s->stack[--s->sp];
+    int dst = tac_new_temp(s, (TypeTag)s->temp_types[lhs]);
+    tac_emit(&s->prog, (tac_instr){.op=op, .dst=dst, .lhs=lhs, .dst_type=s->temp_types[lhs]});
+    s->stack[s->sp++] = dst;
+}
+
+static void tac_abs(VM *vm) { tac_unary_typed(vm, TAC_ABS); }
+static void tac_popcnt(VM *vm) { tac_unary_typed(vm, TAC_POPCNT); }
+static void tac_clz(VM *vm) { tac_unary_typed(vm, TAC_CLZ); }
+static void tac_ctz(VM *vm) { tac_unary_typed(vm, TAC_CTZ); }
+static void tac_bswap(VM *vm) { tac_unary_typed(vm, TAC_BSWAP); }
+static void tac_rotl(VM *vm) { tac_binary(vm, TAC_ROTL); }
+static void tac_rotr(VM *vm) { tac_binary(vm, TAC_ROTR); }
+static void tac_mulhi(VM *vm) { tac_binary(vm, TAC_MULHI); }
+
 // --- New control-flow emit helpers ---
 static inline int tac_new_label(tac_backend_state *s) {
     return s->label_counter++;
@@ -501,12 +1321,39 @@ static void tac_emit_jz(tac_backend_state *s, int cond_temp, int label) {
     tac_emit(&s->prog, (tac_instr){.op=TAC_JZ, .lhs=cond_temp, .imm=(word)label});
 }
 
-static void tac_emit_call(tac_backend_state *s, int dst, int func_idx) {
-    tac_emit(&s->prog, (tac_instr){.op=TAC_CALL, .dst=dst, .imm=(word)func_idx});
+/* rhs keeps the VM function index: a forward call's label is a placeholder */
+static void tac_emit_call(tac_backend_state *s, int dst, int label, int func_idx) {
+    tac_emit(&s->prog, (tac_instr){.op=TAC_CALL, .dst=dst, .rhs=func_idx, .imm=(word)label});
+}
+
+static void tac_emit_ret(tac_backend_state *s, int value) {
+    tac_emit(&s->prog, (tac_instr){.op=TAC_RET, .dst=-1, .lhs=value});
+}
+
+/* dst = src where the arms of an if meet; dst loses its type if they disagree */
+static void tac_emit_copy(tac_backend_state *s, int dst, int src) {
+    if (s->temp_types[dst] != s->temp_types[src]) s->temp_types[dst] = TYPE_UNKNOWN;
+    tac_emit(&s->prog, (tac_instr){.op=TAC_COPY, .dst=dst, .lhs=src, .dst_type=s->temp_types[src]});
 }
 
-static void tac_emit_ret(tac_backend_state *s) {
-    tac_emit(&s->prog, (tac_instr){.op=TAC_RET});
+/* save the bottom n temps of the virtual stack for an open if; returns their offset in s->join */
+static int tac_join_save(tac_backend_state *s, int n) {
+    if (s->join_len + n > s->join_cap) {
+        int nc = s->join_cap ? s->join_cap * 2 : 64;
+        while (nc < s->join_len + n) nc *= 2;
+        s->join = (int*)realloc(s->join, (size_t)nc * sizeof(int));
+        assert(s->join && "tac_join_save: out of memory");
+        s->join_cap = nc;
+    }
+    if (n) memcpy(s->join + s->join_len, s->stack, (size_t)n * sizeof(int));
+    s->join_len += n;
+    return s->join_len - n;
+}
+
+/* did the code lowered last end in a return (not the closing of a body)? */
+static int tac_arm_returned(const tac_backend_state *s) {
+    size_t n = s->prog.count;
+    return n && tac_op(&s->prog, n - 1) == TAC_RET && s->body_end != n;
 }
 
 /* insert a TAC_LABEL at a specific tac instruction index and fix vm map (diagnostic) */
@@ -530,9 +1377,9 @@ static void tac_insert_label_at_idx(tac_backend_state *s, size_t idx, int label)
         size_t start = idx > 3 ? idx - 3 : 0;
         size_t end = (idx + 3) < s->prog.count ? idx + 3 : s->prog.count - 1;
         for (size_t i = start; i <= end; ++i) {
-            tac_instr *it = &s->prog.code[i];
-            if (it->op == TAC_LABEL) fprintf(stderr, "  prog[%zu] = L%d\n", i, (int)it->imm);
-            else if (it->op == TAC_JZ) fprintf(stderr, "  prog[%zu] = JZ t%d -> L%d\n", i, it->lhs, (int)it->imm);
+            tac_instr it = tac_get(&s->prog, i);
+            if (it.op == TAC_LABEL) fprintf(stderr, "  prog[%zu] = L%d\n", i, (int)it.imm);
+            else if (it.op == TAC_JZ) fprintf(stderr, "  prog[%zu] = JZ t%d -> L%d\n", i, it.lhs, (int)it.imm);
         }
     }
 
@@ -551,9 +1398,16 @@ static void tac_function(VM *vm, word func_index) {
     /* allocate a fresh label id for this function to avoid colliding with generated labels */
     int lbl = tac_new_label(s);
     s->func_label[idx] = lbl;
+    if (s->nfuncs == s->funcs_cap) {
+        int nc = s->funcs_cap ? s->funcs_cap * 2 : 8;
+        s->funcs = (tac_func_span*)tac_mem_grow(&s->prog.arena, s->funcs, (size_t)s->funcs_cap * sizeof(tac_func_span),
+                                                (size_t)nc * sizeof(tac_func_span));
+        s->funcs_cap = nc;
+    }
+    s->funcs[s->nfuncs] = (tac_func_span){ .label = lbl, .index = idx, .start = s->prog.count, .end = (size_t)-1, .sp = s->sp };
     tac_emit_label(s, lbl);
     /* push a FUNCTION block so ENDBLOCK can pop it safely */
-    s->block_stack[s->block_sp++] = (tac_block_entry){ .type = OP_FUNCTION, .start_label = lbl, .else_label = 0, .end_label = 0, .cond_vm_ip = (size_t)-1 };
+    s->block_stack[s->block_sp++] = (tac_block_entry){ .type = OP_FUNCTION, .start_label = lbl, .else_label = 0, .end_label = 0, .cond_vm_ip = (size_t)-1, .func = s->nfuncs++ };
 }
 
 static void tac_call(VM *vm, word func_index) {
@@ -571,8 +1425,8 @@ static void tac_call(VM *vm, word func_index) {
     }
     /* allocate a destination temp for the call result (TAC-SSA style)
        and push it onto the virtual stack so subsequent ops can use it */
-    int dst = s->next_temp++;
-    tac_emit_call(s, dst, label);
+    int dst = tac_new_temp(s, TYPE_UNKNOWN); /* the callee's return type, see tac/types.h */
+    tac_emit_call(s, dst, label, idx);
     s->stack[s->sp++] = dst;
 }
 
@@ -581,7 +1435,12 @@ static void tac_return(VM *vm) {
     size_t opcode_ip = vm->ip > 0 ? vm->ip - 1 : 0;
     tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
 
-    tac_emit_ret(s);
+    /* the value returned is the top of the stack if the body pushed one */
+    int base = 0;
+    for (int b = s->block_sp - 1; b >= 0; --b) {
+        if (s->block_stack[b].type == OP_FUNCTION) { base = s->funcs[s->block_stack[b].func].sp; break; }
+    }
+    tac_emit_ret(s, s->sp > base ? s->stack[s->sp - 1] : -1);
 }
 
 static void tac_if(VM *vm) {
@@ -595,8 +1454,9 @@ static void tac_if(VM *vm) {
     int end_label = tac_new_label(s);
     /* emit conditional jump to else */
     tac_emit_jz(s, cond, else_label);
-    /* push block info so ELSE/ENDBLOCK can emit labels */
-    s->block_stack[s->block_sp++] = (tac_block_entry){ .type = OP_IF, .start_label = 0, .else_label = else_label, .end_label = end_label, .cond_vm_ip = (size_t)-1 };
+    /* push block info so ELSE/ENDBLOCK can emit labels, with the stack the arms start from */
+    int saved = tac_join_save(s, s->sp);
+    s->block_stack[s->block_sp++] = (tac_block_entry){ .type = OP_IF, .start_label = 0, .else_label = else_label, .end_label = end_label, .cond_vm_ip = (size_t)-1, .saved = saved, .if_sp = s->sp };
 }
 
 static void tac_else(VM *vm) {
@@ -605,13 +1465,29 @@ static void tac_else(VM *vm) {
     tac_record_vm_ip(s, opcode_ip, (int)s->prog.count);
 
     assert(s->block_sp > 0);
-    tac_block_entry b = s->block_stack[s->block_sp - 1];
-    assert(b.type == OP_IF && "ELSE without matching IF");
+    tac_block_entry *b = &s->block_stack[s->block_sp - 1];
+    assert(b->type == OP_IF && "ELSE without matching IF");
+    assert(s->join_len == b->saved + b->if_sp);
+    /* a value the arm pushed or replaced goes to a fresh temp, which the
+       else arm writes too (see tac_join) */
+    b->arm_dead = tac_arm_returned(s);
+    for (int k = 0; !b->arm_dead && k < s->sp; ++k) {
+        if (k < b->if_sp && s->stack[k] == s->join[b->saved + k]) continue;
+        int j = tac_new_temp(s, (TypeTag)s->temp_types[s->stack[k]]);
+        tac_emit_copy(s, j, s->stack[k]);
+        s->stack[k] = j;
+    }
+    b->arm_sp = s->sp;
+    tac_join_save(s, s->sp);
     /* jump to end, then emit else label */
-    tac_emit_jmp(s, b.end_label);
-    tac_emit_label(s, b.else_label);
+    b->arm_jmp = s->prog.count;
+    tac_emit_jmp(s, b->end_label);
+    tac_emit_label(s, b->else_label);
+    /* the else arm starts from the stack the if had */
+    memcpy(s->stack, s->join + b->saved, (size_t)b->if_sp * sizeof(int));
+    s->sp = b->if_sp;
     /* mark block as ELSE so ENDBLOCK knows how to finish */
-    s->block_stack[s->block_sp - 1].type = OP_ELSE;
+    b->type = OP_ELSE;
 }
 
 static void tac_while(VM *vm, word cond_ip) {
@@ -661,6 +1537,85 @@ static void tac_while(VM *vm, word cond_ip) {
     s->block_stack[s->block_sp++] = (tac_block_entry){ .type = OP_WHILE, .start_label = cond_label, .else_label = 0, .end_label = end_label, .cond_vm_ip = cond_vm_ip };
 }
 
+/*
+ * Close an if at its end label. TAC has no phi: where the arms leave
+ * different temps in a stack slot, each copies its own into one temp that
+ * the slot holds after the if. An arm that returned never gets to the end,
+ * so the stack the other one left is the one that does. Arms that leave
+ * stacks of different depths both reaching the end are not balanced: the
+ * last one lowered wins, as before.
+ */
+static void tac_join(tac_backend_state *s, const tac_block_entry *b) {
+    const int *at_if = s->join + b->saved;
+    if (b->type == OP_IF) {
+        /* no else: the jz skips the arm with the stack the if had */
+        int differ = 0;
+        if (tac_arm_returned(s)) {
+            memcpy(s->stack, at_if, (size_t)b->if_sp * sizeof(int));
+            s->sp = b->if_sp;
+        } else if (s->sp == b->if_sp) {
+            for (int k = 0; k < s->sp; ++k) differ |= s->stack[k] != at_if[k];
+        }
+        if (!differ) {
+            /* the jz goes to the end: the else label is never emitted */
+            for (size_t i = s->prog.count; i-- > 0; ) {
+                if (tac_op(&s->prog, i) == TAC_JZ && tac_imm(&s->prog, i) == b->else_label) {
+                    TAC_AT(&s->prog, i)->imm[TAC_SLOT(i)] = b->end_label;
+                    break;
+                }
+            }
+            tac_emit_label(s, b->end_label);
+            return;
+        }
+        for (int k = 0; k < s->sp; ++k) {
+            if (s->stack[k] == at_if[k]) continue;
+            int j = tac_new_temp(s, (TypeTag)s->temp_types[s->stack[k]]);
+            tac_emit_copy(s, j, s->stack[k]);
+            s->stack[k] = j;
+        }
+        tac_emit_jmp(s, b->end_label);
+        tac_emit_label(s, b->else_label);
+        for (int k = 0; k < s->sp; ++k) {
+            if (s->stack[k] != at_if[k]) tac_emit_copy(s, s->stack[k], at_if[k]);
+        }
+        tac_emit_label(s, b->end_label);
+        return;
+    }
+
+    const int *arm = at_if + b->if_sp;
+    int fix = 0; /* slots only the else arm replaced */
+    if (tac_arm_returned(s)) {
+        memcpy(s->stack, arm, (size_t)b->arm_sp * sizeof(int));
+        s->sp = b->arm_sp;
+    } else if (!b->arm_dead && s->sp == b->arm_sp) {
+        for (int k = 0; k < s->sp; ++k) {
+            if (s->stack[k] == arm[k]) continue;
+            if (k >= b->if_sp || arm[k] != at_if[k]) {
+                /* the if arm's join temp */
+                tac_emit_copy(s, arm[k], s->stack[k]);
+                s->stack[k] = arm[k];
+            } else {
+                int j = tac_new_temp(s, (TypeTag)s->temp_types[s->stack[k]]);
+                tac_emit_copy(s, j, s->stack[k]);
+                s->stack[k] = j;
+                fix = 1;
+            }
+        }
+    }
+    if (fix) {
+        /* the if arm left those slots alone: its jmp now goes through
+           copies of the temps the if had */
+        int via = tac_new_label(s);
+        tac_emit_jmp(s, b->end_label);
+        TAC_AT(&s->prog, b->arm_jmp)->imm[TAC_SLOT(b->arm_jmp)] = via;
+        tac_emit_label(s, via);
+        for (int k = 0; k < b->if_sp; ++k) {
+            if (arm[k] == at_if[k] && s->stack[k] != arm[k]) tac_emit_copy(s, s->stack[k], at_if[k]);
+        }
+    }
+    tac_emit_label(s, b->end_label);
+}
+
 static void tac_endblock(VM *vm) {
     tac_backend_state *s = tac_state(vm);
     size_t opcode_ip = vm->ip > 0 ? vm->ip - 1 : 0;
@@ -689,11 +1644,12 @@ static void tac_endblock(VM *vm) {
         tac_emit_jmp(s, target_label);
         tac_emit_label(s, b.end_label);
     } else if (b.type == OP_IF || b.type == OP_ELSE) {
-        /* just emit end label */
-        tac_emit_label(s, b.end_label);
+        tac_join(s, &b);
+        s->join_len = b.saved;
     } else if (b.type == OP_FUNCTION) {
-        /* function block: nothing to emit; just popped */
-        (void)0;
+        /* function block: nothing to emit; the body ends here */
+        s->funcs[b.func].end = s->prog.count;
+        s->body_end = s->prog.count;
     } else {
         /* unknown block type */
         assert(0 && "Unknown block type in tac_endblock");
@@ -704,6 +1660,7 @@ static void tac_endblock(VM *vm) {
 static const Backend __TAC = {
     .setup   = tac_setup,
     .finalize= tac_finalize,
+    .stats   = tac_stats,
     .op_push = tac_push,
     .op_add  = tac_add,
     .op_sub  = tac_sub,
@@ -744,6 +1701,49 @@ static const Backend __TAC = {
     .op_lrsh = tac_lrsh,
     .op_arsh = tac_arsh,
     .op_gez = tac_gez,
+
+    .op_arena = tac_arena,
+    .op_ncall = tac_ncall,
+
+    .op_hnew = tac_hnew,
+    .op_hput = tac_hput,
+    .op_hget = tac_hget,
+    .op_hdel = tac_hdel,
+    .op_hlen = tac_hlen,
+    .op_hiter = tac_hiter,
+
+    .op_sort = tac_sort,
+    .op_bsearch = tac_bsearch,
+    .op_lowerbound = tac_lowerbound,
+    .op_pack = tac_pack,
+    .op_findbyte = tac_findbyte,
+    .op_findany = tac_findany,
+    .op_countlines = tac_countlines,
+    .op_splitlines = tac_splitlines,
+    .op_parseint = tac_parseint,
+    .op_hash64 = tac_hash64,
+    .op_hash64b = tac_hash64b,
+    .op_crc32c = tac_crc32c,
+    .op_crc32cb = tac_crc32cb,
+    .op_vload = tac_vload,
+    .op_vstore = tac_vstore,
+    .op_vsplat = tac_vsplat,
+    .op_vbinary = tac_vbinary,
+    .op_vhsum = tac_vhsum,
+    .op_vshuffle = tac_vshuffle,
+
+    .op_select = tac_select,
+    .op_min = tac_min,
+    .op_max = tac_max,
+    .op_abs = tac_abs,
+
+    .op_popcnt = tac_popcnt,
+    .op_clz = tac_clz,
+    .op_ctz = tac_ctz,
+    .op_bswap = tac_bswap,
+    .op_rotl = tac_rotl,
+    .op_rotr = tac_rotr,
+    .op_mulhi = tac_mulhi,
 };
 
 // --- Dump TAC (predicate blocks) ---
@@ -764,13 +1764,42 @@ static const char *type_tag_name(int t) {
         case TYPE_BOOL: return "bool";
         case TYPE_PTR: return "ptr";
         case TYPE_VOID: return "void";
+        case TYPE_V128: return "v128";
         default: return "unknown";
     }
 }
 
-/* Print a single TAC instruction as a Prolog goal, including type annotation for
+/* vector shape for a lane type, e.g. i32x4; bitwise ops print as v128 */
+static const char *tac_lane_name(word lane) {
+    switch ((TypeTag)lane) {
+        case TYPE_I64: return "i64x2";
+        case TYPE_F64: return "f64x2";
+        case TYPE_I32: return "i32x4";
+        case TYPE_F32: return "f32x4";
+        case TYPE_U8: return "u8x16";
+        default: return "v128";
+    }
+}
+
+/* goal name of abs and the bit manipulation ops */
+static const char *tac_bits_name(TacOp op) {
+    switch (op) {
+        case TAC_ABS: return "abs";
+        case TAC_POPCNT: return "popcnt";
+        case TAC_CLZ: return "clz";
+        case TAC_CTZ: return "ctz";
+        case TAC_BSWAP: return "bswap";
+        case TAC_ROTL: return "rotl";
+        case TAC_ROTR: return "rotr";
+        default: return "mulhi";
+    }
+}
+
+/* Print TAC instruction i as a Prolog goal, including type annotation for
    destination temps when available (instr->dst_type). */
-static void tac_print_goal(FILE *out, const tac_instr *instr) {
+static void tac_print_goal(FILE *out, const tac_prog *t, size_t i) {
+    const tac_instr in = tac_get(t, i);
+    const tac_instr *instr = &in;
     switch (instr->op) {
         case TAC_CONST: {
             /* Print float constants as hex bit-patterns for clarity and append a
@@ -845,7 +1874,7 @@ static void tac_print_goal(FILE *out, const tac_instr *instr) {
             fprintf(out, "move(%" WORD_FMT ")", instr->imm);
             break;
         case TAC_LOAD:
-            fprintf(out, "load(t%d)", instr->dst);
+            fprintf(out, "load(t%d, %s)", instr->dst, type_tag_name(instr->dst_type));
             break;
         case TAC_STORE:
             fprintf(out, "store(t%d)", instr->lhs);
@@ -874,19 +1903,149 @@ static void tac_print_goal(FILE *out, const tac_instr *instr) {
         case TAC_SET:
             fprintf(out, "set(t%d, t%d)", instr->lhs, instr->rhs);
             break;
+        case TAC_ARENA:
+            fprintf(out, "arena(t%d, %" WORD_FMT ")", instr->dst, instr->imm);
+            break;
         case TAC_JMP:
             fprintf(out, "jmp(l%d)", (int)instr->imm);
             break;
         case TAC_JZ:
             fprintf(out, "jz(t%d, l%d)", instr->lhs, (int)instr->imm);
             break;
+        case TAC_JNZ:
+            fprintf(out, "jnz(t%d, l%d)", instr->lhs, (int)instr->imm);
+            break;
         case TAC_CALL:
-            if (instr->dst >= 0) fprintf(out, "call(l%d, t%d)", (int)instr->imm, instr->dst);
+            if (instr->dst >= 0) fprintf(out, "call(l%d, t%d, %s)", (int)instr->imm, instr->dst, type_tag_name(instr->dst_type));
             else fprintf(out, "call(l%d)", (int)instr->imm);
             break;
         case TAC_RET:
             fprintf(out, "ret");
             break;
+        case TAC_NCALL: {
+            /* ncall(Name, [Args], Dst, Type, pure|impure); Dst is `none` for void intrinsics */
+            const NativeSig *sig = native_get((int)instr->imm);
+            fprintf(out, "ncall(%s, [", sig ? sig->name : "unknown");
+            for (int a = 0; a < instr->rhs; ++a) fprintf(out, "%st%d", a ? ", " : "", t->args[instr->lhs + a]);
+            if (instr->dst >= 0) fprintf(out, "], t%d, ", instr->dst);
+            else fprintf(out, "], none, ");
+            fprintf(out, "%s, %s)", type_tag_name(instr->dst_type), (sig && sig->pure) ? "pure" : "impure");
+            break;
+        }
+        case TAC_HNEW:
+            fprintf(out, "hnew(t%d)", instr->dst);
+            break;
+        case TAC_HPUT:
+            fprintf(out, "hput(t%d, t%d, t%d)", instr->lhs, instr->rhs, (int)instr->imm);
+            break;
+        case TAC_HGET:
+            fprintf(out, "hget(t%d, t%d, t%d)", instr->dst, instr->lhs, instr->rhs);
+            break;
+        case TAC_HDEL:
+            fprintf(out, "hdel(t%d, t%d, t%d)", instr->dst, instr->lhs, instr->rhs);
+            break;
+        case TAC_HLEN:
+            fprintf(out, "hlen(t%d, t%d)", instr->dst, instr->lhs);
+            break;
+        case TAC_HITER:
+            fprintf(out, "hiter(t%d, t%d)", instr->dst, instr->lhs);
+            break;
+        case TAC_SORT:
+            fprintf(out, "sort(%" WORD_FMT ")", instr->imm);
+            break;
+        case TAC_BSEARCH:
+            fprintf(out, "bsearch(t%d, t%d, %" WORD_FMT ")", instr->dst, instr->lhs, instr->imm);
+            break;
+        case TAC_LOWERBOUND:
+            fprintf(out, "lowerbound(t%d, t%d, %" WORD_FMT ")", instr->dst, instr->lhs, instr->imm);
+            break;
+        case TAC_PACK:
+            fprintf(out, "pack(t%d, %" WORD_FMT ")", instr->dst, instr->imm);
+            break;
+        case TAC_FINDBYTE:
+            fprintf(out, "findbyte(t%d, t%d, t%d, %" WORD_FMT ")", instr->dst, instr->lhs, instr->rhs, instr->imm);
+            break;
+        case TAC_FINDANY:
+            /* findany(Dst, Pos, [Bytes], N) */
+            fprintf(out, "findany(t%d, t%d, [", instr->dst, t->args[instr->lhs]);
+            for (int a = 1; a < instr->rhs; ++a) fprintf(out, "%st%d", a > 1 ? ", " : "", t->args[instr->lhs + a]);
+            fprintf(out, "], %" WORD_FMT ")", instr->imm);
+            break;
+        case TAC_COUNTLINES:
+            fprintf(out, "countlines(t%d, %" WORD_FMT ")", instr->dst, instr->imm);
+            break;
+        case TAC_SPLITLINES:
+            fprintf(out, "splitlines(t%d, t%d, %" WORD_FMT ")", instr->dst, instr->lhs, instr->imm);
+            break;
+        case TAC_PARSEINT:
+            fprintf(out, "parseint(t%d, t%d, t%d, %" WORD_FMT ")", instr->dst, instr->rhs, instr->lhs, instr->imm);
+            break;
+        case TAC_HASH64:
+            fprintf(out, "hash64(t%d, %" WORD_FMT ")", instr->dst, instr->imm);
+            break;
+        case TAC_HASH64B:
+            fprintf(out, "hash64b(t%d, %" WORD_FMT ")", instr->dst, instr->imm);
+            break;
+        case TAC_CRC32C:
+            fprintf(out, "crc32c(t%d, %" WORD_FMT ")", instr->dst, instr->imm);
+            break;
+        case TAC_CRC32CB:
+            fprintf(out, "crc32cb(t%d, %" WORD_FMT ")", instr->dst, instr->imm);
+            break;
+        case TAC_VLOAD:
+            fprintf(out, "vload(t%d, %s)", instr->dst, tac_lane_name(instr->imm));
+            break;
+        case TAC_VSTORE:
+            fprintf(out, "vstore(t%d, %s)", instr->lhs, tac_lane_name(instr->imm));
+            break;
+        case TAC_VSPLAT:
+            fprintf(out, "vsplat(t%d, %s, t%d)", instr->dst, tac_lane_name(instr->imm), instr->lhs);
+            break;
+        case TAC_VADD:
+        case TAC_VSUB:
+        case TAC_VMUL:
+        case TAC_VMIN:
+        case TAC_VMAX:
+        case TAC_VAND:
+        case TAC_VOR:
+        case TAC_VXOR: {
+            static const char *const names[] = { "vadd", "vsub", "vmul", "vmin", "vmax", "vand", "vor", "vxor" };
+            fprintf(out, "%s(t%d, %s, t%d, t%d)", names[instr->op - TAC_VADD], instr->dst,
+                    tac_lane_name(instr->imm), instr->lhs, instr->rhs);
+            break;
+        }
+        case TAC_VHSUM:
+            fprintf(out, "vhsum(t%d, %s, t%d)", instr->dst, tac_lane_name(instr->imm), instr->lhs);
+            break;
+        case TAC_VSHUFFLE:
+            fprintf(out, "vshuffle(t%d, %s, t%d, %" WORD_FMT ")", instr->dst, tac_lane_name(instr->rhs), instr->lhs, instr->imm);
+            break;
+        case TAC_SELECT:
+            fprintf(out, "select(t%d, %s, t%d, t%d, t%d)", instr->dst, type_tag_name(instr->dst_type), instr->lhs,
+                    instr->rhs, (int)instr->imm);
+            break;
+        case TAC_MIN:
+        case TAC_MAX:
+            fprintf(out, "%s(t%d, %s, t%d, t%d)", instr->op == TAC_MIN ? "min" : "max", instr->dst,
+                    type_tag_name(instr->dst_type), instr->lhs, instr->rhs);
+            break;
+        case TAC_ABS:
+        case TAC_POPCNT:
+        case TAC_CLZ:
+        case TAC_CTZ:
+        case TAC_BSWAP:
+            fprintf(out, "%s(t%d, %s, t%d)", tac_bits_name(instr->op), instr->dst, type_tag_name(instr->dst_type),
+                    instr->lhs);
+            break;
+        case TAC_ROTL:
+        case TAC_ROTR:
+        case TAC_MULHI:
+            fprintf(out, "%s(t%d, %s, t%d, t%d)", tac_bits_name(instr->op), instr->dst, type_tag_name(instr->dst_type),
+                    instr->lhs, instr->rhs);
+            break;
+        case TAC_COPY:
+            fprintf(out, "copy(t%d, %s, t%d)", instr->dst, type_tag_name(instr->dst_type), instr->lhs);
+            break;
         case TAC_LABEL:
             /* labels handled by caller */
             fprintf(out, "true");
@@ -902,14 +2061,14 @@ static void tac_dump_write(FILE *out, const tac_prog *t) {
     size_t i = 0;
     while (i < t->count) {
         /* If we encounter a label, start a new predicate for it */
-        if (t->code[i].op == TAC_LABEL) {
-            int lbl = (int)t->code[i].imm;
+        if (tac_op(t, i) == TAC_LABEL) {
+            int lbl = (int)tac_imm(t, i);
             if (curr_label != -1) fprintf(out, "\n");
             curr_label = lbl;
             fprintf(out, "l%d :-\n", curr_label);
             i++;
             /* if label is terminal (next is label or end), emit true. */
-            if (i >= t->count || t->code[i].op == TAC_LABEL) {
+            if (i >= t->count || tac_op(t, i) == TAC_LABEL) {
                 fprintf(out, "  true.\n");
                 continue;
             }
@@ -927,19 +2086,19 @@ static void tac_dump_write(FILE *out, const tac_prog *t) {
            start a new implicit l0 for any following non-label instructions. */
         /* print first goal */
         fprintf(out, "  ");
-        tac_print_goal(out, &t->code[i]);
+        tac_print_goal(out, t, i);
         /* if first goal is a RET, close and advance */
-        if (t->code[i].op == TAC_RET) {
+        if (tac_op(t, i) == TAC_RET) {
             fprintf(out, ".\n");
             i++;
             /* if next is non-label and exists, ensure implicit l0 will be emitted in next loop iteration */
             continue;
         }
         i++;
-        while (i < t->count && t->code[i].op != TAC_LABEL) {
+        while (i < t->count && tac_op(t, i) != TAC_LABEL) {
             fprintf(out, ",\n  ");
-            tac_print_goal(out, &t->code[i]);
-            if (t->code[i].op == TAC_RET) {
+            tac_print_goal(out, t, i);
+            if (tac_op(t, i) == TAC_RET) {
                 fprintf(out, ".\n");
                 i++;
                 break;
@@ -947,18 +2106,18 @@ static void tac_dump_write(FILE *out, const tac_prog *t) {
             i++;
         }
         /* if we exited because next is label or end and we did not already close with a RET, close the clause */
-        if (i >= t->count || (i < t->count && t->code[i].op == TAC_LABEL)) {
+        if (i >= t->count || (i < t->count && tac_op(t, i) == TAC_LABEL)) {
             /* ensure we haven't just closed after a RET (which already printed a period) */
             /* look back to see if previous printed goal was a RET: if previous instr is RET, then we already closed */
             size_t prev_idx = i ? i - 1 : 0;
-            if (!(i > 0 && t->code[prev_idx].op == TAC_RET)) {
+            if (!(i > 0 && tac_op(t, prev_idx) == TAC_RET)) {
                 fprintf(out, ".\n");
             }
         }
     }
 }
 
-static void tac_dump_file(const tac_prog *t, const char *path) {
+static inline void tac_dump_file(const tac_prog *t, const char *path) {
     /* create parent dir if needed */
     create_dir("opt/tmp/raw");
 
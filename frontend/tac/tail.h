@@ -0,0 +1,209 @@
+#ifndef TAC_TAIL_H
+#define TAC_TAIL_H
+
+/*
+ * rrvm/frontend/tac/tail.h
+ *
+ * Self tail calls into loops. A function that calls itself and returns
+ * what the call returned, with nothing in between but labels and jumps,
+ * does not need a new frame: arguments are tape cells, so the stores
+ * before the call have already put them where the callee reads them, and
+ * temps are copied into a callee's frame on entry. The call becomes a jmp
+ * to a loop head just after the function's entry label. Since nothing
+ * moves tp between the call and the ret, it is where the callee would have
+ * left it either way, whatever the call's distance from the entry.
+ *
+ * The accumulator pattern, a call whose result is combined with a value
+ * computed before it (n * f(n - 1)) by add, mul or a bitwise and, or or
+ * xor and then returned, is a loop too: those wrap around in every integer
+ * type, so they can be reassociated. The function gets an accumulator,
+ * set to the op's identity on entry (before the loop head); the call
+ * folds its operand into it and jumps back, and every ret of the function
+ * returns the accumulator combined with what it returned before. That
+ * takes the call's result, the op and every returned value to have the
+ * same integer type (tac/types.h). One op per function.
+ *
+ * Functions with an arena block are left alone (each call frees its
+ * frame's blocks on return), as are bodies holding another function. It
+ * runs after tac_forward_loads, since an accumulator is assigned more than
+ * once.
+ */
+
+#include "alias.h"
+
+#define TAC_TAIL_HOPS 8 /* labels and jumps followed from a call to its ret */
+
+enum { TAC_TAIL_NONE, TAC_TAIL_JMP, TAC_TAIL_ACC, TAC_TAIL_RET, TAC_TAIL_DEAD };
+
+/* per function: the loop the tail calls jump to */
+typedef struct {
+    int head;   /* loop head label, -1 if no tail call */
+    int acc;    /* accumulator temp, -1 if none */
+    TacOp op;
+    uint8_t type;
+} tac_tail_func;
+
+/* identity of an op that may be reassociated, 0 if it may not */
+static inline int tac_tail_assoc(TacOp op, word *unit) {
+    switch (op) {
+        case TAC_ADD: case TAC_BITOR: case TAC_BITXOR: *unit = 0; return 1;
+        case TAC_MUL: *unit = 1; return 1;
+        case TAC_BITAND: *unit = -1; return 1;
+        default: return 0;
+    }
+}
+
+/* the instruction control reaches from i over labels and jumps, n if none */
+static inline size_t tac_tail_next(const tac_backend_state *s, const int *label_at, size_t i, size_t start, size_t end) {
+    const tac_prog *t = &s->prog;
+    for (int hops = 0; i < end && hops < TAC_TAIL_HOPS; ++hops) {
+        while (i < end && tac_op(t, i) == TAC_LABEL) i++;
+        if (i >= end || tac_op(t, i) != TAC_JMP) return i < end ? i : t->count;
+        word l = tac_imm(t, i);
+        if (l < 0 || l > s->label_counter || label_at[l] < 0) return t->count;
+        i = (size_t)label_at[l];
+        if (i <= start || i >= end) return t->count;
+    }
+    return t->count;
+}
+
+/* can f loop back on itself? its body is whole and holds no other function */
+static inline int tac_tail_loopable(const tac_backend_state *s, int f) {
+    const tac_func_span *F = &s->funcs[f];
+    if (F->end == (size_t)-1 || F->end <= F->start || F->index < 0) return 0;
+    for (int h = 0; h < s->nfuncs; ++h) {
+        if (h != f && s->funcs[h].start > F->start && s->funcs[h].start < F->end) return 0;
+    }
+    for (size_t i = F->start; i < F->end; ++i) {
+        if (tac_op(&s->prog, i) == TAC_ARENA) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Turn self tail calls into loops (see above); the alias result is
+ * recomputed. Returns the number of calls turned into jumps.
+ */
+static inline int tac_tail_calls(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    int nfuncs = s->nfuncs;
+    if (nfuncs <= 0) return 0;
+    int *label_at = tac_label_index(s);
+    uint8_t *kind = (uint8_t*)tac_mem_alloc(&t->arena, n + 1);
+    tac_tail_func *tf = (tac_tail_func*)tac_mem_alloc(&t->arena, (size_t)nfuncs * sizeof(tac_tail_func));
+    memset(kind, 0, n + 1);
+
+    int calls = 0;
+    size_t grown = 0;
+    for (int f = 0; f < nfuncs; ++f) {
+        tac_tail_func *T = &tf[f];
+        *T = (tac_tail_func){ .head = -1, .acc = -1 };
+        if (!tac_tail_loopable(s, f)) continue;
+        size_t start = s->funcs[f].start, end = s->funcs[f].end;
+        int direct = 0, acc = 0;
+        for (size_t i = start + 1; i < end; ++i) {
+            if (tac_op(t, i) != TAC_CALL || tac_rhs(t, i) != s->funcs[f].index) continue;
+            int d = tac_dst(t, i);
+            size_t r = tac_tail_next(s, label_at, i + 1, start, end);
+            if (r < n && tac_op(t, r) == TAC_RET && d >= 0 && tac_lhs(t, r) == d) {
+                kind[i] = TAC_TAIL_JMP;
+                direct++;
+                continue;
+            }
+            /* i + 1 combines the result with a value from before the call (of
+               the same type, or the interpreter would stop at it) */
+            TacOp op = i + 1 < end ? tac_op(t, i + 1) : TAC_LABEL;
+            word unit;
+            int a = tac_lhs(t, i + 1), b = tac_rhs(t, i + 1);
+            if (d < 0 || !tac_tail_assoc(op, &unit) || (a == d) == (b == d)) continue;
+            uint8_t ty = (uint8_t)tac_dst_type(t, i + 1);
+            if (ty < TYPE_I8 || ty > TYPE_U64 || s->temp_types[d] != ty) continue;
+            if (acc && (op != T->op || ty != T->type)) continue;
+            r = tac_tail_next(s, label_at, i + 2, start, end);
+            if (r >= n || tac_op(t, r) != TAC_RET || tac_lhs(t, r) != tac_dst(t, i + 1)) continue;
+            T->op = op;
+            T->type = ty;
+            kind[i] = TAC_TAIL_ACC;
+            if (r == i + 2) kind[r] = TAC_TAIL_DEAD;
+            acc++;
+        }
+        if (acc) {
+            /* every way out returns a value of the type; none falls off the end */
+            int ok = tac_op(t, end - 1) == TAC_RET || tac_op(t, end - 1) == TAC_JMP;
+            for (size_t i = start + 1; ok && i < end; ++i) {
+                int v = tac_lhs(t, i);
+                if (tac_op(t, i) == TAC_RET) ok = v >= 0 && v < s->next_temp && s->temp_types[v] == T->type;
+            }
+            for (size_t i = start + 1; i < end; ++i) {
+                if ((kind[i] == TAC_TAIL_ACC || kind[i] == TAC_TAIL_DEAD) && !ok) kind[i] = TAC_TAIL_NONE;
+                if (tac_op(t, i) == TAC_RET && ok && kind[i] != TAC_TAIL_DEAD) { kind[i] = TAC_TAIL_RET; grown++; }
+            }
+            if (!ok) acc = 0;
+        }
+        if (!direct && !acc) continue;
+        T->head = tac_new_label(s);
+        grown++;
+        if (acc) {
+            T->acc = tac_new_temp(s, (TypeTag)T->type);
+            grown++;
+            s->tail.acc += acc;
+        }
+        calls += direct + acc;
+        s->tail.funcs++;
+    }
+    free(label_at);
+    s->tail.calls += calls;
+    if (!calls) return 0;
+
+    /* the loop head after each entry label; calls jump to it */
+    tac_instr *out = (tac_instr*)malloc((n + grown + 1) * sizeof(tac_instr));
+    size_t *to = (size_t*)malloc((n + 1) * sizeof(size_t));
+    int *fn_at = (int*)tac_mem_alloc(&t->arena, (n + 1) * sizeof(int));
+    int *owner = tac_frame_owner(s);
+    size_t k = 0;
+    for (size_t i = 0; i <= n; ++i) fn_at[i] = -1;
+    for (int f = 0; f < nfuncs; ++f) if (tf[f].head >= 0) fn_at[s->funcs[f].start] = f;
+    for (size_t i = 0; i < n; ++i) {
+        tac_instr in = tac_get(t, i);
+        const tac_tail_func *T = owner[i] > 0 ? &tf[owner[i] - 1] : NULL;
+        to[i] = k;
+        if (kind[i] == TAC_TAIL_JMP) {
+            out[k++] = (tac_instr){ .op = TAC_JMP, .imm = T->head };
+        } else if (kind[i] == TAC_TAIL_ACC) {
+            /* the op folds its other operand in; the ret after it is dead */
+            tac_instr next = tac_get(t, i + 1);
+            int x = next.lhs == in.dst ? next.rhs : next.lhs;
+            out[k++] = (tac_instr){ .op = T->op, .dst = T->acc, .lhs = T->acc, .rhs = x, .dst_type = T->type };
+            to[++i] = k;
+            out[k++] = (tac_instr){ .op = TAC_JMP, .imm = T->head };
+        } else if (kind[i] == TAC_TAIL_DEAD) {
+            /* only the call reached it: kept so the jmp is not followed by a label */
+            in.lhs = T->acc;
+            out[k++] = in;
+        } else if (kind[i] == TAC_TAIL_RET) {
+            int r = tac_new_temp(s, (TypeTag)T->type);
+            out[k++] = (tac_instr){ .op = T->op, .dst = r, .lhs = T->acc, .rhs = in.lhs, .dst_type = T->type };
+            in.lhs = r;
+            out[k++] = in;
+        } else {
+            out[k++] = in;
+        }
+        if (fn_at[i] >= 0) {
+            T = &tf[fn_at[i]];
+            word unit = 0;
+            if (T->acc >= 0 && tac_tail_assoc(T->op, &unit))
+                out[k++] = (tac_instr){ .op = TAC_CONST, .dst = T->acc, .imm = unit, .dst_type = T->type };
+            out[k++] = (tac_instr){ .op = TAC_LABEL, .imm = T->head };
+        }
+    }
+    to[n] = k;
+    tac_rewrite(s, out, k, to);
+    free(out);
+    free(to);
+    tac_points_to(vm);
+    return calls;
+}
+
+#endif /* TAC_TAIL_H */
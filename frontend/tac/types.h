@@ -0,0 +1,502 @@
+#ifndef TAC_TYPES_H
+#define TAC_TYPES_H
+
+/*
+ * rrvm/frontend/tac/types.h
+ *
+ * Type propagation over lowered TAC. Lowering types a temp from what it sees
+ * when it emits it: a constant, the operand of a binary op, the fixed result
+ * of a kernel. A load reads whatever the tape holds and a call returns
+ * whatever the callee left on the stack, so both come out unknown, and so
+ * does everything computed from them. tac_infer_types fills them in with a
+ * forward dataflow over each function's control flow:
+ *  - the state is the tape pointer (relative to the frame's entry; the top
+ *    level starts at cell 0), the pointers deref saved for refer, and for
+ *    every cell the frame wrote, the type it wrote and the value when that
+ *    is a constant tape index, so deref and index through a known pointer
+ *    keep tp known. Cells the frame has not written hold what it was entered
+ *    with, which is unknown. Where paths meet, only what they agree on is
+ *    kept;
+ *  - a load takes its cell's type, a binary op its operands' (the
+ *    interpreter requires them to match) and not/gez their operand's (the
+ *    interpreter keeps its tag);
+ *  - a call takes the callee's return type and applies its effect, both
+ *    joined over its rets: the cells it wrote, relative to where it was
+ *    entered, and its tp change if the rets agree on one.
+ * Callee summaries feed their callers, so the walk repeats until no type or
+ * summary changes. A temp whose paths disagree, or whose type only exists
+ * at run time (hget), stays unknown. Run it before tac_assign_slots: it
+ * relies on temps being single-assignment.
+ */
+
+#include <limits.h>
+#include "tac.h"
+
+enum {
+    TAC_TY_UNSET = 0xFF,          /* no path has defined the temp yet */
+    TAC_TY_KEEP = 0xFE,           /* cell not written by the frame */
+    TAC_TP_UNKNOWN = INT_MIN,     /* tp (or a saved pointer) is not known */
+    TAC_TP_NONE = INT_MIN + 1,    /* no ret reached yet (tac_func_effect.delta) */
+    TAC_TP_DEPTH = 4,             /* deref nesting tracked */
+    TAC_TYPE_CELLS = 2 * TAPE_SIZE, /* cells at relative tp -TAPE_SIZE .. TAPE_SIZE-1 */
+};
+
+typedef struct {
+    int tp;     /* relative to the frame's entry */
+    int depth;  /* pointers saved by deref, -1 if not known */
+    int saved[TAC_TP_DEPTH];
+} tac_tp_state;
+
+/* state on entry to a label: the cells that differ from `rest` */
+typedef struct {
+    int reached, queued;
+    tac_tp_state tp;
+    uint8_t rest;
+    int ncells;
+    uint16_t *cell;
+    uint8_t *type;
+    int *val;
+} tac_type_entry;
+
+/* what a call to a function does to its caller, joined over its rets */
+typedef struct {
+    uint8_t ret;
+    int delta;      /* tp change, TAC_TP_UNKNOWN if the rets disagree */
+    uint8_t *cells; /* TAC_TYPE_CELLS types, relative to the entry tp */
+    int *vals;
+} tac_func_effect;
+
+typedef struct {
+    tac_backend_state *s;
+    int *owner, *next, *label_at, *func_frame;
+    int *konst;          /* per temp: the tape index a constant holds, else -1 */
+    uint8_t *types;
+    tac_func_effect *fx; /* per frame, 0 being the top level */
+    tac_type_entry *at;  /* per label */
+    int *work, nwork;
+    int changed;         /* a temp type or a summary moved this round */
+    tac_tp_state tp;
+    uint8_t cells[TAC_TYPE_CELLS];
+    int vals[TAC_TYPE_CELLS]; /* -1: not a known tape index */
+    uint8_t scratch[TAC_TYPE_CELLS];
+    int scratch_vals[TAC_TYPE_CELLS];
+} tac_types_ctx;
+
+/* UNSET < a concrete type < UNKNOWN; KEEP only agrees with itself */
+static inline uint8_t tac_type_join(uint8_t a, uint8_t b) {
+    if (a == b) return a;
+    if (a == TAC_TY_KEEP || b == TAC_TY_KEEP) return TYPE_UNKNOWN;
+    if (a == TAC_TY_UNSET) return b;
+    if (b == TAC_TY_UNSET) return a;
+    return TYPE_UNKNOWN;
+}
+
+static inline int tac_type_known(uint8_t t) {
+    return t != TAC_TY_UNSET && t != TAC_TY_KEEP && t != TYPE_UNKNOWN;
+}
+
+static inline uint8_t tac_type_of(const tac_types_ctx *c, int temp) {
+    return temp >= 0 ? c->types[temp] : TYPE_UNKNOWN;
+}
+
+static inline void tac_type_def(tac_types_ctx *c, int temp, uint8_t type) {
+    if (temp < 0) return;
+    uint8_t j = tac_type_join(c->types[temp], type == TAC_TY_KEEP ? TYPE_UNKNOWN : type);
+    if (j != c->types[temp]) { c->types[temp] = j; c->changed = 1; }
+}
+
+/* index into cells of relative tp + off, -1 when outside the tracked range */
+static inline int tac_type_cell(const tac_types_ctx *c, word off) {
+    if (c->tp.tp == TAC_TP_UNKNOWN) return -1;
+    word k = (word)c->tp.tp + off + TAPE_SIZE;
+    return k >= 0 && k < TAC_TYPE_CELLS ? (int)k : -1;
+}
+
+static inline void tac_type_fill(uint8_t *cells, int *vals, uint8_t type) {
+    memset(cells, type, TAC_TYPE_CELLS);
+    memset(vals, 0xFF, TAC_TYPE_CELLS * sizeof(int));
+}
+
+/* every cell may have been written with anything */
+static inline void tac_type_clobber(tac_types_ctx *c) {
+    tac_type_fill(c->cells, c->vals, TYPE_UNKNOWN);
+}
+
+static inline void tac_type_write(tac_types_ctx *c, word off, uint8_t type, int val) {
+    int k = tac_type_cell(c, off);
+    if (k < 0) { tac_type_clobber(c); return; }
+    c->cells[k] = type;
+    c->vals[k] = val;
+}
+
+static inline void tac_type_move(tac_types_ctx *c, word d) {
+    if (c->tp.tp == TAC_TP_UNKNOWN) return;
+    word tp = (word)c->tp.tp + d;
+    c->tp.tp = tp > -TAPE_SIZE && tp < TAPE_SIZE ? (int)tp : TAC_TP_UNKNOWN;
+}
+
+static inline void tac_type_lose_tp(tac_types_ctx *c) {
+    c->tp.tp = TAC_TP_UNKNOWN;
+    c->tp.depth = -1;
+}
+
+/* keep the current cells in e, relative to whichever of KEEP/UNKNOWN is
+   more common */
+static inline void tac_type_pack(tac_types_ctx *c, tac_type_entry *e) {
+    int keep = 0, unknown = 0;
+    for (int k = 0; k < TAC_TYPE_CELLS; ++k) {
+        keep += c->cells[k] == TAC_TY_KEEP && c->vals[k] < 0;
+        unknown += c->cells[k] == TYPE_UNKNOWN && c->vals[k] < 0;
+    }
+    e->rest = keep >= unknown ? TAC_TY_KEEP : TYPE_UNKNOWN;
+    int n = TAC_TYPE_CELLS - (keep >= unknown ? keep : unknown);
+    free(e->cell);
+    free(e->type);
+    free(e->val);
+    e->cell = (uint16_t*)malloc((size_t)(n ? n : 1) * sizeof(uint16_t));
+    e->type = (uint8_t*)malloc((size_t)(n ? n : 1));
+    e->val = (int*)malloc((size_t)(n ? n : 1) * sizeof(int));
+    e->ncells = 0;
+    for (int k = 0; k < TAC_TYPE_CELLS; ++k) {
+        if (c->cells[k] == e->rest && c->vals[k] < 0) continue;
+        e->cell[e->ncells] = (uint16_t)k;
+        e->type[e->ncells] = c->cells[k];
+        e->val[e->ncells++] = c->vals[k];
+    }
+}
+
+static inline void tac_type_unpack(const tac_type_entry *e, uint8_t *cells, int *vals) {
+    tac_type_fill(cells, vals, e->rest);
+    for (int k = 0; k < e->ncells; ++k) {
+        cells[e->cell[k]] = e->type[k];
+        vals[e->cell[k]] = e->val[k];
+    }
+}
+
+/* join the cells a, av into cells, vals; 1 if any of those moved */
+static inline int tac_type_join_cells(uint8_t *cells, int *vals, const uint8_t *a, const int *av) {
+    int changed = 0;
+    for (int k = 0; k < TAC_TYPE_CELLS; ++k) {
+        uint8_t j = tac_type_join(cells[k], a[k]);
+        int v = vals[k] == av[k] ? vals[k] : -1;
+        if (j != cells[k] || v != vals[k]) changed = 1;
+        cells[k] = j;
+        vals[k] = v;
+    }
+    return changed;
+}
+
+/* join the current state into the entry of `label`, queueing it on change.
+   The current cells are left as the joined ones. */
+static inline void tac_type_merge(tac_types_ctx *c, int label) {
+    tac_type_entry *e = &c->at[label];
+    int changed = 0;
+    if (!e->reached) {
+        tac_type_pack(c, e);
+        e->tp = c->tp;
+        e->reached = changed = 1;
+    } else {
+        if (e->tp.tp != c->tp.tp && e->tp.tp != TAC_TP_UNKNOWN) { e->tp.tp = TAC_TP_UNKNOWN; changed = 1; }
+        if (e->tp.depth != c->tp.depth && e->tp.depth >= 0) { e->tp.depth = -1; changed = 1; }
+        for (int d = 0; d < e->tp.depth; ++d) {
+            if (e->tp.saved[d] != c->tp.saved[d] && e->tp.saved[d] != TAC_TP_UNKNOWN) {
+                e->tp.saved[d] = TAC_TP_UNKNOWN;
+                changed = 1;
+            }
+        }
+        tac_type_unpack(e, c->scratch, c->scratch_vals);
+        if (tac_type_join_cells(c->scratch, c->scratch_vals, c->cells, c->vals)) {
+            memcpy(c->cells, c->scratch, sizeof(c->cells));
+            memcpy(c->vals, c->scratch_vals, sizeof(c->vals));
+            tac_type_pack(c, e);
+            changed = 1;
+        }
+    }
+    if (changed && !e->queued) {
+        e->queued = 1;
+        c->work[c->nwork++] = label;
+    }
+}
+
+/* a ret (or the end of a body) of `frame` returning `type` */
+static inline void tac_type_return(tac_types_ctx *c, int frame, uint8_t type, int known_tp) {
+    tac_func_effect *fx = &c->fx[frame];
+    uint8_t ret = tac_type_join(fx->ret, type);
+    int d = known_tp && c->tp.tp != TAC_TP_UNKNOWN && c->tp.depth == 0 ? c->tp.tp : TAC_TP_UNKNOWN;
+    int changed = ret != fx->ret;
+    if (fx->delta == TAC_TP_NONE) {
+        memcpy(fx->cells, c->cells, TAC_TYPE_CELLS);
+        memcpy(fx->vals, c->vals, TAC_TYPE_CELLS * sizeof(int));
+        changed = 1;
+    } else {
+        if (fx->delta != d) d = TAC_TP_UNKNOWN;
+        changed |= tac_type_join_cells(fx->cells, fx->vals, c->cells, c->vals);
+    }
+    if (d != fx->delta) changed = 1;
+    fx->ret = ret;
+    fx->delta = d;
+    if (changed) c->changed = 1;
+}
+
+/* apply callee g's summary at a call; 0 if it has not returned yet */
+static inline int tac_type_call(tac_types_ctx *c, int g, int dst) {
+    const tac_func_effect *fx = &c->fx[g];
+    if (fx->delta == TAC_TP_NONE) return 0;
+    tac_type_def(c, dst, fx->ret);
+    int wrote = 0;
+    for (int k = 0; k < TAC_TYPE_CELLS && !wrote; ++k) wrote = fx->cells[k] != TAC_TY_KEEP || fx->vals[k] >= 0;
+    if (wrote && c->tp.tp == TAC_TP_UNKNOWN) {
+        tac_type_clobber(c);
+    } else if (wrote) {
+        /* callee cell k is at relative tp k - TAPE_SIZE from where it was entered */
+        for (int k = 0; k < TAC_TYPE_CELLS; ++k) {
+            if (fx->cells[k] == TAC_TY_KEEP && fx->vals[k] < 0) continue;
+            int at = tac_type_cell(c, (word)k - TAPE_SIZE);
+            if (at < 0) { tac_type_clobber(c); break; }
+            c->cells[at] = fx->cells[k];
+            c->vals[at] = fx->vals[k];
+        }
+    }
+    if (fx->delta == TAC_TP_UNKNOWN) tac_type_lose_tp(c);
+    else tac_type_move(c, fx->delta);
+    return 1;
+}
+
+/* apply instruction i; 0 when no path continues past it */
+static inline int tac_type_step(tac_types_ctx *c, size_t i) {
+    tac_prog *t = &c->s->prog;
+    TacOp op = tac_op(t, i);
+    int dst = tac_dst(t, i), lhs = tac_lhs(t, i), rhs = tac_rhs(t, i);
+    switch (op) {
+        case TAC_ADD: case TAC_SUB: case TAC_MUL: case TAC_DIV: case TAC_REM:
+        case TAC_BITAND: case TAC_BITOR: case TAC_BITXOR: case TAC_LSH: case TAC_LRSH: case TAC_ARSH:
+        case TAC_OR: case TAC_AND: case TAC_MIN: case TAC_MAX: case TAC_ROTL: case TAC_ROTR: case TAC_MULHI: {
+            uint8_t a = tac_type_of(c, lhs), b = tac_type_of(c, rhs);
+            if (tac_type_known(a)) tac_type_def(c, dst, a);
+            else if (tac_type_known(b)) tac_type_def(c, dst, b);
+            else if (a == TYPE_UNKNOWN && b == TYPE_UNKNOWN) tac_type_def(c, dst, TYPE_UNKNOWN);
+            return 1;
+        }
+        case TAC_NOT: case TAC_GEZ: case TAC_ABS: case TAC_POPCNT: case TAC_CLZ: case TAC_CTZ: case TAC_BSWAP:
+        case TAC_COPY:
+            tac_type_def(c, dst, tac_type_of(c, lhs));
+            return 1;
+        case TAC_SELECT: {
+            /* the chosen value keeps its type: known only if both agree */
+            uint8_t a = tac_type_of(c, rhs), b = tac_type_of(c, (int)tac_imm(t, i));
+            tac_type_def(c, dst, a == b ? a : TYPE_UNKNOWN);
+            return 1;
+        }
+        case TAC_LOAD: {
+            int k = tac_type_cell(c, 0);
+            tac_type_def(c, dst, k >= 0 ? c->cells[k] : TYPE_UNKNOWN);
+            return 1;
+        }
+        case TAC_STORE:
+            tac_type_write(c, 0, tac_type_of(c, lhs), lhs >= 0 ? c->konst[lhs] : -1);
+            return 1;
+        case TAC_SET:
+            tac_type_write(c, 0, tac_type_of(c, rhs), rhs >= 0 ? c->konst[rhs] : -1);
+            return 1;
+        case TAC_VSTORE:
+            for (int l = 0; l < simd_lanes((TypeTag)tac_imm(t, i)); ++l) tac_type_write(c, l, (uint8_t)tac_imm(t, i), -1);
+            return 1;
+        case TAC_PACK: {
+            word cells = (tac_imm(t, i) + (word)sizeof(word) - 1) / (word)sizeof(word);
+            for (word k = 0; k < cells; ++k) tac_type_write(c, k, WORD_BITS == 64 ? TYPE_U64 : TYPE_U32, -1);
+            tac_type_def(c, dst, (uint8_t)tac_dst_type(t, i));
+            return 1;
+        }
+        case TAC_SPLITLINES:
+            /* writes at an offset held in a temp */
+            tac_type_clobber(c);
+            tac_type_def(c, dst, (uint8_t)tac_dst_type(t, i));
+            return 1;
+        case TAC_MOVE: case TAC_OFFSET:
+            /* the interpreter moves tp for offset too */
+            tac_type_move(c, tac_imm(t, i));
+            if (op == TAC_OFFSET) tac_type_def(c, dst, TYPE_PTR);
+            return 1;
+        case TAC_DEREF: {
+            /* a pointer is absolute, tp only at the top level */
+            int k = tac_type_cell(c, 0), to = k >= 0 && c->owner[i] == 0 ? c->vals[k] : -1;
+            if (c->tp.depth >= 0 && c->tp.depth < TAC_TP_DEPTH) c->tp.saved[c->tp.depth++] = c->tp.tp;
+            else c->tp.depth = -1;
+            c->tp.tp = to >= 0 ? to : TAC_TP_UNKNOWN;
+            tac_type_def(c, dst, TYPE_PTR);
+            return 1;
+        }
+        case TAC_REFER:
+            if (c->tp.depth > 0) c->tp.tp = c->tp.saved[--c->tp.depth];
+            else tac_type_lose_tp(c);
+            tac_type_def(c, dst, TYPE_PTR);
+            return 1;
+        case TAC_INDEX: {
+            int k = tac_type_cell(c, 0);
+            if (k >= 0 && c->vals[k] >= 0) tac_type_move(c, c->vals[k]);
+            else c->tp.tp = TAC_TP_UNKNOWN;
+            tac_type_def(c, dst, TYPE_PTR);
+            return 1;
+        }
+        case TAC_CALL: {
+            int g = rhs >= 0 && rhs < 256 ? c->func_frame[rhs] : -1;
+            if (g >= 0) return tac_type_call(c, g, dst);
+            tac_type_def(c, dst, TYPE_UNKNOWN);
+            tac_type_clobber(c);
+            tac_type_lose_tp(c);
+            return 1;
+        }
+        case TAC_RET:
+            tac_type_return(c, c->owner[i], lhs >= 0 ? tac_type_of(c, lhs) : TYPE_I64, 1);
+            return 0;
+        case TAC_JMP:
+            tac_type_merge(c, (int)tac_imm(t, i));
+            return 0;
+        case TAC_JZ: case TAC_JNZ:
+            tac_type_merge(c, (int)tac_imm(t, i));
+            return 1;
+        default: {
+            /* the remaining ops fix their result's type at lowering; the
+               ones writing the tape are SORT, which keeps the cells' types
+               but not their values, and HITER */
+            word cells;
+            if (tac_tape_access(op, tac_imm(t, i), &cells) & TAC_MEM_WRITE) {
+                for (word k = 0; k < cells; ++k) {
+                    int at = tac_type_cell(c, k);
+                    if (at >= 0) c->vals[at] = -1;
+                }
+                if (cells < 0 || tac_type_cell(c, 0) < 0) tac_type_clobber(c);
+            }
+            unsigned f = tac_temp_fields(op);
+            if ((f & TAC_F_DST) && dst >= 0) tac_type_def(c, dst, (uint8_t)tac_dst_type(t, i));
+            if (f & TAC_F_RHS_DEF) tac_type_def(c, rhs, (uint8_t)tac_dst_type(t, i));
+            return 1;
+        }
+    }
+}
+
+/* walk from instruction i (a label or a frame entry) to the end of its block */
+static inline void tac_type_walk(tac_types_ctx *c, size_t i) {
+    tac_prog *t = &c->s->prog;
+    for (;;) {
+        if (!tac_type_step(c, i)) return;
+        int j = c->next[i];
+        if (j < 0) {
+            /* fell off the end of a body: nothing known about what it returns */
+            if (c->owner[i]) tac_type_return(c, c->owner[i], TYPE_UNKNOWN, 0);
+            return;
+        }
+        if (tac_op(t, (size_t)j) == TAC_LABEL) {
+            tac_type_merge(c, (int)tac_imm(t, (size_t)j));
+            return;
+        }
+        i = (size_t)j;
+    }
+}
+
+/* enter a frame at instruction i, before it has written anything */
+static inline void tac_type_enter(tac_types_ctx *c, size_t i) {
+    tac_prog *t = &c->s->prog;
+    tac_type_fill(c->cells, c->vals, TAC_TY_KEEP);
+    c->tp = (tac_tp_state){ .tp = 0, .depth = 0 };
+    if (tac_op(t, i) == TAC_LABEL) tac_type_merge(c, (int)tac_imm(t, i));
+    else tac_type_walk(c, i);
+}
+
+/*
+ * Give loads, calls and the values computed from them the types the
+ * program's data flow implies (see above), updating the dump's dst types
+ * and temp_types. Returns the number of temps left unknown.
+ */
+static inline int tac_infer_types(VM *vm) {
+    tac_backend_state *s = tac_state(vm);
+    tac_prog *t = &s->prog;
+    size_t n = t->count;
+    int nt = s->next_temp, nframes = s->nfuncs + 1, nlabels = s->label_counter + 1;
+
+    tac_types_ctx *c = (tac_types_ctx*)calloc(1, sizeof(tac_types_ctx));
+    c->s = s;
+    c->owner = tac_frame_owner(s);
+    c->label_at = tac_label_index(s);
+    c->next = (int*)malloc((n + 1) * sizeof(int));
+    int *last = (int*)malloc((size_t)nframes * sizeof(int));
+    for (int f = 0; f < nframes; ++f) last[f] = -1;
+    for (size_t i = 0; i < n; ++i) {
+        int o = c->owner[i];
+        if (last[o] >= 0) c->next[last[o]] = (int)i;
+        last[o] = (int)i;
+        c->next[i] = -1;
+    }
+    free(last);
+    c->func_frame = tac_callee_frames(s);
+    c->konst = (int*)malloc((size_t)(nt + 1) * sizeof(int));
+    for (int v = 0; v < nt; ++v) c->konst[v] = -1;
+    for (size_t i = 0; i < n; ++i) {
+        if (tac_op(t, i) != TAC_CONST || tac_dst(t, i) < 0 || tac_dst(t, i) >= nt) continue;
+        word imm = tac_imm(t, i);
+        int ty = tac_dst_type(t, i);
+        if (ty != TYPE_F32 && ty != TYPE_F64 && imm >= 0 && imm < TAPE_SIZE) c->konst[tac_dst(t, i)] = (int)imm;
+    }
+    c->types = (uint8_t*)malloc((size_t)(nt ? nt : 1));
+    memset(c->types, TAC_TY_UNSET, (size_t)(nt ? nt : 1));
+    c->fx = (tac_func_effect*)malloc((size_t)nframes * sizeof(tac_func_effect));
+    uint8_t *fx_cells = (uint8_t*)malloc((size_t)nframes * TAC_TYPE_CELLS);
+    int *fx_vals = (int*)malloc((size_t)nframes * TAC_TYPE_CELLS * sizeof(int));
+    for (int f = 0; f < nframes; ++f) {
+        c->fx[f] = (tac_func_effect){ .ret = TAC_TY_UNSET, .delta = TAC_TP_NONE,
+                                      .cells = fx_cells + (size_t)f * TAC_TYPE_CELLS,
+                                      .vals = fx_vals + (size_t)f * TAC_TYPE_CELLS };
+    }
+    c->at = (tac_type_entry*)calloc((size_t)nlabels, sizeof(tac_type_entry));
+    c->work = (int*)malloc((size_t)nlabels * sizeof(int));
+
+    int top = -1;
+    for (size_t i = 0; i < n && top < 0; ++i) if (c->owner[i] == 0) top = (int)i;
+    do {
+        c->changed = 0;
+        if (top >= 0) tac_type_enter(c, (size_t)top);
+        for (int f = 0; f < s->nfuncs; ++f) tac_type_enter(c, s->funcs[f].start);
+        while (c->nwork) {
+            int l = c->work[--c->nwork];
+            tac_type_entry *e = &c->at[l];
+            e->queued = 0;
+            tac_type_unpack(e, c->cells, c->vals);
+            c->tp = e->tp;
+            if (c->label_at[l] >= 0) tac_type_walk(c, (size_t)c->label_at[l]);
+        }
+        for (int l = 0; l < nlabels; ++l) {
+            free(c->at[l].cell);
+            free(c->at[l].type);
+            free(c->at[l].val);
+        }
+        memset(c->at, 0, (size_t)nlabels * sizeof(tac_type_entry));
+    } while (c->changed);
+
+    /* write the types back into the program */
+    int unknown = 0;
+    for (int v = 0; v < nt; ++v) {
+        uint8_t ty = c->types[v] == TAC_TY_UNSET ? TYPE_UNKNOWN : c->types[v];
+        if (c->types[v] != TAC_TY_UNSET) unknown += ty == TYPE_UNKNOWN;
+        s->temp_types[v] = ty;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        TacOp op = tac_op(t, i);
+        int dst = tac_dst(t, i);
+        if (!(tac_temp_fields(op) & TAC_F_DST) || dst < 0 || dst >= nt || op == TAC_CONST) continue;
+        TAC_AT(t, i)->type[TAC_SLOT(i)] = s->temp_types[dst];
+    }
+
+    free(fx_cells);
+    free(fx_vals);
+    free(c->types);
+    free(c->fx);
+    free(c->label_at);
+    free(c->next);
+    free(c->konst);
+    free(c->at);
+    free(c->work);
+    free(c);
+    return unknown;
+}
+
+#endif /* TAC_TYPES_H */
@@ -0,0 +1,853 @@
+/*
+ * rrvm/frontend/tier/jit.c
+ *
+ * Baseline x86-64 JIT (see jit.h).
+ *
+ * Register use inside compiled code:
+ *   rbx = VM*, r12 = sp, r13 = tp (both sign-extended), rax/rcx/rdx/xmm0
+ *   scratch. sp and tp are written back to the VM before every helper call
+ *   and at every exit, and reloaded after helper calls.
+ *
+ * Layout of one compiled region:
+ *   prologue   save callee-saved registers, load sp/tp, jmp to the entry
+ *              address passed as the second argument
+ *   exits      three stubs that store sp/tp and return JIT_EXIT,
+ *              JIT_RETURN or JIT_HALT
+ *   body       one label per instruction (the entry table), in code order
+ *   slow paths one stub per guarded instruction: run that instruction with
+ *              vm_step and jump back to the next label
+ *
+ * A guard that fails on an if/while condition (empty stack, which the
+ * interpreter asserts on) leaves compiled code at that instruction instead,
+ * and so does a branch to an ip outside the region (the end of a loop).
+ *
+ * Loop back-edges check the tier manager's trace table and, when the loop
+ * has a trace, call jit_trace_hook, which runs it and returns the label of
+ * the instruction it exited at.
+ *
+ * The scan also records the block tree of the region: for every ip, the
+ * innermost if, else arm or while body around it. jit_enter uses it to
+ * rebuild the interpreter's block-stack markers when compiled code exits
+ * at an arbitrary instruction.
+ */
+
+/* system headers first: vm.h defines emit macros such as __rem */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "tier.h"
+#include "x64.h"
+#include "../interpreter/interpreter.h"
+
+#define JIT_NO_ENTRY UINT32_MAX
+#define JIT_NO_TARGET SIZE_MAX
+
+/* a block the interpreter keeps a marker for while it runs inside it */
+typedef struct {
+    OpCode type; /* OP_IF, OP_ELSE or OP_WHILE, as interp_if/interp_while push it */
+    size_t ip;   /* the marker's ip */
+    int parent;  /* enclosing block, -1 for none inside the region */
+} jit_block;
+
+struct jit_code {
+    uint8_t *mem;      /* read/exec mapping */
+    size_t map_size;
+    size_t bytes;
+    size_t start, end; /* region ips [start, end]; end is the closing ENDBLOCK */
+    uint32_t *entry;   /* native offset per region ip, JIT_NO_ENTRY inside immediates */
+    jit_block *blocks;
+    int *blk;          /* innermost block around each region ip, -1 for none */
+    size_t exit_other; /* offset of the JIT_EXIT stub */
+};
+
+#if JIT_AVAILABLE
+
+_Static_assert(sizeof(word) == 8 && sizeof(TypeTag) == 4, "JIT assumes 8-byte words and 4-byte type tags");
+
+typedef int (*jit_fn)(VM *vm, const uint8_t *at);
+
+enum { R_VM = X64_RBX, R_SP = X64_R12, R_TP = X64_R13 };
+
+/* rel32 at `at` jumps to the label of bytecode ip `ip` */
+typedef struct { size_t at; size_t ip; } jit_fixup;
+
+/* out-of-line path of a guarded instruction */
+typedef struct {
+    size_t at[4]; /* jcc sites that branch here */
+    int n;
+    size_t ip, next;
+    int deopt;    /* leave compiled code at ip instead of stepping it */
+} jit_slow;
+
+typedef struct {
+    x64_buf x;
+    const word *code;
+    size_t start, end;
+    int loop;       /* region is one while loop: start is its condition, end its ENDBLOCK */
+    struct trace *const *traces; /* see jit_compile; NULL for no trace checks */
+    jit_code *jc;   /* allocated up front: the trace hook receives it */
+    uint32_t *entry;
+    size_t *target; /* static control target per region ip (see jit_scan) */
+    jit_block *blocks;
+    int nblocks;
+    int *blk;
+    jit_fixup *fix;
+    size_t nfix, capfix;
+    jit_slow *slow;
+    size_t nslow, capslow;
+    size_t exit_other, exit_return, exit_halt;
+    int oom;
+} jit_ctx;
+
+static int jit_step(VM *vm) {
+    return vm_step(vm, &__INTERPRETER);
+}
+
+/* --- operands --- */
+
+static x64_mem vm_field(size_t off) { return x64_at(R_VM, (int32_t)off); }
+
+/* stack[sp + k] and types[sp + k] */
+static x64_mem stack_slot(int k) { return x64_idx(R_VM, R_SP, 8, (int32_t)(offsetof(VM, stack) + (ptrdiff_t)k * 8)); }
+static x64_mem type_slot(int k) { return x64_idx(R_VM, R_SP, 4, (int32_t)(offsetof(VM, types) + (ptrdiff_t)k * 4)); }
+
+/* tape[tp] and tape_types[tp] */
+static x64_mem tape_cell(void) { return x64_idx(R_VM, R_TP, 8, (int32_t)offsetof(VM, tape)); }
+static x64_mem tape_type(void) { return x64_idx(R_VM, R_TP, 4, (int32_t)offsetof(VM, tape_types)); }
+
+static int fits_i32(word v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+/* --- emit helpers --- */
+
+static void jit_flush(jit_ctx *c) {
+    x64_store(&c->x, 0, vm_field(offsetof(VM, sp)), R_SP);
+    x64_store(&c->x, 0, vm_field(offsetof(VM, tp)), R_TP);
+}
+
+static void jit_reload(jit_ctx *c) {
+    x64_movsxd(&c->x, R_SP, vm_field(offsetof(VM, sp)));
+    x64_movsxd(&c->x, R_TP, vm_field(offsetof(VM, tp)));
+}
+
+static void jit_set_ip(jit_ctx *c, size_t ip) {
+    x64_store_imm(&c->x, 1, vm_field(offsetof(VM, ip)), (int32_t)ip);
+}
+
+/* flush, call fn(vm[, arg]) and reload; the result is in eax */
+static void jit_call(jit_ctx *c, uintptr_t fn, int has_arg, word arg) {
+    jit_flush(c);
+    x64_mov_rr(&c->x, X64_RDI, R_VM);
+    if (has_arg) x64_mov_imm(&c->x, X64_RSI, arg);
+    x64_mov_imm(&c->x, X64_RAX, (int64_t)fn);
+    x64_call_reg(&c->x, X64_RAX);
+    jit_reload(c);
+}
+
+/* run the instruction at ip through the interpreter */
+static void jit_generic(jit_ctx *c, size_t ip) {
+    jit_set_ip(c, ip);
+    jit_call(c, (uintptr_t)jit_step, 0, 0);
+}
+
+static void jit_jump_exit(jit_ctx *c, size_t exit) {
+    x64_link(&c->x, x64_jmp(&c->x), exit);
+}
+
+static jit_slow *jit_slow_new(jit_ctx *c, size_t ip, size_t next, int deopt);
+
+/* jump (cc < 0: unconditional) to the label of bytecode ip; an ip outside
+ * the region leaves compiled code there */
+static void jit_jump_ip(jit_ctx *c, int cc, size_t ip) {
+    size_t at = cc < 0 ? x64_jmp(&c->x) : x64_jcc(&c->x, cc);
+    if (ip < c->start || ip > c->end) {
+        jit_slow *s = jit_slow_new(c, ip, ip, 1);
+        if (s) s->at[s->n++] = at;
+        return;
+    }
+    if (c->nfix == c->capfix) {
+        size_t cap = c->capfix ? c->capfix * 2 : 64;
+        jit_fixup *nf = (jit_fixup*)realloc(c->fix, cap * sizeof(*nf));
+        if (!nf) { c->oom = 1; return; }
+        c->fix = nf;
+        c->capfix = cap;
+    }
+    c->fix[c->nfix].at = at;
+    c->fix[c->nfix].ip = ip;
+    c->nfix++;
+}
+
+static jit_slow *jit_slow_new(jit_ctx *c, size_t ip, size_t next, int deopt) {
+    if (c->nslow == c->capslow) {
+        size_t cap = c->capslow ? c->capslow * 2 : 64;
+        jit_slow *ns = (jit_slow*)realloc(c->slow, cap * sizeof(*ns));
+        if (!ns) { c->oom = 1; return NULL; }
+        c->slow = ns;
+        c->capslow = cap;
+    }
+    jit_slow *s = &c->slow[c->nslow++];
+    s->n = 0;
+    s->ip = ip;
+    s->next = next;
+    s->deopt = deopt;
+    return s;
+}
+
+/* branch to the slow path when cc holds; guards must precede any state change */
+static void jit_guard(jit_ctx *c, jit_slow *s, int cc) {
+    size_t at = x64_jcc(&c->x, cc);
+    if (s && s->n < (int)(sizeof(s->at) / sizeof(s->at[0]))) s->at[s->n++] = at;
+}
+
+/* at least k values on the stack */
+static void jit_need(jit_ctx *c, jit_slow *s, int k) {
+    x64_alu_imm(&c->x, X64_CMP, 1, R_SP, k);
+    jit_guard(c, s, X64_CC_L);
+}
+
+/* room for one more value */
+static void jit_room(jit_ctx *c, jit_slow *s) {
+    x64_alu_imm(&c->x, X64_CMP, 1, R_SP, STACK_SIZE);
+    jit_guard(c, s, X64_CC_GE);
+}
+
+/* the top two values have the same type; leaves it in eax */
+static void jit_same_types(jit_ctx *c, jit_slow *s) {
+    x64_load(&c->x, 0, X64_RAX, type_slot(-1));
+    x64_alu_load(&c->x, X64_CMP, 0, X64_RAX, type_slot(-2));
+    jit_guard(c, s, X64_CC_NE);
+}
+
+/* store rax (or an immediate) as a qword at m */
+static void jit_store_word(jit_ctx *c, x64_mem m, word v) {
+    if (fits_i32(v)) {
+        x64_store_imm(&c->x, 1, m, (int32_t)v);
+    } else {
+        x64_mov_imm(&c->x, X64_RAX, v);
+        x64_store(&c->x, 1, m, X64_RAX);
+    }
+}
+
+/* --- control-flow scan --- */
+
+/* Find the closing ENDBLOCK of the function body starting at `start` (same
+ * depth rule as interp_skip_block). */
+static int jit_find_end(const word *code, size_t code_len, size_t start, size_t *end) {
+    size_t depth = 0;
+    size_t ip = start;
+    while (ip < code_len) {
+        word op = code[ip];
+        if (op < 0 || op > OP_HALT) return 0;
+        if (op == OP_ENDBLOCK) {
+            if (depth == 0) { *end = ip; return 1; }
+            depth--;
+        } else if (op == OP_IF || op == OP_WHILE || op == OP_FUNCTION) {
+            depth++;
+        }
+        ip += 1 + (size_t)vm_op_imm_count((OpCode)op);
+    }
+    return 0;
+}
+
+/* add a block under `parent`; returns its index */
+static int jit_block_new(jit_ctx *c, OpCode type, size_t ip, int parent) {
+    jit_block *b = &c->blocks[c->nblocks];
+    b->type = type;
+    b->ip = ip;
+    b->parent = parent;
+    return c->nblocks++;
+}
+
+/*
+ * Mark instruction boundaries in c->entry and fill c->target:
+ *   IF       -> first ip of the else arm, or past the ENDBLOCK
+ *   ELSE     -> past the ENDBLOCK
+ *   WHILE    -> past the ENDBLOCK
+ *   ENDBLOCK -> the loop's condition ip if it closes a WHILE
+ * and c->blk with the block tree. An opener belongs to the enclosing block
+ * and an ENDBLOCK to the block it closes, matching when the interpreter
+ * pushes and pops the markers; an ELSE still belongs to its if block.
+ * Returns NULL, or why the region cannot be compiled.
+ */
+static const char *jit_scan(jit_ctx *c) {
+    size_t n = c->end - c->start + 1;
+    struct { OpCode op; size_t ip, else_ip; } *stk = malloc(n * sizeof(*stk));
+    if (!stk) return "out of memory";
+    int sp = 0, cur = -1;
+    const char *why = NULL;
+    /* a function's closing ENDBLOCK has no marker; a loop's is scanned */
+    size_t stop = c->loop ? c->end + 1 : c->end;
+
+    for (size_t i = 0; i < n; ++i) { c->entry[i] = JIT_NO_ENTRY; c->target[i] = JIT_NO_TARGET; c->blk[i] = -1; }
+    for (size_t ip = c->start; ip < stop && !why; ) {
+        OpCode op = (OpCode)c->code[ip];
+        size_t next = ip + 1 + (size_t)vm_op_imm_count(op);
+        if (next > stop) { why = "unbalanced blocks"; break; }
+        c->entry[ip - c->start] = 0;
+        c->blk[ip - c->start] = cur;
+        switch (op) {
+            case OP_FUNCTION:
+                why = "nested func";
+                break;
+            case OP_IF:
+            case OP_WHILE:
+                stk[sp].op = op;
+                stk[sp].ip = ip;
+                stk[sp].else_ip = JIT_NO_TARGET;
+                sp++;
+                cur = jit_block_new(c, op, op == OP_IF ? next : (size_t)c->code[ip + 1], cur);
+                break;
+            case OP_ELSE:
+                if (sp == 0 || stk[sp - 1].op != OP_IF) why = "else outside if";
+                else if (stk[sp - 1].else_ip != JIT_NO_TARGET) why = "repeated else";
+                else {
+                    stk[sp - 1].else_ip = ip;
+                    c->target[stk[sp - 1].ip - c->start] = next;
+                    cur = jit_block_new(c, OP_ELSE, next, c->blocks[cur].parent);
+                }
+                break;
+            case OP_ENDBLOCK: {
+                if (sp == 0) { why = "unbalanced blocks"; break; }
+                sp--;
+                cur = c->blocks[cur].parent;
+                if (stk[sp].op == OP_WHILE) {
+                    word cond = c->code[stk[sp].ip + 1];
+                    if (cond < (word)c->start || cond > (word)stk[sp].ip) { why = "loop condition outside the region"; break; }
+                    c->target[stk[sp].ip - c->start] = next;
+                    c->target[ip - c->start] = (size_t)cond;
+                } else if (stk[sp].else_ip != JIT_NO_TARGET) {
+                    c->target[stk[sp].else_ip - c->start] = next;
+                } else {
+                    c->target[stk[sp].ip - c->start] = next;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        ip = next;
+    }
+    if (!why && sp != 0) why = "unbalanced blocks";
+    if (!why && c->loop && c->target[c->end - c->start] != c->start) why = "not a loop region";
+    c->entry[c->end - c->start] = 0;
+    /* loop conditions must start on an instruction */
+    for (size_t i = 0; i < n && !why; ++i) {
+        if (c->entry[i] == JIT_NO_ENTRY || (OpCode)c->code[c->start + i] != OP_ENDBLOCK) continue;
+        size_t t = c->target[i];
+        if (t != JIT_NO_TARGET && c->entry[t - c->start] == JIT_NO_ENTRY) why = "loop condition inside an instruction";
+    }
+    free(stk);
+    return why;
+}
+
+/* --- code generation --- */
+
+static void jit_prologue(jit_ctx *c) {
+    x64_buf *x = &c->x;
+    /* entry rsp is 8 mod 16: four pushes and 8 bytes keep calls aligned */
+    x64_push(x, X64_RBP);
+    x64_push(x, X64_RBX);
+    x64_push(x, X64_R12);
+    x64_push(x, X64_R13);
+    x64_alu_imm(x, X64_SUB, 1, X64_RSP, 8);
+    x64_mov_rr(x, R_VM, X64_RDI);
+    jit_reload(c);
+    x64_jmp_reg(x, X64_RSI);
+
+    size_t common_at[2];
+    c->exit_other = x->len;
+    x64_mov_imm(x, X64_RAX, JIT_EXIT);
+    common_at[0] = x64_jmp(x);
+    c->exit_return = x->len;
+    x64_mov_imm(x, X64_RAX, JIT_RETURN);
+    common_at[1] = x64_jmp(x);
+    c->exit_halt = x->len;
+    x64_mov_imm(x, X64_RAX, JIT_HALT);
+    x64_link(x, common_at[0], x->len);
+    x64_link(x, common_at[1], x->len);
+    jit_flush(c);
+    x64_alu_imm(x, X64_ADD, 1, X64_RSP, 8);
+    x64_pop(x, X64_R13);
+    x64_pop(x, X64_R12);
+    x64_pop(x, X64_RBX);
+    x64_pop(x, X64_RBP);
+    x64_ret(x);
+}
+
+/* add/sub/mul: integer inline, f64 with SSE2, anything else via the slow path */
+static void jit_arith(jit_ctx *c, OpCode op, jit_slow *s) {
+    x64_buf *x = &c->x;
+    jit_need(c, s, 2);
+    jit_same_types(c, s);
+    x64_alu_imm(x, X64_CMP, 0, X64_RAX, TYPE_F64);
+    size_t to_f64 = x64_jcc(x, X64_CC_E);
+    x64_alu_imm(x, X64_CMP, 0, X64_RAX, TYPE_F32);
+    jit_guard(c, s, X64_CC_E);
+
+    x64_load(x, 1, X64_RAX, stack_slot(-2));
+    if (op == OP_MUL) x64_imul_load(x, X64_RAX, stack_slot(-1));
+    else x64_alu_load(x, op == OP_ADD ? X64_ADD : X64_SUB, 1, X64_RAX, stack_slot(-1));
+    x64_store(x, 1, stack_slot(-2), X64_RAX);
+    size_t done = x64_jmp(x);
+
+    x64_link(x, to_f64, x->len);
+    x64_movq_load(x, 0, stack_slot(-2));
+    x64_sse_sd(x, op == OP_ADD ? X64_ADDSD : op == OP_SUB ? X64_SUBSD : X64_MULSD, 0, stack_slot(-1));
+    x64_movq_store(x, stack_slot(-2), 0);
+
+    x64_link(x, done, x->len);
+    x64_dec(x, 1, R_SP);
+}
+
+/* binary integer ops on the top two values (interp_binary semantics) */
+static void jit_binary(jit_ctx *c, OpCode op, jit_slow *s) {
+    x64_buf *x = &c->x;
+    jit_need(c, s, 2);
+    jit_same_types(c, s);
+    switch (op) {
+        case OP_BITAND:
+        case OP_BITOR:
+        case OP_BITXOR:
+            x64_load(x, 1, X64_RAX, stack_slot(-2));
+            x64_alu_load(x, op == OP_BITAND ? X64_AND : op == OP_BITOR ? X64_OR : X64_XOR, 1, X64_RAX, stack_slot(-1));
+            break;
+        case OP_LSH:
+        case OP_LRSH:
+        case OP_ARSH:
+            x64_load(x, 1, X64_RAX, stack_slot(-2));
+            x64_load(x, 1, X64_RCX, stack_slot(-1));
+            x64_shift_cl(x, op == OP_LSH ? X64_SHL : op == OP_LRSH ? X64_SHR : X64_SAR, X64_RAX);
+            break;
+        case OP_ORASSign:
+            x64_load(x, 1, X64_RAX, stack_slot(-2));
+            x64_alu_load(x, X64_OR, 1, X64_RAX, stack_slot(-1));
+            x64_mov_imm(x, X64_RAX, 0); /* mov keeps the flags */
+            x64_setcc(x, X64_CC_NE, X64_RAX);
+            break;
+        case OP_ANDASSign:
+            x64_alu_rr(x, X64_XOR, 0, X64_RAX, X64_RAX);
+            x64_alu_rr(x, X64_XOR, 0, X64_RCX, X64_RCX);
+            x64_alu_mem_imm8(x, X64_CMP, stack_slot(-2), 0);
+            x64_setcc(x, X64_CC_NE, X64_RAX);
+            x64_alu_mem_imm8(x, X64_CMP, stack_slot(-1), 0);
+            x64_setcc(x, X64_CC_NE, X64_RCX);
+            x64_alu_rr(x, X64_AND, 0, X64_RAX, X64_RCX);
+            break;
+        default:
+            break;
+    }
+    x64_store(x, 1, stack_slot(-2), X64_RAX);
+    x64_dec(x, 1, R_SP);
+}
+
+/* pop the condition of an if/while and branch to its false target */
+static void jit_branch(jit_ctx *c, size_t ip, size_t next) {
+    x64_buf *x = &c->x;
+    jit_need(c, jit_slow_new(c, ip, next, 1), 1);
+    x64_load(x, 1, X64_RAX, stack_slot(-1));
+    x64_dec(x, 1, R_SP);
+    x64_test_rr(x, 1, X64_RAX, X64_RAX);
+    jit_jump_ip(c, X64_CC_E, c->target[ip - c->start]);
+}
+
+/* a loop back-edge ran the loop's trace; continue at the label of vm->ip */
+static const uint8_t *jit_trace_hook(VM *vm, const jit_code *jc) {
+    int block_sp = vm->block_sp;
+    tier_trace_from_jit(vm);
+    /* compiled code keeps no markers: drop what a side exit rebuilt */
+    vm->block_sp = block_sp;
+    size_t ip = vm->ip;
+    if (ip < jc->start || ip > jc->end || jc->entry[ip - jc->start] == JIT_NO_ENTRY) return jc->mem + jc->exit_other;
+    return jc->mem + jc->entry[ip - jc->start];
+}
+
+/* back-edge to cond: run the loop's trace if it has one by now */
+static void jit_trace_edge(jit_ctx *c, size_t cond) {
+    x64_buf *x = &c->x;
+    x64_mov_imm(x, X64_RAX, (int64_t)(uintptr_t)&c->traces[cond]);
+    x64_alu_mem_imm8(x, X64_CMP, x64_at(X64_RAX, 0), 0);
+    jit_jump_ip(c, X64_CC_E, cond);
+    jit_set_ip(c, cond);
+    jit_call(c, (uintptr_t)jit_trace_hook, 1, (word)(uintptr_t)c->jc);
+    x64_jmp_reg(x, X64_RAX);
+}
+
+static void jit_op(jit_ctx *c, size_t ip) {
+    x64_buf *x = &c->x;
+    OpCode op = (OpCode)c->code[ip];
+    size_t next = ip + 1 + (size_t)vm_op_imm_count(op);
+    word imm1 = next > ip + 1 ? c->code[ip + 1] : 0;
+    word imm2 = next > ip + 2 ? c->code[ip + 2] : 0;
+    jit_slow *s;
+
+    switch (op) {
+        case OP_NOP:
+            break;
+
+        case OP_PUSH:
+            s = jit_slow_new(c, ip, next, 0);
+            jit_room(c, s);
+            jit_store_word(c, stack_slot(0), imm2);
+            x64_store_imm(x, 0, type_slot(0), (int32_t)imm1);
+            x64_inc(x, 1, R_SP);
+            break;
+
+        case OP_LOAD:
+            s = jit_slow_new(c, ip, next, 0);
+            jit_room(c, s);
+            x64_load(x, 1, X64_RAX, tape_cell());
+            x64_store(x, 1, stack_slot(0), X64_RAX);
+            x64_load(x, 0, X64_RAX, tape_type());
+            x64_store(x, 0, type_slot(0), X64_RAX);
+            x64_inc(x, 1, R_SP);
+            break;
+
+        case OP_STORE:
+            s = jit_slow_new(c, ip, next, 0);
+            jit_need(c, s, 1);
+            x64_load(x, 1, X64_RAX, stack_slot(-1));
+            x64_store(x, 1, tape_cell(), X64_RAX);
+            x64_load(x, 0, X64_RAX, type_slot(-1));
+            x64_store(x, 0, tape_type(), X64_RAX);
+            x64_dec(x, 1, R_SP);
+            break;
+
+        case OP_SET:
+            jit_store_word(c, tape_cell(), imm2);
+            x64_store_imm(x, 0, tape_type(), (int32_t)imm1);
+            break;
+
+        case OP_WHERE:
+            /* like interp_where, the slot's type is left as it was */
+            s = jit_slow_new(c, ip, next, 0);
+            jit_room(c, s);
+            x64_store(x, 1, stack_slot(0), R_TP);
+            x64_inc(x, 1, R_SP);
+            break;
+
+        case OP_MOVE:
+        case OP_OFFSET:
+            if (!fits_i32(imm1)) { jit_generic(c, ip); break; }
+            s = jit_slow_new(c, ip, next, 0);
+            x64_lea(x, X64_RAX, x64_at(R_TP, (int32_t)imm1));
+            x64_alu_imm(x, X64_CMP, 1, X64_RAX, TAPE_SIZE);
+            jit_guard(c, s, X64_CC_AE);
+            x64_mov_rr(x, R_TP, X64_RAX);
+            break;
+
+        case OP_DEREF:
+            s = jit_slow_new(c, ip, next, 0);
+            x64_load(x, 0, X64_RAX, vm_field(offsetof(VM, tp_sp)));
+            x64_alu_imm(x, X64_CMP, 0, X64_RAX, TAPE_SIZE);
+            jit_guard(c, s, X64_CC_AE);
+            x64_load(x, 1, X64_RDX, tape_cell());
+            x64_alu_imm(x, X64_CMP, 1, X64_RDX, TAPE_SIZE);
+            jit_guard(c, s, X64_CC_AE);
+            x64_store(x, 0, x64_idx(R_VM, X64_RAX, 4, (int32_t)offsetof(VM, tp_stack)), R_TP);
+            x64_inc(x, 0, X64_RAX);
+            x64_store(x, 0, vm_field(offsetof(VM, tp_sp)), X64_RAX);
+            x64_mov_rr(x, R_TP, X64_RDX);
+            break;
+
+        case OP_REFER:
+            s = jit_slow_new(c, ip, next, 0);
+            x64_load(x, 0, X64_RAX, vm_field(offsetof(VM, tp_sp)));
+            x64_alu_imm(x, X64_CMP, 0, X64_RAX, 0);
+            jit_guard(c, s, X64_CC_LE);
+            x64_dec(x, 0, X64_RAX);
+            x64_store(x, 0, vm_field(offsetof(VM, tp_sp)), X64_RAX);
+            x64_movsxd(x, R_TP, x64_idx(R_VM, X64_RAX, 4, (int32_t)offsetof(VM, tp_stack)));
+            break;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+            jit_arith(c, op, jit_slow_new(c, ip, next, 0));
+            break;
+
+        case OP_BITAND:
+        case OP_BITOR:
+        case OP_BITXOR:
+        case OP_LSH:
+        case OP_LRSH:
+        case OP_ARSH:
+        case OP_ORASSign:
+        case OP_ANDASSign:
+            jit_binary(c, op, jit_slow_new(c, ip, next, 0));
+            break;
+
+        case OP_NOT:
+            s = jit_slow_new(c, ip, next, 0);
+            jit_need(c, s, 1);
+            x64_alu_rr(x, X64_XOR, 0, X64_RAX, X64_RAX);
+            x64_alu_mem_imm8(x, X64_CMP, stack_slot(-1), 0);
+            x64_setcc(x, X64_CC_E, X64_RAX);
+            x64_store(x, 1, stack_slot(-1), X64_RAX);
+            break;
+
+        case OP_GEZ:
+            s = jit_slow_new(c, ip, next, 0);
+            jit_need(c, s, 1);
+            x64_load(x, 1, X64_RAX, stack_slot(-1));
+            x64_unary(x, X64_NOT, X64_RAX);
+            x64_shift_imm(x, X64_SHR, X64_RAX, 63);
+            x64_store(x, 1, stack_slot(-1), X64_RAX);
+            break;
+
+        case OP_SELECT:
+            /* value and type of the chosen operand, both by cmov */
+            s = jit_slow_new(c, ip, next, 0);
+            jit_need(c, s, 3);
+            x64_load(x, 1, X64_RCX, stack_slot(-2));
+            x64_load(x, 1, X64_RDX, stack_slot(-1));
+            x64_alu_mem_imm8(x, X64_CMP, stack_slot(-3), 0);
+            x64_cmov(x, X64_CC_E, X64_RCX, X64_RDX);
+            x64_store(x, 1, stack_slot(-3), X64_RCX);
+            x64_load(x, 0, X64_RCX, type_slot(-2));
+            x64_load(x, 0, X64_RDX, type_slot(-1));
+            x64_cmov(x, X64_CC_E, X64_RCX, X64_RDX);
+            x64_store(x, 0, type_slot(-3), X64_RCX);
+            x64_alu_imm(x, X64_SUB, 1, R_SP, 2);
+            break;
+
+        case OP_IF:
+        case OP_WHILE:
+            jit_branch(c, ip, next);
+            break;
+
+        case OP_ELSE:
+            jit_jump_ip(c, -1, c->target[ip - c->start]);
+            break;
+
+        case OP_ENDBLOCK:
+            if (ip == c->end && !c->loop) {
+                /* ran off the end of the body: the interpreter takes over */
+                jit_set_ip(c, ip);
+                jit_jump_exit(c, c->exit_other);
+            } else if (c->target[ip - c->start] != JIT_NO_TARGET) {
+                /* only a while's ENDBLOCK has a target: the back-edge */
+                if (c->traces) jit_trace_edge(c, c->target[ip - c->start]);
+                jit_jump_ip(c, -1, c->target[ip - c->start]);
+            }
+            break;
+
+        case OP_CALL:
+            jit_set_ip(c, next);
+            jit_call(c, (uintptr_t)tier_call_from_jit, 1, imm1);
+            x64_test_rr(x, 0, X64_RAX, X64_RAX);
+            x64_link(x, x64_jcc(x, X64_CC_E), c->exit_halt);
+            break;
+
+        case OP_RETURN:
+            jit_generic(c, ip);
+            jit_jump_exit(c, c->exit_return);
+            break;
+
+        case OP_HALT:
+            jit_set_ip(c, next);
+            jit_jump_exit(c, c->exit_halt);
+            break;
+
+        default:
+            jit_generic(c, ip);
+            break;
+    }
+}
+
+static void jit_slow_paths(jit_ctx *c) {
+    for (size_t i = 0; i < c->nslow; ++i) {
+        jit_slow *s = &c->slow[i];
+        if (s->n == 0) continue;
+        for (int k = 0; k < s->n; ++k) x64_link(&c->x, s->at[k], c->x.len);
+        if (s->deopt) {
+            jit_set_ip(c, s->ip);
+            jit_jump_exit(c, c->exit_other);
+        } else {
+            jit_generic(c, s->ip);
+            jit_jump_ip(c, -1, s->next);
+        }
+    }
+}
+
+/* compile the region [start, end] */
+static jit_code *jit_build(const word *code, size_t start, size_t end, int loop, struct trace *const *traces,
+                           const char **why) {
+    if (end >= (size_t)INT32_MAX) { *why = "code too large"; return NULL; }
+
+    jit_ctx c;
+    memset(&c, 0, sizeof(c));
+    c.code = code;
+    c.start = start;
+    c.end = end;
+    c.loop = loop;
+    c.traces = traces;
+    size_t n = end - start + 1;
+    c.entry = (uint32_t*)malloc(n * sizeof(uint32_t));
+    c.target = (size_t*)malloc(n * sizeof(size_t));
+    c.blocks = (jit_block*)malloc(n * sizeof(jit_block));
+    c.blk = (int*)malloc(n * sizeof(int));
+    c.jc = (jit_code*)malloc(sizeof(jit_code));
+    jit_code *jc = NULL;
+    if (!c.entry || !c.target || !c.blocks || !c.blk || !c.jc) { *why = "out of memory"; goto out; }
+    if ((*why = jit_scan(&c)) != NULL) goto out;
+
+    jit_prologue(&c);
+    for (size_t ip = start; ip <= end; ip += 1 + (size_t)vm_op_imm_count((OpCode)code[ip])) {
+        c.entry[ip - start] = (uint32_t)c.x.len;
+        jit_op(&c, ip);
+    }
+    jit_slow_paths(&c);
+    for (size_t i = 0; i < c.nfix; ++i) x64_link(&c.x, c.fix[i].at, c.entry[c.fix[i].ip - start]);
+    if (c.oom || c.x.oom) { *why = "out of memory"; goto out; }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size = (c.x.len + page - 1) / page * page;
+    void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) { *why = "mmap failed"; goto out; }
+    memcpy(mem, c.x.buf, c.x.len);
+    if (mprotect(mem, map_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, map_size);
+        *why = "mprotect failed";
+        goto out;
+    }
+    jc = c.jc;
+    c.jc = NULL;
+    jc->mem = (uint8_t*)mem;
+    jc->map_size = map_size;
+    jc->bytes = c.x.len;
+    jc->start = start;
+    jc->end = end;
+    jc->entry = c.entry;
+    jc->blocks = c.blocks;
+    jc->blk = c.blk;
+    jc->exit_other = c.exit_other;
+    c.entry = NULL;
+    c.blocks = NULL;
+    c.blk = NULL;
+out:
+    free(c.entry);
+    free(c.blocks);
+    free(c.blk);
+    free(c.jc);
+    free(c.target);
+    free(c.fix);
+    free(c.slow);
+    free(c.x.buf);
+    return jc;
+}
+
+jit_code *jit_compile(const word *code, size_t code_len, size_t start, struct trace *const *traces, const char **why) {
+    const char *dummy;
+    if (!why) why = &dummy;
+    size_t end;
+    if (!jit_find_end(code, code_len, start, &end)) { *why = "unterminated body"; return NULL; }
+    return jit_build(code, start, end, 0, traces, why);
+}
+
+jit_code *jit_compile_loop(const word *code, size_t code_len, size_t cond_ip, size_t end_ip, struct trace *const *traces,
+                           const char **why) {
+    const char *dummy;
+    if (!why) why = &dummy;
+    if (cond_ip >= end_ip || end_ip >= code_len || code[end_ip] != OP_ENDBLOCK) { *why = "not a loop region"; return NULL; }
+    return jit_build(code, cond_ip, end_ip, 1, traces, why);
+}
+
+/* number of markers the interpreter holds inside the region at ip */
+static int jit_depth(const jit_code *jc, size_t ip) {
+    int d = 0;
+    for (int b = jc->blk[ip - jc->start]; b >= 0; b = jc->blocks[b].parent) d++;
+    return d;
+}
+
+/* rebuild the markers for vm->ip on top of the `base` markers held outside the region */
+static void jit_restore_blocks(const jit_code *jc, VM *vm, int base) {
+    int max = (int)(sizeof(vm->block_stack) / sizeof(vm->block_stack[0]));
+    int d = 0;
+    if (vm->ip >= jc->start && vm->ip <= jc->end) {
+        d = jit_depth(jc, vm->ip);
+        /* the chain runs innermost first; markers are stored outermost first */
+        int b = jc->blk[vm->ip - jc->start];
+        for (int k = d - 1; k >= 0; --k, b = jc->blocks[b].parent) {
+            if (base + k >= max) continue;
+            vm->block_stack[base + k].type = jc->blocks[b].type;
+            vm->block_stack[base + k].ip = jc->blocks[b].ip;
+        }
+    }
+    vm->block_sp = base + d > max ? max : base + d;
+}
+
+int jit_enter(const jit_code *jc, VM *vm) {
+    size_t ip = vm->ip;
+    if (ip < jc->start || ip > jc->end || jc->entry[ip - jc->start] == JIT_NO_ENTRY) return JIT_EXIT;
+    int base = vm->block_sp - jit_depth(jc, ip);
+    if (base < 0) base = 0;
+    jit_fn fn = (jit_fn)(uintptr_t)jc->mem;
+    int r = fn(vm, jc->mem + jc->entry[ip - jc->start]);
+    if (r == JIT_EXIT) jit_restore_blocks(jc, vm, base);
+    return r;
+}
+
+int jit_resume(const jit_code *jc, VM *vm, int base) {
+    jit_restore_blocks(jc, vm, base);
+    return jit_enter(jc, vm);
+}
+
+void jit_free(jit_code *jc) {
+    if (!jc) return;
+    munmap(jc->mem, jc->map_size);
+    free(jc->entry);
+    free(jc->blocks);
+    free(jc->blk);
+    free(jc);
+}
+
+#else /* !JIT_AVAILABLE */
+
+jit_code *jit_compile(const word *code, size_t code_len, size_t start, struct trace *const *traces, const char **why) {
+    (void)code; (void)code_len; (void)start; (void)traces;
+    if (why) *why = "no JIT for this target";
+    return NULL;
+}
+
+jit_code *jit_compile_loop(const word *code, size_t code_len, size_t cond_ip, size_t end_ip, struct trace *const *traces,
+                           const char **why) {
+    (void)code; (void)code_len; (void)cond_ip; (void)end_ip; (void)traces;
+    if (why) *why = "no JIT for this target";
+    return NULL;
+}
+
+int jit_enter(const jit_code *jc, VM *vm) {
+    (void)jc; (void)vm;
+    return JIT_EXIT;
+}
+
+int jit_resume(const jit_code *jc, VM *vm, int base) {
+    (void)jc; (void)vm; (void)base;
+    return JIT_EXIT;
+}
+
+void jit_free(jit_code *jc) {
+    (void)jc;
+}
+
+#endif /* JIT_AVAILABLE */
+
+size_t jit_code_bytes(const jit_code *jc) {
+    return jc ? jc->bytes : 0;
+}
+
+const uint8_t *jit_code_addr(const jit_code *jc, size_t *start, size_t *end) {
+    *start = jc->start;
+    *end = jc->end;
+    return jc->mem;
+}
+
+const uint8_t *jit_code_at(const jit_code *jc, size_t ip) {
+    if (ip < jc->start || ip > jc->end || jc->entry[ip - jc->start] == JIT_NO_ENTRY) return NULL;
+    return jc->mem + jc->entry[ip - jc->start];
+}
@@ -0,0 +1,98 @@
+#ifndef TIER_JIT_H
+#define TIER_JIT_H
+
+/*
+ * rrvm/frontend/tier/jit.h
+ *
+ * Baseline JIT: translates one region, a function body or a single while
+ * loop, to x86-64 code that works on the VM state directly (stack, types,
+ * tape and tape types stay where the interpreter keeps them), so execution
+ * can move between the interpreter and compiled code at any instruction
+ * boundary. That is what on-stack replacement uses: a hot loop is entered
+ * at its condition with the frame the interpreter built.
+ *
+ * Compiled code:
+ *  - keeps sp and tp in registers and resolves if/else/while targets
+ *    statically, so structured blocks need no block-stack markers and no
+ *    runtime scanning;
+ *  - inlines push/load/store/set, pointer moves, deref/refer, integer and
+ *    f64 add/sub/mul, bitwise, shift and logical ops, each guarded by the
+ *    checks the interpreter asserts (types equal, stack and tape bounds);
+ *    a failing guard runs that one instruction through the interpreter;
+ *  - runs every other instruction through vm_step with the interpreter
+ *    backend, and calls through the tier manager (tier_call_from_jit);
+ *  - checks at each loop back-edge whether the loop has a trace
+ *    (tier/trace.h) and, if so, runs it and continues where it exited.
+ *
+ * The only interpreter state compiled code does not keep is the block
+ * stack. jit_enter records how many markers the interpreter holds for the
+ * blocks around the entry instruction; when compiled code exits elsewhere
+ * (the end of a function body, past the end of a loop region, or a deopt on
+ * an instruction it cannot run) the markers for the blocks around the exit
+ * instruction are rebuilt, so the interpreter continues as if it had run
+ * the region itself.
+ *
+ * Regions containing a nested `func`, an else outside an if, or a while
+ * whose condition label lies outside the region are not compiled.
+ *
+ * Available on x86-64 with 64-bit words and without TAPE_GUARD (JIT_AVAILABLE);
+ * elsewhere jit_compile always fails and everything stays interpreted.
+ */
+
+#include "../vm/vm.h"
+
+#if defined(__x86_64__) && WORD_BITS == 64 && !TAPE_GUARD
+#define JIT_AVAILABLE 1
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+/* why jit_enter returned */
+enum {
+    JIT_EXIT = 0, /* left compiled code at vm->ip: continue interpreting there */
+    JIT_RETURN,   /* the function executed ret (vm->ip is the return ip) */
+    JIT_HALT,     /* the program halted */
+};
+
+typedef struct jit_code jit_code;
+struct trace;
+
+/*
+ * Compile the function whose first instruction is at `start` (the ip its
+ * OP_FUNCTION records). Returns NULL and sets *why (static string) if the
+ * body cannot be compiled. Only reads `code`, so it may run on another thread.
+ * `traces` (indexed by loop condition ip, may be NULL) is where the tier
+ * manager keeps loop traces; compiled back-edges look there at run time.
+ */
+jit_code *jit_compile(const word *code, size_t code_len, size_t start, struct trace *const *traces, const char **why);
+
+/*
+ * Compile the while loop whose condition starts at cond_ip and whose
+ * OP_ENDBLOCK is at end_ip. Leaving the loop exits at end_ip + 1.
+ */
+jit_code *jit_compile_loop(const word *code, size_t code_len, size_t cond_ip, size_t end_ip, struct trace *const *traces,
+                           const char **why);
+
+/* Run compiled code from vm->ip, which must be an instruction of the region
+ * (otherwise JIT_EXIT is returned at once). */
+int jit_enter(const jit_code *jc, VM *vm);
+
+/* Continue at vm->ip after other code ran part of the region without
+ * touching the block markers: rebuild the markers for vm->ip on top of the
+ * `base` held outside the region, then jit_enter. */
+int jit_resume(const jit_code *jc, VM *vm, int base);
+
+/* bytes of machine code emitted */
+size_t jit_code_bytes(const jit_code *jc);
+
+/* Start of the machine code; *start and *end are the region's first ip and
+ * its closing ENDBLOCK. For profilers (tier/perf.h). */
+const uint8_t *jit_code_addr(const jit_code *jc, size_t *start, size_t *end);
+
+/* machine code of region instruction ip, NULL outside the region or inside
+ * an immediate */
+const uint8_t *jit_code_at(const jit_code *jc, size_t ip);
+
+void jit_free(jit_code *jc);
+
+#endif /* TIER_JIT_H */
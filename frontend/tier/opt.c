@@ -0,0 +1,1357 @@
+/*
+ * rrvm/frontend/tier/opt.c
+ *
+ * Optimizing compiler (see opt.h): TAC construction, type speculation,
+ * branch folding, liveness, linear-scan register allocation and code
+ * generation.
+ *
+ * The TAC backend is run over the function body on a scratch VM. It lowers
+ * the code in program order, not execution order, so the virtual stack
+ * before each instruction (saved per ip as a snapshot) is what a deopt at
+ * that instruction writes back. Each temp is defined by one instruction;
+ * the scan only admits blocks that leave the stack as they found it, so no
+ * value flows into a label from two places and no phis are needed.
+ *
+ * Register use inside optimized code:
+ *   rbx = VM*, r13 = tp at the start of the basic block, rax/rcx/rdx
+ *   scratch, rsi rdi r8-r11 rbp r12 r14 r15 allocated to temps. The frame
+ *   holds a save area for the caller-saved ones (around helper calls) and
+ *   one slot per spilled temp. The VM's sp does not move: the stack only
+ *   exists at exits.
+ *
+ * Layout of the compiled function:
+ *   prologue   save callee-saved registers, load tp, jmp to the entry
+ *              address passed as the second argument
+ *   epilogue   restore and return eax (0: left at ret or the end of the
+ *              body, 1: deoptimized)
+ *   body       the TAC instructions in order
+ *   exits      one stub per guard: write the virtual stack to the VM stack,
+ *              set sp/tp/ip and return 1
+ */
+
+/* system headers first: vm.h defines emit macros such as __rem */
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "opt.h"
+#include "jit.h"
+#include "x64.h"
+#include "../interpreter/interpreter.h"
+#include "../tac/tac.h"
+
+#define OPT_MAX_DEPTH 64 /* values on the virtual stack at once */
+#define OPT_MAX_NEST 64  /* if/while blocks open at once */
+#define OPT_MIN_RUNS 64  /* runs before opt_unprofitable judges */
+
+/* where native code can be entered */
+typedef struct { size_t ip; uint32_t at; } opt_entry;
+
+struct opt_code {
+    uint8_t *mem; /* read/exec mapping */
+    size_t map_size;
+    size_t bytes;
+    size_t start;
+    const struct jit_code *base; /* baseline code for the body: exits continue there */
+    opt_entry *entries;          /* entries[0] is the function start, then loop conditions */
+    int nentries;
+    int max_depth;               /* values a deopt may write to the VM stack */
+    int tac_ops, temps, in_regs, spilled, fused, guards;
+    uint64_t runs, deopts;
+};
+
+#if JIT_AVAILABLE
+
+typedef int (*opt_fn)(VM *vm, const uint8_t *at);
+
+enum { R_VM = X64_RBX, R_TP = X64_R13 };
+
+/* registers for temps; the caller-saved ones come first */
+static const int opt_pool[] = { X64_RSI, X64_RDI, X64_R8, X64_R9, X64_R10, X64_R11, X64_RBP, X64_R12, X64_R14, X64_R15 };
+#define OPT_NREGS ((int)(sizeof(opt_pool) / sizeof(opt_pool[0])))
+#define OPT_NSAVED 6 /* caller-saved registers at the front of opt_pool */
+
+#define OPT_NO_IP SIZE_MAX
+
+/* a jz folded with the instructions computing its condition */
+typedef struct {
+    int test;   /* TAC_SUB: cmp a, b; TAC_BITAND: test a, b; otherwise test a, a */
+    int a, b;
+    int sign;   /* the condition is "negative" rather than "non-zero" */
+    int invert; /* ...negated */
+} opt_branch;
+
+/* guard whose exit stub is emitted after the body */
+typedef struct { size_t at; size_t ip; int d; } opt_stub;
+
+typedef struct { size_t at; int label; } opt_fixup;
+
+typedef struct {
+    const word *code;
+    size_t code_len;
+    size_t start, end; /* the body; end is its closing ENDBLOCK */
+    size_t n;          /* end - start + 1 */
+
+    /* scan, per body ip */
+    int *depth;        /* values on the stack before the instruction, -1 inside immediates */
+    int *nest;         /* if/while blocks open around it */
+    int max_depth;
+    int nsnaps;
+
+    /* TAC, from the TAC backend */
+    tac_instr *ins;
+    int nins, ntemps, nlabels;
+    int *snap_at;      /* per body ip: the virtual stack before it, at snaps + snap_at */
+    int *snaps;
+    size_t *op_of;     /* per instruction: ip of the bytecode instruction that produced it */
+    uint8_t *first;    /* ...and whether it is the first one that instruction produced */
+    int *cond_label;   /* per body ip of a while: label of its condition */
+
+    /* analysis */
+    int *type;         /* per temp: speculated TypeTag */
+    int *def;          /* per temp: defining instruction, -1 none */
+    int *nuses;
+    uint8_t *fused;    /* per instruction: folded into the jz after it */
+    opt_branch *br;    /* per jz */
+
+    /* control-flow graph */
+    int nblocks;
+    int *bstart, *bend; /* instructions [bstart, bend] */
+    int *blk;           /* block of each instruction */
+    int *succ;          /* two per block, -1 for none */
+    int *label_blk;     /* block of each label, -1 if not emitted */
+    size_t *check_ip;   /* per block: deopt ip of the tp range check at its start, OPT_NO_IP
+                           for none (no moves, or checked per move) */
+    int *dmin, *dmax;   /* per block: range of tp offsets its moves reach */
+    int words;          /* bitset words per block */
+    uint64_t *live_in, *live_out;
+
+    /* allocation, per temp */
+    int *istart, *iend; /* live interval, istart -1 for none */
+    int *loc;           /* register, -1 for none, or -2 - frame slot */
+    int nslots;
+    int frame;          /* bytes below the saved registers */
+
+    /* code */
+    x64_buf x;
+    uint32_t *label_off;
+    opt_fixup *fix;
+    int nfix, capfix;
+    opt_stub *stubs;
+    int nstubs, capstubs;
+    size_t epilogue;
+    int d;              /* tp offset from r13 */
+    int *known;         /* per offset [d + TAPE_SIZE]: type the cell is known to hold, -1 unknown */
+    int *touched;       /* offsets set in known */
+    int ntouched;
+    int oom;
+} opt_ctx;
+
+/* grow *arr (elements of size sz) to hold one more than n */
+static int opt_grow(opt_ctx *c, void **arr, int n, int *cap, size_t sz) {
+    if (n < *cap) return 1;
+    int nc = *cap ? *cap * 2 : 32;
+    void *na = realloc(*arr, (size_t)nc * sz);
+    if (!na) { c->oom = 1; return 0; }
+    *arr = na;
+    *cap = nc;
+    return 1;
+}
+
+static int opt_is_binary(TacOp op) { return op >= TAC_ADD && op <= TAC_AND; }
+static int fits_i32(word v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+static int opt_int_type(word t) {
+    return t == TYPE_UNKNOWN || (t >= TYPE_I8 && t <= TYPE_U64) || t == TYPE_BOOL || t == TYPE_PTR;
+}
+
+/* --- scan --- */
+
+/* values op pops and pushes; -1 for ops the compiler does not handle */
+static int opt_stack_effect(OpCode op, int *pops, int *pushes) {
+    *pops = *pushes = 0;
+    switch (op) {
+        case OP_NOP:
+        case OP_RETURN:
+        case OP_MOVE:
+        case OP_ELSE:
+        case OP_ENDBLOCK:
+            return 0;
+        case OP_PUSH:
+        case OP_LOAD:
+            *pushes = 1;
+            return 0;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_REM:
+        case OP_BITAND: case OP_BITOR: case OP_BITXOR:
+        case OP_LSH: case OP_LRSH: case OP_ARSH:
+        case OP_ORASSign: case OP_ANDASSign:
+            *pops = 2;
+            *pushes = 1;
+            return 0;
+        case OP_NOT:
+        case OP_GEZ:
+            *pops = 1;
+            *pushes = 1;
+            return 0;
+        case OP_STORE:
+        case OP_PRINT:
+        case OP_PRINTCHAR:
+        case OP_IF:
+        case OP_WHILE:
+            *pops = 1;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/*
+ * Check that the body only uses what the compiler handles, and record the
+ * stack depth and block nesting before each instruction. Code inside a
+ * block (or a loop condition) only reads values it pushed itself: otherwise
+ * a slot would hold different temps depending on the path taken. Returns
+ * NULL, or why the body cannot be compiled.
+ */
+static const char *opt_scan(opt_ctx *c) {
+    struct { OpCode op; int depth; int has_else; } blk[OPT_MAX_NEST];
+    int nb = 0, depth = 0;
+    long tp = 0; /* the TAC backend tracks tp over the code in order; keep it on the tape */
+
+    for (size_t i = 0; i < c->n; ++i) c->depth[i] = -1;
+    for (size_t ip = c->start; ip < c->end; ) {
+        word w = c->code[ip];
+        if (w < 0 || w > OP_HALT) return "bad opcode";
+        OpCode op = (OpCode)w;
+        size_t next = ip + 1 + (size_t)vm_op_imm_count(op);
+        if (next > c->end) return "unbalanced blocks";
+        c->depth[ip - c->start] = depth;
+        c->nest[ip - c->start] = nb;
+        c->nsnaps += depth;
+        int pops, pushes;
+        if (opt_stack_effect(op, &pops, &pushes) < 0) {
+            if (op == OP_CALL) return "calls a function";
+            if (op == OP_FUNCTION) return "nested func";
+            return "unsupported instruction";
+        }
+        if (op == OP_PUSH && !opt_int_type(c->code[ip + 1])) return "non-integer value";
+        if (op == OP_MOVE) {
+            word imm = c->code[ip + 1];
+            if (imm <= -TAPE_SIZE || imm >= TAPE_SIZE) return "tape moves out of range";
+            tp += (long)imm;
+            if (tp <= -TAPE_SIZE / 2 || tp >= TAPE_SIZE / 2) return "tape moves out of range";
+        }
+        if (depth - pops < (nb ? blk[nb - 1].depth : 0)) return nb ? "block reads values from outside" : "reads below its frame";
+        depth += pushes - pops;
+        if (depth > OPT_MAX_DEPTH) return "stack too deep";
+        if (depth > c->max_depth) c->max_depth = depth;
+
+        if (op == OP_IF || op == OP_WHILE) {
+            if (nb == OPT_MAX_NEST) return "blocks nested too deep";
+            if (op == OP_WHILE) {
+                /* the condition: straight-line code in this block, net one value */
+                word cond = c->code[ip + 1];
+                if (cond < (word)c->start || cond >= (word)ip || c->depth[cond - (word)c->start] != depth)
+                    return "loop condition outside the body";
+                for (size_t k = (size_t)cond; k < ip; k += 1 + (size_t)vm_op_imm_count((OpCode)c->code[k])) {
+                    OpCode ko = (OpCode)c->code[k];
+                    int kpops, kpushes;
+                    if (ko == OP_IF || ko == OP_ELSE || ko == OP_WHILE || ko == OP_ENDBLOCK) return "branch in a loop condition";
+                    opt_stack_effect(ko, &kpops, &kpushes);
+                    if (c->depth[k - c->start] < 0 || c->depth[k - c->start] - kpops < depth)
+                        return "loop condition reads values from outside";
+                }
+            }
+            blk[nb].op = op;
+            blk[nb].depth = depth;
+            blk[nb].has_else = 0;
+            nb++;
+        } else if (op == OP_ELSE) {
+            if (nb == 0 || blk[nb - 1].op != OP_IF || blk[nb - 1].has_else) return "else outside if";
+            if (depth != blk[nb - 1].depth) return "if arm leaves values on the stack";
+            blk[nb - 1].has_else = 1;
+        } else if (op == OP_ENDBLOCK) {
+            if (nb == 0) return "unbalanced blocks";
+            if (depth != blk[nb - 1].depth) return "block leaves values on the stack";
+            nb--;
+        }
+        ip = next;
+    }
+    if (nb != 0) return "unbalanced blocks";
+    c->depth[c->n - 1] = depth;
+    c->nest[c->n - 1] = 0;
+    c->nsnaps += depth;
+    return NULL;
+}
+
+/* --- TAC construction --- */
+
+static const int *opt_snap(const opt_ctx *c, size_t ip, int *n) {
+    *n = c->depth[ip - c->start];
+    return c->snaps + c->snap_at[ip - c->start];
+}
+
+/* Run the TAC backend over the body, from its OP_FUNCTION to the closing
+ * ENDBLOCK, and keep the program, the stack snapshots and the ip map. */
+static const char *opt_lower(opt_ctx *c) {
+    if (c->start < 2 || c->code[c->start - 2] != OP_FUNCTION) return "not a function body";
+    VM *vm = (VM*)calloc(1, sizeof(VM));
+    if (!vm) return "out of memory";
+    vm->code = c->code;
+    vm->code_len = c->code_len;
+    tac_setup(vm);
+    tac_backend_state *s = tac_state(vm);
+    /* the scan keeps the moves within half the tape either way */
+    s->tp = TAPE_SIZE / 2;
+
+    const char *why = NULL;
+    int nsnap = 0;
+    vm->ip = c->start - 2;
+    while (vm->ip <= c->end) {
+        size_t ip = vm->ip;
+        if (ip >= c->start) {
+            int k = c->depth[ip - c->start];
+            if (k != s->sp) { why = "stack mismatch"; break; }
+            c->snap_at[ip - c->start] = nsnap;
+            if (k) memcpy(&c->snaps[nsnap], s->stack, (size_t)k * sizeof(int));
+            nsnap += k;
+        }
+        if (!vm_step(vm, &__TAC)) { why = "halt in the body"; break; }
+    }
+
+    if (!why) {
+        /* instruction -> bytecode ip; of several ips mapped to one index
+           (instructions that emit nothing) the last is the one it belongs to */
+        int n = (int)s->prog.count;
+        c->op_of = (size_t*)malloc(((size_t)n + 1) * sizeof(size_t));
+        c->first = (uint8_t*)calloc((size_t)n + 1, 1);
+        if (!c->op_of || !c->first) why = "out of memory";
+        for (int i = 0; !why && i <= n; ++i) c->op_of[i] = OPT_NO_IP;
+        for (size_t ip = c->start - 2; !why && ip <= c->end; ) {
+            int idx = s->vm_ip_to_tac_index[ip];
+            if (idx >= 0 && idx < n) c->op_of[idx] = ip;
+            OpCode op = (OpCode)c->code[ip];
+            if (op == OP_WHILE) c->cond_label[ip - c->start] = s->vm_ip_to_tac_label[(size_t)c->code[ip + 1]];
+            ip += 1 + (size_t)vm_op_imm_count(op);
+        }
+        size_t cur = c->start - 2;
+        for (int i = 0; !why && i < n; ++i) {
+            if (c->op_of[i] != OPT_NO_IP) { cur = c->op_of[i]; c->first[i] = 1; }
+            c->op_of[i] = cur;
+        }
+    }
+    if (!why) {
+        /* unpacked, with room for the exit at the end of the body */
+        tac_instr *ins = (tac_instr*)malloc((s->prog.count + 1) * sizeof(tac_instr));
+        if (!ins) {
+            why = "out of memory";
+        } else {
+            for (size_t i = 0; i < s->prog.count; ++i) ins[i] = tac_get(&s->prog, i);
+            c->ins = ins;
+            c->nins = (int)s->prog.count;
+            c->ntemps = s->next_temp;
+            c->nlabels = s->label_counter;
+        }
+    }
+    tac_finalize(vm, 0);
+    free(vm);
+    if (why) return why;
+
+    /* falling off the end leaves at the closing ENDBLOCK like a ret */
+    if (c->nins == 0 || (c->ins[c->nins - 1].op != TAC_RET && c->ins[c->nins - 1].op != TAC_JMP)) {
+        c->ins[c->nins] = (tac_instr){ .op = TAC_RET, .dst = -1 };
+        c->op_of[c->nins] = c->end;
+        c->first[c->nins] = 1;
+        c->nins++;
+    }
+    return NULL;
+}
+
+/* --- analysis --- */
+
+static int opt_find(int *p, int t) {
+    while (p[t] != t) {
+        p[t] = p[p[t]];
+        t = p[t];
+    }
+    return t;
+}
+
+/* merge the classes of a and b; -1 if their types conflict */
+static int opt_union(int *p, int *ty, int a, int b) {
+    a = opt_find(p, a);
+    b = opt_find(p, b);
+    if (a == b) return 0;
+    if (ty[a] >= 0 && ty[b] >= 0 && ty[a] != ty[b]) return -1;
+    if (ty[a] < 0) ty[a] = ty[b];
+    p[b] = a;
+    return 0;
+}
+
+/*
+ * Speculated types: operands and result of a binary op share a type, as do
+ * the operand and result of not/gez (the interpreter asserts the first and
+ * keeps the operand's tag for the second). A class takes the type of its
+ * constants and defaults to i64; loads are checked against it at run time.
+ * Also fills def and nuses.
+ */
+static const char *opt_types(opt_ctx *c) {
+    int n = c->ntemps;
+    int *p = (int*)malloc((size_t)(n ? n : 1) * sizeof(int));
+    int *ty = (int*)malloc((size_t)(n ? n : 1) * sizeof(int));
+    if (!p || !ty) { free(p); free(ty); return "out of memory"; }
+    for (int t = 0; t < n; ++t) { p[t] = t; ty[t] = -1; c->def[t] = -1; c->nuses[t] = 0; }
+
+    const char *why = NULL;
+    for (int i = 0; i < c->nins && !why; ++i) {
+        const tac_instr *in = &c->ins[i];
+        if (in->op == TAC_CONST) {
+            int r = opt_find(p, in->dst);
+            if (ty[r] >= 0 && ty[r] != in->dst_type) why = "mixed operand types";
+            ty[r] = in->dst_type;
+        } else if (opt_is_binary(in->op)) {
+            if (opt_union(p, ty, in->dst, in->lhs) < 0 || opt_union(p, ty, in->dst, in->rhs) < 0) why = "mixed operand types";
+            c->nuses[in->lhs]++;
+            c->nuses[in->rhs]++;
+        } else if (in->op == TAC_NOT || in->op == TAC_GEZ) {
+            if (opt_union(p, ty, in->dst, in->lhs) < 0) why = "mixed operand types";
+            c->nuses[in->lhs]++;
+        } else if (in->op == TAC_STORE || in->op == TAC_PRINT || in->op == TAC_PRINTCHAR || in->op == TAC_JZ) {
+            c->nuses[in->lhs]++;
+        }
+        if (in->op == TAC_CONST || in->op == TAC_LOAD || in->op == TAC_NOT || in->op == TAC_GEZ || opt_is_binary(in->op))
+            c->def[in->dst] = i;
+    }
+    for (int t = 0; t < n; ++t) {
+        int r = ty[opt_find(p, t)];
+        c->type[t] = r < 0 ? TYPE_I64 : r;
+    }
+    free(p);
+    free(ty);
+    return why;
+}
+
+static int opt_is_const(const opt_ctx *c, int t) {
+    return c->def[t] >= 0 && c->ins[c->def[t]].op == TAC_CONST;
+}
+
+static word opt_const(const opt_ctx *c, int t) {
+    return c->ins[c->def[t]].imm;
+}
+
+/*
+ * Fold the chain computing a jz's condition into the branch: not and gez
+ * flip or turn the test into a sign test, and a sub or bitand at the bottom
+ * becomes the cmp/test itself. Only single-use values defined right before
+ * the jz fold, so no guard can observe them missing.
+ */
+static void opt_fold_branches(opt_ctx *c) {
+    for (int i = 0; i < c->nins; ++i) {
+        if (c->ins[i].op != TAC_JZ) continue;
+        opt_branch b = { .test = -1, .a = c->ins[i].lhs, .b = -1, .sign = 0, .invert = 0 };
+        int t = b.a, pos = i - 1;
+        for (;;) {
+            int j = c->def[t];
+            if (j < 0 || j != pos || c->nuses[t] != 1) break;
+            const tac_instr *d = &c->ins[j];
+            if (d->op == TAC_NOT && !b.sign) {
+                b.invert ^= 1;
+            } else if (d->op == TAC_GEZ && !b.sign) {
+                /* lhs >= 0 is "not negative" */
+                b.sign = 1;
+                b.invert ^= 1;
+            } else if (d->op == TAC_SUB || d->op == TAC_BITAND) {
+                /* cmp/test set ZF and SF from the (wrapping) result */
+                c->fused[j] = 1;
+                b.test = d->op;
+                b.a = d->lhs;
+                b.b = d->rhs;
+                break;
+            } else {
+                break;
+            }
+            c->fused[j] = 1;
+            t = d->lhs;
+            b.a = t;
+            pos = j - 1;
+        }
+        c->br[i] = b;
+    }
+}
+
+/* Basic blocks, successors and per-block tp ranges. */
+static const char *opt_cfg(opt_ctx *c) {
+    int nb = 0;
+    for (int i = 0; i < c->nins; ++i) {
+        TacOp prev = i > 0 ? c->ins[i - 1].op : TAC_JMP;
+        if (i == 0 || c->ins[i].op == TAC_LABEL || prev == TAC_JMP || prev == TAC_JZ || prev == TAC_RET) {
+            c->bstart[nb] = i;
+            if (nb > 0) c->bend[nb - 1] = i - 1;
+            nb++;
+        }
+        c->blk[i] = nb - 1;
+    }
+    c->bend[nb - 1] = c->nins - 1;
+    c->nblocks = nb;
+
+    for (int l = 0; l < c->nlabels; ++l) c->label_blk[l] = -1;
+    for (int i = 0; i < c->nins; ++i) {
+        const tac_instr *in = &c->ins[i];
+        if (in->op == TAC_LABEL && in->imm >= 0 && in->imm < c->nlabels) c->label_blk[in->imm] = c->blk[i];
+    }
+    for (int b = 0; b < nb; ++b) {
+        const tac_instr *last = &c->ins[c->bend[b]];
+        int *s = &c->succ[2 * b];
+        s[0] = s[1] = -1;
+        if (last->op == TAC_JMP || last->op == TAC_JZ) {
+            if (last->imm < 0 || last->imm >= c->nlabels || c->label_blk[last->imm] < 0) return "jump to a missing label";
+            s[0] = c->label_blk[last->imm];
+            if (last->op == TAC_JZ && b + 1 < nb) s[1] = b + 1;
+        } else if (last->op != TAC_RET && b + 1 < nb) {
+            s[0] = b + 1;
+        }
+
+        /* one range check at the start covers every move in the block, if
+           the block starts on a bytecode instruction a deopt can resume at */
+        int d = 0, moves = 0;
+        c->dmin[b] = c->dmax[b] = 0;
+        for (int i = c->bstart[b]; i <= c->bend[b]; ++i) {
+            if (c->ins[i].op != TAC_MOVE) continue;
+            d += (int)c->ins[i].imm;
+            if (d < c->dmin[b]) c->dmin[b] = d;
+            if (d > c->dmax[b]) c->dmax[b] = d;
+            moves = 1;
+        }
+        c->check_ip[b] = OPT_NO_IP;
+        int j = c->bstart[b];
+        while (j <= c->bend[b] && c->ins[j].op == TAC_LABEL) j++;
+        if (moves && j <= c->bend[b] && c->first[j] && c->op_of[j] >= c->start && c->op_of[j] <= c->end &&
+            c->dmax[b] - c->dmin[b] < TAPE_SIZE)
+            c->check_ip[b] = c->op_of[j];
+    }
+    return NULL;
+}
+
+/* ip whose virtual stack a deopt at instruction i writes back, OPT_NO_IP if none */
+static size_t opt_guard_ip(const opt_ctx *c, int i) {
+    int b = c->blk[i];
+    if (i == c->bstart[b] && c->check_ip[b] != OPT_NO_IP) return c->check_ip[b];
+    switch (c->ins[i].op) {
+        case TAC_LOAD:
+        case TAC_DIV:
+        case TAC_REM:
+        case TAC_RET:
+            return c->op_of[i];
+        case TAC_MOVE:
+            return c->check_ip[b] == OPT_NO_IP ? c->op_of[i] : OPT_NO_IP;
+        default:
+            return OPT_NO_IP;
+    }
+}
+
+/* Temps instruction i reads, including those a deopt there writes back.
+ * Constants are left out: they are rematerialized, never live. */
+static int opt_uses(const opt_ctx *c, int i, int *u) {
+    const tac_instr *in = &c->ins[i];
+    int n = 0, raw[2 + OPT_MAX_DEPTH], nraw = 0;
+    if (!c->fused[i]) {
+        if (opt_is_binary(in->op)) {
+            raw[nraw++] = in->lhs;
+            raw[nraw++] = in->rhs;
+        } else if (in->op == TAC_NOT || in->op == TAC_GEZ || in->op == TAC_STORE || in->op == TAC_PRINT ||
+                   in->op == TAC_PRINTCHAR) {
+            raw[nraw++] = in->lhs;
+        } else if (in->op == TAC_JZ) {
+            raw[nraw++] = c->br[i].a;
+            if (c->br[i].test >= 0) raw[nraw++] = c->br[i].b;
+        }
+    }
+    size_t ip = opt_guard_ip(c, i);
+    if (ip != OPT_NO_IP) {
+        int k;
+        const int *s = opt_snap(c, ip, &k);
+        for (int j = 0; j < k; ++j) raw[nraw++] = s[j];
+    }
+    for (int j = 0; j < nraw; ++j)
+        if (!opt_is_const(c, raw[j])) u[n++] = raw[j];
+    return n;
+}
+
+/* temp defined by instruction i, -1 for none */
+static int opt_def_of(const opt_ctx *c, int i) {
+    const tac_instr *in = &c->ins[i];
+    if (c->fused[i] || in->op == TAC_CONST) return -1;
+    if (in->op == TAC_LOAD || in->op == TAC_NOT || in->op == TAC_GEZ || opt_is_binary(in->op)) return in->dst;
+    return -1;
+}
+
+#define BIT_SET(s, t) ((s)[(t) >> 6] |= (uint64_t)1 << ((t) & 63))
+#define BIT_HAS(s, t) (((s)[(t) >> 6] >> ((t) & 63)) & 1)
+
+/* Liveness over the CFG, then one interval per temp covering every point it is live. */
+static const char *opt_liveness(opt_ctx *c) {
+    int nb = c->nblocks, w = c->words;
+    uint64_t *use = (uint64_t*)calloc((size_t)nb * (size_t)w, sizeof(uint64_t));
+    uint64_t *def = (uint64_t*)calloc((size_t)nb * (size_t)w, sizeof(uint64_t));
+    if (!use || !def) { free(use); free(def); return "out of memory"; }
+    int u[2 + OPT_MAX_DEPTH];
+
+    for (int b = 0; b < nb; ++b) {
+        uint64_t *ub = use + (size_t)b * w, *db = def + (size_t)b * w;
+        for (int i = c->bstart[b]; i <= c->bend[b]; ++i) {
+            int nu = opt_uses(c, i, u);
+            for (int k = 0; k < nu; ++k)
+                if (!BIT_HAS(db, u[k])) BIT_SET(ub, u[k]);
+            int t = opt_def_of(c, i);
+            if (t >= 0) BIT_SET(db, t);
+        }
+    }
+    for (int changed = 1; changed; ) {
+        changed = 0;
+        for (int b = nb - 1; b >= 0; --b) {
+            uint64_t *in = c->live_in + (size_t)b * w, *out = c->live_out + (size_t)b * w;
+            for (int k = 0; k < 2; ++k) {
+                int s = c->succ[2 * b + k];
+                if (s < 0) continue;
+                const uint64_t *sin = c->live_in + (size_t)s * w;
+                for (int j = 0; j < w; ++j) out[j] |= sin[j];
+            }
+            for (int j = 0; j < w; ++j) {
+                uint64_t v = use[(size_t)b * w + j] | (out[j] & ~def[(size_t)b * w + j]);
+                if (v != in[j]) { in[j] = v; changed = 1; }
+            }
+        }
+    }
+    free(use);
+    free(def);
+
+    for (int t = 0; t < c->ntemps; ++t) { c->istart[t] = -1; c->iend[t] = -1; }
+#define EXTEND(t, p) do { \
+        if (c->istart[t] < 0 || (p) < c->istart[t]) c->istart[t] = (p); \
+        if ((p) > c->iend[t]) c->iend[t] = (p); \
+    } while (0)
+    for (int b = 0; b < nb; ++b) {
+        const uint64_t *in = c->live_in + (size_t)b * w, *out = c->live_out + (size_t)b * w;
+        for (int t = 0; t < c->ntemps; ++t) {
+            if (BIT_HAS(in, t)) EXTEND(t, c->bstart[b]);
+            if (BIT_HAS(out, t)) EXTEND(t, c->bend[b]);
+        }
+        for (int i = c->bstart[b]; i <= c->bend[b]; ++i) {
+            int nu = opt_uses(c, i, u);
+            for (int k = 0; k < nu; ++k) EXTEND(u[k], i);
+            int t = opt_def_of(c, i);
+            if (t >= 0) EXTEND(t, i);
+        }
+    }
+#undef EXTEND
+    return NULL;
+}
+
+/*
+ * Linear scan (Poletto and Sarkar): intervals in order of start; when no
+ * register is free the interval ending last is spilled for its whole life.
+ * An interval ending where the next one starts hands its register over, so
+ * x = op(y, ...) can reuse y's register. Intervals spanning a helper call
+ * prefer the callee-saved registers.
+ */
+static const char *opt_allocate(opt_ctx *c) {
+    int n = c->ntemps;
+    int *order = (int*)malloc((size_t)(n ? n : 1) * sizeof(int));
+    int *calls = (int*)malloc(((size_t)c->nins + 1) * sizeof(int)); /* helper calls before each position */
+    if (!order || !calls) { free(order); free(calls); return "out of memory"; }
+    calls[0] = 0;
+    for (int i = 0; i < c->nins; ++i)
+        calls[i + 1] = calls[i] + (c->ins[i].op == TAC_PRINT || c->ins[i].op == TAC_PRINTCHAR);
+
+    int m = 0;
+    for (int t = 0; t < n; ++t) {
+        c->loc[t] = -1;
+        if (c->istart[t] >= 0) order[m++] = t;
+    }
+    /* insertion sort by start (temps come roughly in order already) */
+    for (int i = 1; i < m; ++i) {
+        int t = order[i], j = i - 1;
+        while (j >= 0 && c->istart[order[j]] > c->istart[t]) { order[j + 1] = order[j]; j--; }
+        order[j + 1] = t;
+    }
+
+    int active[OPT_NREGS], nactive = 0;
+    int owner[16];
+    for (int r = 0; r < 16; ++r) owner[r] = -1;
+    for (int k = 0; k < m; ++k) {
+        int t = order[k];
+        for (int a = 0; a < nactive; ) {
+            if (c->iend[active[a]] <= c->istart[t]) {
+                owner[c->loc[active[a]]] = -1;
+                active[a] = active[--nactive];
+            } else {
+                a++;
+            }
+        }
+        int spans = c->iend[t] > c->istart[t] && calls[c->iend[t]] - calls[c->istart[t] + 1] > 0;
+        int reg = -1;
+        for (int pass = 0; pass < 2 && reg < 0; ++pass) {
+            for (int r = 0; r < OPT_NREGS; ++r) {
+                int callee_saved = r >= OPT_NSAVED;
+                if ((pass == 0) != (callee_saved == spans)) continue;
+                if (owner[opt_pool[r]] < 0) { reg = opt_pool[r]; break; }
+            }
+        }
+        if (reg >= 0) {
+            c->loc[t] = reg;
+            owner[reg] = t;
+            active[nactive++] = t;
+            continue;
+        }
+        int far = 0;
+        for (int a = 1; a < nactive; ++a)
+            if (c->iend[active[a]] > c->iend[active[far]]) far = a;
+        int v = active[far];
+        if (c->iend[v] > c->iend[t]) {
+            c->loc[t] = c->loc[v];
+            owner[c->loc[t]] = t;
+            c->loc[v] = -2 - c->nslots++;
+            active[far] = t;
+        } else {
+            c->loc[t] = -2 - c->nslots++;
+        }
+    }
+    free(order);
+    free(calls);
+    /* entry rsp is 8 mod 16 and six registers are pushed: keep calls aligned */
+    c->frame = 8 * (OPT_NSAVED + c->nslots);
+    if (c->frame % 16 == 0) c->frame += 8;
+    return NULL;
+}
+
+/* --- code generation --- */
+
+static x64_mem vm_field(size_t off) { return x64_at(R_VM, (int32_t)off); }
+
+/* tape[tp + d] and tape_types[tp + d], tp being r13 */
+static x64_mem opt_cell(int d) { return x64_idx(R_VM, R_TP, 8, (int32_t)(offsetof(VM, tape) + (ptrdiff_t)d * 8)); }
+static x64_mem opt_cell_type(int d) { return x64_idx(R_VM, R_TP, 4, (int32_t)(offsetof(VM, tape_types) + (ptrdiff_t)d * 4)); }
+
+static x64_mem opt_save_slot(int k) { return x64_at(X64_RSP, 8 * k); }
+static x64_mem opt_slot(const opt_ctx *c, int t) { return x64_at(X64_RSP, 8 * (OPT_NSAVED + (-2 - c->loc[t]))); }
+
+static int opt_spilled(const opt_ctx *c, int t) { return c->loc[t] <= -2; }
+
+/* t as an imm32 operand */
+static int opt_imm(const opt_ctx *c, int t, int32_t *v) {
+    if (!opt_is_const(c, t) || !fits_i32(opt_const(c, t))) return 0;
+    *v = (int32_t)opt_const(c, t);
+    return 1;
+}
+
+/* copy t into register r */
+static void opt_move_to(opt_ctx *c, int r, int t) {
+    if (opt_is_const(c, t)) x64_mov_imm(&c->x, r, opt_const(c, t));
+    else if (opt_spilled(c, t)) x64_load(&c->x, 1, r, opt_slot(c, t));
+    else if (c->loc[t] != r) x64_mov_rr(&c->x, r, c->loc[t]);
+}
+
+/* the register holding t; a spilled temp or a constant is loaded into scratch */
+static int opt_reg(opt_ctx *c, int t, int scratch) {
+    if (!opt_is_const(c, t) && !opt_spilled(c, t)) return c->loc[t];
+    opt_move_to(c, scratch, t);
+    return scratch;
+}
+
+/* register to compute t in: its own, or rax when it lives in the frame */
+static int opt_dst(const opt_ctx *c, int t) {
+    return c->loc[t] >= 0 ? c->loc[t] : X64_RAX;
+}
+
+/* t was computed in r: write it back if it is spilled */
+static void opt_def(opt_ctx *c, int t, int r) {
+    if (opt_spilled(c, t)) x64_store(&c->x, 1, opt_slot(c, t), r);
+}
+
+static void opt_know(opt_ctx *c, int d, int type) {
+    if (c->known[d + TAPE_SIZE] < 0) c->touched[c->ntouched++] = d + TAPE_SIZE;
+    c->known[d + TAPE_SIZE] = type;
+}
+
+static void opt_forget(opt_ctx *c) {
+    for (int k = 0; k < c->ntouched; ++k) c->known[c->touched[k]] = -1;
+    c->ntouched = 0;
+}
+
+/* deoptimize to ip when cc holds; the virtual stack is that before ip */
+static void opt_guard(opt_ctx *c, int cc, size_t ip) {
+    size_t at = x64_jcc(&c->x, cc);
+    if (!opt_grow(c, (void**)&c->stubs, c->nstubs, &c->capstubs, sizeof(opt_stub))) return;
+    c->stubs[c->nstubs].at = at;
+    c->stubs[c->nstubs].ip = ip;
+    c->stubs[c->nstubs].d = c->d;
+    c->nstubs++;
+}
+
+static void opt_jump_label(opt_ctx *c, int cc, int label) {
+    size_t at = cc < 0 ? x64_jmp(&c->x) : x64_jcc(&c->x, cc);
+    if (!opt_grow(c, (void**)&c->fix, c->nfix, &c->capfix, sizeof(opt_fixup))) return;
+    c->fix[c->nfix].at = at;
+    c->fix[c->nfix].label = label;
+    c->nfix++;
+}
+
+/* bring r13 up to date before control leaves the block */
+static void opt_sync_tp(opt_ctx *c) {
+    if (c->d) x64_lea(&c->x, R_TP, x64_at(R_TP, c->d));
+    c->d = 0;
+}
+
+/* Leave native code before the bytecode instruction at ip: write the
+ * virtual stack there to the VM stack, set sp/tp/ip and return kind. */
+static void opt_gen_exit(opt_ctx *c, size_t ip, int d, int kind) {
+    x64_buf *x = &c->x;
+    int n;
+    const int *s = opt_snap(c, ip, &n);
+    x64_movsxd(x, X64_RAX, vm_field(offsetof(VM, sp)));
+    for (int k = 0; k < n; ++k) {
+        int t = s[k];
+        x64_mem slot = x64_idx(R_VM, X64_RAX, 8, (int32_t)(offsetof(VM, stack) + (size_t)k * 8));
+        int32_t imm;
+        if (opt_imm(c, t, &imm)) x64_store_imm(x, 1, slot, imm);
+        else x64_store(x, 1, slot, opt_reg(c, t, X64_RCX));
+        x64_store_imm(x, 0, x64_idx(R_VM, X64_RAX, 4, (int32_t)(offsetof(VM, types) + (size_t)k * 4)), c->type[t]);
+    }
+    if (n) {
+        x64_alu_imm(x, X64_ADD, 0, X64_RAX, n);
+        x64_store(x, 0, vm_field(offsetof(VM, sp)), X64_RAX);
+    }
+    x64_lea(x, X64_RCX, x64_at(R_TP, d));
+    x64_store(x, 0, vm_field(offsetof(VM, tp)), X64_RCX);
+    x64_store_imm(x, 1, vm_field(offsetof(VM, ip)), (int32_t)ip);
+    x64_mov_imm(x, X64_RAX, kind);
+    x64_link(x, x64_jmp(x), c->epilogue);
+}
+
+static void opt_print(VM *vm, word v, int type) {
+    vm_push(vm, v);
+    vm->types[vm->sp - 1] = (TypeTag)type;
+    interp_print(vm);
+}
+
+static void opt_print_char(VM *vm, word v, int type) {
+    vm_push(vm, v);
+    vm->types[vm->sp - 1] = (TypeTag)type;
+    interp_print_char(vm);
+}
+
+/* call fn(vm, t, type(t)) at instruction i, saving the caller-saved
+ * registers of temps live across it */
+static void opt_gen_call(opt_ctx *c, int i, uintptr_t fn, int t) {
+    x64_buf *x = &c->x;
+    int saved[OPT_NSAVED];
+    for (int k = 0; k < OPT_NSAVED; ++k) {
+        saved[k] = 0;
+        for (int v = 0; v < c->ntemps; ++v) {
+            if (c->loc[v] == opt_pool[k] && c->istart[v] < i && c->iend[v] > i) { saved[k] = 1; break; }
+        }
+        if (saved[k]) x64_store(x, 1, opt_save_slot(k), opt_pool[k]);
+    }
+    opt_move_to(c, X64_RSI, t);
+    x64_mov_rr(x, X64_RDI, R_VM);
+    x64_mov_imm(x, X64_RDX, c->type[t]);
+    x64_mov_imm(x, X64_RAX, (int64_t)fn);
+    x64_call_reg(x, X64_RAX);
+    for (int k = 0; k < OPT_NSAVED; ++k)
+        if (saved[k]) x64_load(x, 1, opt_pool[k], opt_save_slot(k));
+}
+
+/* rd op= t (add/sub/and/or/xor/mul) */
+static void opt_apply(opt_ctx *c, TacOp op, int rd, int t) {
+    x64_buf *x = &c->x;
+    int alu = op == TAC_ADD ? X64_ADD : op == TAC_SUB ? X64_SUB : op == TAC_BITAND ? X64_AND :
+              op == TAC_BITOR ? X64_OR : X64_XOR;
+    int32_t imm;
+    if (opt_imm(c, t, &imm)) {
+        if (op == TAC_MUL) x64_imul_imm(x, rd, rd, imm);
+        else x64_alu_imm(x, alu, 1, rd, imm);
+    } else if (opt_spilled(c, t)) {
+        if (op == TAC_MUL) x64_imul_load(x, rd, opt_slot(c, t));
+        else x64_alu_load(x, alu, 1, rd, opt_slot(c, t));
+    } else {
+        int r = opt_reg(c, t, X64_RCX);
+        if (op == TAC_MUL) x64_imul_rr(x, rd, r);
+        else x64_alu_rr(x, alu, 1, rd, r);
+    }
+}
+
+static void opt_gen_alu(opt_ctx *c, const tac_instr *in) {
+    x64_buf *x = &c->x;
+    int a = in->lhs, b = in->rhs;
+    int commutative = in->op != TAC_SUB;
+    if (commutative && opt_is_const(c, a) && !opt_is_const(c, b)) { int t = a; a = b; b = t; }
+    int rd = opt_dst(c, in->dst);
+    int32_t imm;
+    if (in->op == TAC_MUL && opt_imm(c, b, &imm)) {
+        x64_imul_imm(x, rd, opt_reg(c, a, rd), imm);
+    } else if (!opt_is_const(c, b) && c->loc[b] == rd && c->loc[a] != rd) {
+        /* the result took b's register */
+        if (commutative) {
+            opt_apply(c, in->op, rd, a);
+        } else {
+            x64_mov_rr(x, X64_RCX, rd);
+            opt_move_to(c, rd, a);
+            x64_alu_rr(x, X64_SUB, 1, rd, X64_RCX);
+        }
+    } else {
+        opt_move_to(c, rd, a);
+        opt_apply(c, in->op, rd, b);
+    }
+    opt_def(c, in->dst, rd);
+}
+
+static void opt_gen_ins(opt_ctx *c, int i) {
+    x64_buf *x = &c->x;
+    const tac_instr *in = &c->ins[i];
+    int32_t imm;
+    switch (in->op) {
+        case TAC_CONST:
+        case TAC_LABEL:
+            break;
+        case TAC_ADD:
+        case TAC_SUB:
+        case TAC_MUL:
+        case TAC_BITAND:
+        case TAC_BITOR:
+        case TAC_BITXOR:
+            opt_gen_alu(c, in);
+            break;
+        case TAC_DIV:
+        case TAC_REM: {
+            /* 0 traps and INT64_MIN / -1 overflows: leave both to the interpreter */
+            opt_move_to(c, X64_RCX, in->rhs);
+            x64_lea(x, X64_RDX, x64_at(X64_RCX, 1));
+            x64_alu_imm(x, X64_CMP, 1, X64_RDX, 2);
+            opt_guard(c, X64_CC_B, c->op_of[i]);
+            opt_move_to(c, X64_RAX, in->lhs);
+            x64_cqo(x);
+            x64_unary(x, X64_IDIV, X64_RCX);
+            int rd = opt_dst(c, in->dst);
+            int res = in->op == TAC_DIV ? X64_RAX : X64_RDX;
+            if (rd != res) x64_mov_rr(x, rd, res);
+            opt_def(c, in->dst, rd);
+            break;
+        }
+        case TAC_LSH:
+        case TAC_LRSH:
+        case TAC_ARSH: {
+            int sh = in->op == TAC_LSH ? X64_SHL : in->op == TAC_LRSH ? X64_SHR : X64_SAR;
+            int rd = opt_dst(c, in->dst);
+            if (opt_imm(c, in->rhs, &imm)) {
+                opt_move_to(c, rd, in->lhs);
+                x64_shift_imm(x, sh, rd, (uint8_t)(imm & 63));
+            } else {
+                opt_move_to(c, X64_RCX, in->rhs);
+                opt_move_to(c, rd, in->lhs);
+                x64_shift_cl(x, sh, rd);
+            }
+            opt_def(c, in->dst, rd);
+            break;
+        }
+        case TAC_OR: {
+            int rd = opt_dst(c, in->dst);
+            opt_move_to(c, X64_RAX, in->lhs);
+            if (opt_imm(c, in->rhs, &imm)) x64_alu_imm(x, X64_OR, 1, X64_RAX, imm);
+            else x64_alu_rr(x, X64_OR, 1, X64_RAX, opt_reg(c, in->rhs, X64_RCX));
+            x64_mov_imm(x, X64_RAX, 0); /* mov keeps the flags */
+            x64_setcc(x, X64_CC_NE, X64_RAX);
+            if (rd != X64_RAX) x64_mov_rr(x, rd, X64_RAX);
+            opt_def(c, in->dst, rd);
+            break;
+        }
+        case TAC_AND: {
+            int rd = opt_dst(c, in->dst);
+            x64_alu_rr(x, X64_XOR, 0, X64_RAX, X64_RAX);
+            x64_alu_rr(x, X64_XOR, 0, X64_RDX, X64_RDX);
+            int ra = opt_reg(c, in->lhs, X64_RCX);
+            x64_test_rr(x, 1, ra, ra);
+            x64_setcc(x, X64_CC_NE, X64_RAX);
+            int rb = opt_reg(c, in->rhs, X64_RCX);
+            x64_test_rr(x, 1, rb, rb);
+            x64_setcc(x, X64_CC_NE, X64_RDX);
+            x64_alu_rr(x, X64_AND, 0, X64_RAX, X64_RDX);
+            if (rd != X64_RAX) x64_mov_rr(x, rd, X64_RAX);
+            opt_def(c, in->dst, rd);
+            break;
+        }
+        case TAC_NOT: {
+            int rd = opt_dst(c, in->dst);
+            x64_alu_rr(x, X64_XOR, 0, X64_RAX, X64_RAX);
+            int ra = opt_reg(c, in->lhs, X64_RCX);
+            x64_test_rr(x, 1, ra, ra);
+            x64_setcc(x, X64_CC_E, X64_RAX);
+            if (rd != X64_RAX) x64_mov_rr(x, rd, X64_RAX);
+            opt_def(c, in->dst, rd);
+            break;
+        }
+        case TAC_GEZ: {
+            int rd = opt_dst(c, in->dst);
+            opt_move_to(c, rd, in->lhs);
+            x64_unary(x, X64_NOT, rd);
+            x64_shift_imm(x, X64_SHR, rd, 63);
+            opt_def(c, in->dst, rd);
+            break;
+        }
+        case TAC_MOVE:
+            if (c->check_ip[c->blk[i]] == OPT_NO_IP) {
+                x64_lea(x, X64_RAX, x64_at(R_TP, c->d + (int32_t)in->imm));
+                x64_alu_imm(x, X64_CMP, 1, X64_RAX, TAPE_SIZE);
+                opt_guard(c, X64_CC_AE, c->op_of[i]);
+            }
+            c->d += (int)in->imm;
+            break;
+        case TAC_LOAD: {
+            int type = c->type[in->dst];
+            if (c->known[c->d + TAPE_SIZE] != type) {
+                x64_alu_mem_imm(x, X64_CMP, 0, opt_cell_type(c->d), type);
+                opt_guard(c, X64_CC_NE, c->op_of[i]);
+                opt_know(c, c->d, type);
+            }
+            int rd = opt_dst(c, in->dst);
+            x64_load(x, 1, rd, opt_cell(c->d));
+            opt_def(c, in->dst, rd);
+            break;
+        }
+        case TAC_STORE: {
+            int type = c->type[in->lhs];
+            if (opt_imm(c, in->lhs, &imm)) x64_store_imm(x, 1, opt_cell(c->d), imm);
+            else x64_store(x, 1, opt_cell(c->d), opt_reg(c, in->lhs, X64_RAX));
+            if (c->known[c->d + TAPE_SIZE] != type) {
+                x64_store_imm(x, 0, opt_cell_type(c->d), type);
+                opt_know(c, c->d, type);
+            }
+            break;
+        }
+        case TAC_PRINT:
+            opt_gen_call(c, i, (uintptr_t)opt_print, in->lhs);
+            break;
+        case TAC_PRINTCHAR:
+            opt_gen_call(c, i, (uintptr_t)opt_print_char, in->lhs);
+            break;
+        case TAC_JMP:
+            opt_sync_tp(c);
+            opt_jump_label(c, -1, (int)in->imm);
+            break;
+        case TAC_JZ: {
+            const opt_branch *b = &c->br[i];
+            opt_sync_tp(c);
+            int ra = opt_reg(c, b->a, X64_RAX);
+            if (b->test == TAC_SUB && opt_imm(c, b->b, &imm)) {
+                x64_alu_imm(x, X64_CMP, 1, ra, imm);
+            } else if (b->test == TAC_SUB && opt_spilled(c, b->b)) {
+                x64_alu_load(x, X64_CMP, 1, ra, opt_slot(c, b->b));
+            } else if (b->test == TAC_SUB) {
+                x64_alu_rr(x, X64_CMP, 1, ra, opt_reg(c, b->b, X64_RCX));
+            } else if (b->test == TAC_BITAND) {
+                x64_test_rr(x, 1, ra, opt_reg(c, b->b, X64_RCX));
+            } else {
+                x64_test_rr(x, 1, ra, ra);
+            }
+            /* jz jumps when the condition is false */
+            int cc = b->sign ? X64_CC_S : X64_CC_NE;
+            opt_jump_label(c, b->invert ? cc : cc ^ 1, (int)in->imm);
+            break;
+        }
+        case TAC_RET:
+            opt_gen_exit(c, c->op_of[i], c->d, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+static void opt_gen(opt_ctx *c) {
+    x64_buf *x = &c->x;
+    x64_push(x, X64_RBX);
+    x64_push(x, X64_RBP);
+    x64_push(x, X64_R12);
+    x64_push(x, X64_R13);
+    x64_push(x, X64_R14);
+    x64_push(x, X64_R15);
+    x64_alu_imm(x, X64_SUB, 1, X64_RSP, c->frame);
+    x64_mov_rr(x, R_VM, X64_RDI);
+    x64_movsxd(x, R_TP, vm_field(offsetof(VM, tp)));
+    x64_jmp_reg(x, X64_RSI);
+
+    c->epilogue = x->len;
+    x64_alu_imm(x, X64_ADD, 1, X64_RSP, c->frame);
+    x64_pop(x, X64_R15);
+    x64_pop(x, X64_R14);
+    x64_pop(x, X64_R13);
+    x64_pop(x, X64_R12);
+    x64_pop(x, X64_RBP);
+    x64_pop(x, X64_RBX);
+    x64_ret(x);
+
+    for (int b = 0; b < c->nblocks; ++b) {
+        c->d = 0;
+        opt_forget(c);
+        int i = c->bstart[b];
+        for (; i <= c->bend[b] && c->ins[i].op == TAC_LABEL; ++i) c->label_off[c->ins[i].imm] = (uint32_t)x->len;
+        if (c->check_ip[b] != OPT_NO_IP) {
+            /* every tp the block's moves reach is on the tape */
+            x64_lea(x, X64_RAX, x64_at(R_TP, c->dmin[b]));
+            x64_alu_imm(x, X64_CMP, 1, X64_RAX, TAPE_SIZE - (c->dmax[b] - c->dmin[b]));
+            opt_guard(c, X64_CC_AE, c->check_ip[b]);
+        }
+        for (; i <= c->bend[b]; ++i) {
+            if (!c->fused[i]) opt_gen_ins(c, i);
+        }
+        TacOp last = c->ins[c->bend[b]].op;
+        if (last != TAC_JMP && last != TAC_JZ && last != TAC_RET) opt_sync_tp(c);
+    }
+
+    for (int k = 0; k < c->nfix; ++k) x64_link(x, c->fix[k].at, c->label_off[c->fix[k].label]);
+    for (int k = 0; k < c->nstubs; ++k) {
+        x64_link(x, c->stubs[k].at, x->len);
+        opt_gen_exit(c, c->stubs[k].ip, c->stubs[k].d, 1);
+    }
+}
+
+static void opt_ctx_free(opt_ctx *c) {
+    free(c->depth);
+    free(c->nest);
+    free(c->ins);
+    free(c->snap_at);
+    free(c->snaps);
+    free(c->op_of);
+    free(c->first);
+    free(c->cond_label);
+    free(c->type);
+    free(c->def);
+    free(c->nuses);
+    free(c->fused);
+    free(c->br);
+    free(c->bstart);
+    free(c->bend);
+    free(c->blk);
+    free(c->succ);
+    free(c->label_blk);
+    free(c->check_ip);
+    free(c->dmin);
+    free(c->dmax);
+    free(c->live_in);
+    free(c->live_out);
+    free(c->istart);
+    free(c->iend);
+    free(c->loc);
+    free(c->x.buf);
+    free(c->label_off);
+    free(c->fix);
+    free(c->stubs);
+    free(c->known);
+    free(c->touched);
+}
+
+/* allocate the per-instruction, per-temp and per-block tables */
+static int opt_tables(opt_ctx *c) {
+    size_t ni = (size_t)c->nins + 1, nt = (size_t)(c->ntemps ? c->ntemps : 1), nl = (size_t)(c->nlabels ? c->nlabels : 1);
+    c->words = (c->ntemps + 63) / 64;
+    size_t nw = ni * (size_t)(c->words ? c->words : 1);
+    c->type = (int*)malloc(nt * sizeof(int));
+    c->def = (int*)malloc(nt * sizeof(int));
+    c->nuses = (int*)malloc(nt * sizeof(int));
+    c->istart = (int*)malloc(nt * sizeof(int));
+    c->iend = (int*)malloc(nt * sizeof(int));
+    c->loc = (int*)malloc(nt * sizeof(int));
+    c->fused = (uint8_t*)calloc(ni, 1);
+    c->br = (opt_branch*)calloc(ni, sizeof(opt_branch));
+    c->bstart = (int*)malloc(ni * sizeof(int));
+    c->bend = (int*)malloc(ni * sizeof(int));
+    c->blk = (int*)malloc(ni * sizeof(int));
+    c->succ = (int*)malloc(2 * ni * sizeof(int));
+    c->check_ip = (size_t*)malloc(ni * sizeof(size_t));
+    c->dmin = (int*)malloc(ni * sizeof(int));
+    c->dmax = (int*)malloc(ni * sizeof(int));
+    c->live_in = (uint64_t*)calloc(nw, sizeof(uint64_t));
+    c->live_out = (uint64_t*)calloc(nw, sizeof(uint64_t));
+    c->label_blk = (int*)malloc(nl * sizeof(int));
+    c->label_off = (uint32_t*)malloc(nl * sizeof(uint32_t));
+    c->known = (int*)malloc((2 * TAPE_SIZE + 1) * sizeof(int));
+    c->touched = (int*)malloc(ni * sizeof(int));
+    if (!c->type || !c->def || !c->nuses || !c->istart || !c->iend || !c->loc || !c->fused || !c->br || !c->bstart ||
+        !c->bend || !c->blk || !c->succ || !c->check_ip || !c->dmin || !c->dmax || !c->live_in || !c->live_out ||
+        !c->label_blk || !c->label_off || !c->known || !c->touched)
+        return 0;
+    for (int k = 0; k < 2 * TAPE_SIZE + 1; ++k) c->known[k] = -1;
+    return 1;
+}
+
+/* Find the closing ENDBLOCK of the body starting at `start`. */
+static int opt_find_end(const word *code, size_t code_len, size_t start, size_t *end) {
+    size_t depth = 0;
+    for (size_t ip = start; ip < code_len; ) {
+        word op = code[ip];
+        if (op < 0 || op > OP_HALT) return 0;
+        if (op == OP_ENDBLOCK) {
+            if (depth == 0) { *end = ip; return 1; }
+            depth--;
+        } else if (op == OP_IF || op == OP_WHILE || op == OP_FUNCTION) {
+            depth++;
+        }
+        ip += 1 + (size_t)vm_op_imm_count((OpCode)op);
+    }
+    return 0;
+}
+
+opt_code *opt_compile(const word *code, size_t code_len, size_t start, const struct jit_code *base, const char **why) {
+    const char *dummy;
+    if (!why) why = &dummy;
+    if (!base) { *why = "no baseline code"; return NULL; }
+    opt_ctx c;
+    memset(&c, 0, sizeof(c));
+    c.code = code;
+    c.code_len = code_len;
+    c.start = start;
+    if (!opt_find_end(code, code_len, start, &c.end)) { *why = "unterminated body"; return NULL; }
+    c.n = c.end - c.start + 1;
+
+    opt_code *oc = NULL;
+    const char *err = NULL;
+    c.depth = (int*)malloc(c.n * sizeof(int));
+    c.nest = (int*)malloc(c.n * sizeof(int));
+    c.snap_at = (int*)malloc(c.n * sizeof(int));
+    c.cond_label = (int*)malloc(c.n * sizeof(int));
+    if (!c.depth || !c.nest || !c.snap_at || !c.cond_label) { err = "out of memory"; goto out; }
+    if ((err = opt_scan(&c)) != NULL) goto out;
+    c.snaps = (int*)malloc((size_t)(c.nsnaps ? c.nsnaps : 1) * sizeof(int));
+    if (!c.snaps) { err = "out of memory"; goto out; }
+    if ((err = opt_lower(&c)) != NULL) goto out;
+    if (!opt_tables(&c)) { err = "out of memory"; goto out; }
+    if ((err = opt_types(&c)) != NULL) goto out;
+    opt_fold_branches(&c);
+    if ((err = opt_cfg(&c)) != NULL) goto out;
+    if ((err = opt_liveness(&c)) != NULL) goto out;
+    if ((err = opt_allocate(&c)) != NULL) goto out;
+    for (int l = 0; l < c.nlabels; ++l) c.label_off[l] = 0;
+    opt_gen(&c);
+    if (c.oom || c.x.oom) { err = "out of memory"; goto out; }
+
+    oc = (opt_code*)calloc(1, sizeof(opt_code));
+    opt_entry *entries = (opt_entry*)malloc(c.n * sizeof(opt_entry));
+    if (!oc || !entries) { free(oc); free(entries); oc = NULL; err = "out of memory"; goto out; }
+    /* the function start, then each top-level loop condition with nothing live */
+    entries[0].ip = start;
+    entries[0].at = c.label_off[c.ins[0].imm];
+    oc->nentries = 1;
+    for (size_t ip = start; ip < c.end; ip += 1 + (size_t)vm_op_imm_count((OpCode)code[ip])) {
+        if (code[ip] != OP_WHILE || c.nest[ip - start] != 0) continue;
+        size_t cond = (size_t)code[ip + 1];
+        int label = c.cond_label[ip - start];
+        if (c.depth[cond - start] != 0 || label <= 0 || label >= c.nlabels || c.label_blk[label] < 0) continue;
+        const uint64_t *in = c.live_in + (size_t)c.label_blk[label] * c.words;
+        int live = 0;
+        for (int k = 0; k < c.words; ++k) live |= in[k] != 0;
+        if (live) continue;
+        entries[oc->nentries].ip = cond;
+        entries[oc->nentries].at = c.label_off[label];
+        oc->nentries++;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size = (c.x.len + page - 1) / page * page;
+    void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) { free(entries); free(oc); oc = NULL; err = "mmap failed"; goto out; }
+    memcpy(mem, c.x.buf, c.x.len);
+    if (mprotect(mem, map_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, map_size);
+        free(entries);
+        free(oc);
+        oc = NULL;
+        err = "mprotect failed";
+        goto out;
+    }
+    oc->mem = (uint8_t*)mem;
+    oc->map_size = map_size;
+    oc->bytes = c.x.len;
+    oc->start = start;
+    oc->base = base;
+    oc->entries = entries;
+    oc->max_depth = c.max_depth;
+    oc->tac_ops = c.nins;
+    oc->temps = c.ntemps;
+    for (int t = 0; t < c.ntemps; ++t) {
+        if (c.loc[t] >= 0) oc->in_regs++;
+    }
+    oc->spilled = c.nslots;
+    for (int i = 0; i < c.nins; ++i) oc->fused += c.fused[i];
+    oc->guards = c.nstubs;
+out:
+    opt_ctx_free(&c);
+    *why = err;
+    return oc;
+}
+
+int opt_enter(opt_code *oc, VM *vm) {
+    size_t at = SIZE_MAX;
+    for (int k = 0; k < oc->nentries; ++k) {
+        if (oc->entries[k].ip == vm->ip) { at = oc->entries[k].at; break; }
+    }
+    if (at == SIZE_MAX) return JIT_EXIT;
+    /* exits write up to max_depth values above sp */
+    if (vm->sp + oc->max_depth > STACK_SIZE) return jit_enter(oc->base, vm);
+    int base = vm->block_sp;
+    oc->runs++;
+    if (((opt_fn)(uintptr_t)oc->mem)(vm, oc->mem + at)) oc->deopts++;
+    return jit_resume(oc->base, vm, base);
+}
+
+void opt_free(opt_code *oc) {
+    if (!oc) return;
+    munmap(oc->mem, oc->map_size);
+    free(oc->entries);
+    free(oc);
+}
+
+#else /* !JIT_AVAILABLE */
+
+opt_code *opt_compile(const word *code, size_t code_len, size_t start, const struct jit_code *base, const char **why) {
+    (void)code; (void)code_len; (void)start; (void)base;
+    if (why) *why = "no JIT for this target";
+    return NULL;
+}
+
+int opt_enter(opt_code *oc, VM *vm) {
+    (void)oc; (void)vm;
+    return JIT_EXIT;
+}
+
+void opt_free(opt_code *oc) {
+    (void)oc;
+}
+
+#endif /* JIT_AVAILABLE */
+
+int opt_entry_at(const opt_code *oc, size_t ip) {
+    for (int k = 0; oc && k < oc->nentries; ++k) {
+        if (oc->entries[k].ip == ip) return 1;
+    }
+    return 0;
+}
+
+size_t opt_code_bytes(const opt_code *oc) {
+    return oc ? oc->bytes : 0;
+}
+
+const uint8_t *opt_code_addr(const opt_code *oc) {
+    return oc->mem;
+}
+
+int opt_unprofitable(const opt_code *oc) {
+    return oc->runs >= OPT_MIN_RUNS && oc->deopts * 2 > oc->runs;
+}
+
+void opt_print_stats(const opt_code *oc, long fi, FILE *out) {
+    fprintf(out, "opt func %ld: %d tac ops, %d temps (%d in registers, %d spilled), %d branch ops fused, %d guards, "
+            "%d entries, %zu bytes, runs=%" PRIu64 " deopts=%" PRIu64 "\n", fi, oc->tac_ops, oc->temps, oc->in_regs,
+            oc->spilled, oc->fused, oc->guards, oc->nentries, oc->bytes, oc->runs, oc->deopts);
+}
@@ -0,0 +1,74 @@
+#ifndef TIER_OPT_H
+#define TIER_OPT_H
+
+/*
+ * rrvm/frontend/tier/opt.h
+ *
+ * Optimizing JIT: the tier above the baseline JIT (jit.h). A function that
+ * stays hot after the baseline compiled it is lowered to three-address code
+ * with the TAC backend (tac/tac.h) and compiled from there:
+ *  - liveness over the TAC control-flow graph gives each temp one live
+ *    interval, and a linear scan assigns the intervals to x86-64 registers,
+ *    spilling the one that ends last to a frame slot when they run out;
+ *  - constants are rematerialized where they are used, as immediates where
+ *    the instruction takes one;
+ *  - tape moves become displacements of the accesses after them
+ *    ([tape + tp*8 + d*8]) and tp is updated once per basic block, with one
+ *    range check for all the moves in the block;
+ *  - the compare chain feeding a branch (sub/bitand, gez, not, ending in the
+ *    jz of an if or while) becomes a single cmp or test and conditional jump.
+ *
+ * The code speculates on types. Each temp gets the type its constants
+ * imply (i64 when none reaches it) and every tape load checks that the cell
+ * has that type. A failed check, a divisor of 0 or -1, or a move off the
+ * tape deoptimizes: the temps on the virtual stack are written to the VM
+ * stack with their types, sp/tp/ip are set and execution continues in the
+ * function's baseline code at that instruction (jit_resume). ret and the
+ * end of the body leave the same way, so the baseline code pops the frame.
+ *
+ * Only leaf functions over integer values compile: no calls, floats,
+ * vectors, pointer ops or kernels; every block leaves the stack as it found
+ * it and nothing is read from below the frame. Besides the function start,
+ * the condition of each while at the top level of the body is an entry when
+ * the stack is empty there, so a running invocation moves in at a back-edge.
+ *
+ * Available where the baseline JIT is (JIT_AVAILABLE); elsewhere
+ * opt_compile always fails.
+ */
+
+#include <stdio.h>
+
+#include "../vm/vm.h"
+
+typedef struct opt_code opt_code;
+struct jit_code;
+
+/*
+ * Compile the function whose first instruction is at `start`. `base` is the
+ * baseline code for the same function, where exits continue. Returns NULL
+ * and sets *why (static string) if the body cannot be compiled. Only reads
+ * `code`, so it may run on another thread.
+ */
+opt_code *opt_compile(const word *code, size_t code_len, size_t start, const struct jit_code *base, const char **why);
+
+/* ip is the function start or the condition of a loop that can be entered */
+int opt_entry_at(const opt_code *oc, size_t ip);
+
+/* Run from vm->ip (an entry) until the function returns or deoptimizes and
+ * the baseline code takes over; returns like jit_enter. */
+int opt_enter(opt_code *oc, VM *vm);
+
+/* Enough runs deoptimized that the speculation does not hold. */
+int opt_unprofitable(const opt_code *oc);
+
+/* bytes of machine code emitted */
+size_t opt_code_bytes(const opt_code *oc);
+
+/* start of the machine code (for tier/perf.h) */
+const uint8_t *opt_code_addr(const opt_code *oc);
+
+void opt_print_stats(const opt_code *oc, long fi, FILE *out);
+
+void opt_free(opt_code *oc);
+
+#endif /* TIER_OPT_H */
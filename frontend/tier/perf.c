@@ -0,0 +1,192 @@
+/*
+ * rrvm/frontend/tier/perf.c
+ *
+ * perf map and jitdump writer (see perf.h). The jitdump layout follows
+ * tools/perf/Documentation/jitdump-specification.txt in the Linux tree:
+ * a file header, then records, each starting with {id, total_size,
+ * timestamp}. perf finds the file through a PROT_EXEC mapping of it made
+ * when it is opened, which is why the mapping is kept.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "perf.h"
+#include "jit.h"
+#include "../parser/parser.h"
+
+enum { JITDUMP_MAGIC = 0x4A695444, JITDUMP_VERSION = 1, JITDUMP_EM_X86_64 = 62 };
+enum { JIT_CODE_LOAD = 0, JIT_CODE_DEBUG_INFO = 2 };
+
+typedef struct {
+    uint32_t magic, version, total_size, elf_mach, pad1, pid;
+    uint64_t timestamp, flags;
+} jitdump_header;
+
+typedef struct {
+    uint32_t id, total_size;
+    uint64_t timestamp;
+} jitdump_record;
+
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *perf_map;
+static FILE *perf_dump;
+static int perf_failed; /* PERF_* outputs that could not be opened */
+static uint64_t perf_code_index;
+
+static uint64_t perf_timestamp(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static FILE *perf_open_map(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+    return fopen(path, "a");
+}
+
+static FILE *perf_open_dump(void) {
+    const char *dir = getenv("JITDUMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/jit-%d.dump", dir && *dir ? dir : ".", (int)getpid());
+    FILE *f = fopen(path, "w+");
+    if (!f) return NULL;
+    long page = sysconf(_SC_PAGESIZE);
+    void *marker = mmap(NULL, page > 0 ? (size_t)page : 4096, PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(f), 0);
+    if (marker == MAP_FAILED) {
+        fclose(f);
+        return NULL;
+    }
+    jitdump_header h = {
+        .magic = JITDUMP_MAGIC,
+        .version = JITDUMP_VERSION,
+        .total_size = sizeof(jitdump_header),
+        .elf_mach = JITDUMP_EM_X86_64,
+        .pid = (uint32_t)getpid(),
+        .timestamp = perf_timestamp(),
+    };
+    fwrite(&h, sizeof(h), 1, f);
+    fflush(f);
+    return f;
+}
+
+/* source line of ip, 0 if unknown */
+static int perf_line(const ParserSymbols *syms, size_t ip) {
+    return syms && syms->lines && ip < syms->nlines ? syms->lines[ip] : 0;
+}
+
+static void perf_name(const perf_region *r, char *out, size_t cap) {
+    const ParserSymbols *syms = r->syms;
+    char func[96];
+    if (r->fi < 0) snprintf(func, sizeof(func), "main");
+    else if (syms && r->fi < syms->count && syms->names[r->fi]) snprintf(func, sizeof(func), "%s", syms->names[r->fi]);
+    else snprintf(func, sizeof(func), "func%ld", r->fi);
+    char kind[48];
+    if (strcmp(r->kind, "loop") == 0 || strcmp(r->kind, "trace") == 0) snprintf(kind, sizeof(kind), "%s @%zu", r->kind, r->start);
+    else snprintf(kind, sizeof(kind), "%s", r->kind);
+
+    int lo = 0, hi = 0;
+    for (size_t ip = r->start; ip <= r->end; ++ip) {
+        int l = perf_line(syms, ip);
+        if (!l) continue;
+        if (!lo || l < lo) lo = l;
+        if (l > hi) hi = l;
+    }
+    if (lo) {
+        const char *src = syms->source ? syms->source : "<string>";
+        const char *base = strrchr(src, '/');
+        snprintf(out, cap, "rr:%s [%s] %s:%d-%d", func, kind, base ? base + 1 : src, lo, hi);
+    } else {
+        snprintf(out, cap, "rr:%s [%s] @%zu-%zu", func, kind, r->start, r->end);
+    }
+}
+
+/* JIT_CODE_DEBUG_INFO for r: one entry wherever the source line changes */
+static void perf_dump_lines(FILE *f, const perf_region *r) {
+    const ParserSymbols *syms = r->syms;
+    if (!syms || !syms->lines) return;
+    const char *file = syms->source ? syms->source : "<string>";
+    size_t flen = strlen(file) + 1;
+    size_t cap = r->end - r->start + 1, n = 0;
+    uint64_t *addr = (uint64_t*)malloc(cap * sizeof(uint64_t));
+    uint32_t *line = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    if (!addr || !line) {
+        free(addr);
+        free(line);
+        return;
+    }
+    for (size_t ip = r->start; ip <= r->end; ++ip) {
+        int l = perf_line(syms, ip);
+        const uint8_t *at = r->jc ? jit_code_at(r->jc, ip) : ip == r->start ? r->code : NULL;
+        if (!l || !at || (n && ((uint32_t)l == line[n - 1] || (uint64_t)(uintptr_t)at <= addr[n - 1]))) continue;
+        addr[n] = (uint64_t)(uintptr_t)at;
+        line[n++] = (uint32_t)l;
+    }
+    if (n) {
+        uint64_t head[2] = { (uint64_t)(uintptr_t)r->code, n };
+        jitdump_record rec = {
+            .id = JIT_CODE_DEBUG_INFO,
+            .total_size = (uint32_t)(sizeof(rec) + sizeof(head) + n * (16 + flen)),
+            .timestamp = perf_timestamp(),
+        };
+        fwrite(&rec, sizeof(rec), 1, f);
+        fwrite(head, sizeof(head), 1, f);
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t ld[2] = { line[i], 0 }; /* line, discriminator */
+            fwrite(&addr[i], sizeof(uint64_t), 1, f);
+            fwrite(ld, sizeof(ld), 1, f);
+            fwrite(file, flen, 1, f);
+        }
+    }
+    free(addr);
+    free(line);
+}
+
+static void perf_dump_load(FILE *f, const perf_region *r, const char *name) {
+    size_t nlen = strlen(name) + 1;
+    uint32_t ids[2] = { (uint32_t)getpid(), (uint32_t)syscall(SYS_gettid) };
+    uint64_t code[4] = { (uint64_t)(uintptr_t)r->code, (uint64_t)(uintptr_t)r->code, r->size, perf_code_index++ };
+    jitdump_record rec = {
+        .id = JIT_CODE_LOAD,
+        .total_size = (uint32_t)(sizeof(rec) + sizeof(ids) + sizeof(code) + nlen + r->size),
+        .timestamp = perf_timestamp(),
+    };
+    fwrite(&rec, sizeof(rec), 1, f);
+    fwrite(ids, sizeof(ids), 1, f);
+    fwrite(code, sizeof(code), 1, f); /* vma, code_addr, code_size, code_index */
+    fwrite(name, nlen, 1, f);
+    fwrite(r->code, r->size, 1, f);
+}
+
+void perf_record(int flags, const perf_region *r) {
+    if (!JIT_AVAILABLE || !flags || !r->code || !r->size) return;
+    char name[512];
+    perf_name(r, name, sizeof(name));
+
+    pthread_mutex_lock(&perf_lock);
+    if ((flags & PERF_MAP) && !perf_map && !(perf_failed & PERF_MAP)) {
+        perf_map = perf_open_map();
+        if (!perf_map) perf_failed |= PERF_MAP;
+    }
+    if ((flags & PERF_JITDUMP) && !perf_dump && !(perf_failed & PERF_JITDUMP)) {
+        perf_dump = perf_open_dump();
+        if (!perf_dump) perf_failed |= PERF_JITDUMP;
+    }
+    if ((flags & PERF_MAP) && perf_map) {
+        fprintf(perf_map, "%lx %zx %s\n", (unsigned long)(uintptr_t)r->code, r->size, name);
+        fflush(perf_map);
+    }
+    if ((flags & PERF_JITDUMP) && perf_dump) {
+        perf_dump_lines(perf_dump, r);
+        perf_dump_load(perf_dump, r, name);
+        fflush(perf_dump);
+    }
+    pthread_mutex_unlock(&perf_lock);
+}
@@ -0,0 +1,52 @@
+#ifndef TIER_PERF_H
+#define TIER_PERF_H
+
+/*
+ * rrvm/frontend/tier/perf.h
+ *
+ * Symbols for Linux perf. Every region a tier compiles (baseline function
+ * or loop, trace, optimized function) is announced as it is published:
+ *  - PERF_MAP appends "addr size name" to /tmp/perf-<pid>.map, which
+ *    `perf report` reads for addresses outside any mapped object;
+ *  - PERF_JITDUMP writes the jitdump format to jit-<pid>.dump in
+ *    $JITDUMPDIR (else the current directory): a code load record with a
+ *    copy of the machine code, preceded by line info mapping native
+ *    addresses to .rr source lines. `perf record -k mono` followed by
+ *    `perf inject --jit` turns it into per-region objects, so samples are
+ *    annotated down to source lines.
+ *
+ * Names read "rr:<func> [<kind>] <source>:<first>-<last>", with the .rr
+ * function name (main for code outside functions), the tier that compiled
+ * it (jit, loop @ip, trace @ip, opt) and the source lines the region spans,
+ * e.g. "rr:collatz [opt] tier_calls.rr:9-44". Without parser symbols the
+ * function index and ip range stand in.
+ *
+ * Both files are opened on first use and written under one lock, so
+ * compiles on the tier worker and traces on the main thread may announce
+ * regions concurrently. Nothing is written when the JIT is unavailable.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum { PERF_MAP = 1, PERF_JITDUMP = 2 };
+
+struct ParserSymbols;
+struct jit_code;
+
+typedef struct {
+    const uint8_t *code; /* machine code */
+    size_t size;
+    const char *kind;    /* "jit", "loop", "trace", "opt" */
+    long fi;             /* function around the region, -1 at top level */
+    size_t start, end;   /* bytecode ips the region covers */
+    const struct jit_code *jc; /* baseline code: its per-ip addresses give the
+                                * line info; NULL attributes all of the code
+                                * to the region's first line */
+    const struct ParserSymbols *syms; /* may be NULL */
+} perf_region;
+
+/* announce r in the outputs `flags` selects */
+void perf_record(int flags, const perf_region *r);
+
+#endif /* TIER_PERF_H */
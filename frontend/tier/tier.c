@@ -0,0 +1,491 @@
+/*
+ * rrvm/frontend/tier/tier.c
+ *
+ * Tiered execution manager (see tier.h): hotness bookkeeping, the tier-up
+ * event log and the background compile worker. Each request is one event;
+ * the worker takes them in order, compiles outside the lock and publishes
+ * the code where tier_enter / tier_loop_edge look for it. Traces are
+ * recorded while the loop runs, so they are made and logged right here.
+ * Optimizing compiles are queued like baseline ones and read the published
+ * baseline code. Published code is announced to perf where it is made.
+ */
+
+/* system headers first: vm.h defines emit macros such as __rem */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tier.h"
+#include "jit.h"
+#include "trace.h"
+#include "opt.h"
+#include "perf.h"
+#include "../interpreter/interpreter.h"
+
+tier_config tier_defaults = {
+    .enabled = 1,
+    .background = 1,
+    .call_threshold = 1000,
+    .loop_threshold = 10000,
+    .trace = 1,
+    .trace_threshold = 1000,
+    .opt = 1,
+    .opt_threshold = 5000,
+};
+
+/* recordings per loop before it is left to the other tiers */
+#define TIER_TRACE_TRIES 3
+
+/* outcome of a tier-up request */
+enum { TIER_QUEUED, TIER_COMPILED, TIER_FAILED };
+
+/* what a request compiles */
+enum { TIER_FUNC, TIER_LOOP, TIER_TRACE, TIER_OPT };
+
+typedef struct {
+    int kind;       /* TIER_FUNC / TIER_LOOP / TIER_TRACE / TIER_OPT */
+    long fi;        /* function (around the loop), -1 at top level */
+    size_t start;   /* first ip of the body, or the loop's condition */
+    size_t end;     /* loops: ip of the ENDBLOCK */
+    int reason;     /* TIER_HOT_CALLS / TIER_HOT_LOOPS */
+    uint64_t count; /* calls or back-edges (both for TIER_OPT) when requested */
+    int status;
+    size_t bytes;
+    double usec;
+    const char *why; /* TIER_FAILED: reason from jit_compile, trace_record or opt_compile */
+} tier_event;
+
+struct tier_shared {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running; /* worker started */
+    int stop;
+    tier_event *events; /* grows under the lock; copy out before unlocking */
+    int nevents, capevents;
+    int next;    /* first event the worker has not taken */
+};
+
+static double tier_now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec * 1e-3;
+}
+
+/* announce compiled code of function fi to perf */
+static void tier_perf(tier_state *t, const char *kind, long fi, const jit_code *jc, const opt_code *oc) {
+    perf_region r;
+    memset(&r, 0, sizeof(r));
+    r.kind = kind;
+    r.fi = fi;
+    r.syms = t->cfg.symbols;
+    if (oc) {
+        jit_code_addr(jc, &r.start, &r.end);
+        r.code = opt_code_addr(oc);
+        r.size = opt_code_bytes(oc);
+    } else {
+        r.code = jit_code_addr(jc, &r.start, &r.end);
+        r.size = jit_code_bytes(jc);
+        r.jc = jc;
+    }
+    perf_record(t->cfg.perf, &r);
+}
+
+/* Compile event e, whose fields were copied to `job`. Called without the lock held. */
+static void tier_compile(tier_state *t, int e, tier_event job) {
+    struct tier_shared *sh = t->shared;
+    const char *why = NULL;
+    jit_code *jc = NULL;
+    opt_code *oc = NULL;
+    const jit_code *base = NULL;
+    double t0 = tier_now_usec();
+    if (job.kind == TIER_OPT)
+        oc = opt_compile(t->code, t->code_len, job.start, base = __atomic_load_n(&t->compiled[job.fi], __ATOMIC_ACQUIRE), &why);
+    else if (job.kind == TIER_LOOP)
+        jc = jit_compile_loop(t->code, t->code_len, job.start, job.end, t->traces, &why);
+    else
+        jc = jit_compile(t->code, t->code_len, job.start, t->traces, &why);
+    double dt = tier_now_usec() - t0;
+
+    pthread_mutex_lock(&sh->lock);
+    sh->events[e].status = jc || oc ? TIER_COMPILED : TIER_FAILED;
+    sh->events[e].bytes = oc ? opt_code_bytes(oc) : jit_code_bytes(jc);
+    sh->events[e].usec = dt;
+    sh->events[e].why = why;
+    pthread_mutex_unlock(&sh->lock);
+    if (t->cfg.perf && (jc || oc))
+        tier_perf(t, job.kind == TIER_OPT ? "opt" : job.kind == TIER_LOOP ? "loop" : "jit", job.fi, oc ? base : jc, oc);
+    if (job.kind == TIER_OPT) {
+        if (oc) __atomic_store_n(&t->optimized[job.fi], oc, __ATOMIC_RELEASE);
+    } else if (job.kind == TIER_LOOP) {
+        if (jc) __atomic_store_n(&t->loop_compiled[job.start], jc, __ATOMIC_RELEASE);
+    } else if (jc) {
+        __atomic_store_n(&t->compiled[job.fi], jc, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&t->failed[job.fi], 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void *tier_worker(void *arg) {
+    tier_state *t = (tier_state*)arg;
+    struct tier_shared *sh = t->shared;
+    pthread_mutex_lock(&sh->lock);
+    for (;;) {
+        while (!sh->stop && sh->next == sh->nevents) pthread_cond_wait(&sh->wake, &sh->lock);
+        if (sh->stop) break;
+        int e = sh->next++;
+        /* traces are logged already made */
+        if (sh->events[e].status != TIER_QUEUED) continue;
+        tier_event job = sh->events[e];
+        pthread_mutex_unlock(&sh->lock);
+        tier_compile(t, e, job);
+        pthread_mutex_lock(&sh->lock);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return NULL;
+}
+
+/* Innermost function around each code ip (-1 at top level). */
+static void tier_map_owners(tier_state *t) {
+    int *fstack = (int*)malloc((t->code_len + 1) * sizeof(int));
+    int *fdepth = (int*)malloc((t->code_len + 1) * sizeof(int));
+    if (!fstack || !fdepth) {
+        for (size_t i = 0; i < t->code_len; ++i) t->owner[i] = -1;
+        free(fstack);
+        free(fdepth);
+        return;
+    }
+    int nf = 0, depth = 0;
+    size_t ip = 0;
+    while (ip < t->code_len) {
+        OpCode op = (OpCode)t->code[ip];
+        size_t next = ip + 1 + (size_t)vm_op_imm_count(op);
+        if (next > t->code_len) next = t->code_len;
+        int cur = nf > 0 ? fstack[nf - 1] : -1;
+        if (op == OP_FUNCTION && ip + 1 < t->code_len) {
+            fstack[nf] = (int)t->code[ip + 1];
+            fdepth[nf++] = depth++;
+        } else if (op == OP_IF || op == OP_WHILE) {
+            depth++;
+        } else if (op == OP_ENDBLOCK && depth > 0) {
+            depth--;
+            if (nf > 0 && fdepth[nf - 1] == depth) nf--;
+        }
+        for (size_t i = ip; i < next; ++i) t->owner[i] = cur;
+        ip = next;
+    }
+    free(fstack);
+    free(fdepth);
+}
+
+tier_state *tier_new(const VM *vm, const tier_config *cfg) {
+    if (!cfg->enabled) return NULL;
+    tier_state *t = (tier_state*)calloc(1, sizeof(tier_state));
+    struct tier_shared *sh = (struct tier_shared*)calloc(1, sizeof(struct tier_shared));
+    size_t n = vm->code_len ? vm->code_len : 1;
+    int *owner = (int*)malloc(n * sizeof(int));
+    uint64_t *loop_edges = (uint64_t*)calloc(n, sizeof(uint64_t));
+    uint8_t *loop_requested = (uint8_t*)calloc(n, 1);
+    jit_code **loop_compiled = (jit_code**)calloc(n, sizeof(jit_code*));
+    int tracing = cfg->trace && JIT_AVAILABLE;
+    trace **traces = tracing ? (trace**)calloc(n, sizeof(trace*)) : NULL;
+    uint64_t *trace_next = tracing ? (uint64_t*)malloc(n * sizeof(uint64_t)) : NULL;
+    uint8_t *trace_tries = tracing ? (uint8_t*)calloc(n, 1) : NULL;
+    if (!t || !sh || !owner || !loop_edges || !loop_requested || !loop_compiled ||
+        (tracing && (!traces || !trace_next || !trace_tries))) {
+        free(t);
+        free(sh);
+        free(owner);
+        free(loop_edges);
+        free(loop_requested);
+        free(loop_compiled);
+        free(traces);
+        free(trace_next);
+        free(trace_tries);
+        return NULL;
+    }
+    t->cfg = *cfg;
+    if (t->cfg.call_threshold == 0) t->cfg.call_threshold = 1;
+    if (t->cfg.loop_threshold == 0) t->cfg.loop_threshold = 1;
+    if (t->cfg.trace_threshold == 0) t->cfg.trace_threshold = 1;
+    if (t->cfg.opt_threshold == 0) t->cfg.opt_threshold = 1;
+    t->code = vm->code;
+    t->code_len = vm->code_len;
+    t->owner = owner;
+    t->loop_edges = loop_edges;
+    t->loop_requested = loop_requested;
+    t->loop_compiled = loop_compiled;
+    t->traces = traces;
+    t->trace_next = trace_next;
+    t->trace_tries = trace_tries;
+    for (size_t i = 0; tracing && i < n; ++i) trace_next[i] = t->cfg.trace_threshold;
+    t->shared = sh;
+    pthread_mutex_init(&sh->lock, NULL);
+    pthread_cond_init(&sh->wake, NULL);
+    tier_map_owners(t);
+    return t;
+}
+
+void tier_free(tier_state *t) {
+    if (!t) return;
+    struct tier_shared *sh = t->shared;
+    if (sh->running) {
+        /* queued requests that have not started are dropped */
+        pthread_mutex_lock(&sh->lock);
+        sh->stop = 1;
+        pthread_cond_signal(&sh->wake);
+        pthread_mutex_unlock(&sh->lock);
+        pthread_join(sh->thread, NULL);
+    }
+    pthread_mutex_destroy(&sh->lock);
+    pthread_cond_destroy(&sh->wake);
+    for (size_t i = 0; i < TIER_MAX_FUNCS; ++i) opt_free(t->optimized[i]);
+    for (size_t i = 0; i < TIER_MAX_FUNCS; ++i) jit_free(t->compiled[i]);
+    for (size_t i = 0; i < t->code_len; ++i) jit_free(t->loop_compiled[i]);
+    for (size_t i = 0; t->traces && i < t->code_len; ++i) trace_free(t->traces[i]);
+    for (int i = 0; i < t->nretired; ++i) trace_free(t->retired[i]);
+    free(sh->events);
+    free(sh);
+    free(t->owner);
+    free(t->loop_edges);
+    free(t->loop_requested);
+    free(t->loop_compiled);
+    free(t->traces);
+    free(t->trace_next);
+    free(t->trace_tries);
+    free(t->retired);
+    free(t);
+}
+
+/* Append `ev` to the event log; returns its index, -1 if it could not grow.
+ * Called with the lock held. */
+static int tier_log(struct tier_shared *sh, const tier_event *ev) {
+    if (sh->nevents == sh->capevents) {
+        int cap = sh->capevents ? sh->capevents * 2 : 16;
+        tier_event *ne = (tier_event*)realloc(sh->events, (size_t)cap * sizeof(*ne));
+        if (!ne) return -1;
+        sh->events = ne;
+        sh->capevents = cap;
+    }
+    sh->events[sh->nevents] = *ev;
+    return sh->nevents++;
+}
+
+/* Log `job` as a new event and compile it, here or on the worker. */
+static void tier_submit(tier_state *t, const tier_event *job) {
+    struct tier_shared *sh = t->shared;
+    pthread_mutex_lock(&sh->lock);
+    int e = tier_log(sh, job);
+    if (e < 0) {
+        /* not logged and not compiled: that code stays interpreted */
+        pthread_mutex_unlock(&sh->lock);
+        return;
+    }
+    sh->events[e].status = TIER_QUEUED;
+
+    if (!t->cfg.background || !JIT_AVAILABLE) {
+        sh->next = sh->nevents;
+        pthread_mutex_unlock(&sh->lock);
+        tier_compile(t, e, *job);
+        return;
+    }
+    if (!sh->running) {
+        if (pthread_create(&sh->thread, NULL, tier_worker, t) == 0) {
+            sh->running = 1;
+        } else {
+            /* no worker: compile here */
+            sh->next = sh->nevents;
+            pthread_mutex_unlock(&sh->lock);
+            tier_compile(t, e, *job);
+            return;
+        }
+    }
+    pthread_cond_signal(&sh->wake);
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void tier_request(tier_state *t, VM *vm, size_t fi, int reason) {
+    t->requested[fi] = 1;
+    tier_event job;
+    memset(&job, 0, sizeof(job));
+    job.kind = TIER_FUNC;
+    job.fi = (long)fi;
+    job.start = vm->functions[fi];
+    job.reason = reason;
+    job.count = reason == TIER_HOT_CALLS ? t->calls[fi] : t->edges[fi];
+    tier_submit(t, &job);
+}
+
+void tier_request_loop(tier_state *t, size_t cond_ip, size_t end_ip) {
+    t->loop_requested[cond_ip] = 1;
+    tier_event job;
+    memset(&job, 0, sizeof(job));
+    job.kind = TIER_LOOP;
+    job.fi = t->owner[cond_ip];
+    job.start = cond_ip;
+    job.end = end_ip;
+    job.reason = TIER_HOT_LOOPS;
+    job.count = t->loop_edges[cond_ip];
+    tier_submit(t, &job);
+}
+
+void tier_request_opt(tier_state *t, VM *vm, size_t fi) {
+    t->opt_requested[fi] = 1;
+    tier_event job;
+    memset(&job, 0, sizeof(job));
+    job.kind = TIER_OPT;
+    job.fi = (long)fi;
+    job.start = vm->functions[fi];
+    job.reason = TIER_HOT_CALLS;
+    job.count = t->calls[fi] + t->edges[fi];
+    tier_submit(t, &job);
+}
+
+/* run the loop's trace; drop it if the loop keeps leaving it at once */
+static void tier_run_trace(tier_state *t, VM *vm, size_t cond_ip) {
+    trace *tr = t->traces[cond_ip];
+    trace_run(tr, vm);
+    if (!trace_unprofitable(tr)) return;
+    if (t->nretired == t->capretired) {
+        int cap = t->capretired ? t->capretired * 2 : 8;
+        trace **nr = (trace**)realloc(t->retired, (size_t)cap * sizeof(*nr));
+        if (!nr) return; /* keep running it */
+        t->retired = nr;
+        t->capretired = cap;
+    }
+    t->retired[t->nretired++] = tr;
+    t->traces[cond_ip] = NULL;
+    t->trace_next[cond_ip] = t->trace_tries[cond_ip] < TIER_TRACE_TRIES ?
+        t->loop_edges[cond_ip] + t->cfg.trace_threshold : UINT64_MAX;
+}
+
+void tier_trace(tier_state *t, VM *vm, size_t cond_ip, size_t end_ip) {
+    if (!t->traces[cond_ip]) {
+        tier_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.kind = TIER_TRACE;
+        ev.fi = t->owner[cond_ip];
+        ev.start = cond_ip;
+        ev.end = end_ip;
+        ev.reason = TIER_HOT_LOOPS;
+        ev.count = t->loop_edges[cond_ip];
+        double t0 = tier_now_usec();
+        trace *tr = trace_record(vm, end_ip, &ev.why);
+        ev.usec = tier_now_usec() - t0;
+        ev.status = tr ? TIER_COMPILED : TIER_FAILED;
+        ev.bytes = trace_code_bytes(tr);
+        pthread_mutex_lock(&t->shared->lock);
+        tier_log(t->shared, &ev);
+        pthread_mutex_unlock(&t->shared->lock);
+
+        t->trace_tries[cond_ip]++;
+        if (!tr) {
+            t->trace_next[cond_ip] = t->trace_tries[cond_ip] < TIER_TRACE_TRIES ?
+                t->loop_edges[cond_ip] + t->cfg.trace_threshold : UINT64_MAX;
+            return;
+        }
+        if (t->cfg.perf) {
+            perf_region r;
+            memset(&r, 0, sizeof(r));
+            r.code = trace_code_addr(tr);
+            r.size = trace_code_bytes(tr);
+            r.kind = "trace";
+            r.fi = ev.fi;
+            r.start = cond_ip;
+            r.end = end_ip;
+            r.syms = t->cfg.symbols;
+            perf_record(t->cfg.perf, &r);
+        }
+        t->traces[cond_ip] = tr;
+    }
+    tier_run_trace(t, vm, cond_ip);
+}
+
+void tier_trace_from_jit(VM *vm) {
+    tier_state *t = interp_get_state(vm)->tier;
+    if (t && t->traces && vm->ip < t->code_len && t->traces[vm->ip]) tier_run_trace(t, vm, vm->ip);
+}
+
+void tier_run(VM *vm, const jit_code *jc) {
+    if (jit_enter(jc, vm) == JIT_HALT) vm->ip = vm->code_len;
+}
+
+void tier_run_opt(tier_state *t, VM *vm, size_t fi, opt_code *oc) {
+    if (opt_enter(oc, vm) == JIT_HALT) vm->ip = vm->code_len;
+    if (opt_unprofitable(oc)) t->opt_off[fi] = 1;
+}
+
+int tier_call_from_jit(VM *vm, word fi) {
+    int depth = vm->call_sp;
+    interp_call(vm, fi);
+    /* the callee was not compiled (or left compiled code): interpret it */
+    while (vm->call_sp > depth) {
+        if (vm->ip >= vm->code_len || !vm_step(vm, &__INTERPRETER)) {
+            vm->ip = vm->code_len;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void tier_print_stats(tier_state *t, FILE *out) {
+    struct tier_shared *sh = t->shared;
+    static const char *status_name[] = { "queued", "compiled", "failed" };
+
+    fprintf(out, "tier: call_threshold=%" PRIu64 " loop_threshold=%" PRIu64 " %s jit=%s",
+            t->cfg.call_threshold, t->cfg.loop_threshold, t->cfg.background ? "background" : "sync",
+            JIT_AVAILABLE ? "x86-64" : "none");
+    if (t->traces) fprintf(out, " trace_threshold=%" PRIu64, t->cfg.trace_threshold);
+    if (t->cfg.opt) fprintf(out, " opt_threshold=%" PRIu64, t->cfg.opt_threshold);
+    fprintf(out, "\n");
+    pthread_mutex_lock(&sh->lock);
+    for (int i = 0; i < sh->nevents; ++i) {
+        const tier_event *ev = &sh->events[i];
+        const char *what = ev->kind == TIER_TRACE ? "trace" : "loop";
+        if (ev->kind == TIER_FUNC) fprintf(out, "tier-up %d: func %ld", i, ev->fi);
+        else if (ev->kind == TIER_OPT) fprintf(out, "tier-up %d: opt func %ld", i, ev->fi);
+        else if (ev->fi >= 0) fprintf(out, "tier-up %d: %s @%zu (func %ld)", i, what, ev->start, ev->fi);
+        else fprintf(out, "tier-up %d: %s @%zu (top level)", i, what, ev->start);
+        fprintf(out, " after %" PRIu64 " %s: %s", ev->count,
+                ev->kind == TIER_OPT ? "calls and back-edges" : ev->reason == TIER_HOT_CALLS ? "calls" : "loop back-edges",
+                status_name[ev->status]);
+        if (ev->status == TIER_COMPILED) fprintf(out, " (%zu bytes, %.0f us)", ev->bytes, ev->usec);
+        if (ev->status == TIER_FAILED) fprintf(out, " (%s)", ev->why ? ev->why : "?");
+        fprintf(out, "\n");
+    }
+    pthread_mutex_unlock(&sh->lock);
+    for (size_t fi = 0; fi < TIER_MAX_FUNCS; ++fi) {
+        if (!t->calls[fi] && !t->edges[fi]) continue;
+        const char *tier = __atomic_load_n(&t->optimized[fi], __ATOMIC_ACQUIRE) && !t->opt_off[fi] ? "opt" :
+                           __atomic_load_n(&t->compiled[fi], __ATOMIC_ACQUIRE) ? "jit" : "interp";
+        fprintf(out, "func %zu: calls=%" PRIu64 " loop_edges=%" PRIu64 " tier=%s\n", fi, t->calls[fi], t->edges[fi], tier);
+    }
+    for (size_t ip = 0; ip < t->code_len; ++ip) {
+        if (!t->loop_edges[ip]) continue;
+        int fi = t->owner[ip];
+        /* compiled on its own or as part of its function */
+        int jit = __atomic_load_n(&t->loop_compiled[ip], __ATOMIC_ACQUIRE) != NULL ||
+                  (fi >= 0 && fi < TIER_MAX_FUNCS && __atomic_load_n(&t->compiled[fi], __ATOMIC_ACQUIRE) != NULL);
+        fprintf(out, "loop @%zu", ip);
+        if (fi >= 0) fprintf(out, " (func %d)", fi);
+        else fprintf(out, " (top level)");
+        const char *tier = t->traces && t->traces[ip] ? "trace" : jit ? "jit" : "interp";
+        fprintf(out, ": back-edges=%" PRIu64 " tier=%s\n", t->loop_edges[ip], tier);
+    }
+    for (size_t ip = 0; t->traces && ip < t->code_len; ++ip) {
+        if (t->traces[ip]) trace_print_stats(t->traces[ip], out);
+    }
+    for (size_t fi = 0; fi < TIER_MAX_FUNCS; ++fi) {
+        const opt_code *oc = __atomic_load_n(&t->optimized[fi], __ATOMIC_ACQUIRE);
+        if (!oc) continue;
+        if (t->opt_off[fi]) fprintf(out, "retired ");
+        opt_print_stats(oc, (long)fi, out);
+    }
+    for (int i = 0; i < t->nretired; ++i) {
+        fprintf(out, "retired ");
+        trace_print_stats(t->retired[i], out);
+    }
+    if (t->osr_entries) fprintf(out, "osr: entries=%" PRIu64 "\n", t->osr_entries);
+}
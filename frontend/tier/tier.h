@@ -0,0 +1,198 @@
+#ifndef TIER_H
+#define TIER_H
+
+/*
+ * rrvm/frontend/tier/tier.h
+ *
+ * Tiered execution manager for the interpreter backend.
+ *
+ * The interpreter counts calls per function (interp_call) and taken while
+ * back-edges per loop (interp_endblock); back-edges also count towards the
+ * function containing the loop. When a function reaches call_threshold
+ * calls or loop_threshold back-edges it is compiled by the baseline JIT
+ * (tier/jit.h), on a worker thread unless `background` is off. Calls made
+ * after the code is published run compiled (in sync mode that includes the
+ * triggering call).
+ *
+ * An invocation that is already running moves over at its next loop
+ * back-edge (on-stack replacement): the compiled code is entered at the
+ * loop condition with the interpreter's stack, tape and frame as they are.
+ * Loops outside any function, and loops in functions the JIT rejected, are
+ * compiled on their own as loop regions once that loop reaches
+ * loop_threshold back-edges, and entered the same way. Compiled code that
+ * meets something it does not handle hands the instruction back to the
+ * interpreter with the block stack rebuilt (see jit.h).
+ *
+ * Before that, a loop reaching trace_threshold back-edges is traced
+ * (tier/trace.h): one iteration is recorded as the interpreter runs it and
+ * compiled along the path it took. Later back-edges of the loop, in the
+ * interpreter or in baseline code, run the trace until one of its guards
+ * fails. A trace whose runs average less than one iteration is dropped and
+ * the loop re-recorded later, a few times at most.
+ *
+ * A function that keeps running after that, to opt_threshold calls and
+ * back-edges together, is compiled again by the optimizing JIT
+ * (tier/opt.h) from the baseline code's TAC. Calls enter the optimized code
+ * at the function start, and interpreted invocations move in at the
+ * back-edges of its top-level loops, ahead of any trace. Optimized code
+ * that deoptimizes continues in the baseline code; a function whose runs
+ * mostly deoptimize goes back to the baseline for good.
+ *
+ * Compiled code calls other functions through tier_call_from_jit, so calls
+ * from compiled code are counted and enter compiled callees too. Each
+ * request is recorded as a tier-up event and reported by inter_stats
+ * (CLI --stats) together with the counters. With `perf` set, every region
+ * compiled is also announced to Linux perf (tier/perf.h), named after its
+ * .rr function and source lines when `symbols` is given.
+ */
+
+#include "../vm/vm.h"
+#include "opt.h"
+#include "perf.h"
+
+/* function indices the manager tracks (size of VM.functions) */
+#define TIER_MAX_FUNCS 256
+
+typedef struct {
+    int enabled;             /* count hotness and tier up */
+    int background;          /* compile on a worker thread (else at the triggering call) */
+    uint64_t call_threshold; /* calls before a function is compiled */
+    uint64_t loop_threshold; /* loop back-edges before a function or loop region is compiled */
+    int trace;               /* record and compile traces of hot loops */
+    uint64_t trace_threshold; /* loop back-edges before a loop is traced */
+    int opt;                 /* recompile hot functions with the optimizing JIT */
+    uint64_t opt_threshold;  /* calls plus loop back-edges before a function is optimized */
+    int perf;                /* PERF_MAP / PERF_JITDUMP outputs for compiled code */
+    const struct ParserSymbols *symbols; /* names and lines for perf, may be NULL */
+} tier_config;
+
+/* configuration for VMs set up after it changes (CLI flags set it) */
+extern tier_config tier_defaults;
+
+/* why a function or loop was requested */
+enum { TIER_HOT_CALLS, TIER_HOT_LOOPS };
+
+struct jit_code;
+struct trace;
+struct tier_shared;
+
+typedef struct {
+    tier_config cfg;
+    const word *code;
+    size_t code_len;
+    uint64_t calls[TIER_MAX_FUNCS];   /* calls per function */
+    uint64_t edges[TIER_MAX_FUNCS];   /* loop back-edges inside each function */
+    uint8_t requested[TIER_MAX_FUNCS];
+    struct jit_code *compiled[TIER_MAX_FUNCS]; /* published with release, read with acquire */
+    uint8_t failed[TIER_MAX_FUNCS];   /* the JIT rejected the function (release/acquire too) */
+    uint8_t opt_requested[TIER_MAX_FUNCS];
+    struct opt_code *optimized[TIER_MAX_FUNCS]; /* published like compiled */
+    uint8_t opt_off[TIER_MAX_FUNCS];  /* the optimized code deoptimized too often */
+    int *owner;                       /* innermost function around each code ip, -1 at top level */
+    uint64_t *loop_edges;             /* back-edges per loop, by the ip of its condition */
+    uint8_t *loop_requested;          /* loop regions, by condition ip like loop_edges */
+    struct jit_code **loop_compiled;
+    uint64_t osr_entries;             /* running invocations moved into compiled code */
+    struct trace **traces;            /* by condition ip; NULL when tracing is off */
+    uint64_t *trace_next;             /* back-edges at which the loop is (re-)recorded */
+    uint8_t *trace_tries;             /* recordings made per loop */
+    struct trace **retired;           /* unprofitable traces, kept for the stats */
+    int nretired, capretired;
+    struct tier_shared *shared;       /* event log and worker, see tier.c */
+} tier_state;
+
+/* NULL if cfg->enabled is 0 */
+tier_state *tier_new(const VM *vm, const tier_config *cfg);
+void tier_free(tier_state *t);
+void tier_print_stats(tier_state *t, FILE *out);
+
+/* queue (or, in sync mode, perform) compilation of function fi */
+void tier_request(tier_state *t, VM *vm, size_t fi, int reason);
+
+/* the same for the loop region [cond_ip, end_ip] (end_ip is its ENDBLOCK) */
+void tier_request_loop(tier_state *t, size_t cond_ip, size_t end_ip);
+
+/* queue (or perform) optimizing compilation of fi, whose baseline code is published */
+void tier_request_opt(tier_state *t, VM *vm, size_t fi);
+
+/* record the loop at vm->ip (its condition) if it has no trace yet, then run
+ * the trace; vm->ip is wherever the trace or the recording stopped */
+void tier_trace(tier_state *t, VM *vm, size_t cond_ip, size_t end_ip);
+
+/* back-edge in baseline code: run the trace for the loop at vm->ip, if any */
+void tier_trace_from_jit(VM *vm);
+
+/* run compiled code from vm->ip; a halt stops the dispatch loop */
+void tier_run(VM *vm, const struct jit_code *jc);
+
+/* run fi's optimized code from vm->ip (an entry); a halt stops the dispatch
+ * loop, and code that mostly deoptimizes is switched off */
+void tier_run_opt(tier_state *t, VM *vm, size_t fi, struct opt_code *oc);
+
+/*
+ * OP_CALL from compiled code: enter function fi like interp_call and run it
+ * until it returns. vm->ip must be the return ip. Returns 0 if the program
+ * halted instead.
+ */
+int tier_call_from_jit(VM *vm, word fi);
+
+/* Optimized code for fi, which has baseline code, if it may run; requests
+ * it once fi is hot enough. */
+static inline struct opt_code *tier_optimized(tier_state *t, VM *vm, size_t fi) {
+    if (!t->cfg.opt || t->opt_off[fi]) return NULL;
+    if (!t->opt_requested[fi] && t->calls[fi] + t->edges[fi] >= t->cfg.opt_threshold) tier_request_opt(t, vm, fi);
+    return __atomic_load_n(&t->optimized[fi], __ATOMIC_ACQUIRE);
+}
+
+/* Count a call to fi, whose frame is pushed with vm->ip at its first
+ * instruction, and run it compiled if code for it has been published. */
+static inline void tier_enter(tier_state *t, VM *vm, size_t fi) {
+    if (fi >= TIER_MAX_FUNCS) return;
+    if (++t->calls[fi] >= t->cfg.call_threshold && !t->requested[fi]) tier_request(t, vm, fi, TIER_HOT_CALLS);
+    const struct jit_code *jc = __atomic_load_n(&t->compiled[fi], __ATOMIC_ACQUIRE);
+    if (!jc) return;
+    struct opt_code *oc = tier_optimized(t, vm, fi);
+    if (oc) tier_run_opt(t, vm, fi, oc);
+    else tier_run(vm, jc);
+}
+
+/* Count a taken back-edge of the while loop whose condition starts at cond_ip
+ * and whose ENDBLOCK is at end_ip; vm->ip is cond_ip. If a trace or compiled
+ * code covers the loop, continue there. */
+static inline void tier_loop_edge(tier_state *t, VM *vm, size_t cond_ip, size_t end_ip) {
+    if (cond_ip >= t->code_len) return;
+    uint64_t n = ++t->loop_edges[cond_ip];
+    int fi = t->owner[cond_ip];
+    const struct jit_code *jc;
+    if (fi >= 0 && fi < TIER_MAX_FUNCS && __atomic_load_n(&t->compiled[fi], __ATOMIC_ACQUIRE)) {
+        struct opt_code *oc = tier_optimized(t, vm, (size_t)fi);
+        if (oc && opt_entry_at(oc, cond_ip)) {
+            t->edges[fi]++;
+            t->osr_entries++;
+            tier_run_opt(t, vm, (size_t)fi, oc);
+            return;
+        }
+    }
+    if (t->traces && (t->traces[cond_ip] || n >= t->trace_next[cond_ip])) {
+        tier_trace(t, vm, cond_ip, end_ip);
+        /* left the loop, or stopped inside it: the interpreter continues there */
+        if (vm->ip != cond_ip) return;
+    }
+    if (fi >= 0 && fi < TIER_MAX_FUNCS) {
+        if (++t->edges[fi] >= t->cfg.loop_threshold && !t->requested[fi]) tier_request(t, vm, (size_t)fi, TIER_HOT_LOOPS);
+        if ((jc = __atomic_load_n(&t->compiled[fi], __ATOMIC_ACQUIRE)) != NULL) {
+            t->osr_entries++;
+            tier_run(vm, jc);
+            return;
+        }
+        /* the loop on its own may still compile */
+        if (!__atomic_load_n(&t->failed[fi], __ATOMIC_ACQUIRE)) return;
+    }
+    if (n >= t->cfg.loop_threshold && !t->loop_requested[cond_ip]) tier_request_loop(t, cond_ip, end_ip);
+    if ((jc = __atomic_load_n(&t->loop_compiled[cond_ip], __ATOMIC_ACQUIRE)) != NULL) {
+        t->osr_entries++;
+        tier_run(vm, jc);
+    }
+}
+
+#endif /* TIER_H */
@@ -0,0 +1,1107 @@
+/*
+ * rrvm/frontend/tier/trace.c
+ *
+ * Trace recorder, optimizer and compiler (see trace.h).
+ *
+ * A trace is a list of SSA instructions (tr_ins); a value is the index of
+ * the instruction that defines it. Tape offsets are relative to tp at the
+ * loop condition, and the VM stack below the loop's own values is never
+ * touched, so inside compiled code the VM stack only exists at side exits.
+ *
+ * Register use inside a trace:
+ *   rbx = VM*, r12 = sp at entry, r13 = tp at the start of the iteration,
+ *   rax/rcx/rdx scratch, rsi rdi rbp r8-r11 r14 r15 trace values.
+ *
+ * Layout of a compiled trace:
+ *   prologue   save callee-saved registers, load sp/tp
+ *   pre-header guards that hold for every iteration once they hold for one;
+ *              for a versioned loop, the check selecting the fast loop
+ *   loop       header guards, the body, tp += per-iteration offset, jmp loop
+ *   fast loop  (versioned loops) the body again under fewer header checks,
+ *              back to the loop once tp passes the last safe position
+ *   exits      one stub per side exit: write the live values to the VM
+ *              stack, store sp/tp and return the exit index; trace_run
+ *              sets ip and the block markers from the exit record
+ */
+
+/* system headers first: vm.h defines emit macros such as __rem */
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+#include "jit.h"
+#include "x64.h"
+#include "../interpreter/interpreter.h"
+
+#define TRACE_MAX_OPS 512  /* instructions recorded per trace */
+#define TRACE_MAX_DEPTH 64 /* trace values on the VM stack at once */
+#define TRACE_MIN_RUNS 64  /* runs before trace_unprofitable judges */
+
+/* side exit: where the interpreter resumes and what it finds there */
+typedef struct {
+    size_t ip;
+    int d;         /* tp offset */
+    int nstack;    /* trace values on the VM stack, bottom first (at vals_at) */
+    int vals_at;
+    int nblocks;   /* block markers above the loop's base (at blocks_at) */
+    int blocks_at;
+    uint64_t count;
+} tr_exit;
+
+struct trace {
+    uint8_t *mem; /* read/exec mapping */
+    size_t map_size;
+    size_t bytes;
+    size_t cond_ip;
+    tr_exit *exits; /* exit 0 is the loop header */
+    int nexits;
+    block_entry *blocks;
+    int recorded;   /* bytecode instructions in the iteration */
+    int ins;        /* trace instructions left after optimization */
+    int guards;
+    int hoisted;    /* guards run once before the loop */
+    int dropped;    /* header checks the fast loop goes without, 0 if not versioned */
+    uint64_t runs, iterations;
+};
+
+#if JIT_AVAILABLE
+
+typedef int (*trace_fn)(VM *vm);
+
+enum { R_VM = X64_RBX, R_SP = X64_R12, R_TP = X64_R13 };
+
+/* registers for trace values */
+static const int tr_pool[] = { X64_RSI, X64_RDI, X64_R8, X64_R9, X64_R10, X64_R11, X64_R14, X64_R15, X64_RBP };
+#define TR_NREGS ((int)(sizeof(tr_pool) / sizeof(tr_pool[0])))
+
+/* trace instruction kinds */
+enum { TR_CONST, TR_LOAD, TR_STORE, TR_BIN, TR_NOT, TR_GEZ, TR_ABS, TR_BITS, TR_SEL, TR_GUARD };
+
+typedef struct {
+    uint8_t kind;
+    uint8_t dead;    /* TR_STORE overwritten before anything could observe it */
+    uint8_t on_zero; /* TR_GUARD: exit when a == 0 (else when a != 0) */
+    OpCode op;       /* TR_BIN, TR_BITS: the bytecode op */
+    TypeTag type;    /* type of the value (TR_STORE: of the stored value) */
+    int a, b;        /* operands (TR_STORE: a is the value; TR_GUARD: a is tested) */
+    int c;           /* TR_SEL: the value when a is zero (b when it is not) */
+    word k;          /* TR_CONST: value; TR_LOAD/TR_STORE: tape offset */
+    int exit;        /* TR_GUARD */
+} tr_ins;
+
+/* offsets index per-offset tables as [d + TAPE_SIZE] */
+#define TR_OFFSETS (2 * TAPE_SIZE + 1)
+
+typedef struct {
+    VM *vm;
+    size_t cond;
+    int base; /* block_sp at the condition */
+
+    tr_ins *ins;
+    int nins, capins;
+    int stack[TRACE_MAX_DEPTH]; /* trace values standing in for the VM stack */
+    int sp, maxsp;
+    int d, dmin, dmax;          /* tp offset, and its range over the iteration */
+    int nguards;                /* TR_GUARDs so far */
+
+    int *cell;      /* per offset: value the cell holds in this iteration, -1 unknown */
+    int *store;     /* per offset: last TR_STORE, -1 none */
+    int *store_at;  /* per offset: nguards when that store was recorded */
+    int *guard;     /* per offset: type checked at the header, -1 none */
+    int *guarded;   /* offsets with a header type guard, in order */
+    int nguarded;
+
+    tr_exit *exits;
+    int nexits, capexits;
+    int *vals;
+    int nvals, capvals;
+    block_entry *blocks;
+    int nblocks, capblocks;
+    int oom;
+} tr_rec;
+
+/* grow *arr (elements of size sz) to hold one more than n */
+static int tr_grow(tr_rec *r, void **arr, int n, int *cap, size_t sz, int more) {
+    if (n + more <= *cap) return 1;
+    int c = *cap ? *cap : 32;
+    while (c < n + more) c *= 2;
+    void *na = realloc(*arr, (size_t)c * sz);
+    if (!na) { r->oom = 1; return 0; }
+    *arr = na;
+    *cap = c;
+    return 1;
+}
+
+static int tr_emit(tr_rec *r, tr_ins in) {
+    if (!tr_grow(r, (void**)&r->ins, r->nins, &r->capins, sizeof(tr_ins), 1)) return -1;
+    r->ins[r->nins] = in;
+    return r->nins++;
+}
+
+static int tr_const(tr_rec *r, TypeTag type, word k) {
+    tr_ins in = { .kind = TR_CONST, .type = type, .a = -1, .b = -1, .k = k };
+    return tr_emit(r, in);
+}
+
+static int tr_is_const(const tr_rec *r, int v) { return r->ins[v].kind == TR_CONST; }
+
+/* a side exit resuming at ip with the current stack, tp offset and markers */
+static int tr_exit_new(tr_rec *r, size_t ip) {
+    VM *vm = r->vm;
+    int nb = vm->block_sp - r->base;
+    if (nb < 0) nb = 0;
+    if (!tr_grow(r, (void**)&r->exits, r->nexits, &r->capexits, sizeof(tr_exit), 1) ||
+        !tr_grow(r, (void**)&r->vals, r->nvals, &r->capvals, sizeof(int), r->sp) ||
+        !tr_grow(r, (void**)&r->blocks, r->nblocks, &r->capblocks, sizeof(block_entry), nb)) return -1;
+    tr_exit *x = &r->exits[r->nexits];
+    x->ip = ip;
+    x->d = r->d;
+    x->nstack = r->sp;
+    x->vals_at = r->nvals;
+    x->nblocks = nb;
+    x->blocks_at = r->nblocks;
+    x->count = 0;
+    memcpy(&r->vals[r->nvals], r->stack, (size_t)r->sp * sizeof(int));
+    r->nvals += r->sp;
+    if (nb) memcpy(&r->blocks[r->nblocks], &vm->block_stack[r->base], (size_t)nb * sizeof(block_entry));
+    r->nblocks += nb;
+    return r->nexits++;
+}
+
+/* leave through a new side exit at ip unless v is non-zero (on_zero) / zero */
+static void tr_guard(tr_rec *r, int v, int on_zero, size_t ip) {
+    int e = tr_exit_new(r, ip);
+    if (e < 0) return;
+    tr_ins in = { .kind = TR_GUARD, .on_zero = (uint8_t)on_zero, .a = v, .b = -1, .exit = e };
+    if (tr_emit(r, in) >= 0) r->nguards++;
+}
+
+static void tr_push(tr_rec *r, int v) {
+    r->stack[r->sp++] = v;
+    if (r->sp > r->maxsp) r->maxsp = r->sp;
+}
+
+static void tr_offset_seen(tr_rec *r) {
+    if (r->d < r->dmin) r->dmin = r->d;
+    if (r->d > r->dmax) r->dmax = r->d;
+}
+
+static void tr_store(tr_rec *r, int v) {
+    int d = r->d + TAPE_SIZE;
+    tr_ins in = { .kind = TR_STORE, .type = r->ins[v].type, .a = v, .b = -1, .k = r->d };
+    int s = tr_emit(r, in);
+    if (s < 0) return;
+    /* no guard since the previous store to this cell: nothing can observe it */
+    if (r->store[d] >= 0 && r->store_at[d] == r->nguards) r->ins[r->store[d]].dead = 1;
+    r->store[d] = s;
+    r->store_at[d] = r->nguards;
+    r->cell[d] = v;
+    tr_offset_seen(r);
+}
+
+static int tr_fits(word v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+/* fold op over constants the way the interpreter computes it; 0 if it cannot */
+static int tr_fold(OpCode op, word a, word b, word *out) {
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    switch (op) {
+        case OP_ADD: *out = (word)(ua + ub); return 1;
+        case OP_SUB: *out = (word)(ua - ub); return 1;
+        case OP_MUL: *out = (word)(ua * ub); return 1;
+        case OP_DIV: if (b == 0 || b == -1) return 0; *out = a / b; return 1;
+        case OP_REM: if (b == 0 || b == -1) return 0; *out = a % b; return 1;
+        case OP_BITAND: *out = a & b; return 1;
+        case OP_BITOR: *out = a | b; return 1;
+        case OP_BITXOR: *out = a ^ b; return 1;
+        /* x86 masks variable shift counts, and so does the interpreter's code */
+        case OP_LSH: *out = (word)(ua << (b & 63)); return 1;
+        case OP_LRSH: *out = (word)(ua >> (b & 63)); return 1;
+        case OP_ARSH: *out = a >> (b & 63); return 1;
+        case OP_ORASSign: *out = (a || b) ? 1 : 0; return 1;
+        case OP_ANDASSign: *out = (a && b) ? 1 : 0; return 1;
+        default: return 0;
+    }
+}
+
+/* a op b where the result is one operand: x+0, x*1, 0|x, ... (-1 if none) */
+static int tr_identity(const tr_rec *r, OpCode op, int a, int b) {
+    int ca = tr_is_const(r, a), cb = tr_is_const(r, b);
+    word ka = ca ? r->ins[a].k : 0, kb = cb ? r->ins[b].k : 0;
+    switch (op) {
+        case OP_ADD:
+        case OP_BITOR:
+        case OP_BITXOR:
+            if (cb && kb == 0) return a;
+            if (ca && ka == 0) return b;
+            return -1;
+        case OP_SUB:
+        case OP_LSH:
+        case OP_LRSH:
+        case OP_ARSH:
+            return cb && kb == 0 ? a : -1;
+        case OP_MUL:
+            if (cb && kb == 1) return a;
+            if (ca && ka == 1) return b;
+            return -1;
+        case OP_DIV:
+            return cb && kb == 1 ? a : -1;
+        default:
+            return -1;
+    }
+}
+
+static int tr_bin(tr_rec *r, OpCode op, int a, int b, TypeTag type) {
+    word k;
+    if (op == OP_MIN || op == OP_MAX) {
+        if (tr_is_const(r, a) && tr_is_const(r, b))
+            return tr_const(r, type, minmax_impl(r->ins[a].k, r->ins[b].k, type, op == OP_MAX));
+        if (a == b) return a;
+    }
+    if (op == OP_ROTL || op == OP_ROTR || op == OP_MULHI) {
+        if (tr_is_const(r, a) && tr_is_const(r, b)) {
+            word ka = r->ins[a].k, kb = r->ins[b].k;
+            return tr_const(r, type, op == OP_MULHI ? mulhi_impl(ka, kb, type) : rot_impl(ka, kb, type, op == OP_ROTR));
+        }
+        if (op != OP_MULHI && tr_is_const(r, b) && (r->ins[b].k & 63) == 0) return a;
+    }
+    if (tr_is_const(r, a) && tr_is_const(r, b) && tr_fold(op, r->ins[a].k, r->ins[b].k, &k)) return tr_const(r, type, k);
+    int same = tr_identity(r, op, a, b);
+    if (same >= 0) return same;
+    if ((op == OP_MUL || op == OP_BITAND) &&
+        ((tr_is_const(r, a) && r->ins[a].k == 0) || (tr_is_const(r, b) && r->ins[b].k == 0))) return tr_const(r, type, 0);
+    tr_ins in = { .kind = TR_BIN, .op = op, .type = type, .a = a, .b = b };
+    return tr_emit(r, in);
+}
+
+static int tr_unary(tr_rec *r, int kind, int a) {
+    if (tr_is_const(r, a)) {
+        word k = r->ins[a].k;
+        TypeTag t = r->ins[a].type;
+        return tr_const(r, t, kind == TR_NOT ? (k ? 0 : 1) : kind == TR_ABS ? abs_impl(k, t) : (k >= 0 ? 1 : 0));
+    }
+    /* like the interpreter, the result keeps the operand's type */
+    tr_ins in = { .kind = (uint8_t)kind, .type = r->ins[a].type, .a = a, .b = -1 };
+    return tr_emit(r, in);
+}
+
+/* popcnt, clz, ctz or bswap of a (a 64-bit type) */
+static int tr_bits(tr_rec *r, OpCode op, int a) {
+    TypeTag t = r->ins[a].type;
+    if (tr_is_const(r, a)) {
+        word k = r->ins[a].k;
+        return tr_const(r, t, op == OP_POPCNT ? popcnt_impl(k, t) : op == OP_CLZ ? clz_impl(k, t) :
+                              op == OP_CTZ ? ctz_impl(k, t) : bswap_impl(k, t));
+    }
+    tr_ins in = { .kind = TR_BITS, .op = op, .type = t, .a = a, .b = -1 };
+    return tr_emit(r, in);
+}
+
+/* c ? a : b; a constant condition picks its value now */
+static int tr_select(tr_rec *r, int c, int a, int b) {
+    if (tr_is_const(r, c)) return r->ins[c].k ? a : b;
+    if (a == b) return a;
+    tr_ins in = { .kind = TR_SEL, .type = r->ins[a].type, .a = c, .b = a, .c = b };
+    return tr_emit(r, in);
+}
+
+/* Record the instruction at ip (not yet executed); returns why not, or NULL. */
+static const char *tr_record_op(tr_rec *r, size_t ip, OpCode op) {
+    VM *vm = r->vm;
+    word imm1 = ip + 1 < vm->code_len ? vm->code[ip + 1] : 0;
+    word imm2 = ip + 2 < vm->code_len ? vm->code[ip + 2] : 0;
+    int v, a, b;
+
+    switch (op) {
+        case OP_NOP:
+        case OP_ELSE:
+        case OP_ENDBLOCK:
+            /* the interpreter takes the arm the recorded guards pin down */
+            return NULL;
+
+        case OP_PUSH:
+            if (r->sp == TRACE_MAX_DEPTH) return "stack too deep";
+            if ((v = tr_const(r, (TypeTag)imm1, imm2)) < 0) return "out of memory";
+            tr_push(r, v);
+            return NULL;
+
+        case OP_SET:
+            if ((v = tr_const(r, (TypeTag)imm1, imm2)) < 0) return "out of memory";
+            tr_store(r, v);
+            return NULL;
+
+        case OP_LOAD: {
+            int d = r->d + TAPE_SIZE;
+            if (r->sp == TRACE_MAX_DEPTH) return "stack too deep";
+            if (r->cell[d] < 0) {
+                /* first read of the cell in this iteration: its type is checked at the header */
+                TypeTag t = vm->tape_types[vm->tp];
+                r->guard[d] = (int)t;
+                r->guarded[r->nguarded++] = r->d;
+                tr_ins in = { .kind = TR_LOAD, .type = t, .a = -1, .b = -1, .k = r->d };
+                if ((r->cell[d] = tr_emit(r, in)) < 0) return "out of memory";
+                tr_offset_seen(r);
+            }
+            tr_push(r, r->cell[d]);
+            return NULL;
+        }
+
+        case OP_STORE:
+            if (r->sp < 1) return "reads the stack below the loop";
+            tr_store(r, r->stack[--r->sp]);
+            return NULL;
+
+        case OP_MOVE:
+        case OP_OFFSET:
+            if (imm1 < -TAPE_SIZE || imm1 > TAPE_SIZE || r->d + imm1 < -TAPE_SIZE || r->d + imm1 > TAPE_SIZE) {
+                return "tape offset out of range";
+            }
+            r->d += (int)imm1;
+            tr_offset_seen(r);
+            return NULL;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_REM:
+        case OP_BITAND:
+        case OP_BITOR:
+        case OP_BITXOR:
+        case OP_LSH:
+        case OP_LRSH:
+        case OP_ARSH:
+        case OP_ORASSign:
+        case OP_ANDASSign:
+        case OP_MIN:
+        case OP_MAX:
+        case OP_ROTL:
+        case OP_ROTR:
+        case OP_MULHI: {
+            if (r->sp < 2) return "reads the stack below the loop";
+            TypeTag t = vm->types[vm->sp - 1];
+            if (t != vm->types[vm->sp - 2]) return "type mismatch";
+            if (t == TYPE_F32 || t == TYPE_F64) return "float arithmetic";
+            if (t == TYPE_V128) return "vector value";
+            /* narrower types rotate and multiply within their width */
+            if ((op == OP_ROTL || op == OP_ROTR || op == OP_MULHI) && type_bits(t) != 64) return "narrow bit operation";
+            b = r->stack[r->sp - 1];
+            a = r->stack[r->sp - 2];
+            if (r->ins[a].type != t || r->ins[b].type != t) return "type mismatch";
+            if (op == OP_DIV || op == OP_REM) {
+                if (tr_is_const(r, b) && r->ins[b].k == 0) return "division by zero";
+                /* the divisor is checked where the interpreter would assert */
+                if (!tr_is_const(r, b)) tr_guard(r, b, 1, ip);
+            }
+            r->sp -= 2;
+            if ((v = tr_bin(r, op, a, b, t)) < 0) return "out of memory";
+            tr_push(r, v);
+            return NULL;
+        }
+
+        case OP_NOT:
+        case OP_GEZ:
+            if (r->sp < 1) return "reads the stack below the loop";
+            if ((v = tr_unary(r, op == OP_NOT ? TR_NOT : TR_GEZ, r->stack[r->sp - 1])) < 0) return "out of memory";
+            r->stack[r->sp - 1] = v;
+            return NULL;
+
+        case OP_ABS: {
+            if (r->sp < 1) return "reads the stack below the loop";
+            TypeTag t = vm->types[vm->sp - 1];
+            if (t == TYPE_F32 || t == TYPE_F64) return "float arithmetic";
+            if (t == TYPE_V128) return "vector value";
+            if ((v = tr_unary(r, TR_ABS, r->stack[r->sp - 1])) < 0) return "out of memory";
+            r->stack[r->sp - 1] = v;
+            return NULL;
+        }
+
+        case OP_POPCNT:
+        case OP_CLZ:
+        case OP_CTZ:
+        case OP_BSWAP:
+            if (r->sp < 1) return "reads the stack below the loop";
+            if (vm->types[vm->sp - 1] == TYPE_V128) return "vector value";
+            if (type_bits(vm->types[vm->sp - 1]) != 64) return "narrow bit operation";
+            if (op == OP_POPCNT && !__builtin_cpu_supports("popcnt")) return "no popcnt instruction";
+            if ((v = tr_bits(r, op, r->stack[r->sp - 1])) < 0) return "out of memory";
+            r->stack[r->sp - 1] = v;
+            return NULL;
+
+        case OP_SELECT:
+            if (r->sp < 3) return "reads the stack below the loop";
+            /* the result takes the chosen value's type: only one type is known here */
+            if (vm->types[vm->sp - 1] != vm->types[vm->sp - 2]) return "type mismatch";
+            if (vm->types[vm->sp - 1] == TYPE_V128) return "vector value";
+            b = r->stack[r->sp - 1];
+            a = r->stack[r->sp - 2];
+            if (r->ins[a].type != r->ins[b].type) return "type mismatch";
+            r->sp -= 3;
+            if ((v = tr_select(r, r->stack[r->sp], a, b)) < 0) return "out of memory";
+            tr_push(r, v);
+            return NULL;
+
+        case OP_IF:
+        case OP_WHILE: {
+            if (r->sp < 1) return "reads the stack below the loop";
+            v = r->stack[r->sp - 1];
+            int taken = vm->stack[vm->sp - 1] != 0;
+            if (op == OP_WHILE) {
+                int own = imm1 == (word)r->cond && vm->block_sp == r->base;
+                if (own && !taken) return "loop exited";
+                if (!own && taken) return "inner loop";
+            }
+            /* a constant condition always goes the recorded way */
+            if (!tr_is_const(r, v)) tr_guard(r, v, taken, ip);
+            r->sp--;
+            return NULL;
+        }
+
+        case OP_CALL:
+            return "call";
+        case OP_RETURN:
+            return "return";
+        case OP_HALT:
+            return "halt";
+        case OP_WHERE:
+        case OP_INDEX:
+        case OP_DEREF:
+        case OP_REFER:
+            return "computed tape position";
+        default:
+            return "unsupported instruction";
+    }
+}
+
+/* --- code generation --- */
+
+typedef struct {
+    x64_buf x;
+    tr_rec *r;
+    trace *tr;
+    int *live;
+    int *last;  /* last instruction using each value */
+    int *loc;   /* register of each value, -1 for constants */
+    int *exit_loc; /* register of each exit value at its guard (parallel to r->vals) */
+    int freeregs[TR_NREGS];
+    int nfree;
+    struct { size_t at; int exit; } *fix;
+    int nfix, capfix;
+} tr_gen;
+
+static x64_mem tr_cell(int d) { return x64_idx(R_VM, R_TP, 8, (int32_t)(offsetof(VM, tape) + (ptrdiff_t)d * 8)); }
+static x64_mem tr_cell_type(int d) { return x64_idx(R_VM, R_TP, 4, (int32_t)(offsetof(VM, tape_types) + (ptrdiff_t)d * 4)); }
+static x64_mem tr_stack_slot(int k) { return x64_idx(R_VM, R_SP, 8, (int32_t)(offsetof(VM, stack) + (ptrdiff_t)k * 8)); }
+static x64_mem tr_type_slot(int k) { return x64_idx(R_VM, R_SP, 4, (int32_t)(offsetof(VM, types) + (ptrdiff_t)k * 4)); }
+
+/* jump to side exit e when cc holds */
+static void tr_jump_exit(tr_gen *g, int cc, int e) {
+    size_t at = x64_jcc(&g->x, cc);
+    if (!tr_grow(g->r, (void**)&g->fix, g->nfix, &g->capfix, sizeof(*g->fix), 1)) return;
+    g->fix[g->nfix].at = at;
+    g->fix[g->nfix].exit = e;
+    g->nfix++;
+}
+
+/* register holding v; constants are materialized in `scratch` */
+static int tr_reg(tr_gen *g, int v, int scratch) {
+    if (g->r->ins[v].kind == TR_CONST) {
+        x64_mov_imm(&g->x, scratch, g->r->ins[v].k);
+        return scratch;
+    }
+    return g->loc[v];
+}
+
+/* store v as a qword at m */
+static void tr_store_value(tr_gen *g, x64_mem m, int v) {
+    const tr_ins *in = &g->r->ins[v];
+    if (in->kind == TR_CONST && tr_fits(in->k)) x64_store_imm(&g->x, 1, m, (int32_t)in->k);
+    else x64_store(&g->x, 1, m, tr_reg(g, v, X64_RAX));
+}
+
+static void tr_gen_bin(tr_gen *g, const tr_ins *in, int rd) {
+    x64_buf *x = &g->x;
+    const tr_rec *r = g->r;
+    int cb = tr_is_const(r, in->b);
+    word kb = cb ? r->ins[in->b].k : 0;
+
+    if (in->op == OP_DIV || in->op == OP_REM) {
+        int ra = tr_reg(g, in->a, X64_RAX);
+        if (ra != X64_RAX) x64_mov_rr(x, X64_RAX, ra);
+        int rb = tr_reg(g, in->b, X64_RCX);
+        x64_cqo(x);
+        x64_unary(x, X64_IDIV, rb);
+        x64_mov_rr(x, rd, in->op == OP_DIV ? X64_RAX : X64_RDX);
+        return;
+    }
+    if (in->op == OP_MULHI) {
+        /* rdx:rax = rax * b */
+        int ra = tr_reg(g, in->a, X64_RAX);
+        if (ra != X64_RAX) x64_mov_rr(x, X64_RAX, ra);
+        x64_unary(x, type_is_unsigned(in->type) ? X64_MUL : X64_IMUL, tr_reg(g, in->b, X64_RCX));
+        x64_mov_rr(x, rd, X64_RDX);
+        return;
+    }
+    if (in->op == OP_ANDASSign) {
+        int ra = tr_reg(g, in->a, X64_RDX);
+        int rb = tr_reg(g, in->b, X64_RCX);
+        x64_alu_rr(x, X64_XOR, 0, X64_RAX, X64_RAX);
+        x64_test_rr(x, 1, ra, ra);
+        x64_setcc(x, X64_CC_NE, X64_RAX);
+        x64_mov_rr(x, rd, X64_RAX);
+        x64_alu_rr(x, X64_XOR, 0, X64_RAX, X64_RAX);
+        x64_test_rr(x, 1, rb, rb);
+        x64_setcc(x, X64_CC_NE, X64_RAX);
+        x64_alu_rr(x, X64_AND, 1, rd, X64_RAX);
+        return;
+    }
+
+    if (tr_is_const(r, in->a)) x64_mov_imm(x, rd, r->ins[in->a].k);
+    else x64_mov_rr(x, rd, g->loc[in->a]);
+    switch (in->op) {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_BITAND:
+        case OP_BITOR:
+        case OP_BITXOR:
+        case OP_ORASSign: {
+            int opc = in->op == OP_ADD ? X64_ADD : in->op == OP_SUB ? X64_SUB : in->op == OP_BITAND ? X64_AND :
+                      in->op == OP_BITXOR ? X64_XOR : X64_OR;
+            if (cb && tr_fits(kb)) x64_alu_imm(x, opc, 1, rd, (int32_t)kb);
+            else x64_alu_rr(x, opc, 1, rd, tr_reg(g, in->b, X64_RCX));
+            if (in->op == OP_ORASSign) {
+                x64_mov_imm(x, X64_RAX, 0); /* mov keeps the flags */
+                x64_setcc(x, X64_CC_NE, X64_RAX);
+                x64_mov_rr(x, rd, X64_RAX);
+            }
+            break;
+        }
+        case OP_MUL:
+            if (cb && tr_fits(kb)) x64_imul_imm(x, rd, rd, (int32_t)kb);
+            else x64_imul_rr(x, rd, tr_reg(g, in->b, X64_RCX));
+            break;
+        case OP_MIN:
+        case OP_MAX: {
+            /* keep a unless b is the smaller (larger) one */
+            int u = type_is_unsigned(in->type);
+            int rb = tr_reg(g, in->b, X64_RCX);
+            x64_alu_rr(x, X64_CMP, 1, rd, rb);
+            if (in->op == OP_MIN) x64_cmov(x, u ? X64_CC_A : X64_CC_G, rd, rb);
+            else x64_cmov(x, u ? X64_CC_B : X64_CC_L, rd, rb);
+            break;
+        }
+        case OP_LSH:
+        case OP_LRSH:
+        case OP_ARSH:
+        case OP_ROTL:
+        case OP_ROTR: {
+            int sh = in->op == OP_LSH ? X64_SHL : in->op == OP_LRSH ? X64_SHR : in->op == OP_ARSH ? X64_SAR :
+                     in->op == OP_ROTL ? X64_ROL : X64_ROR;
+            if (cb) {
+                x64_shift_imm(x, sh, rd, (uint8_t)(kb & 63));
+            } else {
+                x64_mov_rr(x, X64_RCX, g->loc[in->b]);
+                x64_shift_cl(x, sh, rd);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/*
+ * The type guard at offset d holds at every header after a complete
+ * iteration: tp moves by r->d, so the cell is the one the previous
+ * iteration last stored to at d + r->d, with the guarded type.
+ */
+static int tr_carried(const tr_rec *r, int d) {
+    int at = d + r->d;
+    if (r->d == 0 || at < -TAPE_SIZE || at > TAPE_SIZE) return 0;
+    int s = r->store[at + TAPE_SIZE];
+    return s >= 0 && (int)r->ins[s].type == r->guard[d + TAPE_SIZE];
+}
+
+/*
+ * Header checks; `once` selects the ones that hold for every iteration
+ * after the first. The fast loop of a versioned trace skips the bounds,
+ * which its back-edge keeps, and the guards the previous iteration
+ * satisfies (tr_carried).
+ */
+static void tr_gen_header(tr_gen *g, int once, int fast) {
+    x64_buf *x = &g->x;
+    tr_rec *r = g->r;
+    int invariant = r->d == 0; /* tp is the same at every header */
+
+    if (once == invariant && !fast) {
+        if (r->dmin < 0) {
+            x64_lea(x, X64_RAX, x64_at(R_TP, r->dmin));
+            x64_test_rr(x, 1, X64_RAX, X64_RAX);
+            tr_jump_exit(g, X64_CC_S, 0);
+        }
+        if (r->dmax > 0) {
+            x64_lea(x, X64_RAX, x64_at(R_TP, r->dmax));
+            x64_alu_imm(x, X64_CMP, 1, X64_RAX, TAPE_SIZE);
+            tr_jump_exit(g, X64_CC_GE, 0);
+        }
+    }
+    if (once && r->maxsp > 0) {
+        /* the exits write at most maxsp values above sp */
+        x64_alu_imm(x, X64_CMP, 1, R_SP, STACK_SIZE - r->maxsp);
+        tr_jump_exit(g, X64_CC_G, 0);
+    }
+    for (int i = 0; i < r->nguarded; ++i) {
+        int d = r->guarded[i];
+        int s = r->store[d + TAPE_SIZE];
+        /* the iteration leaves the cell with the guarded type (or untouched) */
+        int keeps = s < 0 || (int)r->ins[s].type == r->guard[d + TAPE_SIZE];
+        if ((invariant && keeps) != once || (fast && tr_carried(r, d))) continue;
+        x64_alu_mem_imm(x, X64_CMP, 0, tr_cell_type(d), r->guard[d + TAPE_SIZE]);
+        tr_jump_exit(g, X64_CC_NE, 0);
+        if (once) g->tr->hoisted++;
+    }
+}
+
+static const char *tr_gen_body(tr_gen *g) {
+    x64_buf *x = &g->x;
+    tr_rec *r = g->r;
+    /* the type each cell is known to have, to skip rewriting it */
+    int *known = (int*)malloc(TR_OFFSETS * sizeof(int));
+    if (!known) return "out of memory";
+    memcpy(known, r->guard, TR_OFFSETS * sizeof(int));
+    /* the same allocation for every copy: the exits' registers are shared */
+    g->nfree = 0;
+    for (int k = TR_NREGS - 1; k >= 0; --k) g->freeregs[g->nfree++] = tr_pool[k];
+    for (int i = 0; i < r->nins; ++i) g->loc[i] = -1;
+
+    for (int i = 0; i < r->nins; ++i) {
+        const tr_ins *in = &r->ins[i];
+        if (!g->live[i] || in->kind == TR_CONST) continue;
+        int rd = -1;
+        if (in->kind != TR_STORE && in->kind != TR_GUARD) {
+            /* allocate before freeing the operands so rd never aliases one */
+            if (g->nfree == 0) { free(known); return "too many live values"; }
+            rd = g->loc[i] = g->freeregs[--g->nfree];
+        }
+        switch (in->kind) {
+            case TR_LOAD:
+                x64_load(x, 1, rd, tr_cell((int)in->k));
+                break;
+            case TR_STORE: {
+                int d = (int)in->k + TAPE_SIZE;
+                tr_store_value(g, tr_cell((int)in->k), in->a);
+                if (known[d] != (int)in->type) x64_store_imm(x, 0, tr_cell_type((int)in->k), (int32_t)in->type);
+                known[d] = (int)in->type;
+                break;
+            }
+            case TR_BIN:
+                tr_gen_bin(g, in, rd);
+                break;
+            case TR_NOT: {
+                int ra = tr_reg(g, in->a, X64_RCX);
+                x64_alu_rr(x, X64_XOR, 0, X64_RAX, X64_RAX);
+                x64_test_rr(x, 1, ra, ra);
+                x64_setcc(x, X64_CC_E, X64_RAX);
+                x64_mov_rr(x, rd, X64_RAX);
+                break;
+            }
+            case TR_GEZ:
+                x64_mov_rr(x, rd, tr_reg(g, in->a, X64_RCX));
+                x64_unary(x, X64_NOT, rd);
+                x64_shift_imm(x, X64_SHR, rd, 63);
+                break;
+            case TR_ABS:
+                x64_mov_rr(x, rd, tr_reg(g, in->a, X64_RCX));
+                if (type_is_unsigned(in->type) || in->type == TYPE_BOOL || in->type == TYPE_PTR) break;
+                x64_mov_rr(x, X64_RAX, rd);
+                x64_unary(x, X64_NEG, X64_RAX);
+                x64_cmov(x, X64_CC_NS, rd, X64_RAX);
+                break;
+            case TR_BITS: {
+                int ra = tr_reg(g, in->a, X64_RCX);
+                if (in->op == OP_POPCNT) {
+                    x64_popcnt(x, rd, ra);
+                } else if (in->op == OP_BSWAP) {
+                    x64_mov_rr(x, rd, ra);
+                    x64_bswap(x, rd);
+                } else {
+                    /* bsr/bsf leave ZF set for 0, which counts as all 64 bits
+                       (127 ^ 63 = 64 for clz) */
+                    if (in->op == OP_CLZ) x64_bsr(x, X64_RAX, ra);
+                    else x64_bsf(x, X64_RAX, ra);
+                    x64_mov_imm(x, rd, in->op == OP_CLZ ? 127 : 64); /* mov keeps the flags */
+                    x64_cmov(x, X64_CC_NE, rd, X64_RAX);
+                    if (in->op == OP_CLZ) x64_alu_imm(x, X64_XOR, 1, rd, 63);
+                }
+                break;
+            }
+            case TR_SEL: {
+                const tr_ins *c = &r->ins[in->c];
+                if (c->kind == TR_CONST) x64_mov_imm(x, rd, c->k);
+                else x64_mov_rr(x, rd, g->loc[in->c]);
+                int rb = tr_reg(g, in->b, X64_RCX);
+                int ra = tr_reg(g, in->a, X64_RAX);
+                x64_test_rr(x, 1, ra, ra);
+                x64_cmov(x, X64_CC_NE, rd, rb);
+                break;
+            }
+            case TR_GUARD: {
+                /* the stub is emitted later, when these registers may hold other values */
+                const tr_exit *e = &r->exits[in->exit];
+                for (int k = 0; k < e->nstack; ++k) g->exit_loc[e->vals_at + k] = g->loc[r->vals[e->vals_at + k]];
+                int ra = tr_reg(g, in->a, X64_RAX);
+                x64_test_rr(x, 1, ra, ra);
+                tr_jump_exit(g, in->on_zero ? X64_CC_E : X64_CC_NE, in->exit);
+                g->tr->guards++;
+                break;
+            }
+            default:
+                break;
+        }
+        g->tr->ins++;
+        /* release values whose last use was this instruction */
+        int ops[3] = { in->a, in->kind == TR_BIN || in->kind == TR_SEL ? in->b : -1, in->kind == TR_SEL ? in->c : -1 };
+        for (int k = 0; k < 3; ++k) {
+            int v = ops[k];
+            if (v >= 0 && g->last[v] == i && g->loc[v] >= 0) { g->freeregs[g->nfree++] = g->loc[v]; g->loc[v] = -1; }
+        }
+        if (in->kind == TR_GUARD) {
+            const tr_exit *e = &r->exits[in->exit];
+            for (int k = 0; k < e->nstack; ++k) {
+                int v = r->vals[e->vals_at + k];
+                if (g->last[v] == i && g->loc[v] >= 0) { g->freeregs[g->nfree++] = g->loc[v]; g->loc[v] = -1; }
+            }
+        }
+        if (rd >= 0 && g->last[i] < 0) { g->freeregs[g->nfree++] = rd; g->loc[i] = -1; }
+    }
+    free(known);
+    return NULL;
+}
+
+static void tr_gen_exit(tr_gen *g, int e, size_t epilogue_at) {
+    x64_buf *x = &g->x;
+    const tr_exit *ex = &g->r->exits[e];
+    for (int k = 0; k < ex->nstack; ++k) {
+        int v = g->r->vals[ex->vals_at + k];
+        int reg = g->exit_loc[ex->vals_at + k];
+        if (reg >= 0) x64_store(x, 1, tr_stack_slot(k), reg);
+        else tr_store_value(g, tr_stack_slot(k), v);
+        x64_store_imm(x, 0, tr_type_slot(k), (int32_t)g->r->ins[v].type);
+    }
+    x64_lea(x, X64_RAX, x64_at(R_SP, ex->nstack));
+    x64_store(x, 0, x64_at(R_VM, (int32_t)offsetof(VM, sp)), X64_RAX);
+    x64_lea(x, X64_RAX, x64_at(R_TP, ex->d));
+    x64_store(x, 0, x64_at(R_VM, (int32_t)offsetof(VM, tp)), X64_RAX);
+    x64_mov_imm(x, X64_RAX, e);
+    x64_link(x, x64_jmp(x), epilogue_at);
+}
+
+static const char *tr_compile(tr_rec *r, trace *tr) {
+    tr_gen g;
+    memset(&g, 0, sizeof(g));
+    g.r = r;
+    g.tr = tr;
+    g.live = (int*)calloc((size_t)r->nins, sizeof(int));
+    g.last = (int*)malloc((size_t)r->nins * sizeof(int));
+    g.loc = (int*)malloc((size_t)r->nins * sizeof(int));
+    g.exit_loc = (int*)malloc(((size_t)r->nvals + 1) * sizeof(int));
+    const char *why = NULL;
+    if (!g.live || !g.last || !g.loc || !g.exit_loc) { why = "out of memory"; goto out; }
+
+    /* dead code: keep stores, guards and what they (and their exits) use */
+    for (int i = r->nins - 1; i >= 0; --i) {
+        tr_ins *in = &r->ins[i];
+        if ((in->kind == TR_STORE && !in->dead) || in->kind == TR_GUARD) g.live[i] = 1;
+        if (!g.live[i]) continue;
+        if (in->a >= 0) g.live[in->a] = 1;
+        if (in->kind == TR_BIN || in->kind == TR_SEL) g.live[in->b] = 1;
+        if (in->kind == TR_SEL) g.live[in->c] = 1;
+        if (in->kind == TR_GUARD) {
+            const tr_exit *e = &r->exits[in->exit];
+            for (int k = 0; k < e->nstack; ++k) g.live[r->vals[e->vals_at + k]] = 1;
+        }
+    }
+    for (int i = 0; i < r->nins; ++i) g.last[i] = -1;
+    for (int i = 0; i < r->nins; ++i) {
+        tr_ins *in = &r->ins[i];
+        if (!g.live[i]) continue;
+        if (in->a >= 0) g.last[in->a] = i;
+        if (in->kind == TR_BIN || in->kind == TR_SEL) g.last[in->b] = i;
+        if (in->kind == TR_SEL) g.last[in->c] = i;
+        if (in->kind == TR_GUARD) {
+            const tr_exit *e = &r->exits[in->exit];
+            for (int k = 0; k < e->nstack; ++k) g.last[r->vals[e->vals_at + k]] = i;
+        }
+    }
+
+    x64_buf *x = &g.x;
+    x64_push(x, X64_RBX);
+    x64_push(x, X64_RBP);
+    x64_push(x, X64_R12);
+    x64_push(x, X64_R13);
+    x64_push(x, X64_R14);
+    x64_push(x, X64_R15);
+    x64_mov_rr(x, R_VM, X64_RDI);
+    x64_movsxd(x, R_SP, x64_at(R_VM, (int32_t)offsetof(VM, sp)));
+    x64_movsxd(x, R_TP, x64_at(R_VM, (int32_t)offsetof(VM, tp)));
+    tr_gen_header(&g, 1, 0);
+
+    /*
+     * Loop versioning: when tp moves, every header checks that the
+     * iteration's offsets stay on the tape. Once they do for tp, they do
+     * for every tp up to `last` in the direction of travel, so the fast
+     * loop runs the body with no bounds checks and only compares tp with
+     * `last` at its back-edge, which bounds its trip count. The pre-header
+     * checks the range and the carried guards once to enter it; when either
+     * fails, or tp passes `last`, the loop (the safe version) takes over
+     * and leaves through its own checks.
+     */
+    int versioned = r->d != 0;
+    int32_t last = r->d > 0 ? TAPE_SIZE - 1 - r->dmax : -r->dmin;
+    size_t select = versioned ? x64_jmp(x) : 0;
+    size_t loop = x->len, fast = 0, to_fast[2];
+    for (int k = 0; k <= versioned; ++k) {
+        if (k) fast = x->len;
+        tr_gen_header(&g, 0, k);
+        int ins = tr->ins, guards = tr->guards;
+        if ((why = tr_gen_body(&g)) != NULL) goto out;
+        if (k) { tr->ins = ins; tr->guards = guards; }
+        x64_mov_imm(x, X64_RAX, (int64_t)(uintptr_t)&tr->iterations);
+        x64_inc_mem(x, x64_at(X64_RAX, 0));
+        if (r->d) x64_alu_imm(x, X64_ADD, 1, R_TP, r->d);
+        if (versioned) {
+            x64_alu_imm(x, X64_CMP, 1, R_TP, last);
+            to_fast[k] = x64_jcc(x, r->d > 0 ? X64_CC_LE : X64_CC_GE);
+        }
+        x64_link(x, x64_jmp(x), loop);
+    }
+    if (versioned) {
+        x64_link(x, to_fast[0], fast);
+        x64_link(x, to_fast[1], fast);
+        x64_link(x, select, x->len);
+        x64_lea(x, X64_RAX, x64_at(R_TP, r->dmin));
+        x64_test_rr(x, 1, X64_RAX, X64_RAX);
+        x64_link(x, x64_jcc(x, X64_CC_S), loop);
+        x64_lea(x, X64_RAX, x64_at(R_TP, r->dmax));
+        x64_alu_imm(x, X64_CMP, 1, X64_RAX, TAPE_SIZE);
+        x64_link(x, x64_jcc(x, X64_CC_GE), loop);
+        tr->dropped = (r->dmin < 0) + (r->dmax > 0);
+        for (int i = 0; i < r->nguarded; ++i) {
+            int d = r->guarded[i];
+            if (!tr_carried(r, d)) continue;
+            x64_alu_mem_imm(x, X64_CMP, 0, tr_cell_type(d), r->guard[d + TAPE_SIZE]);
+            x64_link(x, x64_jcc(x, X64_CC_NE), loop);
+            tr->dropped++;
+        }
+        x64_link(x, x64_jmp(x), fast);
+    }
+
+    size_t epilogue = x->len;
+    x64_pop(x, X64_R15);
+    x64_pop(x, X64_R14);
+    x64_pop(x, X64_R13);
+    x64_pop(x, X64_R12);
+    x64_pop(x, X64_RBP);
+    x64_pop(x, X64_RBX);
+    x64_ret(x);
+
+    size_t *stub = (size_t*)malloc((size_t)r->nexits * sizeof(size_t));
+    if (!stub) { why = "out of memory"; goto out; }
+    for (int e = 0; e < r->nexits; ++e) stub[e] = SIZE_MAX;
+    for (int i = 0; i < g.nfix; ++i) {
+        int e = g.fix[i].exit;
+        if (stub[e] == SIZE_MAX) { stub[e] = x->len; tr_gen_exit(&g, e, epilogue); }
+        x64_link(x, g.fix[i].at, stub[e]);
+    }
+    free(stub);
+    if (r->oom || x->oom) { why = "out of memory"; goto out; }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size = (x->len + page - 1) / page * page;
+    void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) { why = "mmap failed"; goto out; }
+    memcpy(mem, x->buf, x->len);
+    if (mprotect(mem, map_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, map_size);
+        why = "mprotect failed";
+        goto out;
+    }
+    tr->mem = (uint8_t*)mem;
+    tr->map_size = map_size;
+    tr->bytes = x->len;
+out:
+    free(g.live);
+    free(g.last);
+    free(g.loc);
+    free(g.exit_loc);
+    free(g.fix);
+    free(x->buf);
+    return why;
+}
+
+/* run and record one iteration from the loop header to end_ip; NULL when
+ * it completed, or why it could not be traced */
+static const char *tr_record_iteration(tr_rec *r, size_t end_ip, int *recorded) {
+    VM *vm = r->vm;
+    for (;;) {
+        if (vm->ip >= vm->code_len) return "ran off the code";
+        if (*recorded == TRACE_MAX_OPS) return "trace too long";
+        size_t ip = vm->ip;
+        OpCode op = (OpCode)vm->code[ip];
+        if (op == OP_ENDBLOCK && ip == end_ip && vm->block_sp == r->base + 1) {
+            if (r->sp != 0) return "unbalanced stack";
+            /* the back-edge, taken by hand: the iteration is complete */
+            vm->block_sp--;
+            vm->ip = r->cond;
+            (*recorded)++;
+            return NULL;
+        }
+        const char *err = tr_record_op(r, ip, op);
+        if (err) return err;
+        if (r->oom) return "out of memory";
+        (*recorded)++;
+        vm_step(vm, &__INTERPRETER);
+    }
+}
+
+/* as tr_record_iteration; a guest fault on the way (vm_check) drops the
+ * recording and goes on to the embedder's handler */
+static const char *tr_record_guarded(tr_rec *r, size_t end_ip, int *recorded) {
+    VM *vm = r->vm;
+    jmp_buf env, *outer = vm->fault_env;
+    if (!outer) return tr_record_iteration(r, end_ip, recorded);
+    vm->fault_env = &env;
+    if (setjmp(env)) {
+        vm->fault_env = outer;
+        free(r->cell);
+        free(r->ins);
+        free(r->exits);
+        free(r->vals);
+        free(r->blocks);
+        longjmp(*outer, 1);
+    }
+    const char *err = tr_record_iteration(r, end_ip, recorded);
+    vm->fault_env = outer;
+    return err;
+}
+
+trace *trace_record(VM *vm, size_t end_ip, const char **why) {
+    const char *dummy;
+    if (!why) why = &dummy;
+    tr_rec r;
+    memset(&r, 0, sizeof(r));
+    r.vm = vm;
+    r.cond = vm->ip;
+    r.base = vm->block_sp;
+    int *tables = (int*)malloc(5 * TR_OFFSETS * sizeof(int));
+    trace *tr = NULL;
+    if (!tables) { *why = "out of memory"; return NULL; }
+    r.cell = tables;
+    r.store = tables + TR_OFFSETS;
+    r.store_at = tables + 2 * TR_OFFSETS;
+    r.guard = tables + 3 * TR_OFFSETS;
+    r.guarded = tables + 4 * TR_OFFSETS;
+    for (int i = 0; i < 4 * TR_OFFSETS; ++i) tables[i] = -1;
+    tr_exit_new(&r, r.cond); /* exit 0: the loop header, nothing done yet */
+
+    int recorded = 0;
+    const char *err = tr_record_guarded(&r, end_ip, &recorded);
+
+    if (!err) {
+        tr = (trace*)calloc(1, sizeof(trace));
+        if (!tr) err = "out of memory";
+    }
+    if (!err) {
+        tr->cond_ip = r.cond;
+        tr->recorded = recorded;
+        if ((err = tr_compile(&r, tr)) != NULL) {
+            free(tr);
+            tr = NULL;
+        }
+    }
+    if (tr) {
+        /* the exits outlive the recorder; their stack lists do not */
+        tr->exits = r.exits;
+        tr->nexits = r.nexits;
+        tr->blocks = r.blocks;
+        r.exits = NULL;
+        r.blocks = NULL;
+    }
+    free(tables);
+    free(r.ins);
+    free(r.exits);
+    free(r.vals);
+    free(r.blocks);
+    *why = err;
+    return tr;
+}
+
+void trace_run(trace *tr, VM *vm) {
+    int max = (int)(sizeof(vm->block_stack) / sizeof(vm->block_stack[0]));
+    int base = vm->block_sp;
+    tr->runs++;
+    int e = ((trace_fn)(uintptr_t)tr->mem)(vm);
+    tr_exit *x = &tr->exits[e];
+    x->count++;
+    vm->ip = x->ip;
+    for (int i = 0; i < x->nblocks && base + i < max; ++i) vm->block_stack[base + i] = tr->blocks[x->blocks_at + i];
+    vm->block_sp = base + x->nblocks > max ? max : base + x->nblocks;
+}
+
+void trace_free(trace *tr) {
+    if (!tr) return;
+    munmap(tr->mem, tr->map_size);
+    free(tr->exits);
+    free(tr->blocks);
+    free(tr);
+}
+
+#else /* !JIT_AVAILABLE */
+
+trace *trace_record(VM *vm, size_t end_ip, const char **why) {
+    (void)vm; (void)end_ip;
+    if (why) *why = "no JIT for this target";
+    return NULL;
+}
+
+void trace_run(trace *tr, VM *vm) {
+    (void)tr; (void)vm;
+}
+
+void trace_free(trace *tr) {
+    (void)tr;
+}
+
+#endif /* JIT_AVAILABLE */
+
+size_t trace_code_bytes(const trace *tr) {
+    return tr ? tr->bytes : 0;
+}
+
+const uint8_t *trace_code_addr(const trace *tr) {
+    return tr->mem;
+}
+
+int trace_unprofitable(const trace *tr) {
+    return tr->runs >= TRACE_MIN_RUNS && tr->iterations < tr->runs;
+}
+
+void trace_print_stats(const trace *tr, FILE *out) {
+    fprintf(out, "trace @%zu: %d ops -> %d trace ops, %d guards (%d before the loop), %zu bytes, runs=%" PRIu64
+            " iterations=%" PRIu64 "\n", tr->cond_ip, tr->recorded, tr->ins, tr->guards + tr->hoisted, tr->hoisted,
+            tr->bytes, tr->runs, tr->iterations);
+    if (tr->dropped) fprintf(out, "trace @%zu: versioned, the fast loop skips %d header checks\n", tr->cond_ip, tr->dropped);
+    int any = 0;
+    for (int e = 0; e < tr->nexits; ++e) {
+        if (!tr->exits[e].count) continue;
+        if (!any) fprintf(out, "trace @%zu exits:", tr->cond_ip);
+        fprintf(out, " @%zu=%" PRIu64, tr->exits[e].ip, tr->exits[e].count);
+        any = 1;
+    }
+    if (any) fprintf(out, "\n");
+}
@@ -0,0 +1,77 @@
+#ifndef TIER_TRACE_H
+#define TIER_TRACE_H
+
+/*
+ * rrvm/frontend/tier/trace.h
+ *
+ * Tracing tier: compiles the path one iteration of a hot while loop
+ * actually takes.
+ *
+ * trace_record runs one iteration in the interpreter (vm_step), recording
+ * each instruction into a linear SSA trace. The VM stack is abstracted away
+ * (values become trace values), tape accesses are resolved to offsets from
+ * tp at the loop condition, and the facts the path relies on become guards:
+ * the direction of every if and while, the type of every tape cell read
+ * before the iteration writes it, non-zero divisors, and the tape and stack
+ * bounds. While recording the trace is optimized:
+ *  - constant folding and simple identities (x+0, x*1, ...), including
+ *    branches on constants, which need no guard;
+ *  - redundant load removal: a cell read or written earlier in the
+ *    iteration is not loaded again, and a store overwritten before any
+ *    guard could observe it is dropped;
+ *  - guard hoisting: type and bounds guards move to the loop header, and
+ *    when tp does not move per iteration the ones no store can invalidate
+ *    run once before the loop;
+ *  - loop versioning: when tp does move, the loop is also compiled as a
+ *    fast copy without bounds checks or the type guards the previous
+ *    iteration's stores satisfy, entered after one check of the tape range
+ *    and left when tp passes the last position that range allows;
+ *  - dead code elimination of values no store, guard or exit needs.
+ *
+ * The result is compiled to x86-64 with values in registers and the loop
+ * closed natively. A failing guard leaves through a side exit that writes
+ * the live values back to the VM stack, sets sp/tp/ip and rebuilds the
+ * block-stack markers, so the interpreter resumes at the guarded
+ * instruction exactly as if it had run the iteration itself.
+ *
+ * Recording gives up on calls, returns, inner loops, pointer chasing,
+ * float or vector arithmetic and other instructions the trace compiler does
+ * not model; the loop then stays with the baseline tiers (tier.h).
+ *
+ * Available where the baseline JIT is (JIT_AVAILABLE); elsewhere
+ * trace_record always fails.
+ */
+
+#include <stdio.h>
+
+#include "../vm/vm.h"
+
+typedef struct trace trace;
+
+/*
+ * Record the loop whose condition starts at vm->ip and whose OP_ENDBLOCK
+ * is at end_ip, executing one iteration. On success the VM is back at the
+ * condition and the compiled trace is returned. Otherwise returns NULL,
+ * sets *why (static string) and leaves the VM at the instruction recording
+ * stopped on (not yet executed), so the interpreter can simply continue.
+ */
+trace *trace_record(VM *vm, size_t end_ip, const char **why);
+
+/* Run the trace from its loop condition (vm->ip) until a guard fails. */
+void trace_run(trace *tr, VM *vm);
+
+/* bytes of machine code emitted */
+size_t trace_code_bytes(const trace *tr);
+
+/* start of the machine code (for tier/perf.h) */
+const uint8_t *trace_code_addr(const trace *tr);
+
+/* Loop iterations completed per trace_run is below one on average after
+ * enough runs: the recorded path is not the one the loop takes. */
+int trace_unprofitable(const trace *tr);
+
+void trace_print_stats(const trace *tr, FILE *out);
+
+void trace_free(trace *tr);
+
+#endif /* TIER_TRACE_H */
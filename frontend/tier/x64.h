@@ -0,0 +1,244 @@
+#ifndef TIER_X64_H
+#define TIER_X64_H
+
+/*
+ * rrvm/frontend/tier/x64.h
+ *
+ * Minimal x86-64 instruction encoder for the baseline JIT (tier/jit.c) and
+ * the trace compiler (tier/trace.c).
+ * Only the forms the JIT emits are provided. Memory operands are always
+ * encoded as [base + index*scale + disp32], which keeps every access to a
+ * VM field the same length whatever its offset. Code is assembled into a
+ * growable heap buffer; a failed allocation sets `oom` and later emits are
+ * dropped, so callers check once at the end.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+enum {
+    X64_RAX, X64_RCX, X64_RDX, X64_RBX, X64_RSP, X64_RBP, X64_RSI, X64_RDI,
+    X64_R8, X64_R9, X64_R10, X64_R11, X64_R12, X64_R13, X64_R14, X64_R15,
+};
+
+#define X64_NOINDEX (-1)
+
+/* condition codes (low nibble of Jcc/SETcc) */
+enum {
+    X64_CC_B = 0x2, X64_CC_AE = 0x3, X64_CC_E = 0x4, X64_CC_NE = 0x5, X64_CC_A = 0x7, X64_CC_S = 0x8,
+    X64_CC_NS = 0x9, X64_CC_L = 0xC, X64_CC_GE = 0xD, X64_CC_LE = 0xE, X64_CC_G = 0xF,
+};
+
+/* ALU opcodes of the `reg, r/m` form; the /digit for immediates is op >> 3 */
+enum {
+    X64_ADD = 0x03, X64_OR = 0x0B, X64_AND = 0x23, X64_SUB = 0x2B,
+    X64_XOR = 0x33, X64_CMP = 0x3B,
+};
+
+/* /digit of the shift (D3/C1) and unary (F7/FF) groups */
+enum { X64_ROL = 0, X64_ROR = 1, X64_SHL = 4, X64_SHR = 5, X64_SAR = 7 };
+enum { X64_NOT = 2, X64_NEG = 3, X64_MUL = 4, X64_IMUL = 5, X64_IDIV = 7 };
+
+/* SSE2 scalar double ops (F2 0F xx) */
+enum { X64_ADDSD = 0x58, X64_MULSD = 0x59, X64_SUBSD = 0x5C };
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    int oom;
+} x64_buf;
+
+typedef struct {
+    int base;
+    int index; /* X64_NOINDEX for none */
+    int scale; /* 1, 2, 4 or 8 */
+    int32_t disp;
+} x64_mem;
+
+static inline x64_mem x64_at(int base, int32_t disp) {
+    x64_mem m = { base, X64_NOINDEX, 1, disp };
+    return m;
+}
+
+static inline x64_mem x64_idx(int base, int index, int scale, int32_t disp) {
+    x64_mem m = { base, index, scale, disp };
+    return m;
+}
+
+static inline void x64_emit8(x64_buf *x, uint8_t b) {
+    if (x->len == x->cap) {
+        size_t cap = x->cap ? x->cap * 2 : 1024;
+        uint8_t *nb = (uint8_t*)realloc(x->buf, cap);
+        if (!nb) { x->oom = 1; return; }
+        x->buf = nb;
+        x->cap = cap;
+    }
+    x->buf[x->len++] = b;
+}
+
+static inline void x64_emit32(x64_buf *x, uint32_t v) {
+    for (int i = 0; i < 4; ++i) x64_emit8(x, (uint8_t)(v >> (8 * i)));
+}
+
+static inline void x64_emit64(x64_buf *x, uint64_t v) {
+    for (int i = 0; i < 8; ++i) x64_emit8(x, (uint8_t)(v >> (8 * i)));
+}
+
+/* point the rel32 field at `at` (as returned by the jump emitters) to `target` */
+static inline void x64_link(x64_buf *x, size_t at, size_t target) {
+    if (x->oom || at + 4 > x->len) return;
+    uint32_t rel = (uint32_t)((int64_t)target - (int64_t)(at + 4));
+    for (int i = 0; i < 4; ++i) x->buf[at + i] = (uint8_t)(rel >> (8 * i));
+}
+
+/* [prefix] [REX] opcode (1-3 bytes, most significant first) */
+static inline void x64_prefix_rex_op(x64_buf *x, int pfx, int w, int r, int xi, int b, uint32_t opc) {
+    if (pfx) x64_emit8(x, (uint8_t)pfx);
+    int rex = (w ? 8 : 0) | ((r & 8) ? 4 : 0) | ((xi & 8) ? 2 : 0) | ((b & 8) ? 1 : 0);
+    if (rex) x64_emit8(x, (uint8_t)(0x40 | rex));
+    if (opc > 0xFFFF) x64_emit8(x, (uint8_t)(opc >> 16));
+    if (opc > 0xFF) x64_emit8(x, (uint8_t)(opc >> 8));
+    x64_emit8(x, (uint8_t)opc);
+}
+
+/* op reg, [mem] (or the reverse, depending on the opcode) */
+static inline void x64_op_mem(x64_buf *x, int pfx, int w, uint32_t opc, int reg, x64_mem m) {
+    int index = m.index == X64_NOINDEX ? 0 : m.index;
+    x64_prefix_rex_op(x, pfx, w, reg, index, m.base, opc);
+    if (m.index == X64_NOINDEX && (m.base & 7) != X64_RSP) {
+        x64_emit8(x, (uint8_t)(0x80 | (reg & 7) << 3 | (m.base & 7)));
+    } else {
+        int ss = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+        int idx = m.index == X64_NOINDEX ? 4 : (m.index & 7);
+        x64_emit8(x, (uint8_t)(0x80 | (reg & 7) << 3 | 4));
+        x64_emit8(x, (uint8_t)(ss << 6 | idx << 3 | (m.base & 7)));
+    }
+    x64_emit32(x, (uint32_t)m.disp);
+}
+
+/* op reg, rm (register direct) */
+static inline void x64_op_reg(x64_buf *x, int pfx, int w, uint32_t opc, int reg, int rm) {
+    x64_prefix_rex_op(x, pfx, w, reg, 0, rm, opc);
+    x64_emit8(x, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+/* --- moves --- */
+
+static inline void x64_load(x64_buf *x, int w, int reg, x64_mem m) { x64_op_mem(x, 0, w, 0x8B, reg, m); }
+static inline void x64_store(x64_buf *x, int w, x64_mem m, int reg) { x64_op_mem(x, 0, w, 0x89, reg, m); }
+static inline void x64_movsxd(x64_buf *x, int reg, x64_mem m) { x64_op_mem(x, 0, 1, 0x63, reg, m); }
+static inline void x64_lea(x64_buf *x, int reg, x64_mem m) { x64_op_mem(x, 0, 1, 0x8D, reg, m); }
+static inline void x64_mov_rr(x64_buf *x, int dst, int src) { x64_op_reg(x, 0, 1, 0x89, src, dst); }
+
+/* mov dword/qword [mem], imm32 (sign-extended for qword) */
+static inline void x64_store_imm(x64_buf *x, int w, x64_mem m, int32_t imm) {
+    x64_op_mem(x, 0, w, 0xC7, 0, m);
+    x64_emit32(x, (uint32_t)imm);
+}
+
+/* mov reg, imm (shortest of imm32 forms and movabs) */
+static inline void x64_mov_imm(x64_buf *x, int reg, int64_t imm) {
+    if (imm >= 0 && imm <= 0xFFFFFFFFLL) {
+        x64_prefix_rex_op(x, 0, 0, 0, 0, reg, (uint32_t)(0xB8 + (reg & 7)));
+        x64_emit32(x, (uint32_t)imm);
+    } else if (imm >= INT32_MIN && imm <= INT32_MAX) {
+        x64_op_reg(x, 0, 1, 0xC7, 0, reg);
+        x64_emit32(x, (uint32_t)imm);
+    } else {
+        x64_prefix_rex_op(x, 0, 1, 0, 0, reg, (uint32_t)(0xB8 + (reg & 7)));
+        x64_emit64(x, (uint64_t)imm);
+    }
+}
+
+/* --- arithmetic --- */
+
+static inline void x64_alu_load(x64_buf *x, int op, int w, int reg, x64_mem m) { x64_op_mem(x, 0, w, (uint32_t)op, reg, m); }
+static inline void x64_alu_rr(x64_buf *x, int op, int w, int dst, int src) { x64_op_reg(x, 0, w, (uint32_t)op, dst, src); }
+
+/* op reg, imm (imm8 form when it fits) */
+static inline void x64_alu_imm(x64_buf *x, int op, int w, int reg, int32_t imm) {
+    if (imm >= -128 && imm <= 127) {
+        x64_op_reg(x, 0, w, 0x83, op >> 3, reg);
+        x64_emit8(x, (uint8_t)imm);
+    } else {
+        x64_op_reg(x, 0, w, 0x81, op >> 3, reg);
+        x64_emit32(x, (uint32_t)imm);
+    }
+}
+
+/* op qword [mem], imm8 */
+static inline void x64_alu_mem_imm8(x64_buf *x, int op, x64_mem m, int8_t imm) {
+    x64_op_mem(x, 0, 1, 0x83, op >> 3, m);
+    x64_emit8(x, (uint8_t)imm);
+}
+
+/* op dword/qword [mem], imm32 */
+static inline void x64_alu_mem_imm(x64_buf *x, int op, int w, x64_mem m, int32_t imm) {
+    x64_op_mem(x, 0, w, 0x81, op >> 3, m);
+    x64_emit32(x, (uint32_t)imm);
+}
+
+static inline void x64_imul_load(x64_buf *x, int reg, x64_mem m) { x64_op_mem(x, 0, 1, 0x0FAF, reg, m); }
+static inline void x64_imul_rr(x64_buf *x, int dst, int src) { x64_op_reg(x, 0, 1, 0x0FAF, dst, src); }
+
+/* dst = src * imm32 */
+static inline void x64_imul_imm(x64_buf *x, int dst, int src, int32_t imm) {
+    x64_op_reg(x, 0, 1, 0x69, dst, src);
+    x64_emit32(x, (uint32_t)imm);
+}
+
+/* sign-extend rax into rdx (before idiv) */
+static inline void x64_cqo(x64_buf *x) { x64_emit8(x, 0x48); x64_emit8(x, 0x99); }
+static inline void x64_inc_mem(x64_buf *x, x64_mem m) { x64_op_mem(x, 0, 1, 0xFF, 0, m); }
+static inline void x64_shift_cl(x64_buf *x, int op, int reg) { x64_op_reg(x, 0, 1, 0xD3, op, reg); }
+
+static inline void x64_shift_imm(x64_buf *x, int op, int reg, uint8_t n) {
+    x64_op_reg(x, 0, 1, 0xC1, op, reg);
+    x64_emit8(x, n);
+}
+
+static inline void x64_unary(x64_buf *x, int op, int reg) { x64_op_reg(x, 0, 1, 0xF7, op, reg); }
+static inline void x64_inc(x64_buf *x, int w, int reg) { x64_op_reg(x, 0, w, 0xFF, 0, reg); }
+static inline void x64_dec(x64_buf *x, int w, int reg) { x64_op_reg(x, 0, w, 0xFF, 1, reg); }
+static inline void x64_bsr(x64_buf *x, int dst, int src) { x64_op_reg(x, 0, 1, 0x0FBD, dst, src); }
+static inline void x64_bsf(x64_buf *x, int dst, int src) { x64_op_reg(x, 0, 1, 0x0FBC, dst, src); }
+static inline void x64_popcnt(x64_buf *x, int dst, int src) { x64_op_reg(x, 0xF3, 1, 0x0FB8, dst, src); }
+static inline void x64_bswap(x64_buf *x, int reg) { x64_prefix_rex_op(x, 0, 1, 0, 0, reg, (uint32_t)(0x0FC8 + (reg & 7))); }
+static inline void x64_test_rr(x64_buf *x, int w, int a, int b) { x64_op_reg(x, 0, w, 0x85, b, a); }
+
+/* setcc on al/cl/dl/bl (no REX needed) */
+static inline void x64_cmov(x64_buf *x, int cc, int dst, int src) { x64_op_reg(x, 0, 1, (uint32_t)(0x0F40 + cc), dst, src); }
+static inline void x64_setcc(x64_buf *x, int cc, int reg8) { x64_op_reg(x, 0, 0, (uint32_t)(0x0F90 + cc), 0, reg8); }
+
+/* --- SSE2 scalar double --- */
+
+static inline void x64_movq_load(x64_buf *x, int xmm, x64_mem m) { x64_op_mem(x, 0xF3, 0, 0x0F7E, xmm, m); }
+static inline void x64_movq_store(x64_buf *x, x64_mem m, int xmm) { x64_op_mem(x, 0x66, 0, 0x0FD6, xmm, m); }
+static inline void x64_sse_sd(x64_buf *x, int op, int xmm, x64_mem m) { x64_op_mem(x, 0xF2, 0, (uint32_t)(0x0F00 + op), xmm, m); }
+
+/* --- control flow; jump emitters return the offset of their rel32 --- */
+
+static inline size_t x64_jcc(x64_buf *x, int cc) {
+    x64_emit8(x, 0x0F);
+    x64_emit8(x, (uint8_t)(0x80 + cc));
+    size_t at = x->len;
+    x64_emit32(x, 0);
+    return at;
+}
+
+static inline size_t x64_jmp(x64_buf *x) {
+    x64_emit8(x, 0xE9);
+    size_t at = x->len;
+    x64_emit32(x, 0);
+    return at;
+}
+
+static inline void x64_jmp_reg(x64_buf *x, int reg) { x64_op_reg(x, 0, 0, 0xFF, 4, reg); }
+static inline void x64_call_reg(x64_buf *x, int reg) { x64_op_reg(x, 0, 0, 0xFF, 2, reg); }
+static inline void x64_push(x64_buf *x, int reg) { x64_prefix_rex_op(x, 0, 0, 0, 0, reg, (uint32_t)(0x50 + (reg & 7))); }
+static inline void x64_pop(x64_buf *x, int reg) { x64_prefix_rex_op(x, 0, 0, 0, 0, reg, (uint32_t)(0x58 + (reg & 7))); }
+static inline void x64_ret(x64_buf *x) { x64_emit8(x, 0xC3); }
+
+#endif /* TIER_X64_H */
@@ -0,0 +1,253 @@
+#ifndef VM_SELECT_H
+#define VM_SELECT_H
+
+/*
+ * rrvm/frontend/vm/select.h
+ *
+ * If-conversion over parsed code. An if/else diamond whose arms only
+ * compute a value costs a block-stack push, a skip over the arm not taken
+ * and a data-dependent branch in the interpreter. Evaluating both arms and
+ * keeping one with OP_SELECT costs none of these:
+ *
+ *   c if A else B end                  ->  c A B select
+ *   c if A store M else B store M end  ->  c A M B select store M
+ *   c if A store M end                 ->  c A load select store M
+ *
+ * An arm qualifies when it pushes exactly one value and does nothing else:
+ * push, load, not, gez, abs, select, the bit counts and bswap, and add,
+ * sub, mul, the bitwise ops, min, max, the rotates and mulhi on operands
+ * whose pushed types match, so that evaluating the arm that was not taken
+ * cannot trip a type check. Moves are allowed within VM_SELECT_REACH cells
+ * as long as the arm returns to where it started; in the store forms both
+ * arms store to the same cell and M is the move back from it. Running the
+ * arm that was not taken must not reach a cell the taken one would not
+ * have, or a guarded move or load would now run off the tape: both arms
+ * have to visit the same cells, and the arm of a lone if only its own. Diamonds
+ * are converted inner first, so nested ones become one expression. The
+ * code shrinks in place; while conditions and source lines follow it. A
+ * while whose condition starts inside a diamond keeps it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+
+#define VM_SELECT_DEPTH 8  /* values an arm may hold at once */
+#define VM_SELECT_REACH 16 /* cells an arm may move away from tp */
+#define VM_SELECT_HERE ((uint64_t)1 << VM_SELECT_REACH) /* tp itself in a cell set */
+
+enum { VM_SELECT_NONE = -2, VM_SELECT_ANY = -1 };
+
+/*
+ * Type of the one value code [from, to) pushes (VM_SELECT_ANY if a load
+ * decides it), VM_SELECT_NONE if it is not a pure arm. With store the arm
+ * must instead store that value and then only move back; the store's ip
+ * goes to *store and its offset from the arm's start to *at. The cells
+ * the arm moves to go to *cells, one bit per offset, VM_SELECT_HERE for
+ * the cell it starts at. Words with drop set are skipped.
+ */
+static inline int vm_select_arm(const word *code, const uint8_t *drop, size_t from, size_t to, size_t *store, word *at, uint64_t *cells) {
+    int st[VM_SELECT_DEPTH], sp = 0;
+    word tp = 0;
+    *cells = VM_SELECT_HERE;
+    size_t ip = from;
+    int stored = 0;
+    while (ip < to) {
+        if (drop[ip]) { ip++; continue; }
+        OpCode op = (OpCode)code[ip];
+        size_t next = ip + 1 + (size_t)vm_op_imm_count(op);
+        if (next > to) return VM_SELECT_NONE;
+        if (stored && op != OP_MOVE && op != OP_NOP) return VM_SELECT_NONE;
+        switch (op) {
+            case OP_NOP:
+                break;
+            case OP_PUSH: {
+                word ty = code[ip + 1];
+                if (sp == VM_SELECT_DEPTH || ty == TYPE_V128) return VM_SELECT_NONE;
+                st[sp++] = ty == TYPE_UNKNOWN ? VM_SELECT_ANY : (int)ty;
+                break;
+            }
+            case OP_LOAD:
+                if (sp == VM_SELECT_DEPTH) return VM_SELECT_NONE;
+                st[sp++] = VM_SELECT_ANY;
+                break;
+            case OP_MOVE:
+                tp += code[ip + 1];
+                if (tp < -VM_SELECT_REACH || tp > VM_SELECT_REACH) return VM_SELECT_NONE;
+                *cells |= (uint64_t)1 << (tp + VM_SELECT_REACH);
+                break;
+            case OP_NOT: case OP_GEZ:
+                if (sp < 1) return VM_SELECT_NONE;
+                st[sp - 1] = VM_SELECT_ANY;
+                break;
+            case OP_ABS: case OP_POPCNT: case OP_CLZ: case OP_CTZ: case OP_BSWAP:
+                if (sp < 1) return VM_SELECT_NONE;
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_BITAND: case OP_BITOR: case OP_BITXOR:
+            case OP_MIN: case OP_MAX: case OP_ROTL: case OP_ROTR: case OP_MULHI:
+                if (sp < 2 || st[sp - 1] == VM_SELECT_ANY || st[sp - 1] != st[sp - 2]) return VM_SELECT_NONE;
+                sp--;
+                break;
+            case OP_SELECT:
+                if (sp < 3) return VM_SELECT_NONE;
+                sp -= 2;
+                st[sp - 1] = st[sp] == st[sp + 1] ? st[sp] : VM_SELECT_ANY;
+                break;
+            case OP_STORE:
+                if (!store || sp != 1) return VM_SELECT_NONE;
+                stored = 1;
+                *store = ip;
+                *at = tp;
+                break;
+            default:
+                return VM_SELECT_NONE;
+        }
+        ip = next;
+    }
+    if (tp != 0 || (store ? !stored : sp != 1)) return VM_SELECT_NONE;
+    return st[0];
+}
+
+/*
+ * Convert the diamonds of code[0 .. *len) (see above). lines, if not
+ * NULL, holds a source line per word and is compacted with the code.
+ * Returns the number of diamonds converted; *len gets the new length.
+ */
+static inline int vm_if_convert(word *code, size_t *len, int *lines) {
+    size_t n = *len;
+    if (!n) return 0;
+    /* per if: its else (or n) and its end */
+    size_t *if_at = (size_t*)malloc(n * sizeof(size_t));
+    size_t *else_of = (size_t*)malloc(n * sizeof(size_t));
+    size_t *end_of = (size_t*)malloc(n * sizeof(size_t));
+    size_t *open = (size_t*)malloc(n * sizeof(size_t));
+    uint8_t *drop = (uint8_t*)calloc(n + 1, 1);
+    uint8_t *target = (uint8_t*)calloc(n + 1, 1);
+    word *buf = (word*)malloc(n * sizeof(word));
+    int *buf_line = (int*)malloc(n * sizeof(int));
+    size_t nifs = 0, nopen = 0;
+    int converted = 0;
+
+    for (size_t ip = 0; ip < n; ip += 1 + (size_t)vm_op_imm_count((OpCode)code[ip])) {
+        OpCode op = (OpCode)code[ip];
+        if (op == OP_WHILE && ip + 1 < n && code[ip + 1] >= 0 && (size_t)code[ip + 1] < n) target[code[ip + 1]] = 1;
+        if (op == OP_FUNCTION || op == OP_WHILE || op == OP_IF) {
+            if (op == OP_IF) {
+                if_at[nifs] = ip;
+                else_of[ip] = n;
+                end_of[ip] = n;
+                nifs++;
+            }
+            open[nopen++] = ip;
+        } else if (op == OP_ELSE && nopen && (OpCode)code[open[nopen - 1]] == OP_IF) {
+            else_of[open[nopen - 1]] = ip;
+        } else if (op == OP_ENDBLOCK && nopen) {
+            size_t o = open[--nopen];
+            if ((OpCode)code[o] == OP_IF) end_of[o] = ip;
+        }
+    }
+
+    /* inner diamonds come later in the code: convert from the back */
+    for (size_t k = nifs; k-- > 0; ) {
+        size_t p = if_at[k], e = else_of[p], q = end_of[p];
+        if (q >= n) continue;
+        int blocked = 0;
+        for (size_t ip = p + 1; ip <= q && !blocked; ++ip) blocked = target[ip];
+        if (blocked) continue;
+        size_t s1 = 0, s2 = 0, a_end, b_end;
+        word d1 = 0, d2 = 0;
+        uint64_t c1, c2;
+        int form;
+        if (e < q && vm_select_arm(code, drop, p + 1, e, NULL, NULL, &c1) != VM_SELECT_NONE &&
+            vm_select_arm(code, drop, e + 1, q, NULL, NULL, &c2) != VM_SELECT_NONE && c1 == c2) {
+            form = 0;
+            a_end = e;
+            b_end = q;
+        } else if (e < q && vm_select_arm(code, drop, p + 1, e, &s1, &d1, &c1) != VM_SELECT_NONE &&
+                   vm_select_arm(code, drop, e + 1, q, &s2, &d2, &c2) != VM_SELECT_NONE && d1 == d2 && c1 == c2) {
+            form = 1;
+            a_end = s1;
+            b_end = s2;
+        } else if (e >= q && vm_select_arm(code, drop, p + 1, q, &s1, &d1, &c1) != VM_SELECT_NONE &&
+                   c1 == VM_SELECT_HERE) {
+            form = 2;
+            a_end = s1;
+            b_end = q;
+        } else {
+            continue;
+        }
+
+        /* A, then B (or a load of the cell), select and the store; A of a
+           store form ends at the cell, B starts where the if did */
+        size_t m = 0;
+        int line = lines ? lines[p] : 0;
+        for (size_t ip = p + 1; ip < a_end; ++ip) {
+            if (drop[ip]) continue;
+            buf_line[m] = lines ? lines[ip] : 0;
+            buf[m++] = code[ip];
+        }
+        if (form == 1 && d1) {
+            buf_line[m] = buf_line[m + 1] = line;
+            buf[m++] = OP_MOVE;
+            buf[m++] = -d1;
+        }
+        if (form == 2) {
+            buf_line[m] = line;
+            buf[m++] = OP_LOAD;
+        } else {
+            for (size_t ip = e + 1; ip < b_end; ++ip) {
+                if (drop[ip]) continue;
+                buf_line[m] = lines ? lines[ip] : 0;
+                buf[m++] = code[ip];
+            }
+        }
+        buf_line[m] = line;
+        buf[m++] = OP_SELECT;
+        if (form) {
+            buf_line[m] = lines ? lines[s1] : 0;
+            buf[m++] = OP_STORE;
+            if (d1) {
+                buf_line[m] = buf_line[m + 1] = line;
+                buf[m++] = OP_MOVE;
+                buf[m++] = -d1;
+            }
+        }
+        for (size_t j = 0; j < m; ++j) {
+            code[p + j] = buf[j];
+            if (lines) lines[p + j] = buf_line[j];
+            drop[p + j] = 0;
+        }
+        for (size_t ip = p + m; ip <= q; ++ip) drop[ip] = 1;
+        converted++;
+    }
+
+    if (converted) {
+        /* shrink; a while condition keeps pointing at its (kept) first word */
+        size_t *to = open;
+        size_t w = 0;
+        for (size_t ip = 0; ip < n; ++ip) {
+            to[ip] = w;
+            if (drop[ip]) continue;
+            code[w] = code[ip];
+            if (lines) lines[w] = lines[ip];
+            w++;
+        }
+        for (size_t ip = 0; ip < w; ip += 1 + (size_t)vm_op_imm_count((OpCode)code[ip])) {
+            if ((OpCode)code[ip] == OP_WHILE && ip + 1 < w && code[ip + 1] >= 0 && (size_t)code[ip + 1] < n)
+                code[ip + 1] = (word)to[code[ip + 1]];
+        }
+        *len = w;
+    }
+    free(if_at);
+    free(else_of);
+    free(end_of);
+    free(open);
+    free(drop);
+    free(target);
+    free(buf);
+    free(buf_line);
+    return converted;
+}
+
+#endif /* VM_SELECT_H */
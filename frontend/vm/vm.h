@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 
 /* VM configuration */
 #ifndef STACK_SIZE
@@ -23,15 +24,49 @@
 #define CALL_STACK_SIZE 256
 #endif
 
+/* Number of cells at the top of the tape reserved for frame arenas. OP_ARENA
+ * bump-allocates from [TAPE_SIZE - ARENA_SIZE, TAPE_SIZE); every call frame
+ * saves the bump pointer and OP_RETURN restores it, releasing the frame's
+ * allocations in O(1). Programs should not address that region directly.
+ */
+#ifndef ARENA_SIZE
+#define ARENA_SIZE 256
+#endif
+
+#if ARENA_SIZE > TAPE_SIZE
+#error "ARENA_SIZE must not exceed TAPE_SIZE"
+#endif
+
+/* Guarded tape mode. With TAPE_GUARD=1 the tape and its type array live in
+ * mmap'd reservations that cover every int tape index: the usable cells are
+ * read/write and everything else is PROT_NONE. Tape-pointer ops then skip
+ * their bounds checks; an out-of-range access faults and the SIGSEGV handler
+ * turns it into a VM trap that reports the faulting ip. Requires POSIX
+ * (mmap/sigaction) and TAPE_SIZE cells filling whole pages.
+ */
+#ifndef TAPE_GUARD
+#define TAPE_GUARD 0
+#endif
+
 #include <stdint.h>
 #include <inttypes.h>
+#include <setjmp.h>
+
+#if TAPE_GUARD
+#include <sys/mman.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
 
 #if WORD_BITS == 64
 typedef int64_t word;
 #define WORD_FMT PRId64
+#define WORD_MIN INT64_MIN
 #elif WORD_BITS == 32
 typedef int32_t word;
 #define WORD_FMT PRId32
+#define WORD_MIN INT32_MIN
 #else
 #error "WORD_BITS must be 32 or 64"
 #endif
@@ -58,8 +93,15 @@ typedef enum {
     TYPE_BOOL,
     TYPE_PTR,   /* pointer/tape index */
     TYPE_VOID,
+    TYPE_V128,  /* 128-bit vector (see kernels/simd.h); spans V128_SLOTS stack slots */
 } TypeTag;
 
+/* stack slots one V128 value occupies, each tagged TYPE_V128 */
+#define V128_SLOTS (128 / WORD_BITS)
+
+/* most distinct bytes OP_FINDANY accepts in its set */
+#define TEXT_SET_MAX 16
+
 /* VM opcodes */
 typedef enum {
     OP_NOP = 0,
@@ -104,6 +146,71 @@ typedef enum {
     OP_ARSH,
     OP_GEZ,
 
+    /* frame-scoped tape arena */
+    OP_ARENA, /* followed by cell count immediate; pushes base ptr */
+
+    /* native intrinsics (see native/native.h) */
+    OP_NCALL, /* followed by intrinsic index immediate */
+
+    /* hash maps keyed by word (see hashmap/hashmap.h); handles are i64 */
+    OP_HNEW,  /* -- h */
+    OP_HPUT,  /* h k v -- */
+    OP_HGET,  /* h k -- v (0:i64 if absent) */
+    OP_HDEL,  /* h k -- removed:bool */
+    OP_HLEN,  /* h -- n */
+    OP_HITER, /* h -- n; writes n key/value pairs to tape[tp..tp+2n) */
+
+    /* sort/search over tape[tp..tp+n) (see kernels/sort.h); each takes n */
+    OP_SORT,       /* sort the range in place by its cell type */
+    OP_BSEARCH,    /* key -- i (offset of an equal cell, or -1) */
+    OP_LOWERBOUND, /* key -- i (offset of the first cell >= key, or n) */
+
+    /* text kernels over n bytes packed from tape[tp] (see kernels/text.h);
+       byte offsets are i64, -1 means not found */
+    OP_PACK,       /* n; -- cells (packs n u8 cells at tp in place) */
+    OP_FINDBYTE,   /* n; pos b -- i (first b at or after pos) */
+    OP_FINDANY,    /* n k; pos b1..bk -- i (first byte in the set, k <= TEXT_SET_MAX) */
+    OP_COUNTLINES, /* n; -- count of '\n' */
+    OP_SPLITLINES, /* n; dst -- lines (line start offsets to tape[dst..]) */
+    OP_PARSEINT,   /* n; pos -- value end */
+
+    /* hashes/checksums (see kernels/hash.h); each takes n */
+    OP_HASH64,     /* -- h:u64 over cells tape[tp..tp+n) */
+    OP_HASH64B,    /* -- h:u64 over n packed bytes from tp */
+    OP_CRC32C,     /* -- crc:u32 over cells tape[tp..tp+n) */
+    OP_CRC32CB,    /* -- crc:u32 over n packed bytes from tp */
+
+    /* 128-bit vectors (see kernels/simd.h); the lane type immediate is one of
+       i64/f64 (2 lanes), i32/f32 (4) or u8 (16); binaries are next op top */
+    OP_VLOAD,      /* lt; -- v (lanes cells from tape[tp]) */
+    OP_VSTORE,     /* lt; v -- (to tape[tp..tp+lanes)) */
+    OP_VSPLAT,     /* lt; x -- v */
+    OP_VADD,       /* lt; a b -- v */
+    OP_VSUB,
+    OP_VMUL,
+    OP_VMIN,
+    OP_VMAX,
+    OP_VAND,       /* a b -- v (no lane type) */
+    OP_VOR,
+    OP_VXOR,
+    OP_VHSUM,      /* lt; v -- x (u8 lanes sum to u64) */
+    OP_VSHUFFLE,   /* lt mask; v -- v' (lane i = v[(mask >> 4i) & 15]) */
+
+    /* branch-free choices over any numeric type (see vm/select.h) */
+    OP_SELECT,     /* c a b -- r (a if c is non-zero, else b; with its type) */
+    OP_MIN,        /* a b -- r (signed, unsigned or float by the type) */
+    OP_MAX,
+    OP_ABS,        /* a -- r (unsigned values are left as they are) */
+
+    /* bit manipulation on the low 8/16/32/64 bits the type has */
+    OP_POPCNT,     /* a -- r (set bits) */
+    OP_CLZ,        /* a -- r (leading zeros; the width for 0) */
+    OP_CTZ,        /* a -- r (trailing zeros; the width for 0) */
+    OP_BSWAP,      /* a -- r (bytes reversed) */
+    OP_ROTL,       /* a n -- r (rotated by n mod the width) */
+    OP_ROTR,
+    OP_MULHI,      /* a b -- r (high half of the double-width product) */
+
     OP_HALT,
 } OpCode;
 
@@ -124,8 +231,13 @@ typedef struct {
     TypeTag types[STACK_SIZE];
 
     /* tape and pointer */
+#if TAPE_GUARD
+    word *tape;          /* TAPE_SIZE usable cells inside a guarded reservation */
+    TypeTag *tape_types; /* parallel guarded reservation for cell types */
+#else
     word tape[TAPE_SIZE];
     TypeTag tape_types[TAPE_SIZE];
+#endif
     int tp;
 
     /* pointer stack to support nested deref/refer */
@@ -136,27 +248,45 @@ typedef struct {
     size_t functions[256];
     size_t functions_count;
 
-    /* simple call-stack: stores return ip and old frame pointer */
+    /* simple call-stack: stores return ip, old frame pointer, the arena
+       watermark and the block-stack depth to restore on return */
     struct {
         size_t return_ip;
         int old_fp;
+        int old_arena;
+        int old_block_sp;
     } call_stack[CALL_STACK_SIZE];
     int call_sp;
 
     /* frame pointer (index into stack for locals) */
     int fp;
 
+    /* arena bump pointer (tape index of the next free arena cell) */
+    int arena_top;
+
     /* block stack for IF/ELSE/WHILE/ENDBLOCK handling */
     block_entry block_stack[256];
     int block_sp;
 
     void *user_data; /* backend-specific data */
+
+    FILE *out; /* destination of print/printchar; vm_reset sets stdout */
+
+    jmp_buf *fault_env; /* if set, a guest fault longjmps here (see vm_check) */
+    const char *fault;  /* message of the last guest fault */
+
+#if TAPE_GUARD
+    size_t trap_ip; /* ip of the instruction being dispatched */
+    int trapped;    /* set when run_vm stopped on a tape fault */
+#endif
 } VM;
 
 /* Backend hooks. op_push and op_set now receive a TypeTag (as int) along with the immediate. */
 typedef struct Backend {
     void (*setup)(VM *vm);
     void (*finalize)(VM *vm, word imm);
+    /* optional: report backend statistics after a run (CLI --stats) */
+    void (*stats)(VM *vm, FILE *out);
 
     /* push receives (vm, type, imm) */
     void (*op_push)(VM *vm, int type, word imm);
@@ -204,30 +334,145 @@ typedef struct Backend {
     void (*op_lrsh)(VM *vm);
     void (*op_arsh)(VM *vm);
     void (*op_gez)(VM *vm);
+
+    /* arena receives (vm, cell count) */
+    void (*op_arena)(VM *vm, word n);
+
+    /* ncall receives (vm, intrinsic index resolved by the parser) */
+    void (*op_ncall)(VM *vm, word native_index);
+
+    /* hash map hooks (stack-oriented, no immediate) */
+    void (*op_hnew)(VM *vm);
+    void (*op_hput)(VM *vm);
+    void (*op_hget)(VM *vm);
+    void (*op_hdel)(VM *vm);
+    void (*op_hlen)(VM *vm);
+    void (*op_hiter)(VM *vm);
+
+    /* sort/search hooks receive (vm, range length) */
+    void (*op_sort)(VM *vm, word n);
+    void (*op_bsearch)(VM *vm, word n);
+    void (*op_lowerbound)(VM *vm, word n);
+
+    /* text hooks receive (vm, region length in bytes); findany also gets
+       the set size */
+    void (*op_pack)(VM *vm, word n);
+    void (*op_findbyte)(VM *vm, word n);
+    void (*op_findany)(VM *vm, word n, word k);
+    void (*op_countlines)(VM *vm, word n);
+    void (*op_splitlines)(VM *vm, word n);
+    void (*op_parseint)(VM *vm, word n);
+
+    /* hash hooks receive (vm, cell or byte count) */
+    void (*op_hash64)(VM *vm, word n);
+    void (*op_hash64b)(VM *vm, word n);
+    void (*op_crc32c)(VM *vm, word n);
+    void (*op_crc32cb)(VM *vm, word n);
+
+    /* vector hooks receive (vm, lane type); the lane-wise binaries share
+       op_vbinary with the opcode, and shuffle also gets the lane mask */
+    void (*op_vload)(VM *vm, word lane);
+    void (*op_vstore)(VM *vm, word lane);
+    void (*op_vsplat)(VM *vm, word lane);
+    void (*op_vbinary)(VM *vm, OpCode op, word lane);
+    void (*op_vhsum)(VM *vm, word lane);
+    void (*op_vshuffle)(VM *vm, word lane, word mask);
+
+    /* branch-free choices */
+    void (*op_select)(VM *vm);
+    void (*op_min)(VM *vm);
+    void (*op_max)(VM *vm);
+    void (*op_abs)(VM *vm);
+
+    /* bit manipulation */
+    void (*op_popcnt)(VM *vm);
+    void (*op_clz)(VM *vm);
+    void (*op_ctz)(VM *vm);
+    void (*op_bswap)(VM *vm);
+    void (*op_rotl)(VM *vm);
+    void (*op_rotr)(VM *vm);
+    void (*op_mulhi)(VM *vm);
 } Backend;
 
+/* Guest faults: the program broke a rule the VM checks at run time (operand
+ * types, stack and tape bounds, division by zero). With vm->fault_env set,
+ * as the embedding API does around each run and call, the message goes to
+ * vm->fault and control returns there; otherwise the check is an assert.
+ * Host misuse stays a plain assert. */
+__attribute__((cold, noinline)) static void vm_fault(VM *vm, const char *msg) {
+    if (!vm->fault_env) return;
+    vm->fault = msg;
+    longjmp(*vm->fault_env, 1);
+}
+
+#define vm_check(vm, cond, msg) \
+    do { if (__builtin_expect(!(cond), 0)) { vm_fault((vm), msg); assert((cond) && msg); } } while (0)
+
 /* simple stack helpers */
 static inline void vm_push(VM *vm, word imm) {
-    assert(vm->sp < STACK_SIZE && "Stack overflow");
+    vm_check(vm, vm->sp < STACK_SIZE, "Stack overflow");
     vm->stack[vm->sp++] = imm;
 }
 
 static inline word vm_pop(VM *vm) {
-    assert(vm->sp > 0 && "Stack underflow");
+    vm_check(vm, vm->sp > 0, "Stack underflow");
     return vm->stack[--vm->sp];
 }
 
 /* pointer-stack helpers */
 static inline void vm_push_tp(VM *vm, int tp_val) {
-    assert(vm->tp_sp < TAPE_SIZE && "pointer stack overflow");
+    vm_check(vm, vm->tp_sp < TAPE_SIZE, "pointer stack overflow");
     vm->tp_stack[vm->tp_sp++] = tp_val;
 }
 
 static inline int vm_pop_tp(VM *vm) {
-    assert(vm->tp_sp > 0 && "pointer stack underflow");
+    vm_check(vm, vm->tp_sp > 0, "pointer stack underflow");
     return vm->tp_stack[--vm->tp_sp];
 }
 
+/* number of immediate words that follow an opcode in the code stream. Used by
+ * the block scanners that skip over code without executing it. */
+static inline int vm_op_imm_count(OpCode op) {
+    switch (op) {
+        case OP_PUSH:
+        case OP_SET:
+        case OP_FINDANY:
+        case OP_VSHUFFLE:
+            return 2;
+        case OP_MOVE:
+        case OP_OFFSET:
+        case OP_FUNCTION:
+        case OP_CALL:
+        case OP_WHILE:
+        case OP_ARENA:
+        case OP_NCALL:
+        case OP_SORT:
+        case OP_BSEARCH:
+        case OP_LOWERBOUND:
+        case OP_PACK:
+        case OP_FINDBYTE:
+        case OP_COUNTLINES:
+        case OP_SPLITLINES:
+        case OP_PARSEINT:
+        case OP_HASH64:
+        case OP_HASH64B:
+        case OP_CRC32C:
+        case OP_CRC32CB:
+        case OP_VLOAD:
+        case OP_VSTORE:
+        case OP_VSPLAT:
+        case OP_VADD:
+        case OP_VSUB:
+        case OP_VMUL:
+        case OP_VMIN:
+        case OP_VMAX:
+        case OP_VHSUM:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
 /* emit helpers for building programs (in the sample program files) */
 static inline size_t emit0(word *buf, size_t pos, word op) {
     buf[pos++] = op;
@@ -248,10 +493,155 @@ static inline size_t emit2(word *buf, size_t pos, word op, word imm1, word imm2)
     return pos;
 }
 
-/* VM main loop: dispatch to backend hooks. OP_PUSH and OP_SET read a type immediate
- * followed by the value immediate.
- */
-static inline void run_vm(VM *vm, const Backend *backend) {
+#if TAPE_GUARD
+/* Each reservation spans 2^31 cells on either side of the tape base, so any
+ * int tape index (tp is an int) lands in the tape or in a PROT_NONE page. */
+#define TAPE_GUARD_SPAN ((size_t)1 << 31)
+
+typedef struct {
+    VM *vm;                 /* VM currently inside run_vm */
+    char *lo[2], *hi[2];    /* reservations: [0] = tape, [1] = tape_types */
+    void *fault_addr;       /* NULL when a tp op left the reservations */
+    long long fault_cell;   /* the index it computed then */
+    sigjmp_buf env;
+} vm_guard_state;
+
+static inline vm_guard_state *vm_guard(void) {
+    static vm_guard_state g;
+    return &g;
+}
+
+static inline void *vm_guard_map(size_t cell_size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if ((TAPE_SIZE * cell_size) % page != 0) {
+        fprintf(stderr, "TAPE_GUARD: TAPE_SIZE cells must fill whole %zu-byte pages\n", page);
+        exit(1);
+    }
+    size_t span = TAPE_GUARD_SPAN * cell_size;
+    char *base = (char *)mmap(NULL, 2 * span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        perror("TAPE_GUARD: mmap");
+        exit(1);
+    }
+    if (mprotect(base + span, TAPE_SIZE * cell_size, PROT_READ | PROT_WRITE) != 0) {
+        perror("TAPE_GUARD: mprotect");
+        exit(1);
+    }
+    return base + span;
+}
+
+static inline void vm_guard_handler(int sig, siginfo_t *info, void *uctx) {
+    (void)uctx;
+    vm_guard_state *g = vm_guard();
+    char *addr = (char *)info->si_addr;
+    if (g->vm && ((addr >= g->lo[0] && addr < g->hi[0]) || (addr >= g->lo[1] && addr < g->hi[1]))) {
+        g->fault_addr = addr;
+        siglongjmp(g->env, 1);
+    }
+    /* not a tape fault: fall back to the default action and re-fault */
+    signal(sig, SIG_DFL);
+}
+
+/* Narrow a tape index computed in 64 bits. Only int indices are covered by
+ * the reservations, so one outside them traps here instead of wrapping back
+ * onto the tape; outside run_vm it becomes INT_MIN, which faults. */
+static inline int vm_guard_tp(VM *vm, int64_t tp) {
+    if (tp >= INT_MIN && tp <= INT_MAX) return (int)tp;
+    vm_guard_state *g = vm_guard();
+    if (g->vm == vm) {
+        g->fault_addr = NULL;
+        g->fault_cell = (long long)tp;
+        siglongjmp(g->env, 1);
+    }
+    return INT_MIN;
+}
+
+/* tp + delta for move, offset and index; a delta that large leaves the
+ * reservations whatever tp is, so clamping it keeps the sum in range */
+static inline int vm_guard_step(VM *vm, int64_t delta) {
+    const int64_t far = (int64_t)1 << 33;
+    if (delta > far) delta = far;
+    if (delta < -far) delta = -far;
+    return vm_guard_tp(vm, (int64_t)vm->tp + delta);
+}
+
+/* make `vm` the one whose guard pages the trap handler recognizes */
+static inline void vm_guard_activate(VM *vm) {
+    vm_guard_state *g = vm_guard();
+    g->lo[0] = (char *)vm->tape - TAPE_GUARD_SPAN * sizeof(word);
+    g->hi[0] = (char *)vm->tape + TAPE_GUARD_SPAN * sizeof(word);
+    g->lo[1] = (char *)vm->tape_types - TAPE_GUARD_SPAN * sizeof(TypeTag);
+    g->hi[1] = (char *)vm->tape_types + TAPE_GUARD_SPAN * sizeof(TypeTag);
+    g->vm = vm;
+}
+
+/* map the guarded tape for `vm` and install the trap handler */
+static inline void vm_guard_enter(VM *vm) {
+    vm->tape = (word *)vm_guard_map(sizeof(word));
+    vm->tape_types = (TypeTag *)vm_guard_map(sizeof(TypeTag));
+    vm->trapped = 0;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = vm_guard_handler;
+    /* SA_NODEFER keeps SIGSEGV unblocked inside the handler, so leaving it
+       with siglongjmp needs no saved signal mask (sigsetjmp(env, 0) is a
+       plain register save, cheap enough for every host call) */
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+/* report the trap taken by run_vm (called after siglongjmp) */
+static inline void vm_guard_trap(VM *vm) {
+    vm_guard_state *g = vm_guard();
+    char *addr = (char *)g->fault_addr;
+    long long cell = !addr ? g->fault_cell
+        : (addr >= g->lo[0] && addr < g->hi[0])
+        ? (long long)((addr - (char *)vm->tape) / (ptrdiff_t)sizeof(word))
+        : (long long)((addr - (char *)vm->tape_types) / (ptrdiff_t)sizeof(TypeTag));
+    fprintf(stderr, "VM trap: tape access out of bounds at ip %zu (cell %lld, tp=%d)\n", vm->trap_ip, cell, vm->tp);
+    vm->trapped = 1;
+    g->vm = NULL;
+}
+#endif
+
+/* Release the tape mapping created by run_vm (no-op unless TAPE_GUARD). */
+static inline void vm_tape_release(VM *vm) {
+#if TAPE_GUARD
+    if (vm->tape) munmap((char *)vm->tape - TAPE_GUARD_SPAN * sizeof(word), 2 * TAPE_GUARD_SPAN * sizeof(word));
+    if (vm->tape_types) munmap((char *)vm->tape_types - TAPE_GUARD_SPAN * sizeof(TypeTag), 2 * TAPE_GUARD_SPAN * sizeof(TypeTag));
+    vm->tape = NULL;
+    vm->tape_types = NULL;
+#else
+    (void)vm;
+#endif
+}
+
+/* Record the start ip of every function (the ip OP_FUNCTION stores when it
+ * runs) without executing anything, so functions can be entered before the
+ * top-level code has run. ips[i] is left untouched for indices with no
+ * OP_FUNCTION; returns the highest index found + 1. */
+static inline size_t vm_scan_functions(const word *code, size_t code_len, size_t *ips, size_t max) {
+    size_t count = 0;
+    size_t ip = 0;
+    while (ip < code_len) {
+        OpCode op = (OpCode)code[ip++];
+        if (op == OP_FUNCTION && ip < code_len) {
+            size_t fi = (size_t)code[ip];
+            if (fi < max) {
+                ips[fi] = ip + 1;
+                if (count <= fi) count = fi + 1;
+            }
+        }
+        ip += (size_t)vm_op_imm_count(op);
+    }
+    return count;
+}
+
+/* Set up the backend and clear all VM state (stacks, tape, cell types). */
+static inline void vm_reset(VM *vm, const Backend *backend) {
 
     if (backend && backend->setup) backend->setup(vm);
 
@@ -263,168 +653,411 @@ static inline void run_vm(VM *vm, const Backend *backend) {
     vm->fp = 0;
     vm->functions_count = 0;
     vm->block_sp = 0;
-    memset(vm->tape, 0, sizeof(vm->tape));
+    vm->arena_top = TAPE_SIZE - ARENA_SIZE;
+    vm->out = stdout;
+    vm->fault_env = NULL;
+    vm->fault = NULL;
+#if TAPE_GUARD
+    vm_guard_enter(vm);
+#endif
+    memset(vm->tape, 0, TAPE_SIZE * sizeof(vm->tape[0]));
 
     /* initialize types to unknown */
     for (size_t i = 0; i < STACK_SIZE; ++i) vm->types[i] = TYPE_UNKNOWN;
     for (size_t i = 0; i < TAPE_SIZE; ++i) vm->tape_types[i] = TYPE_UNKNOWN;
+}
 
-    while (vm->ip < vm->code_len) {
-        OpCode op = (OpCode)vm->code[vm->ip++];
-
-        switch (op) {
-            case OP_NOP:
-                break;
-
-            case OP_PUSH: {
-                /* format: OP_PUSH, type_tag, imm */
-                assert(vm->ip + 1 < vm->code_len && "Unexpected end of code (PUSH expects type + imm)");
-                int type = (int)vm->code[vm->ip++];
-                word imm = vm->code[vm->ip++];
-                if (backend && backend->op_push) backend->op_push(vm, type, imm);
-                break;
-            }
+/* Execute the instruction at vm->ip through the backend hooks and leave ip
+ * at the next one. OP_PUSH and OP_SET read a type immediate followed by the
+ * value immediate. Returns 0 if the instruction was OP_HALT. Compiled code
+ * (tier/jit.c) calls this for the instructions it does not translate.
+ */
+static inline int vm_step(VM *vm, const Backend *backend) {
+    OpCode op = (OpCode)vm->code[vm->ip++];
+
+    switch (op) {
+        case OP_NOP:
+            break;
+
+        case OP_PUSH: {
+            /* format: OP_PUSH, type_tag, imm */
+            assert(vm->ip + 1 < vm->code_len && "Unexpected end of code (PUSH expects type + imm)");
+            int type = (int)vm->code[vm->ip++];
+            word imm = vm->code[vm->ip++];
+            if (backend && backend->op_push) backend->op_push(vm, type, imm);
+            break;
+        }
 
-            case OP_ADD:
-                if (backend && backend->op_add) backend->op_add(vm);
-                break;
-            case OP_SUB:
-                if (backend && backend->op_sub) backend->op_sub(vm);
-                break;
-            case OP_MUL:
-                if (backend && backend->op_mul) backend->op_mul(vm);
-                break;
-            case OP_DIV:
-                if (backend && backend->op_div) backend->op_div(vm);
-                break;
-            case OP_REM:
-                if (backend && backend->op_rem) backend->op_rem(vm);
-                break;
-
-            case OP_MOVE: {
-                assert(vm->ip < vm->code_len && "Unexpected end of code (MOVE expects imm)");
-                word imm = vm->code[vm->ip++];
-                if (backend && backend->op_move) backend->op_move(vm, imm);
-                break;
-            }
+        case OP_ADD:
+            if (backend && backend->op_add) backend->op_add(vm);
+            break;
+        case OP_SUB:
+            if (backend && backend->op_sub) backend->op_sub(vm);
+            break;
+        case OP_MUL:
+            if (backend && backend->op_mul) backend->op_mul(vm);
+            break;
+        case OP_DIV:
+            if (backend && backend->op_div) backend->op_div(vm);
+            break;
+        case OP_REM:
+            if (backend && backend->op_rem) backend->op_rem(vm);
+            break;
+
+        case OP_MOVE: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (MOVE expects imm)");
+            word imm = vm->code[vm->ip++];
+            if (backend && backend->op_move) backend->op_move(vm, imm);
+            break;
+        }
 
-            case OP_LOAD:
-                if (backend && backend->op_load) backend->op_load(vm);
-                break;
-            case OP_STORE:
-                if (backend && backend->op_store) backend->op_store(vm);
-                break;
-            case OP_PRINT:
-                if (backend && backend->op_print) backend->op_print(vm);
-                break;
-            case OP_PRINTCHAR:
-                if (backend && backend->op_print_char) backend->op_print_char(vm);
-                break;
-
-            case OP_DEREF:
-                if (backend && backend->op_deref) backend->op_deref(vm);
-                break;
-            case OP_REFER:
-                if (backend && backend->op_refer) backend->op_refer(vm);
-                break;
-            case OP_WHERE:
-                if (backend && backend->op_where) backend->op_where(vm);
-                break;
-
-            case OP_OFFSET: {
-                assert(vm->ip < vm->code_len && "Unexpected end of code (OFFSET expects imm)");
-                word imm = vm->code[vm->ip++];
-                if (backend && backend->op_offset) backend->op_offset(vm, imm);
-                break;
-            }
+        case OP_LOAD:
+            if (backend && backend->op_load) backend->op_load(vm);
+            break;
+        case OP_STORE:
+            if (backend && backend->op_store) backend->op_store(vm);
+            break;
+        case OP_PRINT:
+            if (backend && backend->op_print) backend->op_print(vm);
+            break;
+        case OP_PRINTCHAR:
+            if (backend && backend->op_print_char) backend->op_print_char(vm);
+            break;
+
+        case OP_DEREF:
+            if (backend && backend->op_deref) backend->op_deref(vm);
+            break;
+        case OP_REFER:
+            if (backend && backend->op_refer) backend->op_refer(vm);
+            break;
+        case OP_WHERE:
+            if (backend && backend->op_where) backend->op_where(vm);
+            break;
+
+        case OP_OFFSET: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (OFFSET expects imm)");
+            word imm = vm->code[vm->ip++];
+            if (backend && backend->op_offset) backend->op_offset(vm, imm);
+            break;
+        }
 
-            case OP_INDEX:
-                if (backend && backend->op_index) backend->op_index(vm);
-                break;
-
-            case OP_SET: {
-                /* format: OP_SET, type_tag, imm */
-                assert(vm->ip + 1 < vm->code_len && "Unexpected end of code (SET expects type + imm)");
-                int type = (int)vm->code[vm->ip++];
-                word imm = vm->code[vm->ip++];
-                if (backend && backend->op_set) backend->op_set(vm, type, imm);
-                break;
-            }
+        case OP_INDEX:
+            if (backend && backend->op_index) backend->op_index(vm);
+            break;
+
+        case OP_SET: {
+            /* format: OP_SET, type_tag, imm */
+            assert(vm->ip + 1 < vm->code_len && "Unexpected end of code (SET expects type + imm)");
+            int type = (int)vm->code[vm->ip++];
+            word imm = vm->code[vm->ip++];
+            if (backend && backend->op_set) backend->op_set(vm, type, imm);
+            break;
+        }
 
-            case OP_FUNCTION: {
-                assert(vm->ip < vm->code_len && "Unexpected end of code (FUNCTION expects imm)");
-                word func_idx = vm->code[vm->ip++];
-                if (backend && backend->op_function) backend->op_function(vm, func_idx);
-                break;
-            }
+        case OP_FUNCTION: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (FUNCTION expects imm)");
+            word func_idx = vm->code[vm->ip++];
+            if (backend && backend->op_function) backend->op_function(vm, func_idx);
+            break;
+        }
 
-            case OP_CALL: {
-                assert(vm->ip < vm->code_len && "Unexpected end of code (CALL expects imm)");
-                word func_idx = vm->code[vm->ip++];
-                if (backend && backend->op_call) backend->op_call(vm, func_idx);
-                break;
-            }
+        case OP_CALL: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (CALL expects imm)");
+            word func_idx = vm->code[vm->ip++];
+            if (backend && backend->op_call) backend->op_call(vm, func_idx);
+            break;
+        }
 
-            case OP_RETURN:
-                if (backend && backend->op_return) backend->op_return(vm);
-                break;
+        case OP_RETURN:
+            if (backend && backend->op_return) backend->op_return(vm);
+            break;
 
-            case OP_WHILE: {
-                assert(vm->ip < vm->code_len && "Unexpected end of code (WHILE expects imm)");
-                word cond_ip = vm->code[vm->ip++];
-                if (backend && backend->op_while) backend->op_while(vm, cond_ip);
-                break;
-            }
+        case OP_WHILE: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (WHILE expects imm)");
+            word cond_ip = vm->code[vm->ip++];
+            if (backend && backend->op_while) backend->op_while(vm, cond_ip);
+            break;
+        }
+
+        case OP_IF:
+            if (backend && backend->op_if) backend->op_if(vm);
+            break;
+        case OP_ELSE:
+            if (backend && backend->op_else) backend->op_else(vm);
+            break;
+        case OP_ENDBLOCK:
+            if (backend && backend->op_endblock) backend->op_endblock(vm);
+            break;
+
+        case OP_ORASSign:
+            if (backend && backend->op_orassign) backend->op_orassign(vm);
+            break;
+        case OP_ANDASSign:
+            if (backend && backend->op_andassign) backend->op_andassign(vm);
+            break;
+        case OP_NOT:
+            if (backend && backend->op_not) backend->op_not(vm);
+            break;
+        case OP_BITAND:
+            if (backend && backend->op_bitand) backend->op_bitand(vm);
+            break;
+        case OP_BITOR:
+            if (backend && backend->op_bitor) backend->op_bitor(vm);
+            break;
+        case OP_BITXOR:
+            if (backend && backend->op_bitxor) backend->op_bitxor(vm);
+            break;
+        case OP_LSH:
+            if (backend && backend->op_lsh) backend->op_lsh(vm);
+            break;
+        case OP_LRSH:
+            if (backend && backend->op_lrsh) backend->op_lrsh(vm);
+            break;
+        case OP_ARSH:
+            if (backend && backend->op_arsh) backend->op_arsh(vm);
+            break;
+        case OP_GEZ:
+            if (backend && backend->op_gez) backend->op_gez(vm);
+            break;
+
+        case OP_ARENA: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (ARENA expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_arena) backend->op_arena(vm, n);
+            break;
+        }
 
-            case OP_IF:
-                if (backend && backend->op_if) backend->op_if(vm);
-                break;
-            case OP_ELSE:
-                if (backend && backend->op_else) backend->op_else(vm);
-                break;
-            case OP_ENDBLOCK:
-                if (backend && backend->op_endblock) backend->op_endblock(vm);
-                break;
-
-            case OP_ORASSign:
-                if (backend && backend->op_orassign) backend->op_orassign(vm);
-                break;
-            case OP_ANDASSign:
-                if (backend && backend->op_andassign) backend->op_andassign(vm);
-                break;
-            case OP_NOT:
-                if (backend && backend->op_not) backend->op_not(vm);
-                break;
-            case OP_BITAND:
-                if (backend && backend->op_bitand) backend->op_bitand(vm);
-                break;
-            case OP_BITOR:
-                if (backend && backend->op_bitor) backend->op_bitor(vm);
-                break;
-            case OP_BITXOR:
-                if (backend && backend->op_bitxor) backend->op_bitxor(vm);
-                break;
-            case OP_LSH:
-                if (backend && backend->op_lsh) backend->op_lsh(vm);
-                break;
-            case OP_LRSH:
-                if (backend && backend->op_lrsh) backend->op_lrsh(vm);
-                break;
-            case OP_ARSH:
-                if (backend && backend->op_arsh) backend->op_arsh(vm);
-                break;
-            case OP_GEZ:
-                if (backend && backend->op_gez) backend->op_gez(vm);
-                break;
-
-            case OP_HALT:
-                return;
-
-            default:
-                fprintf(stderr, "Unknown opcode: %d\n", op);
-                exit(1);
+        case OP_NCALL: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (NCALL expects imm)");
+            word idx = vm->code[vm->ip++];
+            if (backend && backend->op_ncall) backend->op_ncall(vm, idx);
+            break;
+        }
+
+        case OP_HNEW:
+            if (backend && backend->op_hnew) backend->op_hnew(vm);
+            break;
+        case OP_HPUT:
+            if (backend && backend->op_hput) backend->op_hput(vm);
+            break;
+        case OP_HGET:
+            if (backend && backend->op_hget) backend->op_hget(vm);
+            break;
+        case OP_HDEL:
+            if (backend && backend->op_hdel) backend->op_hdel(vm);
+            break;
+        case OP_HLEN:
+            if (backend && backend->op_hlen) backend->op_hlen(vm);
+            break;
+        case OP_HITER:
+            if (backend && backend->op_hiter) backend->op_hiter(vm);
+            break;
+
+        case OP_SORT: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (SORT expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_sort) backend->op_sort(vm, n);
+            break;
+        }
+        case OP_BSEARCH: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (BSEARCH expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_bsearch) backend->op_bsearch(vm, n);
+            break;
+        }
+        case OP_LOWERBOUND: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (LOWERBOUND expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_lowerbound) backend->op_lowerbound(vm, n);
+            break;
+        }
+
+        case OP_PACK: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (PACK expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_pack) backend->op_pack(vm, n);
+            break;
+        }
+        case OP_FINDBYTE: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (FINDBYTE expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_findbyte) backend->op_findbyte(vm, n);
+            break;
+        }
+        case OP_FINDANY: {
+            /* format: OP_FINDANY, n, k */
+            assert(vm->ip + 1 < vm->code_len && "Unexpected end of code (FINDANY expects n + k)");
+            word n = vm->code[vm->ip++];
+            word k = vm->code[vm->ip++];
+            if (backend && backend->op_findany) backend->op_findany(vm, n, k);
+            break;
         }
+        case OP_COUNTLINES: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (COUNTLINES expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_countlines) backend->op_countlines(vm, n);
+            break;
+        }
+        case OP_SPLITLINES: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (SPLITLINES expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_splitlines) backend->op_splitlines(vm, n);
+            break;
+        }
+        case OP_PARSEINT: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (PARSEINT expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_parseint) backend->op_parseint(vm, n);
+            break;
+        }
+
+        case OP_HASH64: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (HASH64 expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_hash64) backend->op_hash64(vm, n);
+            break;
+        }
+        case OP_HASH64B: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (HASH64B expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_hash64b) backend->op_hash64b(vm, n);
+            break;
+        }
+        case OP_CRC32C: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (CRC32C expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_crc32c) backend->op_crc32c(vm, n);
+            break;
+        }
+        case OP_CRC32CB: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (CRC32CB expects imm)");
+            word n = vm->code[vm->ip++];
+            if (backend && backend->op_crc32cb) backend->op_crc32cb(vm, n);
+            break;
+        }
+
+        case OP_VLOAD: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (VLOAD expects lane type)");
+            word lane = vm->code[vm->ip++];
+            if (backend && backend->op_vload) backend->op_vload(vm, lane);
+            break;
+        }
+        case OP_VSTORE: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (VSTORE expects lane type)");
+            word lane = vm->code[vm->ip++];
+            if (backend && backend->op_vstore) backend->op_vstore(vm, lane);
+            break;
+        }
+        case OP_VSPLAT: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (VSPLAT expects lane type)");
+            word lane = vm->code[vm->ip++];
+            if (backend && backend->op_vsplat) backend->op_vsplat(vm, lane);
+            break;
+        }
+        case OP_VADD:
+        case OP_VSUB:
+        case OP_VMUL:
+        case OP_VMIN:
+        case OP_VMAX: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (vector op expects lane type)");
+            word lane = vm->code[vm->ip++];
+            if (backend && backend->op_vbinary) backend->op_vbinary(vm, op, lane);
+            break;
+        }
+        case OP_VAND:
+        case OP_VOR:
+        case OP_VXOR:
+            if (backend && backend->op_vbinary) backend->op_vbinary(vm, op, TYPE_V128);
+            break;
+        case OP_VHSUM: {
+            assert(vm->ip < vm->code_len && "Unexpected end of code (VHSUM expects lane type)");
+            word lane = vm->code[vm->ip++];
+            if (backend && backend->op_vhsum) backend->op_vhsum(vm, lane);
+            break;
+        }
+        case OP_VSHUFFLE: {
+            /* format: OP_VSHUFFLE, lane type, mask */
+            assert(vm->ip + 1 < vm->code_len && "Unexpected end of code (VSHUFFLE expects lane type + mask)");
+            word lane = vm->code[vm->ip++];
+            word mask = vm->code[vm->ip++];
+            if (backend && backend->op_vshuffle) backend->op_vshuffle(vm, lane, mask);
+            break;
+        }
+
+        case OP_SELECT:
+            if (backend && backend->op_select) backend->op_select(vm);
+            break;
+        case OP_MIN:
+            if (backend && backend->op_min) backend->op_min(vm);
+            break;
+        case OP_MAX:
+            if (backend && backend->op_max) backend->op_max(vm);
+            break;
+        case OP_ABS:
+            if (backend && backend->op_abs) backend->op_abs(vm);
+            break;
+
+        case OP_POPCNT:
+            if (backend && backend->op_popcnt) backend->op_popcnt(vm);
+            break;
+        case OP_CLZ:
+            if (backend && backend->op_clz) backend->op_clz(vm);
+            break;
+        case OP_CTZ:
+            if (backend && backend->op_ctz) backend->op_ctz(vm);
+            break;
+        case OP_BSWAP:
+            if (backend && backend->op_bswap) backend->op_bswap(vm);
+            break;
+        case OP_ROTL:
+            if (backend && backend->op_rotl) backend->op_rotl(vm);
+            break;
+        case OP_ROTR:
+            if (backend && backend->op_rotr) backend->op_rotr(vm);
+            break;
+        case OP_MULHI:
+            if (backend && backend->op_mulhi) backend->op_mulhi(vm);
+            break;
+
+        case OP_HALT:
+            return 0;
+
+        default:
+            fprintf(stderr, "Unknown opcode: %d\n", op);
+            exit(1);
+    }
+    return 1;
+}
+
+/* VM main loop: step from vm->ip until the code ends, OP_HALT runs or ip is
+ * moved to code_len (how an embedder's call returns, see rrvm.c). State is
+ * kept, so dispatch can be resumed or re-entered.
+ */
+static inline void vm_dispatch(VM *vm, const Backend *backend) {
+#if TAPE_GUARD
+    vm_guard_activate(vm);
+    vm->trapped = 0;
+    if (sigsetjmp(vm_guard()->env, 0)) {
+        vm_guard_trap(vm);
+        return;
+    }
+#endif
+
+    while (vm->ip < vm->code_len) {
+#if TAPE_GUARD
+        vm->trap_ip = vm->ip;
+#endif
+        if (!vm_step(vm, backend)) break;
     }
+#if TAPE_GUARD
+    vm_guard()->vm = NULL;
+#endif
+}
+
+/* Reset the VM and run the program from the start. */
+static inline void run_vm(VM *vm, const Backend *backend) {
+    vm_reset(vm, backend);
+    vm_dispatch(vm, backend);
 }
 
 /* helpers for constructing VM programs in C sources */
@@ -455,6 +1088,7 @@ static inline void run_vm(VM *vm, const Backend *backend) {
 #define __BOOL TYPE_BOOL
 #define __PTR  TYPE_PTR
 #define __VOID TYPE_VOID
+#define __V128 TYPE_V128
 #define __UNKNOWN TYPE_UNKNOWN
 
 /* typed push/set macros: first arg is a type token (one of the __I64/__U32 etc) */
@@ -507,4 +1141,65 @@ static inline void run_vm(VM *vm, const Backend *backend) {
 #define __arsh     p = emit0(prog, p, OP_ARSH)
 #define __gez      p = emit0(prog, p, OP_GEZ)
 
-#endif /* VM_H */
\ No newline at end of file
+/* frame arena emit helper */
+#define __arena(n) p = emit1(prog, p, OP_ARENA, (word)(n))
+
+/* native intrinsic call; idx comes from native_lookup() */
+#define __ncall(idx) p = emit1(prog, p, OP_NCALL, (word)(idx))
+
+/* hash map emit helpers */
+#define __hnew     p = emit0(prog, p, OP_HNEW)
+#define __hput     p = emit0(prog, p, OP_HPUT)
+#define __hget     p = emit0(prog, p, OP_HGET)
+#define __hdel     p = emit0(prog, p, OP_HDEL)
+#define __hlen     p = emit0(prog, p, OP_HLEN)
+#define __hiter    p = emit0(prog, p, OP_HITER)
+
+/* sort/search emit helpers */
+#define __sort(n)       p = emit1(prog, p, OP_SORT, (word)(n))
+#define __bsearch(n)    p = emit1(prog, p, OP_BSEARCH, (word)(n))
+#define __lowerbound(n) p = emit1(prog, p, OP_LOWERBOUND, (word)(n))
+
+/* text kernel emit helpers */
+#define __pack(n)        p = emit1(prog, p, OP_PACK, (word)(n))
+#define __findbyte(n)    p = emit1(prog, p, OP_FINDBYTE, (word)(n))
+#define __findany(n, k)  p = emit2(prog, p, OP_FINDANY, (word)(n), (word)(k))
+#define __countlines(n)  p = emit1(prog, p, OP_COUNTLINES, (word)(n))
+#define __splitlines(n)  p = emit1(prog, p, OP_SPLITLINES, (word)(n))
+#define __parseint(n)    p = emit1(prog, p, OP_PARSEINT, (word)(n))
+
+/* hash/checksum emit helpers */
+#define __hash64(n)      p = emit1(prog, p, OP_HASH64, (word)(n))
+#define __hash64b(n)     p = emit1(prog, p, OP_HASH64B, (word)(n))
+#define __crc32c(n)      p = emit1(prog, p, OP_CRC32C, (word)(n))
+#define __crc32cb(n)     p = emit1(prog, p, OP_CRC32CB, (word)(n))
+
+/* vector emit helpers; lt is a lane type token (__I64, __F64, __I32, __F32, __U8) */
+#define __vload(lt)      p = emit1(prog, p, OP_VLOAD, (word)(lt))
+#define __vstore(lt)     p = emit1(prog, p, OP_VSTORE, (word)(lt))
+#define __vsplat(lt)     p = emit1(prog, p, OP_VSPLAT, (word)(lt))
+#define __vadd(lt)       p = emit1(prog, p, OP_VADD, (word)(lt))
+#define __vsub(lt)       p = emit1(prog, p, OP_VSUB, (word)(lt))
+#define __vmul(lt)       p = emit1(prog, p, OP_VMUL, (word)(lt))
+#define __vmin(lt)       p = emit1(prog, p, OP_VMIN, (word)(lt))
+#define __vmax(lt)       p = emit1(prog, p, OP_VMAX, (word)(lt))
+#define __vand           p = emit0(prog, p, OP_VAND)
+#define __vor            p = emit0(prog, p, OP_VOR)
+#define __vxor           p = emit0(prog, p, OP_VXOR)
+#define __vhsum(lt)      p = emit1(prog, p, OP_VHSUM, (word)(lt))
+#define __vshuffle(lt, m) p = emit2(prog, p, OP_VSHUFFLE, (word)(lt), (word)(m))
+
+#define __select         p = emit0(prog, p, OP_SELECT)
+#define __min            p = emit0(prog, p, OP_MIN)
+#define __max            p = emit0(prog, p, OP_MAX)
+#define __abs            p = emit0(prog, p, OP_ABS)
+
+#define __popcnt         p = emit0(prog, p, OP_POPCNT)
+#define __clz            p = emit0(prog, p, OP_CLZ)
+#define __ctz            p = emit0(prog, p, OP_CTZ)
+#define __bswap          p = emit0(prog, p, OP_BSWAP)
+#define __rotl           p = emit0(prog, p, OP_ROTL)
+#define __rotr           p = emit0(prog, p, OP_ROTR)
+#define __mulhi          p = emit0(prog, p, OP_MULHI)
+
+#endif /* VM_H */